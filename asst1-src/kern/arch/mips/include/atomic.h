@@ -0,0 +1,55 @@
+#ifndef _MIPS_ATOMIC_H_
+#define _MIPS_ATOMIC_H_
+
+/*
+ * Atomic compare-and-swap, using LL/SC. See the comments on
+ * spinlock_data_testandset in spinlock.h for how LL/SC works.
+ */
+
+ATOMIC_INLINE
+bool
+atomic_cas(volatile unsigned *p, unsigned old, unsigned new)
+{
+	unsigned x;
+	unsigned y;
+
+	/*
+	 * If *P is OLD, try to store NEW. Y is set to 0 in the branch
+	 * delay slot, so it stays 0 if the compare fails; otherwise
+	 * after the SC it contains 1 if the store succeeded, 0 if it
+	 * failed.
+	 */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		".set noreorder;"	/* we fill the delay slot */
+		"ll %0, 0(%2);"		/*   x = *p */
+		"bne %0, %3, 1f;"	/*   if (x != old) goto 1 */
+		" move %1, $0;"		/*   y = 0 (delay slot) */
+		"move %1, %4;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"1:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return y != 0;
+}
+
+/*
+ * Atomically add DELTA to *P, and return the new value.
+ */
+ATOMIC_INLINE
+unsigned
+atomic_add(volatile unsigned *p, unsigned delta)
+{
+	unsigned x;
+
+	do {
+		x = *p;
+	} while (!atomic_cas(p, x, x + delta));
+	return x + delta;
+}
+
+
+#endif /* _MIPS_ATOMIC_H_ */
@@ -3,6 +3,8 @@
 #include <synch.h>
 #include <test.h>
 #include <thread.h>
+#include <membar.h>
+#include <atomic.h>
 
 #include "bar.h"
 #include "bar_driver.h"
@@ -16,24 +18,85 @@
  */
 
 /* Declare any globals you need here (e.g. locks, etc...) */
-/* a circle list to store orders */
-/* order_start point to list head */
-/* order_end point to list end */
-struct orderlist *order_queue;
-/* a lock to lockup order_list */
-struct lock *lock_order;
-/* two cvs to control order flow */
-struct cv *cv_customer;
-struct cv *cv_server;
-/* a series locks to lockup bottles with one idle lock 
+
+/*
+ * Each bartender has a queue of orders. Customers hand their orders
+ * to the bartenders in turn, and a bartender whose own queue is empty
+ * steals from the others', so bartenders normally only take their
+ * own queue's lock and don't get in each other's way.
+ *
+ * A bartender with nothing to do anywhere sleeps on cv_idle. A
+ * customer only takes lock_idle to wake one up if the count of idle
+ * bartenders says there are any, which is checked after the order is
+ * queued; and an idle bartender looks at the queues again after
+ * counting itself, so one or the other will notice.
+ */
+struct barqueue {
+        struct lock *lock;
+        struct orderlist *orders;
+        /* number of go home orders in the list; these are never
+           stolen, so every bartender gets its own */
+        int nhome;
+        /* readable without the lock, as a hint for bar_anywork() */
+        volatile int nstealable;
+
+        /* statistics, for bar_stats() */
+        unsigned long stat_orders;
+        unsigned long stat_batches;
+        unsigned long stat_steals;
+};
+
+static struct barqueue *queues;
+static unsigned nqueues;
+/* the queue the next customer hands their order to */
+static volatile unsigned next_queue;
+
+static struct lock *lock_idle;
+static struct cv *cv_idle;
+static volatile unsigned nidle;  /* bartenders waiting in cv_idle */
+
+/* a series locks to lockup bottles with one idle lock
  * so wecan simply use lock_bottles[eachwine] for eachwine */
 struct lock *lock_bottles[NBOTTLES + 1];
 
-/* NCUSTOMERS semaphore for all the orders */
-struct semaphore *order_sem[NCUSTOMERS];
-int sem_index;          //index always point to next available semaphore
-/* a lock along with the semaphore list */
-struct lock *lock_sem;
+/* most bottles a bartender locks at once when batching orders */
+#define BAR_BATCH_MAXBOTTLES DRINK_COMPLEXITY
+
+/* the set of bottles an order needs, as a bit mask */
+static unsigned order_bottles(struct barorder *order)
+{
+        unsigned mask = 0;
+
+        for(int i = 0;i< DRINK_COMPLEXITY;i++){
+                if(order->requested_bottles[i] != 0){
+                        mask |= 1U << order->requested_bottles[i];
+                }
+        }
+        return mask;
+}
+
+static unsigned bottle_count(unsigned mask)
+{
+        unsigned n = 0;
+
+        while (mask != 0) {
+                mask &= mask - 1;
+                n++;
+        }
+        return n;
+}
+
+/* pick the next queue, round robin */
+static struct barqueue *pick_queue(void)
+{
+        unsigned x;
+
+        do {
+                x = next_queue;
+        } while (!atomic_cas(&next_queue, x, (x + 1) % nqueues));
+        return &queues[x];
+}
+
 /*
  * **********************************************************************
  * FUNCTIONS EXECUTED BY CUSTOMER THREADS
@@ -50,34 +113,41 @@ struct lock *lock_sem;
 
 void order_drink(struct barorder *order)
 {
-        /* when start order, first initialize its semaphore */
-        lock_acquire(lock_sem);
-        /* grab a available semaphore */
-        order->sem_order = order_sem[sem_index];
-        sem_index++;
-        lock_release(lock_sem);
-
-        /* get the lock */
-        lock_acquire(lock_order);
-        /* if order list is full put it to sleep */
-        while(order_full(order_queue)){
-                cv_wait(cv_customer, lock_order);
+        struct barqueue *q;
+
+        if (completion_init(&order->done, "order done")) {
+                panic("completion allocate wrong");
         }
-        /* insert order into orderlist */
-        order_insert(order_queue,order);
-        /* if order list is not empty, wake a server up */
-        if(!order_empty(order_queue)){
-                cv_signal(cv_server, lock_order);
+
+        /* give the order to the next bartender */
+        q = pick_queue();
+        lock_acquire(q->lock);
+        order_insert(q->orders, order);
+        if (order->go_home_flag) {
+                q->nhome++;
+        }
+        else {
+                q->nstealable++;
+        }
+        lock_release(q->lock);
+
+        /* wake up an idle bartender, in case ours is busy; go home
+           orders need their own bartender, so wake them all */
+        membar_any_any();
+        if (nidle > 0) {
+                lock_acquire(lock_idle);
+                if (order->go_home_flag) {
+                        cv_broadcast(cv_idle, lock_idle);
+                }
+                else {
+                        cv_signal(cv_idle, lock_idle);
+                }
+                lock_release(lock_idle);
         }
-        lock_release(lock_order);
 
         /* wait to wake up signal */
-        P(order->sem_order);
-        /* return the semaphore */
-        lock_acquire(lock_sem);
-        sem_index--;
-        order_sem[sem_index] = order->sem_order;
-        lock_release(lock_sem);
+        completion_wait(&order->done);
+        completion_cleanup(&order->done);
 }
 
 
@@ -88,6 +158,106 @@ void order_drink(struct barorder *order)
  * **********************************************************************
  */
 
+/*
+ * Take an order from Q, or NULL if it has none we can have. When
+ * stealing, go home orders are left for their own bartender.
+ *
+ * Any later orders that can be mixed with the same bottles, or with a
+ * few more, are chained onto the one returned, so fill_order() can
+ * fill them all under one acquisition of the bottle locks. The oldest
+ * order we can have is always taken first, so an order is passed over
+ * at most as many times as there are orders ahead of it, and nobody
+ * waits forever.
+ */
+static struct barorder *queue_take(struct barqueue *q, bool stealing)
+{
+        struct barorder *ret = NULL, *order, **tailp;
+        unsigned mask, ordermask;
+        int i, n, count;
+
+        lock_acquire(q->lock);
+        count = order_count(q->orders);
+        for (i = 0; i < count; i++) {
+                ret = order_peek(q->orders, i);
+                if (!stealing || ret->go_home_flag == 0) {
+                        break;
+                }
+        }
+        if (i == count) {
+                lock_release(q->lock);
+                return NULL;
+        }
+        order_remove(q->orders, i);
+        ret->batch_next = NULL;
+        n = 1;
+
+        if (ret->go_home_flag) {
+                q->nhome--;
+        }
+        else {
+                mask = order_bottles(ret);
+                tailp = &ret->batch_next;
+                count = order_count(q->orders);
+                if (count > BAR_BATCH_SCAN) {
+                        count = BAR_BATCH_SCAN;
+                }
+                while (n < BAR_BATCH_MAX && i < count) {
+                        order = order_peek(q->orders, i);
+                        if (order->go_home_flag != 0) {
+                                i++;
+                                continue;
+                        }
+                        ordermask = order_bottles(order);
+                        if (bottle_count(mask | ordermask) >
+                            BAR_BATCH_MAXBOTTLES) {
+                                i++;
+                                continue;
+                        }
+                        order_remove(q->orders, i);
+                        count--;
+                        order->batch_next = NULL;
+                        *tailp = order;
+                        tailp = &order->batch_next;
+                        mask |= ordermask;
+                        n++;
+                }
+                q->nstealable -= n;
+        }
+
+        q->stat_orders += n;
+        q->stat_batches++;
+        if (stealing) {
+                q->stat_steals++;
+        }
+        lock_release(q->lock);
+        return ret;
+}
+
+/*
+ * Whether there's anything for bartender STAFF to do. The other
+ * queues are looked at without their locks, so the answer is only a
+ * hint, but it errs on the side of yes.
+ */
+static bool bar_anywork(unsigned long staff)
+{
+        struct barqueue *q;
+        unsigned i;
+        int nhome;
+
+        for (i = 0; i < nqueues; i++) {
+                q = &queues[i];
+                if (q->nstealable > 0) {
+                        return true;
+                }
+        }
+        /* our own go home order is also something to do */
+        q = &queues[staff];
+        lock_acquire(q->lock);
+        nhome = q->nhome;
+        lock_release(q->lock);
+        return nhome > 0;
+}
+
 /*
  * take_order()
  *
@@ -96,24 +266,33 @@ void order_drink(struct barorder *order)
  *
  */
 
-struct barorder *take_order(void)
+struct barorder *take_order(unsigned long staff)
 {
-        struct barorder *ret = NULL;
-        /* test orderlist empty */
-        /* get the lock */
-        lock_acquire(lock_order);
-        /* if order list is empty, put it to sleep */
-        while(order_empty(order_queue)){
-                cv_wait(cv_server, lock_order);
-        }
-        /* take order */
-        ret = order_get(order_queue);
-        /* if order list is not full, wake up a server */
-        if(!order_full(order_queue)){
-                cv_signal(cv_customer, lock_order);
+        struct barorder *ret;
+        unsigned i;
+
+        KASSERT(staff < nqueues);
+
+        while (1) {
+                /* our own queue first, then steal from the others */
+                for (i = 0; i < nqueues; i++) {
+                        ret = queue_take(&queues[(staff + i) % nqueues],
+                                         i != 0);
+                        if (ret != NULL) {
+                                return ret;
+                        }
+                }
+
+                /* nothing anywhere, so sleep until a customer comes */
+                lock_acquire(lock_idle);
+                nidle++;
+                membar_any_any();
+                if (!bar_anywork(staff)) {
+                        cv_wait(cv_idle, lock_idle);
+                }
+                nidle--;
+                lock_release(lock_idle);
         }
-        lock_release(lock_order);
-        return ret;
 }
 
 
@@ -130,30 +309,27 @@ struct barorder *take_order(void)
 
 void fill_order(struct barorder *order)
 {
+        struct barorder *o;
+        unsigned mask = 0;
 
-        /* add any sync primitives you need to ensure mutual exclusion
-           holds as described */
-        /* lock all bottles */
-        /* need to lock from BOTTLE1 to N to avoid deadlock */
-        int bottles[NBOTTLES + 1] = {0};
-        /* find out all bottles */
-        for(int i = 0;i< DRINK_COMPLEXITY;i++){
-                if(order->requested_bottles[i] != 0){
-                        bottles[order->requested_bottles[i]] = 1;
-                }
+        /* find out all bottles the batch needs */
+        for (o = order; o != NULL; o = o->batch_next) {
+                mask |= order_bottles(o);
         }
-        /* lock them up */
+        /* lock them up, from BOTTLE1 to N to avoid deadlock */
         for(int i= 1;i<=NBOTTLES;i++){
-                if(bottles[i] == 1){
+                if(mask & (1U << i)){
                         lock_acquire(lock_bottles[i]);
                 }
         }
 
-        mix(order);
+        for (o = order; o != NULL; o = o->batch_next) {
+                mix(o);
+        }
 
         /* then release them one by one */
         for(int i = 1;i<=NBOTTLES;i++){
-                if(bottles[i] == 1){
+                if(mask & (1U << i)){
                         lock_release(lock_bottles[i]);
                 }
         }
@@ -169,9 +345,15 @@ void fill_order(struct barorder *order)
 
 void serve_order(struct barorder *order)
 {
-        /* order done */
-        /* wake customer up */
-        V(order->sem_order);
+        struct barorder *next;
+
+        /* orders done, wake the customers up */
+        while (order != NULL) {
+                /* once woken, the customer may reuse the order */
+                next = order->batch_next;
+                completion_signal(&order->done);
+                order = next;
+        }
 }
 
 
@@ -191,22 +373,42 @@ void serve_order(struct barorder *order)
  * synch primitive and variable.
  */
 
-void bar_open(void)
+void bar_open(unsigned nbartenders)
 {
-        order_queue = orderlist_create();
-        if(order_queue == NULL) {
-                panic("orderlist allocate wrong");
+        KASSERT(nbartenders > 0);
+
+        nqueues = nbartenders;
+        next_queue = 0;
+        queues = kmalloc(nqueues * sizeof(*queues));
+        if (queues == NULL) {
+                panic("queues allocate wrong");
         }
-        /* initialize locks */
-        lock_order = lock_create("order lock");
-        if(lock_order == NULL){
-                panic("lock allocate wrong");
+        for (unsigned i = 0; i < nqueues; i++) {
+                queues[i].lock = lock_create("queue lock");
+                if (queues[i].lock == NULL) {
+                        panic("lock allocate wrong");
+                }
+                queues[i].orders = orderlist_create();
+                if (queues[i].orders == NULL) {
+                        panic("orderlist allocate wrong");
+                }
+                queues[i].nhome = 0;
+                queues[i].nstealable = 0;
+                queues[i].stat_orders = 0;
+                queues[i].stat_batches = 0;
+                queues[i].stat_steals = 0;
         }
 
-        lock_sem = lock_create("sem lock");
-        if(lock_sem == NULL) {
+        /* initialize locks */
+        lock_idle = lock_create("idle lock");
+        if(lock_idle == NULL){
                 panic("lock allocate wrong");
         }
+        cv_idle = cv_create("cv_idle");
+        if(cv_idle == NULL){
+                panic("cv allocate wrong");
+        }
+        nidle = 0;
 
         for (int i = 1; i <= NBOTTLES; i++)
         {
@@ -215,23 +417,6 @@ void bar_open(void)
                         panic("lock allocate wrong");
                 }
         }
-        /* intialize cvs */
-        cv_customer = cv_create("cv_customer");
-        if(cv_customer == NULL){
-                panic("cv allocate wrong");
-        }
-        cv_server = cv_create("cv_server");
-        if(cv_server == NULL){
-                panic("cv allocate wrong");
-        }
-
-        /* initial all the semaphores */
-        for(int i = 0;i < NCUSTOMERS; i++) {
-                order_sem[i] = sem_create("sem order", 0);
-                if(order_sem[i] == NULL) {
-                        panic("semaphore allocate wrong");
-                }
-        }
 }
 
 /*
@@ -243,18 +428,42 @@ void bar_open(void)
 
 void bar_close(void)
 {
-        orderlist_destroy(order_queue);
-        lock_destroy(lock_order);
-        lock_destroy(lock_sem);
+        for (unsigned i = 0; i < nqueues; i++) {
+                orderlist_destroy(queues[i].orders);
+                lock_destroy(queues[i].lock);
+        }
+        kfree(queues);
+        queues = NULL;
+        nqueues = 0;
+
+        lock_destroy(lock_idle);
+        cv_destroy(cv_idle);
         for(int i = 1; i<= NBOTTLES; i++){
                 lock_destroy(lock_bottles[i]);
         }
-        cv_destroy(cv_server);
-        cv_destroy(cv_customer);
-        /* I believe when all the orders done, all the semaphore should be returned */
-        /* So please dont close the bar when there is still order not served */
-        for(int i = 0;i < NCUSTOMERS; i++) {
-                sem_destroy(order_sem[i]);
-        }
 }
 
+/*
+ * bar_stats()
+ *
+ * Print how many orders were filled per trip to the bottles, and how
+ * many were stolen from other bartenders' queues.
+ */
+
+void bar_stats(void)
+{
+        unsigned long orders = 0, batches = 0, steals = 0;
+
+        for (unsigned i = 0; i < nqueues; i++) {
+                lock_acquire(queues[i].lock);
+                orders += queues[i].stat_orders;
+                batches += queues[i].stat_batches;
+                steals += queues[i].stat_steals;
+                lock_release(queues[i].lock);
+        }
+
+        kprintf("%lu orders taken in %lu batches (%lu.%02lu per batch), "
+                "%lu batches stolen\n",
+                orders, batches, batches ? orders / batches : 0,
+                batches ? (orders * 100 / batches) % 100 : 0, steals);
+}
@@ -19,11 +19,22 @@ struct barorder {
         struct glass glass;                               /* Do not change */
 
         /* This struct can be extended with your own entries below here */ 
-        /* each barorder contain a unique semaphore to wake customer up
-         * when their orders been done
-         */
-        struct semaphore *sem_order;
+        /* signalled to wake the customer up when the order is done */
+        struct completion done;
+        /* link in a bartender's order list */
+        struct barorder *list_next;
+        /* other orders filled along with this one, see take_order() */
+        struct barorder *batch_next;
 
 };
 
+/* The most orders a bartender takes at once */
+#define BAR_BATCH_MAX 4
+
+/* How far down an order list to look for orders to batch */
+#define BAR_BATCH_SCAN 16
+
+/* Print how well orders have been batched so far */
+void bar_stats(void);
+
 #endif
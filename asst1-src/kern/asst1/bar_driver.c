@@ -1,11 +1,13 @@
 #include "opt-synchprobs.h"
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <synch.h>
 #include <test.h>
 #include <thread.h>
 
 #include "bar_driver.h"
+#include "bench.h"
 
 
 /*
@@ -33,6 +35,17 @@ struct bottle bottles[NBOTTLES];
 static int customers;
 static struct lock *cust_lock;
 
+/* The number of customers and bartenders in this run */
+static int ncustomers;
+static int nbartenders;
+
+/* The number of drinks each customer has, by default and in this run */
+#define NDRINKS 10
+static int ndrinks;
+
+/* For the benchmark, the time each order_drink takes; otherwise NULL */
+static struct benchlat *bar_lat;
+
 /* A function used to manage staff leaving */
 
 static void go_home(void);
@@ -58,6 +71,7 @@ static void customer(void *unusedpointer, unsigned long customernum)
 {
         struct barorder order;
         int i,j;
+        uint64_t start;
 
         (void) unusedpointer; /* avoid compiler warning */
 
@@ -80,7 +94,15 @@ static void customer(void *unusedpointer, unsigned long customernum)
                 order.requested_bottles[0] = BEER;
 
                 /* order the drink, this blocks until the order is fulfilled */
-                order_drink(&order);
+                if (bar_lat != NULL && benchlat_due(bar_lat, i)) {
+                        start = bench_now();
+                        order_drink(&order);
+                        benchlat_add(bar_lat, customernum,
+                                     bench_now() - start);
+                }
+                else {
+                        order_drink(&order);
+                }
 
 #ifdef PRINT_ON
                 kprintf("C %ld drinking %d, %d, %d\n",
@@ -100,7 +122,7 @@ static void customer(void *unusedpointer, unsigned long customernum)
                 thread_yield();
 
                 i++;
-        } while (i < 10); /* keep going until .... */
+        } while (i < ndrinks); /* keep going until .... */
 
 #ifdef PRINT_ON
         kprintf("C %ld going home\n", customernum);
@@ -134,7 +156,6 @@ static void bartender(void *unusedpointer, unsigned long staff)
 
         /* avoid compiler warning */
         (void)unusedpointer;
-        (void)staff;
 
         i = 0; /* count orders filled for stats */
         while (1) {
@@ -143,7 +164,7 @@ static void bartender(void *unusedpointer, unsigned long staff)
                 kprintf("S %ld taking order\n", staff);
 #endif
 
-                order = take_order();
+                order = take_order(staff);
 
                 if (order->go_home_flag == 0) {
 
@@ -189,12 +210,10 @@ static void bartender(void *unusedpointer, unsigned long staff)
  *
  */
 
-int run_bar(int nargs, char **args)
+static int bar_run(void)
 {
-        int i, result;
-
-        (void) nargs; /* avoid compiler warnings */
-        (void) args;
+        int i, result, doses;
+        uint64_t before, after, nsecs;
 
         /* this semaphore indicates everybody has gone home */
         alldone = sem_create("alldone", 0);
@@ -209,7 +228,7 @@ int run_bar(int nargs, char **args)
 
         /* initialise the count of customers and create a lock to
            facilitate updating the counter by multiple threads */
-        customers = NCUSTOMERS;
+        customers = ncustomers;
 
         cust_lock = lock_create("cust lock");
         if (cust_lock == NULL) {
@@ -219,10 +238,12 @@ int run_bar(int nargs, char **args)
         /**********************************************************************
          * call your routine that initialises the rest of the bar
          */
-        bar_open();
+        bar_open(nbartenders);
+
+        before = bench_now();
 
         /* Start the bartenders */
-        for (i = 0; i<NBARTENDERS; i++) {
+        for (i = 0; i<nbartenders; i++) {
                 result = thread_fork("bartender thread", NULL,
                                      &bartender, NULL, i);
                 if (result) {
@@ -233,7 +254,7 @@ int run_bar(int nargs, char **args)
 
         /* Start the customers */
 
-        for (i=0; i<NCUSTOMERS; i++) {
+        for (i=0; i<ncustomers; i++) {
                 result = thread_fork("customer thread", NULL,
                                      &customer, NULL, i);
                 if (result) {
@@ -243,13 +264,43 @@ int run_bar(int nargs, char **args)
         }
 
         /* Wait for everybody to finish. */
-        for (i = 0; i < NCUSTOMERS + NBARTENDERS; i++) {
+        for (i = 0; i < ncustomers + nbartenders; i++) {
                 P(alldone);
         }
 
+        after = bench_now();
+        nsecs = after - before;
+        if (bar_lat != NULL) {
+                bench_report("1db", "queues", ncustomers + nbartenders,
+                             (uint64_t)ncustomers * ndrinks, nsecs,
+                             bar_lat);
+        }
+        else {
+                if (nsecs == 0) {
+                        nsecs = 1;
+                }
+                kprintf("%d customers, %d bartenders: %d drinks in "
+                        "%llu ms, %llu drinks/sec\n", ncustomers,
+                        nbartenders, ncustomers * ndrinks,
+                        (unsigned long long)(nsecs / 1000000),
+                        (unsigned long long)((uint64_t)ncustomers *
+                                             ndrinks * 1000000000ULL /
+                                             nsecs));
+        }
+        bar_stats();
+
+        doses = 0;
         for (i = 0; i < NBOTTLES; i++) {
-                kprintf("Bottle %d used for %d doses\n", i + 1,
-                        bottles[i].doses);
+                if (bar_lat == NULL) {
+                        kprintf("Bottle %d used for %d doses\n", i + 1,
+                                bottles[i].doses);
+                }
+                doses += bottles[i].doses;
+        }
+        /* every customer always has a beer, so one dose a drink */
+        if (doses != ncustomers * ndrinks) {
+                kprintf("*** Error! %d doses poured for %d drinks\n",
+                        doses, ncustomers * ndrinks);
         }
 
         /***********************************************************************
@@ -263,6 +314,64 @@ int run_bar(int nargs, char **args)
         return 0;
 }
 
+int run_bar(int nargs, char **args)
+{
+        ncustomers = NCUSTOMERS;
+        nbartenders = NBARTENDERS;
+        ndrinks = NDRINKS;
+        if (nargs > 1) {
+                ncustomers = atoi(args[1]);
+        }
+        if (nargs > 2) {
+                nbartenders = atoi(args[2]);
+        }
+        if (nargs > 3 || ncustomers <= 0 || nbartenders <= 0) {
+                kprintf("Usage: 1d [customers [bartenders]]\n");
+                return EINVAL;
+        }
+
+        bar_lat = NULL;
+        return bar_run();
+}
+
+/*
+ * The same, reporting as described in bench.h, with the time
+ * customers wait for each drink as the latency.
+ */
+
+int run_bar_bench(int nargs, char **args)
+{
+        int result;
+
+        ncustomers = NCUSTOMERS;
+        nbartenders = NBARTENDERS;
+        ndrinks = NDRINKS;
+        if (nargs > 1) {
+                ncustomers = atoi(args[1]);
+        }
+        if (nargs > 2) {
+                nbartenders = atoi(args[2]);
+        }
+        if (nargs > 3) {
+                ndrinks = atoi(args[3]);
+        }
+        if (nargs > 4 || ncustomers <= 0 || nbartenders <= 0 ||
+            ndrinks <= 0) {
+                kprintf("Usage: 1db [customers [bartenders "
+                        "[drinks-per-customer]]]\n");
+                return EINVAL;
+        }
+
+        bar_lat = benchlat_create(ncustomers, ndrinks);
+        if (bar_lat == NULL) {
+                panic("run_bar_bench: out of memory\n");
+        }
+        result = bar_run();
+        benchlat_destroy(bar_lat);
+        bar_lat = NULL;
+        return result;
+}
+
 
 
 /*
@@ -329,7 +438,7 @@ static void go_home(void)
                 lock_release(cust_lock); /* don't hold the lock longer than strictly needed */
                 go_home_order.go_home_flag = 1;
 
-                for (i = 0; i < NBARTENDERS; i++) {
+                for (i = 0; i < nbartenders; i++) {
                         order_drink(&go_home_order); /* returns without order being filled */
                 }
         } else {
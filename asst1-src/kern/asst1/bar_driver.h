@@ -14,6 +14,7 @@
 
 
 extern int run_bar(int, char**);
+extern int run_bar_bench(int, char**);
 
 /*
  * FUNCTION PROTOTYPES FOR THE FUNCTIONS YOU MUST WRITE
@@ -27,13 +28,13 @@ extern void order_drink(struct barorder *);
 
 
 /* Bar staff functions */ 
-extern struct barorder * take_order(void);
+extern struct barorder * take_order(unsigned long staff);
 extern void fill_order(struct barorder *);
 extern void serve_order(struct barorder *);
 
 
 /* Bar opening and closing functions */
-extern void bar_open(void);
+extern void bar_open(unsigned nbartenders);
 extern void bar_close(void);
 
 
@@ -51,6 +52,9 @@ extern void mix(struct barorder *);
  * THESE PARAMETERS CAN BE CHANGED BY US, so you should test various
  * combinations. NOTE: We will only ever set these to something
  * greater than zero.
+ *
+ * These are the defaults; the bar command can be given others, as
+ * 1d [customers [bartenders]].
  */ 
 
 #define NCUSTOMERS 10 /* The number of customers drinking today */
@@ -0,0 +1,148 @@
+/*
+ * Benchmark support for the asst1 problems. See bench.h.
+ */
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <clock.h>
+
+#include "bench.h"
+
+/* Most latency samples kept per thread */
+#define BENCH_MAXSAMPLES 1024
+
+struct benchlat {
+        unsigned nthreads;
+        unsigned stride;        /* time one operation in this many */
+        uint32_t *ns;           /* BENCH_MAXSAMPLES per thread */
+        unsigned *num;          /* samples so far, per thread */
+};
+
+uint64_t bench_now(void)
+{
+        struct timespec ts;
+
+        gettime(&ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct benchlat *benchlat_create(unsigned nthreads, uint64_t opsperthread)
+{
+        struct benchlat *bl;
+        unsigned i;
+
+        bl = kmalloc(sizeof(*bl));
+        if (bl == NULL) {
+                return NULL;
+        }
+        bl->nthreads = nthreads;
+        bl->stride = opsperthread / BENCH_MAXSAMPLES + 1;
+        bl->ns = kmalloc(nthreads * BENCH_MAXSAMPLES * sizeof(bl->ns[0]));
+        bl->num = kmalloc(nthreads * sizeof(bl->num[0]));
+        if (bl->ns == NULL || bl->num == NULL) {
+                kfree(bl->ns);
+                kfree(bl->num);
+                kfree(bl);
+                return NULL;
+        }
+        for (i = 0; i < nthreads; i++) {
+                bl->num[i] = 0;
+        }
+        return bl;
+}
+
+void benchlat_destroy(struct benchlat *bl)
+{
+        kfree(bl->ns);
+        kfree(bl->num);
+        kfree(bl);
+}
+
+bool benchlat_due(struct benchlat *bl, uint64_t i)
+{
+        return i % bl->stride == 0;
+}
+
+void benchlat_add(struct benchlat *bl, unsigned thread, uint64_t ns)
+{
+        KASSERT(thread < bl->nthreads);
+        if (bl->num[thread] == BENCH_MAXSAMPLES) {
+                return;
+        }
+        if (ns > 0xffffffff) {
+                ns = 0xffffffff;
+        }
+        bl->ns[thread * BENCH_MAXSAMPLES + bl->num[thread]++] = ns;
+}
+
+/* heapsort, as there's no qsort in the kernel */
+static void sift_down(uint32_t *a, unsigned root, unsigned n)
+{
+        unsigned child;
+        uint32_t tmp;
+
+        while ((child = 2 * root + 1) < n) {
+                if (child + 1 < n && a[child + 1] > a[child]) {
+                        child++;
+                }
+                if (a[root] >= a[child]) {
+                        return;
+                }
+                tmp = a[root];
+                a[root] = a[child];
+                a[child] = tmp;
+                root = child;
+        }
+}
+
+static void sort_samples(uint32_t *a, unsigned n)
+{
+        unsigned i;
+        uint32_t tmp;
+
+        for (i = n / 2; i > 0; i--) {
+                sift_down(a, i - 1, n);
+        }
+        for (i = n; i > 1; i--) {
+                tmp = a[0];
+                a[0] = a[i - 1];
+                a[i - 1] = tmp;
+                sift_down(a, 0, i - 1);
+        }
+}
+
+void bench_report(const char *test, const char *mode, unsigned threads,
+                  uint64_t ops, uint64_t nsecs, struct benchlat *bl)
+{
+        unsigned i, j, n = 0;
+        uint32_t p50 = 0, p99 = 0, max = 0;
+
+        if (nsecs == 0) {
+                nsecs = 1;
+        }
+
+        if (bl != NULL) {
+                /* gather the samples at the front, and sort them */
+                for (i = 0; i < bl->nthreads; i++) {
+                        for (j = 0; j < bl->num[i]; j++) {
+                                bl->ns[n++] =
+                                        bl->ns[i * BENCH_MAXSAMPLES + j];
+                        }
+                        bl->num[i] = 0;
+                }
+                if (n > 0) {
+                        sort_samples(bl->ns, n);
+                        p50 = bl->ns[n / 2];
+                        p99 = bl->ns[(uint64_t)n * 99 / 100];
+                        max = bl->ns[n - 1];
+                }
+        }
+
+        kprintf("bench test=%s mode=%s cpus=%u threads=%u ops=%llu "
+                "nsecs=%llu ops_per_sec=%llu p50_ns=%u p99_ns=%u "
+                "max_ns=%u samples=%u\n", test, mode, cpu_count(),
+                threads, (unsigned long long)ops,
+                (unsigned long long)nsecs,
+                (unsigned long long)(ops * 1000000000ULL / nsecs),
+                p50, p99, max, n);
+}
@@ -0,0 +1,51 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Support for the asst1 benchmark commands (1ab, 1cb, 1db).
+ *
+ * Each benchmark times whole runs with bench_now() and, for every
+ * few operations, the operation itself, so it can report how long
+ * threads wait as well as the throughput. Results come out as one
+ * line per run of the form
+ *
+ *    bench test=1cb mode=ring cpus=2 threads=7 ops=40000 nsecs=...
+ *          ops_per_sec=... p50_ns=... p99_ns=... max_ns=... samples=...
+ *
+ * (all on one line), so that runs can be collected with grep and
+ * compared. Modes never contain spaces.
+ *
+ * Timing an operation costs two gettime calls, which is part of what
+ * is measured, so the latencies are inflated by a constant and only
+ * comparable with each other.
+ */
+
+#include <types.h>
+
+/* Nanoseconds since boot, more or less; from gettime(). */
+uint64_t bench_now(void);
+
+/*
+ * Latency samples for NTHREADS threads each doing about OPSPERTHREAD
+ * operations. Thread T should call benchlat_due(bl, i) for its I'th
+ * operation and, if it returns true, time that operation and pass
+ * the result to benchlat_add(bl, T, ns). Threads only write their own
+ * part of the structure, so no locking is needed.
+ */
+struct benchlat;
+
+struct benchlat *benchlat_create(unsigned nthreads, uint64_t opsperthread);
+void benchlat_destroy(struct benchlat *bl);
+bool benchlat_due(struct benchlat *bl, uint64_t i);
+void benchlat_add(struct benchlat *bl, unsigned thread, uint64_t ns);
+
+/*
+ * Print the result line for a run of OPS operations by THREADS
+ * threads that took NSECS. BL may be NULL if there were no latency
+ * samples. Call once all the threads are done; this sorts the
+ * samples.
+ */
+void bench_report(const char *test, const char *mode, unsigned threads,
+                  uint64_t ops, uint64_t nsecs, struct benchlat *bl);
+
+#endif
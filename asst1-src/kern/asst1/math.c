@@ -4,6 +4,10 @@
 #include <test.h>
 #include <thread.h>
 #include <synch.h>
+#include <pcpucounter.h>
+#include <kern/errno.h>
+
+#include "bench.h"
 
 
 
@@ -198,3 +202,171 @@ int maths (int data1, char **data2)
         return 0;
 }
 
+
+/*
+ * **********************************************************************
+ * COUNTER BENCHMARK
+ * **********************************************************************
+ *
+ * maths_bench() runs adder threads that each add a fixed number of
+ * times to a shared counter, done three ways: under a sleep lock as
+ * above, under a spinlock, and with a sharded per-cpu counter. It
+ * reports each run as described in bench.h, and checks the totals.
+ *
+ * The number of cpus is whatever the machine was booted with; run it
+ * with different cpu counts in sys161.conf to see how each scales.
+ */
+
+#define BENCH_NADDERS   8       /* default adder threads */
+#define BENCH_NADDS     100000  /* default adds per thread */
+#define BENCH_BATCH     64      /* pcpucounter batch size */
+
+enum {
+        BENCH_SLEEPLOCK,
+        BENCH_SPINLOCK,
+        BENCH_SHARDED,
+        BENCH_NMODES
+};
+
+static const char *const bench_modenames[BENCH_NMODES] = {
+        "sleeplock",
+        "spinlock",
+        "sharded",
+};
+
+static int bench_mode;
+static unsigned long bench_nadds;
+static volatile unsigned long bench_counter;
+static struct lock *bench_lock;
+static struct spinlock bench_spinlock;
+static struct pcpucounter *bench_pcounter;
+static struct benchlat *bench_lat;
+
+static void bench_add(void)
+{
+        switch (bench_mode) {
+        case BENCH_SLEEPLOCK:
+                lock_acquire(bench_lock);
+                bench_counter++;
+                lock_release(bench_lock);
+                break;
+        case BENCH_SPINLOCK:
+                spinlock_acquire(&bench_spinlock);
+                bench_counter++;
+                spinlock_release(&bench_spinlock);
+                break;
+        case BENCH_SHARDED:
+                pcpucounter_add(bench_pcounter, 1);
+                break;
+        }
+}
+
+static void bench_adder(void *unusedpointer, unsigned long addernumber)
+{
+        unsigned long i;
+        uint64_t start;
+
+        (void) unusedpointer;
+
+        for (i = 0; i < bench_nadds; i++) {
+                if (benchlat_due(bench_lat, i)) {
+                        start = bench_now();
+                        bench_add();
+                        benchlat_add(bench_lat, addernumber,
+                                     bench_now() - start);
+                }
+                else {
+                        bench_add();
+                }
+        }
+        V(finished);
+}
+
+/* Run one mode with NADDERS threads. Returns false if the count is off. */
+static bool bench_run(int mode, unsigned nadders)
+{
+        uint64_t before, after, total;
+        unsigned long result;
+        unsigned index;
+        int error;
+
+        bench_mode = mode;
+        bench_counter = 0;
+
+        before = bench_now();
+        for (index = 0; index < nadders; index++) {
+                error = thread_fork("bench adder", NULL, &bench_adder,
+                                    NULL, index);
+                if (error) {
+                        panic("bench adder: thread_fork failed: %s\n",
+                              strerror(error));
+                }
+        }
+        for (index = 0; index < nadders; index++) {
+                P(finished);
+        }
+        if (mode == BENCH_SHARDED) {
+                result = pcpucounter_read_exact(bench_pcounter);
+        }
+        else {
+                result = bench_counter;
+        }
+        after = bench_now();
+
+        total = (uint64_t)nadders * bench_nadds;
+        bench_report("1ab", bench_modenames[mode], nadders, total,
+                     after - before, bench_lat);
+
+        if (result != total) {
+                kprintf("*** Error! %s: counted %lu, expected %llu\n",
+                        bench_modenames[mode], result,
+                        (unsigned long long)total);
+                return false;
+        }
+        return true;
+}
+
+/*
+ * Usage: 1ab [adders [adds-per-adder]]
+ */
+int maths_bench(int nargs, char **args)
+{
+        unsigned nadders;
+        bool ok = true;
+        int mode;
+
+        nadders = BENCH_NADDERS;
+        bench_nadds = BENCH_NADDS;
+        if (nargs > 1) {
+                nadders = atoi(args[1]);
+        }
+        if (nargs > 2) {
+                bench_nadds = atoi(args[2]);
+        }
+        if (nargs > 3 || nadders == 0 || bench_nadds == 0) {
+                kprintf("Usage: 1ab [adders [adds-per-adder]]\n");
+                return EINVAL;
+        }
+
+        finished = sem_create("finished", 0);
+        bench_lock = lock_create("bench counter");
+        bench_pcounter = pcpucounter_create(BENCH_BATCH);
+        bench_lat = benchlat_create(nadders, bench_nadds);
+        if (finished == NULL || bench_lock == NULL ||
+            bench_pcounter == NULL || bench_lat == NULL) {
+                panic("maths_bench: out of memory");
+        }
+        spinlock_init(&bench_spinlock);
+
+        for (mode = 0; mode < BENCH_NMODES; mode++) {
+                ok = bench_run(mode, nadders) && ok;
+        }
+        kprintf("Counter benchmark %s\n", ok ? "done" : "FAILED");
+
+        spinlock_cleanup(&bench_spinlock);
+        benchlat_destroy(bench_lat);
+        pcpucounter_destroy(bench_pcounter);
+        lock_destroy(bench_lock);
+        sem_destroy(finished);
+        return 0;
+}
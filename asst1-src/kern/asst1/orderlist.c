@@ -6,42 +6,27 @@
 #include "orderlist.h"
 
 
-/* simple implementation of circle list */
+/* simple implementation of a linked FIFO list */
 /* always use inside lock */
 
 struct orderlist *orderlist_create(){
         struct orderlist *ret = kmalloc(sizeof(struct orderlist));
-        ret->order_end = 0;
-        ret->order_start = 0;
+        if (ret == NULL) {
+                return NULL;
+        }
+        ret->head = NULL;
+        ret->tailp = &ret->head;
+        ret->count = 0;
         return ret;
 }
 
 void orderlist_destroy(struct orderlist *l) {
+        KASSERT(l->head == NULL);
         kfree(l);
 }
 
-int order_full(struct orderlist *l) {
-        if(l->order_end == ORDER_LIST_SIZE - 1) {
-                /* list is empty */
-                if(l->order_start == 0) {
-                        return 1;
-                }
-                else {
-                        return 0;
-                }
-        }
-        else {
-                if(l->order_end + 1 == l->order_start) {
-                        return 1;
-                }
-                else {
-                        return 0;
-                }
-        }
-}
-
 int order_empty(struct orderlist *l) {
-        if(l->order_end == l->order_start) {
+        if(l->head == NULL) {
                 return 1;
         }
         else {
@@ -49,20 +34,48 @@ int order_empty(struct orderlist *l) {
         }
 }
 
-/* only used when list status checked, a little bit lazy */
 void order_insert(struct orderlist *l, struct barorder *order) {
-        l->list[l->order_end] = order;
-        l->order_end++;
-        if(l->order_end == ORDER_LIST_SIZE){
-                l->order_end = 0;
-        }
+        order->list_next = NULL;
+        *l->tailp = order;
+        l->tailp = &order->list_next;
+        l->count++;
 }
 
+/* only used when list status checked, a little bit lazy */
 struct barorder *order_get(struct orderlist *l){
-        struct barorder *ret = l->list[l->order_start];
-        l->order_start++;
-        if(l->order_start == ORDER_LIST_SIZE){
-                l->order_start = 0;
-        }
+        struct barorder *ret = l->head;
+        order_remove(l, 0);
         return ret;
-}
\ No newline at end of file
+}
+
+int order_count(struct orderlist *l) {
+        return l->count;
+}
+
+/* look at the i'th order from the head without taking it */
+struct barorder *order_peek(struct orderlist *l, int i) {
+        struct barorder *o;
+
+        KASSERT(i >= 0 && i < l->count);
+        for (o = l->head; i > 0; i--) {
+                o = o->list_next;
+        }
+        return o;
+}
+
+/* take out the i'th order, leaving the others in order */
+void order_remove(struct orderlist *l, int i) {
+        struct barorder **op, *o;
+
+        KASSERT(i >= 0 && i < l->count);
+        for (op = &l->head; i > 0; i--) {
+                op = &(*op)->list_next;
+        }
+        o = *op;
+        *op = o->list_next;
+        if (l->tailp == &o->list_next) {
+                l->tailp = op;
+        }
+        o->list_next = NULL;
+        l->count--;
+}
@@ -1,22 +1,23 @@
-
 #ifndef ORDERLIST_H
 #define ORDERLIST_H
 
-/* some very simple implementation of a circle array */
+/* some very simple implementation of a FIFO list of orders, linked
+   through list_next in the orders themselves so it never fills up */
 
 #include "bar.h"
-#define ORDER_LIST_SIZE 10
 struct orderlist {
-    struct barorder *list[ORDER_LIST_SIZE];
-    int order_start;
-    int order_end;
+    struct barorder *head;
+    struct barorder **tailp;
+    int count;
 };
 
 struct orderlist *orderlist_create(void);
 void orderlist_destroy(struct orderlist *);
 int order_empty(struct orderlist *);
-int order_full(struct orderlist *);
 void order_insert(struct orderlist *, struct barorder *order);
 struct barorder *order_get(struct orderlist *);
+int order_count(struct orderlist *);
+struct barorder *order_peek(struct orderlist *, int i);
+void order_remove(struct orderlist *, int i);
 
-#endif
\ No newline at end of file
+#endif
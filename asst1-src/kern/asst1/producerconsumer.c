@@ -3,18 +3,25 @@
 #include "producerconsumer_driver.h"
 #include <synch.h>
 #include <lib.h>
+#include <mpmcring.h>
 
-/* Declare any variables you need here to keep track of and
-   synchronise your bounded. A sample declaration of a buffer is shown
-   below. You can change this if you choose another implementation. */
+/* The bounded buffer is an mpmcring of BUFFER_SIZE pc_data items. It
+   is FIFO, and producers and consumers only sleep when it is full or
+   empty, so there's no lock to take for every item. */
+
+static struct mpmcring *pc_ring;
+
+/* The original lock and CV version, kept so the benchmark can compare
+   against it. It is a circular buffer, so it is FIFO too: items are
+   taken from buffer_head and added buffer_count items after it. */
 
 static struct pc_data buffer[BUFFER_SIZE];
-/* buffer_index point to the next empty position in buffer */
-int buffer_index;
+static unsigned buffer_head;
+static unsigned buffer_count;
 
-struct lock *lock_buffer;
-struct cv *cv_full;
-struct cv *cv_empty;
+static struct lock *lock_buffer;
+static struct cv *cv_full;
+static struct cv *cv_empty;
 
 /* consumer_receive() is called by a consumer to request more data. It
    should block on a sync primitive if no data is available in your
@@ -24,43 +31,64 @@ struct pc_data consumer_receive(void)
 {
         struct pc_data thedata;
 
-        /* get the lock */
+        mpmcring_receive(pc_ring, &thedata);
+        return thedata;
+}
+
+/* procucer_send() is called by a producer to store data in your
+   bounded buffer. */
+
+void producer_send(struct pc_data item)
+{
+        mpmcring_send(pc_ring, &item);
+}
+
+/* Batch versions: send all N items, or receive between 1 and MAX. */
+
+unsigned consumer_receive_n(struct pc_data *items, unsigned max)
+{
+        return mpmcring_receive_n(pc_ring, items, max);
+}
+
+void producer_send_n(const struct pc_data *items, unsigned n)
+{
+        mpmcring_send_n(pc_ring, items, n);
+}
+
+/* The lock and CV versions. */
+
+struct pc_data consumer_receive_lockcv(void)
+{
+        struct pc_data thedata;
+
         lock_acquire(lock_buffer);
         /* send to sleep if buffer is empty */
-        while(buffer_index == 0){
+        while (buffer_count == 0) {
                 cv_wait(cv_empty, lock_buffer);
         }
-        /* recieve data from buffer */
-        buffer_index--;
-        thedata.item1 = buffer[buffer_index].item1;
-        thedata.item2 = buffer[buffer_index].item2;
-        /* if buffer is not full wake up a producer */
-        if(buffer_index < BUFFER_SIZE - 1){
-                cv_signal(cv_full, lock_buffer);
-        }
+        /* take the oldest item */
+        thedata = buffer[buffer_head];
+        buffer_head = (buffer_head + 1) % BUFFER_SIZE;
+        buffer_count--;
+        /* there's room now, so wake up a producer */
+        cv_signal(cv_full, lock_buffer);
         lock_release(lock_buffer);
 
         return thedata;
 }
 
-/* procucer_send() is called by a producer to store data in your
-   bounded buffer. */
-
-void producer_send(struct pc_data item)
+void producer_send_lockcv(struct pc_data item)
 {
-        /* get the lock */
         lock_acquire(lock_buffer);
         /* send to sleep if buffer is full */
-        while(buffer_index == BUFFER_SIZE - 1){
+        while (buffer_count == BUFFER_SIZE) {
                 cv_wait(cv_full, lock_buffer);
         }
-        /* put data into buffer */
-        buffer[buffer_index] = item;   
-        buffer_index++;
-        /* if buffer not empty, wake up a consumer */
-        if(buffer_index > 0){
-                cv_signal(cv_empty, lock_buffer);
-        }
+        /* add after the newest item */
+        buffer[(buffer_head + buffer_count) % BUFFER_SIZE] = item;
+        buffer_count++;
+        /* there's data now, so wake up a consumer */
+        cv_signal(cv_empty, lock_buffer);
         lock_release(lock_buffer);
 }
 
@@ -72,7 +100,14 @@ void producer_send(struct pc_data item)
 
 void producerconsumer_startup(void)
 {
-        buffer_index = 0;
+        pc_ring = mpmcring_create("pc_ring", BUFFER_SIZE,
+                                  sizeof(struct pc_data));
+        if (pc_ring == NULL) {
+                panic("ring allocate wrong");
+        }
+
+        buffer_head = 0;
+        buffer_count = 0;
         /* initial lock and cvs */
         lock_buffer = lock_create("buffer");
         if(lock_buffer == NULL){
@@ -91,8 +126,8 @@ void producerconsumer_startup(void)
 /* Perform any clean-up you need here */
 void producerconsumer_shutdown(void)
 {
+        mpmcring_destroy(pc_ring);
         lock_destroy(lock_buffer);
         cv_destroy(cv_full);
         cv_destroy(cv_empty);
 }
-
@@ -10,12 +10,14 @@
  */
 #include "opt-synchprobs.h"
 #include <types.h>  /* required by lib.h */
+#include <kern/errno.h>
 #include <lib.h>    /* for kprintf */
 #include <synch.h>  /* for P(), V(), sem_* */
 #include <thread.h> /* for thread_fork() */
 #include <test.h>
 
 #include "producerconsumer_driver.h"
+#include "bench.h"
 
 /* The number of producers
  * This will be changed during testing
@@ -242,3 +244,282 @@ run_producerconsumer(int nargs, char **args)
         return 0;
 }
 
+
+
+/*
+ * Throughput benchmark.
+ *
+ * This runs producers and consumers three ways: through the lock and
+ * CV buffer, through the ring one item at a time, and through the
+ * ring in batches. Rather than using the stop protocol above, each
+ * consumer takes a fixed share of the items, so batches don't have to
+ * be split around stop markers.
+ *
+ * The items are numbered 1 to the total; the consumers check each
+ * item and add up the numbers, so we can tell none were lost or
+ * duplicated.
+ *
+ * Each run is reported as described in bench.h. The latencies are of
+ * single producer_send and consumer_receive calls, or of whole
+ * batches, so mostly they are how long the calls waited.
+ */
+
+#define BENCH_ITEMS 20000    /* default items per producer */
+#define BENCH_BATCH 8        /* default batch size */
+#define BENCH_MAXBATCH 64
+
+enum {
+        BENCH_LOCKCV,
+        BENCH_RING,
+        BENCH_RINGBATCH,
+        BENCH_NMODES
+};
+
+static const char *const bench_modenames[BENCH_NMODES] = {
+        "lockcv",
+        "ring",
+        "ring_batched",
+};
+
+static int bench_mode;
+static unsigned bench_nproducers;
+static unsigned bench_nconsumers;
+static unsigned bench_items;   /* per producer */
+static unsigned bench_batch;
+static struct semaphore *bench_finished;
+static struct benchlat *bench_lat;
+static uint64_t *bench_sums;           /* per consumer */
+static unsigned *bench_errors;         /* per consumer */
+
+/* Send N items from BATCH the current way. */
+static void
+bench_send(struct pc_data *batch, unsigned n)
+{
+        switch (bench_mode) {
+        case BENCH_LOCKCV:
+                KASSERT(n == 1);
+                producer_send_lockcv(batch[0]);
+                break;
+        case BENCH_RING:
+                KASSERT(n == 1);
+                producer_send(batch[0]);
+                break;
+        case BENCH_RINGBATCH:
+                producer_send_n(batch, n);
+                break;
+        }
+}
+
+/* Receive up to MAX items into BATCH the current way. */
+static unsigned
+bench_receive(struct pc_data *batch, unsigned max)
+{
+        switch (bench_mode) {
+        case BENCH_LOCKCV:
+                batch[0] = consumer_receive_lockcv();
+                return 1;
+        case BENCH_RING:
+                batch[0] = consumer_receive();
+                return 1;
+        default:
+                return consumer_receive_n(batch, max);
+        }
+}
+
+static void
+bench_producer(void *unused_ptr, unsigned long thread_num)
+{
+        struct pc_data batch[BENCH_MAXBATCH];
+        unsigned i, n, max, calls;
+        uint64_t start;
+
+        (void)unused_ptr;
+
+        max = bench_mode == BENCH_RINGBATCH ? bench_batch : 1;
+        n = 0;
+        calls = 0;
+        for (i = 0; i < bench_items; i++) {
+                batch[n].item1 = thread_num * bench_items + i + 1;
+                batch[n].item2 = batch[n].item1 + 1;
+                n++;
+                if (n < max && i < bench_items - 1) {
+                        continue;
+                }
+
+                if (benchlat_due(bench_lat, calls++)) {
+                        start = bench_now();
+                        bench_send(batch, n);
+                        benchlat_add(bench_lat, thread_num,
+                                     bench_now() - start);
+                }
+                else {
+                        bench_send(batch, n);
+                }
+                n = 0;
+        }
+        V(bench_finished);
+}
+
+static void
+bench_consumer(void *unused_ptr, unsigned long consumer_num)
+{
+        struct pc_data batch[BENCH_MAXBATCH];
+        unsigned total, togo, max, n, i, calls;
+        uint64_t start;
+
+        (void)unused_ptr;
+
+        total = bench_nproducers * bench_items;
+        togo = total / bench_nconsumers;
+        if (consumer_num < total % bench_nconsumers) {
+                togo++;
+        }
+
+        calls = 0;
+        while (togo > 0) {
+                max = togo < bench_batch ? togo : bench_batch;
+                if (benchlat_due(bench_lat, calls++)) {
+                        start = bench_now();
+                        n = bench_receive(batch, max);
+                        benchlat_add(bench_lat,
+                                     bench_nproducers + consumer_num,
+                                     bench_now() - start);
+                }
+                else {
+                        n = bench_receive(batch, max);
+                }
+
+                for (i = 0; i < n; i++) {
+                        if (batch[i].item1 + 1 != batch[i].item2) {
+                                bench_errors[consumer_num]++;
+                        }
+                        bench_sums[consumer_num] += batch[i].item1;
+                }
+                togo -= n;
+        }
+        V(bench_finished);
+}
+
+/* Run one mode. Returns false on errors. */
+static bool
+bench_run(int mode)
+{
+        uint64_t before, after, total, expected, sum;
+        unsigned i, errors;
+        int result;
+
+        bench_mode = mode;
+        for (i = 0; i < bench_nconsumers; i++) {
+                bench_sums[i] = 0;
+                bench_errors[i] = 0;
+        }
+
+        before = bench_now();
+        for (i = 0; i < bench_nconsumers; i++) {
+                result = thread_fork("bench consumer", NULL,
+                                     bench_consumer, NULL, i);
+                if (result) {
+                        panic("bench_run: couldn't fork (%s)\n",
+                              strerror(result));
+                }
+        }
+        for (i = 0; i < bench_nproducers; i++) {
+                result = thread_fork("bench producer", NULL,
+                                     bench_producer, NULL, i);
+                if (result) {
+                        panic("bench_run: couldn't fork (%s)\n",
+                              strerror(result));
+                }
+        }
+        for (i = 0; i < bench_nproducers + bench_nconsumers; i++) {
+                P(bench_finished);
+        }
+        after = bench_now();
+
+        sum = 0;
+        errors = 0;
+        for (i = 0; i < bench_nconsumers; i++) {
+                sum += bench_sums[i];
+                errors += bench_errors[i];
+        }
+        total = (uint64_t)bench_nproducers * bench_items;
+        expected = total * (total + 1) / 2;
+
+        bench_report("1cb", bench_modenames[mode],
+                     bench_nproducers + bench_nconsumers, total,
+                     after - before, bench_lat);
+
+        if (errors > 0 || sum != expected) {
+                kprintf("*** Error! %s: %u bad items, sum %llu "
+                        "(expected %llu)\n", bench_modenames[mode],
+                        errors, (unsigned long long)sum,
+                        (unsigned long long)expected);
+                return false;
+        }
+        return true;
+}
+
+/*
+ * Usage: 1cb [producers [consumers [items-per-producer [batch-size]]]]
+ */
+int
+run_producerconsumer_bench(int nargs, char **args)
+{
+        bool ok = true;
+        int mode;
+
+        bench_nproducers = NUM_PRODUCERS;
+        bench_nconsumers = NUM_CONSUMERS;
+        bench_items = BENCH_ITEMS;
+        bench_batch = BENCH_BATCH;
+        if (nargs > 1) {
+                bench_nproducers = atoi(args[1]);
+        }
+        if (nargs > 2) {
+                bench_nconsumers = atoi(args[2]);
+        }
+        if (nargs > 3) {
+                bench_items = atoi(args[3]);
+        }
+        if (nargs > 4) {
+                bench_batch = atoi(args[4]);
+        }
+        if (nargs > 5 || bench_nproducers == 0 || bench_nconsumers == 0 ||
+            bench_items == 0 || bench_batch == 0 ||
+            bench_batch > BENCH_MAXBATCH) {
+                kprintf("Usage: 1cb [producers [consumers "
+                        "[items-per-producer [batch-size]]]]\n");
+                kprintf("       (batch size at most %u)\n",
+                        BENCH_MAXBATCH);
+                return EINVAL;
+        }
+
+        bench_finished = sem_create("bench_finished", 0);
+        bench_sums = kmalloc(bench_nconsumers * sizeof(bench_sums[0]));
+        bench_errors = kmalloc(bench_nconsumers * sizeof(bench_errors[0]));
+        /* consumers make the most calls, one per item */
+        bench_lat = benchlat_create(bench_nproducers + bench_nconsumers,
+                                    (uint64_t)bench_nproducers *
+                                    bench_items / bench_nconsumers + 1);
+        if (bench_finished == NULL || bench_sums == NULL ||
+            bench_errors == NULL || bench_lat == NULL) {
+                panic("run_producerconsumer_bench: out of memory\n");
+        }
+        producerconsumer_startup();
+
+        kprintf("%u producers, %u consumers, buffer size %u, "
+                "batch size %u\n", bench_nproducers, bench_nconsumers,
+                BUFFER_SIZE, bench_batch);
+        for (mode = 0; mode < BENCH_NMODES; mode++) {
+                ok = bench_run(mode) && ok;
+        }
+        kprintf("Producer/consumer benchmark %s\n",
+                ok ? "done" : "FAILED");
+
+        producerconsumer_shutdown();
+        benchlat_destroy(bench_lat);
+        kfree(bench_errors);
+        kfree(bench_sums);
+        sem_destroy(bench_finished);
+        return 0;
+}
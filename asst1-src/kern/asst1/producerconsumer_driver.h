@@ -31,6 +31,7 @@ struct pc_data {
 
 
 extern int run_producerconsumer(int, char**);
+extern int run_producerconsumer_bench(int, char**);
 
 
 
@@ -43,6 +44,16 @@ struct pc_data consumer_receive(void); /* receive a data item, blocking
 void producer_send(struct pc_data); /* send a data item to the shared
                                        buffer */
 
+/* Batch versions: send all n items; receive at least one, and up to
+   max, blocking only if none are available. */
+unsigned consumer_receive_n(struct pc_data *items, unsigned max);
+void producer_send_n(const struct pc_data *items, unsigned n);
+
+/* The same protocol done with a lock and CVs, for comparison by the
+   benchmark. */
+struct pc_data consumer_receive_lockcv(void);
+void producer_send_lockcv(struct pc_data);
+
 void producerconsumer_startup(void); /* initialise your buffer and
                                         surrounding code */
 
@@ -0,0 +1,32 @@
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+/*
+ * Atomic operations on single machine words, for lock-free code.
+ *
+ *    atomic_cas - if *P equals OLD, set it to NEW, and return true;
+ *                 otherwise leave it alone and return false. May also
+ *                 fail spuriously (on LL/SC machines), so call it in
+ *                 a loop.
+ *    atomic_add - add DELTA to *P and return the result.
+ *
+ * These do not imply memory barriers for other locations; use
+ * membar.h for that.
+ */
+
+#include <cdefs.h>
+
+/* Inlining support - for making sure an out-of-line copy gets built */
+#ifndef ATOMIC_INLINE
+#define ATOMIC_INLINE INLINE
+#endif
+
+ATOMIC_INLINE bool atomic_cas(volatile unsigned *p, unsigned old,
+			      unsigned new);
+ATOMIC_INLINE unsigned atomic_add(volatile unsigned *p, unsigned delta);
+
+/* Get the machine-dependent bits. */
+#include <machine/atomic.h>
+
+
+#endif /* _ATOMIC_H_ */
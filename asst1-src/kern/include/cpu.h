@@ -112,6 +112,12 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * The number of cpus; cpu numbers run from 0 to this minus one. Only
+ * final once thread_start_cpus has run.
+ */
+unsigned cpu_count(void);
+
 /*
  * Produce a string describing the CPU type.
  */
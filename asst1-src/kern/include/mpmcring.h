@@ -0,0 +1,62 @@
+#ifndef _MPMCRING_H_
+#define _MPMCRING_H_
+
+/*
+ * Bounded multi-producer multi-consumer FIFO queue.
+ *
+ * Items are fixed-size and are copied in and out. Sending and
+ * receiving are lock-free: each side claims slots by advancing its
+ * position with atomic_cas, and each slot has a sequence number that
+ * says whether it is full or empty for the current trip around the
+ * ring. Threads only sleep (and only touch the ring's spinlock) when
+ * the ring is full or empty, or to wake someone who is.
+ *
+ * The _n calls move a batch of items, claiming as many slots as they
+ * can with one atomic_cas, which is cheaper than moving them one at
+ * a time.
+ *
+ * The try calls never sleep, and so may be used from interrupt
+ * handlers. The others must be called from thread context.
+ */
+
+struct mpmcring;	/* Opaque */
+
+/*
+ * Create a ring holding up to NSLOTS items of ELSIZE bytes each.
+ * NSLOTS must be at least 2. NAME is copied.
+ */
+struct mpmcring *mpmcring_create(const char *name, unsigned nslots,
+				 size_t elsize);
+
+/* Destroy a ring. Nobody may be waiting on it. */
+void mpmcring_destroy(struct mpmcring *r);
+
+/*
+ * Send one item; wait while the ring is full.
+ * Receive one item; wait while the ring is empty.
+ */
+void mpmcring_send(struct mpmcring *r, const void *item);
+void mpmcring_receive(struct mpmcring *r, void *item);
+
+/*
+ * Send all N items in ITEMS, in order, waiting for space as needed.
+ * Items from other senders may be interleaved between batches.
+ */
+void mpmcring_send_n(struct mpmcring *r, const void *items, unsigned n);
+
+/*
+ * Receive between 1 and MAX items into ITEMS, waiting only if the
+ * ring is empty. Returns the number received.
+ */
+unsigned mpmcring_receive_n(struct mpmcring *r, void *items, unsigned max);
+
+/*
+ * Send or receive up to N items without waiting. Return the number
+ * moved, which is 0 if the ring was full (or empty).
+ */
+unsigned mpmcring_trysend_n(struct mpmcring *r, const void *items,
+			    unsigned n);
+unsigned mpmcring_tryreceive_n(struct mpmcring *r, void *items, unsigned n);
+
+
+#endif /* _MPMCRING_H_ */
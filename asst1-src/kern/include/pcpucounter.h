@@ -0,0 +1,37 @@
+#ifndef _PCPUCOUNTER_H_
+#define _PCPUCOUNTER_H_
+
+/*
+ * Sharded per-cpu counter.
+ *
+ * For counters that are bumped much more often than they are read.
+ * Each cpu adds into its own shard, which it alone writes, so adding
+ * normally touches no shared cache line and takes no lock. When a
+ * shard's delta reaches the batch size it is folded into the shared
+ * total under a spinlock.
+ *
+ *    pcpucounter_add        - add N (which may be negative).
+ *    pcpucounter_read       - the shared total only. Cheap, but may be
+ *                             off by up to (batch - 1) per cpu.
+ *    pcpucounter_read_exact - the shared total plus every shard. Exact
+ *                             if nobody is adding meanwhile.
+ *
+ * The counter is a long. Adding may be done from interrupt handlers.
+ */
+
+struct pcpucounter;	/* Opaque */
+
+/*
+ * Create a counter, starting at 0, that folds shards into the total
+ * once they get BATCH away from it. Must be called once all the cpus
+ * are running.
+ */
+struct pcpucounter *pcpucounter_create(unsigned batch);
+void pcpucounter_destroy(struct pcpucounter *pc);
+
+void pcpucounter_add(struct pcpucounter *pc, long n);
+long pcpucounter_read(struct pcpucounter *pc);
+long pcpucounter_read_exact(struct pcpucounter *pc);
+
+
+#endif /* _PCPUCOUNTER_H_ */
@@ -140,4 +140,33 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Completion: a one-shot event that one thread waits for and another
+ * signals, such as a request being finished.
+ *
+ * Unlike the above, the structure is meant to be embedded in the
+ * object whose completion it reports, so it is initialized in place
+ * rather than allocated. completion_init returns ENOMEM if it can't
+ * get a wait channel.
+ *
+ *    completion_wait   - Sleep until the completion is signalled. If
+ *                        it already has been, return at once.
+ *    completion_signal - Mark it done and wake up the waiter.
+ *
+ * Once the waiter has returned it may clean up the structure; the
+ * signaller must not touch it after completion_signal.
+ */
+struct completion {
+        struct wchan *c_wchan;
+        struct spinlock c_lock;
+        volatile bool c_done;
+};
+
+int completion_init(struct completion *c, const char *name);
+void completion_cleanup(struct completion *c);
+
+void completion_wait(struct completion *c);
+void completion_signal(struct completion *c);
+
+
 #endif /* _SYNCH_H_ */
@@ -38,8 +38,11 @@
 #ifdef OPT_SYNCHPROBS
 int twolocks(int, char **);
 int maths(int, char **);
+int maths_bench(int, char **);
 int run_producerconsumer(int, char **);
+int run_producerconsumer_bench(int, char **);
 int run_bar(int, char **);
+int run_bar_bench(int, char **);
 #endif
 
 
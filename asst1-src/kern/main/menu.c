@@ -599,9 +599,12 @@ static const char *mainmenu[] = {
 	"[?t] Tests menu                     ",
 #if OPT_SYNCHPROBS
 	"[1a] Simple math synchronisation    ",
+	"[1ab] Math counter benchmark        ",
 	"[1b] Simple deadlock                ",
 	"[1c] Producer/consumer problem      ",
+	"[1cb] Producer/consumer benchmark   ",
 	"[1d] Bar synchronisation            ",
+	"[1db] Bar benchmark                 ",
 #endif
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
@@ -656,9 +659,12 @@ static struct {
 #if OPT_SYNCHPROBS
 	/* in-kernel synchronization problem(s) */
 	{ "1a",     maths },
+	{ "1ab",    maths_bench },
 	{ "1b",     twolocks },
 	{ "1c",     run_producerconsumer},
+	{ "1cb",    run_producerconsumer_bench},
 	{ "1d",     run_bar},
+	{ "1db",    run_bar_bench},
 #endif
 
 	/* stats */
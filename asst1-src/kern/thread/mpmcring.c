@@ -0,0 +1,369 @@
+/*
+ * Bounded MPMC ring. See mpmcring.h.
+ *
+ * This is the usual sequence-numbered ring. Positions count items
+ * sent (r_head) and received (r_tail), and position P uses slot
+ * P % nslots. Slot S's sequence number is:
+ *
+ *    P       when it is empty and waiting for the item at position P;
+ *    P + 1   when it holds the item at position P;
+ *
+ * and the receiver of position P sets it to P + nslots, which makes
+ * it empty for the next trip around.
+ *
+ * A sender reads r_head, checks the slots from there are empty, and
+ * claims them by advancing r_head with atomic_cas. Nobody else can
+ * fill those slots after that, so it copies the items in at leisure
+ * and then publishes them by setting the sequence numbers. Receivers
+ * do the same with r_tail. If the cas fails someone else got there
+ * first and we start again.
+ *
+ * Positions are 32 bits and wrap; so that wrapping doesn't disturb
+ * P % nslots, they wrap at r_wrap, a multiple of nslots, rather than
+ * at 2^32, and are compared with ring_diff.
+ *
+ * Sleeping: a sender that finds the ring full counts itself in
+ * r_nfullwait under r_lock, then checks again before sleeping. A
+ * receiver, after publishing, checks r_nfullwait and if it is nonzero
+ * takes r_lock to wake it. The memory barriers between the counting
+ * and the checking on each side mean at least one of them sees the
+ * other, so no wakeup is lost. The same goes the other way round for
+ * r_nemptywait.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <atomic.h>
+#include <wchan.h>
+#include <mpmcring.h>
+
+/*
+ * With one slot, "holds the item at P - 1" and "waiting for the item
+ * at P" would be the same sequence number, so there must be two. The
+ * upper limit keeps positions far from wrapping into each other.
+ */
+#define MPMCRING_MINSLOTS	2
+#define MPMCRING_MAXSLOTS	0x10000
+
+struct mpmcring {
+	char *r_name;
+	unsigned r_nslots;
+	size_t r_elsize;
+	unsigned r_wrap;		/* Positions count modulo this */
+	volatile unsigned *r_seq;	/* Sequence numbers, per slot */
+	char *r_data;			/* The items */
+
+	volatile unsigned r_head;	/* Next position to send */
+	volatile unsigned r_tail;	/* Next position to receive */
+
+	/* Only for sleeping and waking */
+	struct spinlock r_lock;
+	struct wchan *r_fullwchan;	/* Senders wait here */
+	struct wchan *r_emptywchan;	/* Receivers wait here */
+	volatile unsigned r_nfullwait;
+	volatile unsigned r_nemptywait;
+};
+
+/*
+ * Position arithmetic.
+ */
+static
+unsigned
+ring_next(struct mpmcring *r, unsigned pos, unsigned n)
+{
+	pos += n;
+	if (pos >= r->r_wrap) {
+		pos -= r->r_wrap;
+	}
+	return pos;
+}
+
+static
+int
+ring_diff(struct mpmcring *r, unsigned a, unsigned b)
+{
+	unsigned d;
+
+	d = (a >= b) ? a - b : a + r->r_wrap - b;
+	if (d >= r->r_wrap / 2) {
+		return (int)d - (int)r->r_wrap;
+	}
+	return d;
+}
+
+/*
+ * Compare the slot for position POS with what it is when ready for
+ * the side whose sequence numbers run LAG behind (0 for senders, 1
+ * for receivers). Zero means ready; negative means the other side
+ * hasn't got to it yet (full, or empty); positive means POS is stale.
+ */
+static
+int
+ring_slotstate(struct mpmcring *r, unsigned pos, unsigned lag)
+{
+	return ring_diff(r, r->r_seq[pos % r->r_nslots],
+			 ring_next(r, pos, lag));
+}
+
+/*
+ * Claim up to MAX consecutive ready slots at *POSP. Returns the
+ * number claimed, 0 if the first slot isn't ready, and the first
+ * position claimed in *START.
+ */
+static
+unsigned
+ring_claim(struct mpmcring *r, volatile unsigned *posp, unsigned lag,
+	   unsigned max, unsigned *start)
+{
+	unsigned pos, n;
+	int state;
+
+	KASSERT(max > 0);
+	if (max > r->r_nslots) {
+		max = r->r_nslots;
+	}
+
+	while (1) {
+		pos = *posp;
+		membar_load_load();
+
+		state = 0;
+		for (n=0; n<max; n++) {
+			state = ring_slotstate(r, ring_next(r, pos, n), lag);
+			if (state != 0) {
+				break;
+			}
+		}
+		if (n == 0 && state < 0) {
+			return 0;
+		}
+		/* If n is 0 here, POS was stale; try again. */
+		if (n > 0 && atomic_cas(posp, pos, ring_next(r, pos, n))) {
+			*start = pos;
+			return n;
+		}
+	}
+}
+
+/*
+ * Wake anyone waiting in WC (as counted by *NWAITP) after moving some
+ * items.
+ *
+ * This has to wake them all, even for one item. A waiter only looks
+ * at the slot at the current position, and publishes can finish out
+ * of order: if the item we just published is further along, waking
+ * one waiter just puts it back to sleep, and the wakeup for the slot
+ * it was waiting for has already come and gone.
+ */
+static
+void
+ring_wake(struct mpmcring *r, struct wchan *wc, volatile unsigned *nwaitp)
+{
+	membar_any_any();
+	if (*nwaitp == 0) {
+		return;
+	}
+	spinlock_acquire(&r->r_lock);
+	wchan_wakeall(wc, &r->r_lock);
+	spinlock_release(&r->r_lock);
+}
+
+/*
+ * Sleep in WC while the slot at *POSP isn't ready.
+ */
+static
+void
+ring_wait(struct mpmcring *r, struct wchan *wc, volatile unsigned *nwaitp,
+	  volatile unsigned *posp, unsigned lag)
+{
+	spinlock_acquire(&r->r_lock);
+	(*nwaitp)++;
+	membar_any_any();
+	while (ring_slotstate(r, *posp, lag) < 0) {
+		wchan_sleep(wc, &r->r_lock);
+	}
+	(*nwaitp)--;
+	spinlock_release(&r->r_lock);
+}
+
+////////////////////////////////////////////////////////////
+
+struct mpmcring *
+mpmcring_create(const char *name, unsigned nslots, size_t elsize)
+{
+	struct mpmcring *r;
+	unsigned i;
+
+	KASSERT(nslots >= MPMCRING_MINSLOTS && nslots <= MPMCRING_MAXSLOTS);
+	KASSERT(elsize > 0);
+
+	r = kmalloc(sizeof(*r));
+	if (r == NULL) {
+		return NULL;
+	}
+	r->r_name = kstrdup(name);
+	if (r->r_name == NULL) {
+		goto fail;
+	}
+	r->r_seq = kmalloc(nslots * sizeof(r->r_seq[0]));
+	if (r->r_seq == NULL) {
+		goto fail_name;
+	}
+	r->r_data = kmalloc(nslots * elsize);
+	if (r->r_data == NULL) {
+		goto fail_seq;
+	}
+	r->r_fullwchan = wchan_create(r->r_name);
+	if (r->r_fullwchan == NULL) {
+		goto fail_data;
+	}
+	r->r_emptywchan = wchan_create(r->r_name);
+	if (r->r_emptywchan == NULL) {
+		goto fail_fullwchan;
+	}
+
+	r->r_nslots = nslots;
+	r->r_elsize = elsize;
+	r->r_wrap = nslots * (0x80000000U / nslots);
+	for (i=0; i<nslots; i++) {
+		r->r_seq[i] = i;
+	}
+	r->r_head = 0;
+	r->r_tail = 0;
+	spinlock_init(&r->r_lock);
+	r->r_nfullwait = 0;
+	r->r_nemptywait = 0;
+	return r;
+
+ fail_fullwchan:
+	wchan_destroy(r->r_fullwchan);
+ fail_data:
+	kfree(r->r_data);
+ fail_seq:
+	kfree((void *)r->r_seq);
+ fail_name:
+	kfree(r->r_name);
+ fail:
+	kfree(r);
+	return NULL;
+}
+
+void
+mpmcring_destroy(struct mpmcring *r)
+{
+	KASSERT(r->r_nfullwait == 0);
+	KASSERT(r->r_nemptywait == 0);
+
+	spinlock_cleanup(&r->r_lock);
+	wchan_destroy(r->r_emptywchan);
+	wchan_destroy(r->r_fullwchan);
+	kfree(r->r_data);
+	kfree((void *)r->r_seq);
+	kfree(r->r_name);
+	kfree(r);
+}
+
+unsigned
+mpmcring_trysend_n(struct mpmcring *r, const void *items, unsigned n)
+{
+	const char *src = items;
+	unsigned start, got, pos, i;
+
+	got = ring_claim(r, &r->r_head, 0, n, &start);
+	if (got == 0) {
+		return 0;
+	}
+
+	pos = start;
+	for (i=0; i<got; i++) {
+		memcpy(r->r_data + (pos % r->r_nslots) * r->r_elsize,
+		       src + i * r->r_elsize, r->r_elsize);
+		pos = ring_next(r, pos, 1);
+	}
+	membar_store_store();
+	pos = start;
+	for (i=0; i<got; i++) {
+		r->r_seq[pos % r->r_nslots] = ring_next(r, pos, 1);
+		pos = ring_next(r, pos, 1);
+	}
+
+	ring_wake(r, r->r_emptywchan, &r->r_nemptywait);
+	return got;
+}
+
+unsigned
+mpmcring_tryreceive_n(struct mpmcring *r, void *items, unsigned n)
+{
+	char *dest = items;
+	unsigned start, got, pos, i;
+
+	got = ring_claim(r, &r->r_tail, 1, n, &start);
+	if (got == 0) {
+		return 0;
+	}
+
+	pos = start;
+	for (i=0; i<got; i++) {
+		memcpy(dest + i * r->r_elsize,
+		       r->r_data + (pos % r->r_nslots) * r->r_elsize,
+		       r->r_elsize);
+		pos = ring_next(r, pos, 1);
+	}
+	/* Finish reading the items before letting senders overwrite them */
+	membar_any_store();
+	pos = start;
+	for (i=0; i<got; i++) {
+		r->r_seq[pos % r->r_nslots] = ring_next(r, pos, r->r_nslots);
+		pos = ring_next(r, pos, 1);
+	}
+
+	ring_wake(r, r->r_fullwchan, &r->r_nfullwait);
+	return got;
+}
+
+void
+mpmcring_send_n(struct mpmcring *r, const void *items, unsigned n)
+{
+	const char *src = items;
+	unsigned got;
+
+	while (n > 0) {
+		got = mpmcring_trysend_n(r, src, n);
+		if (got == 0) {
+			ring_wait(r, r->r_fullwchan, &r->r_nfullwait,
+				  &r->r_head, 0);
+			continue;
+		}
+		src += got * r->r_elsize;
+		n -= got;
+	}
+}
+
+unsigned
+mpmcring_receive_n(struct mpmcring *r, void *items, unsigned max)
+{
+	unsigned got;
+
+	while (1) {
+		got = mpmcring_tryreceive_n(r, items, max);
+		if (got > 0) {
+			return got;
+		}
+		ring_wait(r, r->r_emptywchan, &r->r_nemptywait,
+			  &r->r_tail, 1);
+	}
+}
+
+void
+mpmcring_send(struct mpmcring *r, const void *item)
+{
+	mpmcring_send_n(r, item, 1);
+}
+
+void
+mpmcring_receive(struct mpmcring *r, void *item)
+{
+	mpmcring_receive_n(r, item, 1);
+}
@@ -0,0 +1,115 @@
+/*
+ * Sharded per-cpu counters. See pcpucounter.h.
+ *
+ * A shard is only written by its own cpu, with interrupts off so the
+ * thread can't be moved to another cpu or interrupted by another
+ * adder partway through. Folding a shard into the total and zeroing
+ * it happen together under pc_lock, so an exact read, which holds
+ * pc_lock, never counts a delta twice or misses one that was folded.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <current.h>
+#include <pcpucounter.h>
+
+/*
+ * Shards are padded out so that no two share a cache line, which is
+ * the point of having them.
+ */
+#define PCPU_SHARDSIZE	64
+
+struct pcpu_shard {
+	volatile long ps_delta;
+	char ps_pad[PCPU_SHARDSIZE - sizeof(long)];
+};
+
+struct pcpucounter {
+	struct spinlock pc_lock;	/* Protects pc_count */
+	volatile long pc_count;		/* Total of the folded shards */
+	long pc_batch;
+	unsigned pc_nshards;		/* One per cpu */
+	struct pcpu_shard *pc_shards;
+};
+
+struct pcpucounter *
+pcpucounter_create(unsigned batch)
+{
+	struct pcpucounter *pc;
+	unsigned i;
+
+	KASSERT(batch > 0);
+
+	pc = kmalloc(sizeof(*pc));
+	if (pc == NULL) {
+		return NULL;
+	}
+	pc->pc_nshards = cpu_count();
+	pc->pc_shards = kmalloc(pc->pc_nshards * sizeof(pc->pc_shards[0]));
+	if (pc->pc_shards == NULL) {
+		kfree(pc);
+		return NULL;
+	}
+	for (i=0; i<pc->pc_nshards; i++) {
+		pc->pc_shards[i].ps_delta = 0;
+	}
+	spinlock_init(&pc->pc_lock);
+	pc->pc_count = 0;
+	pc->pc_batch = batch;
+	return pc;
+}
+
+void
+pcpucounter_destroy(struct pcpucounter *pc)
+{
+	spinlock_cleanup(&pc->pc_lock);
+	kfree(pc->pc_shards);
+	kfree(pc);
+}
+
+void
+pcpucounter_add(struct pcpucounter *pc, long n)
+{
+	struct pcpu_shard *ps;
+	long delta;
+	int spl;
+
+	spl = splhigh();
+	KASSERT(curcpu->c_number < pc->pc_nshards);
+	ps = &pc->pc_shards[curcpu->c_number];
+	delta = ps->ps_delta + n;
+	if (delta >= pc->pc_batch || delta <= -pc->pc_batch) {
+		spinlock_acquire(&pc->pc_lock);
+		pc->pc_count += delta;
+		ps->ps_delta = 0;
+		spinlock_release(&pc->pc_lock);
+	}
+	else {
+		ps->ps_delta = delta;
+	}
+	splx(spl);
+}
+
+long
+pcpucounter_read(struct pcpucounter *pc)
+{
+	return pc->pc_count;
+}
+
+long
+pcpucounter_read_exact(struct pcpucounter *pc)
+{
+	long total;
+	unsigned i;
+
+	spinlock_acquire(&pc->pc_lock);
+	total = pc->pc_count;
+	for (i=0; i<pc->pc_nshards; i++) {
+		total += pc->pc_shards[i].ps_delta;
+	}
+	spinlock_release(&pc->pc_lock);
+	return total;
+}
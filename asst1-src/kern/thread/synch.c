@@ -33,6 +33,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
@@ -315,3 +316,50 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Completion
+
+int
+completion_init(struct completion *c, const char *name)
+{
+	/* The name is only for debugging; wchans don't copy it. */
+	c->c_wchan = wchan_create(name);
+	if (c->c_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&c->c_lock);
+	c->c_done = false;
+	return 0;
+}
+
+void
+completion_cleanup(struct completion *c)
+{
+	spinlock_cleanup(&c->c_lock);
+	wchan_destroy(c->c_wchan);
+	c->c_wchan = NULL;
+}
+
+void
+completion_wait(struct completion *c)
+{
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&c->c_lock);
+	while (!c->c_done) {
+		wchan_sleep(c->c_wchan, &c->c_lock);
+	}
+	spinlock_release(&c->c_lock);
+}
+
+void
+completion_signal(struct completion *c)
+{
+	spinlock_acquire(&c->c_lock);
+	KASSERT(!c->c_done);
+	c->c_done = true;
+	wchan_wakeall(c->c_wchan, &c->c_lock);
+	spinlock_release(&c->c_lock);
+}
@@ -422,6 +422,12 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
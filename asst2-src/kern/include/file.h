@@ -9,8 +9,10 @@
  * Contains some file-related maximum length constants
  */
 #include <limits.h>
-/* globale filetable size */
-#define GOPEN_MAX 128
+/* initial global filetable size, it doubles when full */
+#define GOPEN_INIT 128
+/* most read or write moves in one go, see file_rw() */
+#define FILE_IO_CHUNK (64 * 1024)
 struct vnode;
 
 /* abstract file */
@@ -20,19 +22,30 @@ struct file
     off_t pos;
     int flags;
     int opencount;
+    int gfd_num;  /* slot in the global filetable */
     struct lock *f_lock;
 };
 
-/* file table inside a process */
+/* file table inside a process, NULL for a closed fd.
+ * Only the process's own thread touches it, so looking
+ * an fd up takes no lock.
+ */
 struct filetable
 {
-    int openfiles[OPEN_MAX];
+    struct file *openfiles[OPEN_MAX];
 };
 
-/* global file table */
+/* global file table of every open file. It is only touched
+ * when a file is first opened or finally closed, under gfd_lock.
+ * Free slots are kept on a stack, and when it runs out the
+ * table doubles in size.
+ */
 struct globalfd
 {
-    struct file *openfiles[GOPEN_MAX];
+    struct file **openfiles;
+    int *freeslots;
+    unsigned size;
+    unsigned nfree;
     struct lock *gfd_lock;
 };
 
@@ -81,8 +81,10 @@ struct proc_ctl {
 
 	pid_t pid;
 	pid_t parent;
-	// a bitmap to store all child process
-	int child;
+	// list of child processes, linked through sibling;
+	// the list and parent are protected by gpt->p_lock
+	struct proc_ctl *children;
+	struct proc_ctl *sibling;
 	// semaphore to control waitpid
 	struct semaphore *p_sem;
 	// record of exitcode and status
@@ -92,6 +94,11 @@ struct proc_ctl {
 
 struct pctable {
 	struct proc_ctl *proc[PID_MAX + 1];
+	// free pids, linked through pid_next in the order they
+	// were freed, so a pid isn't reused sooner than it must be
+	uint16_t pid_next[PID_MAX + 1];
+	pid_t pid_head;		/* 0 if there are none */
+	pid_t pid_tail;
 	struct lock *p_lock;
 };
 /* global process control table */
@@ -140,4 +140,59 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or a single
+ * writer. Writers are preferred: once a writer is waiting, newly
+ * arriving readers wait behind it. To keep that from starving
+ * readers, when a writer releases the lock every reader that was
+ * already waiting at that point is let in ahead of the next writer
+ * (rw_readpass counts how many of them are still to come through).
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        struct wchan *rw_readwchan;     /* readers sleep here */
+        struct wchan *rw_writewchan;    /* writers sleep here */
+        struct spinlock rw_lock;
+        volatile unsigned rw_readers;   /* # of readers holding the lock */
+        volatile unsigned rw_readwait;  /* # of readers sleeping */
+        volatile unsigned rw_writewait; /* # of writers sleeping */
+        volatile unsigned rw_readpass;  /* readers admitted ahead of writers */
+        volatile unsigned rw_readgen;   /* bumped when passes are handed out */
+        struct thread *volatile rw_writer;
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Blocks while a
+ *                           writer holds the lock or is waiting for it.
+ *    rwlock_release_read  - Drop a read hold.
+ *    rwlock_acquire_write - Get the lock for exclusive access.
+ *    rwlock_release_write - Drop the exclusive hold. Only the thread
+ *                           holding the lock for writing may do this.
+ *    rwlock_tryupgrade    - Convert a read hold into a write hold, if
+ *                           the caller is the only reader. Returns true
+ *                           on success (the caller now holds the lock
+ *                           for writing); otherwise returns false
+ *                           without blocking and the caller still holds
+ *                           its read hold. Never sleeps, so two readers
+ *                           trying to upgrade at once can't deadlock.
+ *
+ * A thread may not take a read hold on a lock it holds for writing,
+ * or vice versa.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_tryupgrade(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -199,6 +199,16 @@ proc_bootstrap(void)
 	if(gpt->p_lock == NULL){
 		panic("gpt_lock create failed");
 	}
+	for (pid_t i = 0; i <= PID_MAX; i++) {
+		gpt->proc[i] = NULL;
+		gpt->pid_next[i] = 0;
+	}
+	/* every pid is free to start with */
+	for (pid_t i = PID_MIN; i < PID_MAX; i++) {
+		gpt->pid_next[i] = i + 1;
+	}
+	gpt->pid_head = PID_MIN;
+	gpt->pid_tail = PID_MAX;
 }
 
 /*
@@ -354,7 +364,8 @@ struct proc_ctl *proc_ctl_create(struct proc *proc){
 	pc->proc = proc;
 	pc->pid = 0;
 	pc->parent = 0;
-	pc->child = 0;
+	pc->children = NULL;
+	pc->sibling = NULL;
 	pc->exitcode = 0;
 	pc->exitstatus = false;
 	return pc;
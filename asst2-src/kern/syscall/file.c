@@ -48,16 +48,103 @@ struct file *file_init(struct vnode *v, int flags)
     ret->pos = 0;
     ret->flags = flags;
     ret->opencount = 1;
+    ret->gfd_num = -1;
     return ret;
 }
 
 void file_destroy(struct file *f)
 {
-    kfree(f->f_lock);
+    lock_destroy(f->f_lock);
     kfree(f);
 }
 
-/* create a filetable, set all value -1 */
+/* double the size of the global filetable, gfd_lock must be held */
+static int gfd_grow(void)
+{
+    struct file **openfiles;
+    int *freeslots;
+    unsigned newsize;
+
+    KASSERT(lock_do_i_hold(gfd->gfd_lock));
+
+    newsize = gfd->size * 2;
+    openfiles = kmalloc(newsize * sizeof(struct file *));
+    if (openfiles == NULL)
+    {
+        return ENFILE;
+    }
+    freeslots = kmalloc(newsize * sizeof(int));
+    if (freeslots == NULL)
+    {
+        kfree(openfiles);
+        return ENFILE;
+    }
+
+    memcpy(openfiles, gfd->openfiles, gfd->size * sizeof(struct file *));
+    memcpy(freeslots, gfd->freeslots, gfd->nfree * sizeof(int));
+    /* new slots go on the stack highest first, so low ones are used first */
+    for (unsigned i = newsize; i > gfd->size; i--)
+    {
+        openfiles[i - 1] = NULL;
+        freeslots[gfd->nfree++] = i - 1;
+    }
+
+    kfree(gfd->openfiles);
+    kfree(gfd->freeslots);
+    gfd->openfiles = openfiles;
+    gfd->freeslots = freeslots;
+    gfd->size = newsize;
+    return 0;
+}
+
+/* put a new file into the global filetable */
+static int gfd_insert(struct file *f)
+{
+    int result;
+    int gfd_num;
+
+    lock_acquire(gfd->gfd_lock);
+    if (gfd->nfree == 0)
+    {
+        result = gfd_grow();
+        if (result)
+        {
+            lock_release(gfd->gfd_lock);
+            return result;
+        }
+    }
+    gfd_num = gfd->freeslots[--gfd->nfree];
+    KASSERT(gfd->openfiles[gfd_num] == NULL);
+    gfd->openfiles[gfd_num] = f;
+    lock_release(gfd->gfd_lock);
+
+    f->gfd_num = gfd_num;
+    return 0;
+}
+
+/* take a file out of the global filetable on its last close */
+static void gfd_remove(struct file *f)
+{
+    lock_acquire(gfd->gfd_lock);
+    KASSERT(gfd->openfiles[f->gfd_num] == f);
+    gfd->openfiles[f->gfd_num] = NULL;
+    gfd->freeslots[gfd->nfree++] = f->gfd_num;
+    lock_release(gfd->gfd_lock);
+
+    f->gfd_num = -1;
+}
+
+/* find the file for an fd, or NULL if it isn't open */
+static struct file *fd_lookup(struct filetable *fd, int filehandle)
+{
+    if (filehandle < 0 || filehandle >= OPEN_MAX)
+    {
+        return NULL;
+    }
+    return fd->openfiles[filehandle];
+}
+
+/* create a filetable, set all value NULL */
 int filetable_create(struct filetable **fd)
 {
     struct filetable *ret = kmalloc(sizeof(struct filetable));
@@ -67,7 +154,7 @@ int filetable_create(struct filetable **fd)
     }
     for (int i = 0; i < OPEN_MAX; i++)
     {
-        ret->openfiles[i] = -1;
+        ret->openfiles[i] = NULL;
     }
     *fd = ret;
     return 0;
@@ -93,32 +180,24 @@ int filetable_init(struct filetable *fd)
         struct file *f = file_init(v, O_RDWR);
         if (f == NULL)
         {
+            vfs_close(v);
             return ENOMEM;
         }
 
-        int gfd_num = 0;
         /* insert file into global filetable */
-        lock_acquire(gfd->gfd_lock);
-        for (gfd_num = 0; gfd_num < GOPEN_MAX; gfd_num++)
-        {
-            if (gfd->openfiles[gfd_num] == NULL)
-            {
-                gfd->openfiles[gfd_num] = f;
-                break;
-            }
-        }
-        lock_release(gfd->gfd_lock);
-
-        if (gfd_num == GOPEN_MAX)
+        result = gfd_insert(f);
+        if (result)
         {
-            return ENFILE;
+            file_destroy(f);
+            vfs_close(v);
+            return result;
         }
-        fd->openfiles[i] = gfd_num;
+        fd->openfiles[i] = f;
     }
 
     for (int i = 3; i < OPEN_MAX; i++)
     {
-        fd->openfiles[i] = -1;
+        fd->openfiles[i] = NULL;
     }
 
     return 0;
@@ -132,13 +211,10 @@ void filetable_copy(struct filetable *src, struct filetable *dest)
 
     for (int i = 0; i < OPEN_MAX; i++)
     {
-        if (src->openfiles[i] != -1)
+        f = src->openfiles[i];
+        dest->openfiles[i] = f;
+        if (f != NULL)
         {
-            dest->openfiles[i] = src->openfiles[i];
-            /* fetch file */
-            lock_acquire(gfd->gfd_lock);
-            f = gfd->openfiles[dest->openfiles[i]];
-            lock_release(gfd->gfd_lock);
             lock_acquire(f->f_lock);
             f->opencount++;
             VOP_INCREF(f->f_vnode);
@@ -151,7 +227,7 @@ void filetable_destroy(struct filetable *fd)
 {
     for (int i = 0; i < OPEN_MAX; i++)
     {
-        if (fd->openfiles[i] >= 0)
+        if (fd->openfiles[i] != NULL)
         {
             _sys_close(i, fd);
         }
@@ -167,9 +243,18 @@ void gfd_init(void)
     {
         panic("gfd create failed");
     }
-    for (int i = 0; i < OPEN_MAX; i++)
+    gfd->openfiles = kmalloc(GOPEN_INIT * sizeof(struct file *));
+    gfd->freeslots = kmalloc(GOPEN_INIT * sizeof(int));
+    if (gfd->openfiles == NULL || gfd->freeslots == NULL)
+    {
+        panic("gfd create failed");
+    }
+    gfd->size = GOPEN_INIT;
+    gfd->nfree = 0;
+    for (int i = GOPEN_INIT; i > 0; i--)
     {
-        gfd->openfiles[i] = NULL;
+        gfd->openfiles[i - 1] = NULL;
+        gfd->freeslots[gfd->nfree++] = i - 1;
     }
     gfd->gfd_lock = lock_create("gfd lock");
     if (gfd->gfd_lock == NULL)
@@ -181,6 +266,8 @@ void gfd_init(void)
 void gfd_destroy(void)
 {
     lock_destroy(gfd->gfd_lock);
+    kfree(gfd->openfiles);
+    kfree(gfd->freeslots);
     kfree(gfd);
 }
 
@@ -193,7 +280,6 @@ int sys_open(const_userptr_t filename, int flags, int *retval)
     size_t got;
     int fd_num;
     int result;
-    int gfd_num = 0;
 
     /* copy userlevel string into kernel */
     result = copyinstr(filename, path, NAME_MAX, &got);
@@ -215,7 +301,7 @@ int sys_open(const_userptr_t filename, int flags, int *retval)
      */
     for (fd_num = 0; fd_num < OPEN_MAX; fd_num++)
     {
-        if (fd->openfiles[fd_num] == -1)
+        if (fd->openfiles[fd_num] == NULL)
         {
             break;
         }
@@ -223,6 +309,7 @@ int sys_open(const_userptr_t filename, int flags, int *retval)
 
     if (fd_num == OPEN_MAX)
     {
+        vfs_close(v);
         return EMFILE;
     }
 
@@ -230,28 +317,19 @@ int sys_open(const_userptr_t filename, int flags, int *retval)
     f = file_init(v, flags);
     if (f == NULL)
     {
+        vfs_close(v);
         return ENOMEM;
     }
 
-    /* find smallest slot, may have race condition */
-    lock_acquire(gfd->gfd_lock);
-    for (gfd_num = 0; gfd_num < GOPEN_MAX; gfd_num++)
-    {
-        if (gfd->openfiles[gfd_num] == NULL)
-        {
-            break;
-        }
-    }
-    if (gfd_num == GOPEN_MAX)
+    result = gfd_insert(f);
+    if (result)
     {
         file_destroy(f);
-        lock_release(gfd->gfd_lock);
-        return ENFILE;
+        vfs_close(v);
+        return result;
     }
-    gfd->openfiles[gfd_num] = f;
-    lock_release(gfd->gfd_lock);
 
-    fd->openfiles[fd_num] = gfd_num;
+    fd->openfiles[fd_num] = f;
     VOP_INCREF(f->f_vnode);
 
     *retval = fd_num;
@@ -259,128 +337,99 @@ int sys_open(const_userptr_t filename, int flags, int *retval)
     return 0;
 }
 
-int sys_read(int filehandle, void *buf, size_t size, ssize_t *retval)
+/* move data between a file and a user buffer at the file's
+ * position, straight through a user uio so there is no kernel
+ * copy. It goes FILE_IO_CHUNK bytes at a time; if a later chunk
+ * fails, what the earlier ones moved is still reported, and a
+ * short chunk (end of file, a line from the console) ends it.
+ */
+static int file_rw(struct file *f, userptr_t buf, size_t size,
+                   enum uio_rw rw, ssize_t *retval)
 {
-    struct vnode *v;
-    struct filetable *fd;
-    struct file *f;
     struct uio auio;
     struct iovec aiov;
-    void *kbuf;
-    int result;
-    int gfd_num;
-
-    fd = curproc->p_fd;
-    /* check valid fd number */
-    if (filehandle < 0)
-    {
-        return EBADF;
-    }
-    if (filehandle >= OPEN_MAX || fd->openfiles[filehandle] < 0)
-    {
-        return EBADF;
-    }
-
-    gfd_num = fd->openfiles[filehandle];
+    size_t done, len, moved;
+    int result = 0;
 
-    /* fetch file from gfd */
-    lock_acquire(gfd->gfd_lock);
-    f = gfd->openfiles[gfd_num];
-    lock_release(gfd->gfd_lock);
-
-    if ((f->flags & O_ACCMODE) == O_WRONLY)
-    {
-        return EBADF;
-    }
-
-    /* do read, race may happen between two processes
-     * operate the same file at the same time.
+    done = 0;
+    /* hold the file lock throughout, so concurrent users of the
+     * same file don't interleave inside one call.
      */
-    kbuf = kmalloc(size);
     lock_acquire(f->f_lock);
-    v = f->f_vnode;
-    uio_kinit(&aiov, &auio, kbuf, size, f->pos, UIO_READ);
-    result = VOP_READ(v, &auio);
-    if (result)
+    while (done < size)
     {
-
-        lock_release(f->f_lock);
-        return result;
+        len = size - done;
+        if (len > FILE_IO_CHUNK)
+        {
+            len = FILE_IO_CHUNK;
+        }
+        uio_uinit(&aiov, &auio, buf + done, len, f->pos, rw);
+        if (rw == UIO_READ)
+        {
+            result = VOP_READ(f->f_vnode, &auio);
+        }
+        else
+        {
+            result = VOP_WRITE(f->f_vnode, &auio);
+        }
+        moved = len - auio.uio_resid;
+        f->pos += moved;
+        done += moved;
+        if (result || moved < len)
+        {
+            break;
+        }
     }
-
-    *retval = size - auio.uio_resid;
-    f->pos = f->pos + *retval;
     lock_release(f->f_lock);
 
-    result = copyout(kbuf, buf, size);
-    if (result)
+    if (result && done == 0)
     {
-        kfree(kbuf);
         return result;
     }
-
-    kfree(kbuf);
+    *retval = done;
     return 0;
 }
 
-int sys_write(int filehandle, const void *buf, size_t size, ssize_t *retval)
+int sys_read(int filehandle, void *buf, size_t size, ssize_t *retval)
 {
-    struct vnode *v;
     struct filetable *fd;
     struct file *f;
-    struct uio auio;
-    struct iovec aiov;
-    void *kbuf;
-    int result;
-    int gfd_num;
 
     fd = curproc->p_fd;
     /* check valid fd number */
-    if (filehandle < 0)
+    f = fd_lookup(fd, filehandle);
+    if (f == NULL)
     {
         return EBADF;
     }
 
-    if (filehandle >= OPEN_MAX || fd->openfiles[filehandle] < 0)
+    if ((f->flags & O_ACCMODE) == O_WRONLY)
     {
         return EBADF;
     }
 
-    gfd_num = fd->openfiles[filehandle];
-    /* fetch file from gfd */
-    lock_acquire(gfd->gfd_lock);
-    f = gfd->openfiles[gfd_num];
-    lock_release(gfd->gfd_lock);
+    return file_rw(f, (userptr_t)buf, size, UIO_READ, retval);
+}
 
-    if ((f->flags & O_ACCMODE) == O_RDONLY)
-    {
-        return EBADF;
-    }
+int sys_write(int filehandle, const void *buf, size_t size, ssize_t *retval)
+{
+    struct filetable *fd;
+    struct file *f;
 
-    /* copy in buf */
-    kbuf = kmalloc(size);
-    result = copyin((const_userptr_t)buf, kbuf, size);
-    if (result)
+    fd = curproc->p_fd;
+    /* check valid fd number */
+    f = fd_lookup(fd, filehandle);
+    if (f == NULL)
     {
-        kfree(kbuf);
-        return result;
+        return EBADF;
     }
 
-    lock_acquire(f->f_lock);
-    v = f->f_vnode;
-    uio_kinit(&aiov, &auio, kbuf, size, f->pos, UIO_WRITE);
-    result = VOP_WRITE(v, &auio);
-    if (result)
+    if ((f->flags & O_ACCMODE) == O_RDONLY)
     {
-        lock_release(f->f_lock);
-        return result;
+        return EBADF;
     }
 
-    *retval = size - auio.uio_resid;
-    f->pos = f->pos + *retval;
-    lock_release(f->f_lock);
-    kfree(kbuf);
-    return 0;
+    return file_rw(f, (userptr_t)buf, size, UIO_WRITE, retval);
 }
 
 int sys_lseek(int filehandle, off_t pos, int code, off_t *retval)
@@ -391,25 +440,15 @@ int sys_lseek(int filehandle, off_t pos, int code, off_t *retval)
     off_t newpos;
     int result;
     struct stat statbuf;
-    int gfd_num;
 
     fd = curproc->p_fd;
     /* check valid fd number */
-    if (filehandle < 0)
-    {
-        return EBADF;
-    }
-    if (filehandle >= OPEN_MAX || fd->openfiles[filehandle] < 0)
+    f = fd_lookup(fd, filehandle);
+    if (f == NULL)
     {
         return EBADF;
     }
 
-    gfd_num = fd->openfiles[filehandle];
-    /* fetch file from gfd */
-    lock_acquire(gfd->gfd_lock);
-    f = gfd->openfiles[gfd_num];
-    lock_release(gfd->gfd_lock);
-
     v = f->f_vnode;
     if (!VOP_ISSEEKABLE(v))
     {
@@ -468,24 +507,15 @@ int _sys_close(int filehandle, struct filetable *fd)
 {
     struct vnode *v;
     struct file *f;
-    int gfd_num;
 
     /* check valid fd number */
-    if (filehandle < 0)
-    {
-        return EBADF;
-    }
-    if (filehandle >= OPEN_MAX || fd->openfiles[filehandle] < 0)
+    f = fd_lookup(fd, filehandle);
+    if (f == NULL)
     {
         return EBADF;
     }
 
-    gfd_num = fd->openfiles[filehandle];
-    lock_acquire(gfd->gfd_lock);
-    f = gfd->openfiles[gfd_num];
-    lock_release(gfd->gfd_lock);
-
-    fd->openfiles[filehandle] = -1;
+    fd->openfiles[filehandle] = NULL;
 
     v = f->f_vnode;
     lock_acquire(f->f_lock);
@@ -505,11 +535,9 @@ int _sys_close(int filehandle, struct filetable *fd)
     if (f->opencount == 1)
     {
         lock_release(f->f_lock);
+        /* give the gfd table slot back */
+        gfd_remove(f);
         file_destroy(f);
-        /* set gfd table slot to NULL */
-        lock_acquire(gfd->gfd_lock);
-        gfd->openfiles[gfd_num] = NULL;
-        lock_release(gfd->gfd_lock);
     }
     else
     {
@@ -525,31 +553,26 @@ int sys_dup2(int filehandle, int newhandle, int *retval)
     struct filetable *fd;
     struct file *f;
     int result;
-    int gfd_num;
 
     fd = curproc->p_fd;
     /* check valid fd number */
-    if (filehandle < 0 || newhandle < 0)
-    {
-        return EBADF;
-    }
-    if (filehandle >= OPEN_MAX || fd->openfiles[filehandle] < 0)
+    f = fd_lookup(fd, filehandle);
+    if (f == NULL)
     {
         return EBADF;
     }
 
-    gfd_num = fd->openfiles[filehandle];
-    /* fetch file from gfd */
-    lock_acquire(gfd->gfd_lock);
-    f = gfd->openfiles[gfd_num];
-    lock_release(gfd->gfd_lock);
-
     /* check newhandle */
-    if (newhandle >= OPEN_MAX)
+    if (newhandle < 0 || newhandle >= OPEN_MAX)
     {
         return EBADF;
     }
-    if (fd->openfiles[newhandle] != -1)
+    if (newhandle == filehandle)
+    {
+        *retval = newhandle;
+        return 0;
+    }
+    if (fd->openfiles[newhandle] != NULL)
     {
         /* newhandle opened */
         result = sys_close(newhandle);
@@ -559,7 +582,7 @@ int sys_dup2(int filehandle, int newhandle, int *retval)
         }
     }
     /* now the newhandle is available */
-    fd->openfiles[newhandle] = gfd_num;
+    fd->openfiles[newhandle] = f;
 
     lock_acquire(f->f_lock);
     f->opencount++;
@@ -22,6 +22,21 @@
 struct pctable *gpt;
 struct trapframe;
 
+/* take child off its parent's list of children, p_lock must be held */
+static void child_unlink(struct proc_ctl *parent_pc, struct proc_ctl *pc)
+{
+    struct proc_ctl **pp;
+
+    KASSERT(lock_do_i_hold(gpt->p_lock));
+
+    for (pp = &parent_pc->children; *pp != pc; pp = &(*pp)->sibling)
+    {
+        KASSERT(*pp != NULL);
+    }
+    *pp = pc->sibling;
+    pc->sibling = NULL;
+}
+
 int sys_fork(struct trapframe *tf, int *retval)
 {
     struct proc *newproc;
@@ -49,43 +64,45 @@ int sys_fork(struct trapframe *tf, int *retval)
     /* open filetable */
     filetable_copy(curproc->p_fd, newproc->p_fd);
 
+    /* copy trapframe */
+    newtf = kmalloc(sizeof(struct trapframe));
+    if (newtf == NULL)
+    {
+        proc_destroy(newproc);
+        return ENOMEM;
+    }
+    *newtf = *tf;
+
     /* pid allocate */
     result = pid_allocate(newproc);
     if (result)
     {
+        kfree(newtf);
         proc_destroy(newproc);
         return result;
     }
+
     /* process control set parent and child */
     pid = newproc->pid;
     lock_acquire(gpt->p_lock);
     pc = gpt->proc[pid];
-    lock_release(gpt->p_lock);
-
+    parent_pc = gpt->proc[curproc->pid];
     pc->parent = curproc->pid;
-
-    lock_acquire(gpt->p_lock);
-    parent_pc = gpt->proc[pc->parent];
-    // set child bitmap
-    parent_pc->child = parent_pc->child | (1 << pid);
+    pc->sibling = parent_pc->children;
+    parent_pc->children = pc;
     lock_release(gpt->p_lock);
 
-    /* copy trapframe */
-    newtf = kmalloc(sizeof(struct trapframe));
-    if (newtf == NULL)
-    {
-        proc_destroy(newproc);
-        return ENOMEM;
-    }
-    *newtf = *tf;
-
     /* fork thread, put it into work */
     result = thread_fork("child", newproc,
                          (void (*)(void *data1, unsigned long data2))enter_forked_process, newtf, 0);
-    // kfree(newtf);
     if (result)
     {
-        proc_destroy(newproc);
+        kfree(newtf);
+        lock_acquire(gpt->p_lock);
+        child_unlink(parent_pc, pc);
+        lock_release(gpt->p_lock);
+        /* this destroys newproc too */
+        pid_deallocate(pid);
         return result;
     }
 
@@ -93,29 +110,43 @@ int sys_fork(struct trapframe *tf, int *retval)
     return 0;
 }
 
+/* give newproc the pid that has been free longest */
 int pid_allocate(struct proc *newproc)
 {
-    int i;
-    struct proc_ctl *pc = proc_ctl_create(newproc);
-    lock_acquire(gpt->p_lock);
-    for (i = PID_MIN; i <= PID_MAX; i++)
+    struct proc_ctl *pc;
+    pid_t pid;
+
+    pc = proc_ctl_create(newproc);
+    if (pc == NULL)
     {
-        if (gpt->proc[i] == NULL)
-        {
-            gpt->proc[i] = pc;
-            pc->pid = i;
-            newproc->pid = i;
-            break;
-        }
+        return ENOMEM;
     }
-    lock_release(gpt->p_lock);
-    if (i > PID_MAX)
+
+    lock_acquire(gpt->p_lock);
+    pid = gpt->pid_head;
+    if (pid == 0)
     {
+        lock_release(gpt->p_lock);
+        /* not proc_ctl_destroy, the caller still owns newproc */
+        sem_destroy(pc->p_sem);
+        kfree(pc);
         return ENPROC;
     }
+    gpt->pid_head = gpt->pid_next[pid];
+    if (gpt->pid_head == 0)
+    {
+        gpt->pid_tail = 0;
+    }
+    KASSERT(gpt->proc[pid] == NULL);
+    gpt->proc[pid] = pc;
+    lock_release(gpt->p_lock);
+
+    pc->pid = pid;
+    newproc->pid = pid;
     return 0;
 }
 
+/* free a pid, and destroy its process */
 void pid_deallocate(pid_t pid)
 {
     struct proc_ctl *pc;
@@ -124,14 +155,23 @@ void pid_deallocate(pid_t pid)
 
     lock_acquire(gpt->p_lock);
     pc = gpt->proc[pid];
-    lock_release(gpt->p_lock);
-
     KASSERT(pc != NULL);
-    proc_ctl_destroy(pc);
-
-    lock_acquire(gpt->p_lock);
+    KASSERT(pc->children == NULL);
     gpt->proc[pid] = NULL;
+    /* to the back of the free list */
+    gpt->pid_next[pid] = 0;
+    if (gpt->pid_tail == 0)
+    {
+        gpt->pid_head = pid;
+    }
+    else
+    {
+        gpt->pid_next[gpt->pid_tail] = pid;
+    }
+    gpt->pid_tail = pid;
     lock_release(gpt->p_lock);
+
+    proc_ctl_destroy(pc);
 }
 
 int sys_getpid(pid_t *retval)
@@ -144,7 +184,8 @@ int sys_waitpid(pid_t pid, int *status, int options, int *retval)
 {
     struct proc_ctl *pc;
     struct proc_ctl *parent_pc;
-    pid_t parent;
+    int exitcode;
+    int result;
 
     /* in os161 we always return pid */
     *retval = pid;
@@ -161,79 +202,114 @@ int sys_waitpid(pid_t pid, int *status, int options, int *retval)
 
     lock_acquire(gpt->p_lock);
     pc = gpt->proc[pid];
-    lock_release(gpt->p_lock);
-
     if (pc == NULL)
     {
+        lock_release(gpt->p_lock);
         return ESRCH;
     }
-
     /* check parent */
     if (pc->parent != curproc->pid)
     {
+        lock_release(gpt->p_lock);
         return ECHILD;
     }
+    parent_pc = gpt->proc[curproc->pid];
+    lock_release(gpt->p_lock);
 
-    /* child not exited, wait for it */
-    if (pc->exitstatus == false)
-    {
-        /* wait at child's waiting list */
-        /* this wait chanel always get only 1 proc wating
-         * since only parent wait for child
-         */
-        P(pc->p_sem);
-    }
-
-    /* check child status */
-    if (pc->exitstatus == true)
-    {
-        /* child already exited */
-        /* collect code and deallocate child*/
-        *status = pc->exitcode;
-        pid_deallocate(pid);
-    }
-    else
-    {
-        /* should never get here */
-        panic("someting wrong with waitpid\n");
-    }
+    /* wait for the child to exit; only the parent waits
+     * here, so there is only ever one waiter.
+     */
+    P(pc->p_sem);
+    KASSERT(pc->exitstatus == true);
+    exitcode = pc->exitcode;
 
-    parent = curproc->pid;
-    /* should not get race condition, lock up for further concern */
+    /* collect code and deallocate child */
     lock_acquire(gpt->p_lock);
-    parent_pc = gpt->proc[parent];
+    child_unlink(parent_pc, pc);
     lock_release(gpt->p_lock);
-    /* set parent's child to 0 */
-    parent_pc->child = parent_pc->child & ~(1 << pid);
+    pid_deallocate(pid);
 
+    if (status != NULL)
+    {
+        result = copyout(&exitcode, (userptr_t)status, sizeof(int));
+        if (result)
+        {
+            return result;
+        }
+    }
     return 0;
 }
 
 void sys__exit(int exitcode)
 {
     struct proc_ctl *pc;
-    struct proc_ctl *init;
+    struct proc_ctl *child;
+    struct proc_ctl *next;
+    struct proc_ctl *reap = NULL;
+    struct addrspace *as;
+    bool orphan;
     pid_t pid;
 
     /* get process control struct */
     pid = curproc->pid;
     lock_acquire(gpt->p_lock);
     pc = gpt->proc[pid];
-    lock_release(gpt->p_lock);
 
-    /* check we have child or not */
-    if (pc->child != 0)
+    /* children that have exited can't be waited for any more,
+     * so free them; the rest have nobody to wait for them now,
+     * so they free themselves when they exit.
+     */
+    for (child = pc->children; child != NULL; child = next)
     {
-        /* too bad you have child */
-        /* let init process have all your child */
-        lock_acquire(gpt->p_lock);
-        init = gpt->proc[1];
-        lock_release(gpt->p_lock);
-        init->child = init->child | pc->child;
+        next = child->sibling;
+        if (child->exitstatus)
+        {
+            child->sibling = reap;
+            reap = child;
+        }
+        else
+        {
+            child->parent = 0;
+            child->sibling = NULL;
+        }
     }
-    /* good to be lonely, you can die now */
+    pc->children = NULL;
+
     pc->exitcode = _MKWAIT_EXIT(exitcode);
     pc->exitstatus = true;
-    V(pc->p_sem);
+    /* our parent checks exitstatus under p_lock before orphaning us */
+    orphan = (pc->parent == 0);
+    lock_release(gpt->p_lock);
+
+    for (child = reap; child != NULL; child = next)
+    {
+        next = child->sibling;
+        child->sibling = NULL;
+        /* wait until it is off its proc */
+        P(child->p_sem);
+        pid_deallocate(child->pid);
+    }
+
+    /* get off the proc before anyone can destroy it: whoever
+     * frees it checks p_numthreads is 0, and we may not run
+     * again before they do. Get rid of the address space while
+     * we're still in it, and finish exiting as part of the kernel.
+     */
+    as = proc_setas(NULL);
+    as_deactivate();
+    as_destroy(as);
+    proc_remthread(curthread);
+    proc_addthread(kproc, curthread);
+
+    if (orphan)
+    {
+        /* nobody will wait for us, so free our own pid and proc */
+        pid_deallocate(pid);
+    }
+    else
+    {
+        /* PC may be gone as soon as this is done */
+        V(pc->p_sem);
+    }
     thread_exit();
-}
\ No newline at end of file
+}
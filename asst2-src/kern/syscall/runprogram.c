@@ -100,11 +100,6 @@ runprogram(char *progname)
 		panic("filetable init wrong");
 	}
 
-	/* create proc_ctl */
-	struct proc_ctl *pc = proc_ctl_create(curproc);
-	pc->pid = 1;
-	curproc->pid = 1;
-	gpt->proc[1] = pc;
 	/* Define the user stack in the address space */
 	result = as_define_stack(as, &stackptr);
 	if (result) {
@@ -112,6 +107,15 @@ runprogram(char *progname)
 		return result;
 	}
 
+	/*
+	 * Get a pid like any other process, last, so nothing can fail
+	 * after it. With no parent, it frees the pid itself at exit.
+	 */
+	result = pid_allocate(curproc);
+	if (result) {
+		return result;
+	}
+
 	/* Warp to user mode. */
 	enter_new_process(0 /*argc*/, NULL /*userspace addr of argv*/,
 			  NULL /*userspace addr of environment*/,
@@ -315,3 +315,188 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_readwait = 0;
+	rw->rw_writewait = 0;
+	rw->rw_readpass = 0;
+	rw->rw_readgen = 0;
+	rw->rw_writer = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+	kfree(rw->rwlock_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	unsigned gen;
+	bool passed;
+
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer != curthread);
+	/*
+	 * Wait while a writer holds the lock, and also while one is
+	 * waiting, unless a writer has released the lock while we
+	 * were asleep and passed it over to the readers queued behind
+	 * it. The passes are only for those readers: rw_readgen tells
+	 * us whether one was handed out since we went to sleep, so a
+	 * reader that just arrived can't take one.
+	 */
+	passed = false;
+	while (rw->rw_writer != NULL || (rw->rw_writewait > 0 && !passed)) {
+		gen = rw->rw_readgen;
+		rw->rw_readwait++;
+		wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+		rw->rw_readwait--;
+		if (rw->rw_readgen != gen) {
+			passed = true;
+		}
+	}
+	if (passed && rw->rw_readpass > 0) {
+		rw->rw_readpass--;
+	}
+	rw->rw_readers++;
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_readpass == 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer != curthread);
+	while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+	       rw->rw_readpass > 0) {
+		rw->rw_writewait++;
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+		rw->rw_writewait--;
+	}
+	rw->rw_writer = curthread;
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer == curthread);
+	KASSERT(rw->rw_readers == 0);
+	rw->rw_writer = NULL;
+
+	if (rw->rw_readwait > 0) {
+		/*
+		 * Let everyone who queued up behind us in before the
+		 * next writer. Readers that arrive later still wait.
+		 */
+		rw->rw_readpass = rw->rw_readwait;
+		rw->rw_readgen++;
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	else {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_tryupgrade(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	ret = (rw->rw_readers == 1);
+	if (ret) {
+		rw->rw_readers = 0;
+		rw->rw_writer = curthread;
+	}
+
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
+}
@@ -0,0 +1,157 @@
+/*
+ * filebench - read and write throughput.
+ *
+ * Like bigfile, writes a file of the given size in chunks of the given
+ * size, but then reads it back, checks it, and prints how long each
+ * half took. Chunks can be bigger than a page, and bigger than the
+ * kernel moves in one go, so large transfers get exercised too.
+ *
+ * Usage: filebench <filename> <size> [<chunksize>]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define MAXCHUNK (256 * 1024)
+#define DEFCHUNK 4096
+
+static char buffer[MAXCHUNK];
+
+/* nanoseconds since some time or other */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000000ULL + nsecs;
+}
+
+/* the byte at offset POS of the file */
+static
+char
+pattern(size_t pos)
+{
+	return 'a' + (pos * 7 + pos / 4096) % 26;
+}
+
+static
+void
+report(const char *what, size_t size, size_t chunksize,
+       unsigned long long nsecs)
+{
+	unsigned long long usecs;
+
+	usecs = nsecs / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("%s: %lu bytes in %lu-byte chunks, %llu us, %llu KB/s\n",
+	       what, (unsigned long)size, (unsigned long)chunksize, usecs,
+	       (unsigned long long)size * 1000000ULL / 1024 / usecs);
+}
+
+static
+void
+dowrite(const char *filename, size_t size, size_t chunksize)
+{
+	unsigned long long start;
+	size_t pos, i, len;
+	ssize_t r;
+	int fd;
+
+	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC);
+	if (fd < 0) {
+		err(1, "%s: create", filename);
+	}
+
+	start = now();
+	for (pos = 0; pos < size; pos += len) {
+		len = size - pos < chunksize ? size - pos : chunksize;
+		for (i=0; i<len; i++) {
+			buffer[i] = pattern(pos + i);
+		}
+		r = write(fd, buffer, len);
+		if (r < 0) {
+			err(1, "%s: write", filename);
+		}
+		if ((size_t)r != len) {
+			errx(1, "%s: short write at %lu (%ld of %lu)",
+			     filename, (unsigned long)pos, (long)r,
+			     (unsigned long)len);
+		}
+	}
+	close(fd);
+	report("write", size, chunksize, now() - start);
+}
+
+static
+void
+doread(const char *filename, size_t size, size_t chunksize)
+{
+	unsigned long long start;
+	size_t pos, i;
+	ssize_t r;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", filename);
+	}
+
+	start = now();
+	pos = 0;
+	while (1) {
+		r = read(fd, buffer, chunksize);
+		if (r < 0) {
+			err(1, "%s: read", filename);
+		}
+		if (r == 0) {
+			break;
+		}
+		for (i=0; i<(size_t)r; i++) {
+			if (buffer[i] != pattern(pos + i)) {
+				errx(1, "%s: wrong data at %lu", filename,
+				     (unsigned long)(pos + i));
+			}
+		}
+		pos += r;
+	}
+	close(fd);
+	if (pos != size) {
+		errx(1, "%s: read %lu bytes, expected %lu", filename,
+		     (unsigned long)pos, (unsigned long)size);
+	}
+	report("read", size, chunksize, now() - start);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *filename;
+	size_t size, chunksize;
+
+	if (argc != 3 && argc != 4) {
+		errx(1, "Usage: filebench <filename> <size> [<chunksize>]");
+	}
+
+	filename = argv[1];
+	size = atoi(argv[2]);
+	chunksize = argc == 4 ? (size_t)atoi(argv[3]) : DEFCHUNK;
+	if (chunksize == 0) {
+		errx(1, "Really?");
+	}
+	if (chunksize > MAXCHUNK) {
+		chunksize = MAXCHUNK;
+	}
+
+	dowrite(filename, size, chunksize);
+	doread(filename, size, chunksize);
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * orphans - check that processes nobody waits for give back their pids.
+ *
+ * Each round forks a child, which forks two grandchildren: one that
+ * exits before the child does (so the child frees it when it exits)
+ * and one that outlives the child (so nobody is left to wait for it
+ * and it frees itself). The parent waits only for the child. There
+ * are more rounds than pids, so if any of these leak, fork eventually
+ * fails with ENPROC.
+ *
+ * This program itself has no parent to wait for it either; run it
+ * twice in a row from the menu to check that the top-level program
+ * exits cleanly.
+ *
+ * Usage: orphans [<rounds>]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFROUNDS 17000		/* twice this is more than PID_MAX */
+
+static
+void
+spin(unsigned n)
+{
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		getpid();
+	}
+}
+
+static
+void
+child(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		warn("fork (first grandchild)");
+		_exit(1);
+	}
+	if (pid == 0) {
+		_exit(0);
+	}
+	/* give it time to exit; we never wait for it */
+	spin(200);
+
+	pid = fork();
+	if (pid < 0) {
+		warn("fork (second grandchild)");
+		_exit(1);
+	}
+	if (pid == 0) {
+		/* outlive our parent */
+		spin(200);
+		_exit(0);
+	}
+	_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned rounds, i;
+	pid_t pid;
+	int status;
+
+	rounds = argc > 1 ? (unsigned)atoi(argv[1]) : DEFROUNDS;
+
+	for (i=0; i<rounds; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork (round %u)", i);
+		}
+		if (pid == 0) {
+			child();
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "round %u failed", i);
+		}
+		if (i % 1000 == 999) {
+			printf("%u rounds\n", i + 1);
+		}
+	}
+
+	printf("orphans: passed\n");
+	return 0;
+}
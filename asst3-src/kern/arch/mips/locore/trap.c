@@ -136,7 +136,7 @@ mips_trap(struct trapframe *tf)
 	uint32_t code;
 	/*bool isutlb; -- not used */
 	bool iskern;
-	int spl;
+	int spl, acctmode;
 
 	/* The trap frame is supposed to be 35 registers long. */
 	KASSERT(sizeof(struct trapframe)==(35*4));
@@ -157,6 +157,9 @@ mips_trap(struct trapframe *tf)
 						+ STACK_SIZE));
 	}
 
+	/* Start charging time to the interrupt or the kernel. */
+	acctmode = thread_account(code == EX_IRQ ? ACCT_INTR : ACCT_SYS);
+
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
@@ -330,6 +333,9 @@ mips_trap(struct trapframe *tf)
 	cpu_irqoff();
  done2:
 
+	/* Go back to charging whatever was interrupted. */
+	thread_account(acctmode);
+
 	/*
 	 * The boot thread can get here (e.g. on interrupt return) but
 	 * since it doesn't go to userlevel, it can't be returning to
@@ -385,6 +391,8 @@ mips_usermode(struct trapframe *tf)
 	spl0();
 	cpu_irqoff();
 
+	thread_account(ACCT_USER);
+
 	cputhreads[curcpu->c_number] = (vaddr_t)curthread;
 	cpustacks[curcpu->c_number] = (vaddr_t)curthread->t_stack + STACK_SIZE;
 
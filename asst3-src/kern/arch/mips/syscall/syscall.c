@@ -113,6 +113,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -142,6 +147,32 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_getrlimit:
+		err = sys_getrlimit(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_setrlimit:
+		err = sys_setrlimit(tf->tf_a0, (const_userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sched_setaffinity:
+		err = sys_sched_setaffinity(tf->tf_a0, tf->tf_a1,
+					    (const_userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS_sched_getaffinity:
+		err = sys_sched_getaffinity(tf->tf_a0, tf->tf_a1,
+					    (userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS_sched_getcpu:
+		err = sys_sched_getcpu(&retval);
+		break;
+
 
 	    /* file calls */
 
@@ -164,6 +195,26 @@ syscall(struct trapframe *tf)
 		err = sys_close(tf->tf_a0);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_fcntl:
+		err = sys_fcntl(
+			tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
+	    case SYS_poll:
+		err = sys_poll(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
 	    case SYS_read:
 		err = sys_read(
 			tf->tf_a0,
@@ -178,6 +229,85 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
+	    /*
+	     * The positional calls have a 64-bit position as the
+	     * fourth argument. It's aligned, so it skips a3 and goes
+	     * on the stack.
+	     */
+	    case SYS_pread:
+	    case SYS_pwrite:
+	    case SYS_preadv:
+	    case SYS_pwritev:
+		{
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(off_t));
+			if (err) {
+				break;
+			}
+
+			switch (callno) {
+			    case SYS_pread:
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_pwrite:
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_preadv:
+				err = sys_preadv(tf->tf_a0,
+						 (const_userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    default:
+				err = sys_pwritev(tf->tf_a0,
+						  (const_userptr_t)tf->tf_a1,
+						  tf->tf_a2, pos, &retval);
+				break;
+			}
+		}
+		break;
+
+	    case SYS_copy_file_range:
+		{
+			/* len and flags are the fifth and sixth arguments */
+			uint32_t stackargs[2];
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     stackargs, sizeof(stackargs));
+			if (err) {
+				break;
+			}
+			err = sys_copy_file_range(
+				tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				tf->tf_a2,
+				(userptr_t)tf->tf_a3,
+				stackargs[0],
+				stackargs[1],
+				&retval);
+		}
+		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -282,6 +412,26 @@ syscall(struct trapframe *tf)
         err = sys_munmap(tf->tf_a0);
         break;
 
+
+	    /* synchronization calls */
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1,
+				     &retval);
+		break;
+
+	    /* submission rings */
+
+	    case SYS_ioring_setup:
+		err = sys_ioring_setup((userptr_t)tf->tf_a0);
+		break;
+	    case SYS_ioring_enter:
+		err = sys_ioring_enter(tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
 		err = ENOSYS;
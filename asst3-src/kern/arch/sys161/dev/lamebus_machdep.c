@@ -43,6 +43,7 @@
 #include <sys161/bus.h>
 #include <lamebus/lamebus.h>
 #include <lamebus/ltrace.h>
+#include <platform/maxcpus.h>
 #include "autoconf.h"
 
 /*
@@ -60,10 +61,66 @@
  * matches the c0_compare register, the timer interrupt line is
  * asserted. Writing to c0_compare again clears the interrupt.
  */
+
+/*
+ * c0_count is also the cheapest clock there is: one coprocessor move,
+ * where the realtime clock costs three bus reads. But it's per-cpu,
+ * 32 bits, and starts over from zero when the timer fires (and when
+ * mips_timer_restart clears it), so mips_cycles_update extends it to
+ * a 64-bit cycle count per cpu. It has to be called before anything
+ * writes the timer registers, and often enough that the timer can't
+ * fire twice in between; trap entry and exit take care of the latter.
+ *
+ * Each cpu touches only its own slots, with interrupts off.
+ */
+static uint64_t mips_cycles[MAXCPUS];
+static uint32_t mips_lastcount[MAXCPUS];
+static uint32_t mips_compare[MAXCPUS];
+
+static
+uint32_t
+mips_count(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+static
+uint64_t
+mips_cycles_update(void)
+{
+	unsigned n = curcpu->c_number;
+	uint32_t count;
+
+	count = mips_count();
+	if (count >= mips_lastcount[n]) {
+		mips_cycles[n] += count - mips_lastcount[n];
+	}
+	else if (mips_compare[n] > mips_lastcount[n]) {
+		/* went up to the compare value, then started over */
+		mips_cycles[n] += mips_compare[n] - mips_lastcount[n] + count;
+	}
+	else {
+		mips_cycles[n] += count;
+	}
+	mips_lastcount[n] = count;
+	return mips_cycles[n];
+}
+
 static
 void
 mips_timer_set(uint32_t count)
 {
+	mips_cycles_update();
+
 	/*
 	 * $11 == c0_compare; we can't use the symbolic name inside
 	 * the asm string.
@@ -74,6 +131,58 @@ mips_timer_set(uint32_t count)
 		"mtc0 %0, $11;"		/* do it */
 		".set pop"		/* restore assembler mode */
 		:: "r" (count));
+
+	mips_compare[curcpu->c_number] = count;
+	mips_lastcount[curcpu->c_number] = mips_count();
+}
+
+/*
+ * Restart the on-chip timer from zero, to go off in COUNT cycles.
+ * ($9 == c0_count.)
+ */
+static
+void
+mips_timer_restart(uint32_t count)
+{
+	mips_cycles_update();
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 $0, $9;"		/* count = 0 */
+		"mtc0 %0, $11;"		/* compare = count */
+		".set pop"		/* restore assembler mode */
+		:: "r" (count));
+
+	mips_compare[curcpu->c_number] = count;
+	mips_lastcount[curcpu->c_number] = mips_count();
+}
+
+/*
+ * Compare value for a stopped timer: as far away as it gets, about
+ * three minutes at 25 MHz. If it does go off we just push it away
+ * again.
+ */
+#define MIPS_TIMER_FAR 0xffffffff
+
+void
+mainbus_hardclock_stop(void)
+{
+	KASSERT(curthread->t_curspl > 0);
+	mips_timer_restart(MIPS_TIMER_FAR);
+}
+
+void
+mainbus_hardclock_start(void)
+{
+	KASSERT(curthread->t_curspl > 0);
+	mips_timer_restart(CPU_FREQUENCY / HZ);
+}
+
+uint64_t
+mainbus_cpuclock(void)
+{
+	return mips_cycles_update() * (1000000000ULL / CPU_FREQUENCY);
 }
 
 /*
@@ -305,19 +414,27 @@ mainbus_interrupt(struct trapframe *tf)
 
 	cause = tf->tf_cause;
 	if (cause & LAMEBUS_IRQ_BIT) {
+		curcpu->c_devirqs++;
 		lamebus_interrupt(lamebus);
 		seen = true;
 	}
 	if (cause & LAMEBUS_IPI_BIT) {
+		curcpu->c_ipis++;
 		interprocessor_interrupt();
 		lamebus_clear_ipi(lamebus, curcpu);
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
-		/* and call hardclock */
-		hardclock();
+		if (curcpu->c_tickless) {
+			/* Stopped; this is the far-off compare value. */
+			mips_timer_restart(MIPS_TIMER_FAR);
+		}
+		else {
+			/* Reset the timer (this clears the interrupt) */
+			mips_timer_set(CPU_FREQUENCY / HZ);
+			/* and call hardclock */
+			hardclock();
+		}
 		seen = true;
 	}
 
@@ -46,10 +46,8 @@
 #define LT_REG_COUNT  16    /* Time for countdown timer (usec) */
 #define LT_REG_SPKR   20    /* Beep control */
 
-/* Granularity of countdown timer (usec) */
-#define LT_GRANULARITY   1000000
-
-static bool havetimerclock;
+/* The timer doing timerclock, if any. */
+static struct ltimer_softc *timerclock_lt;
 
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
@@ -85,21 +83,41 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 
 	/*
 	 * We do, however, use ltimer for the timer clock, since the
-	 * on-chip timer can't do that.
+	 * on-chip timer can't do that. It runs one-shot, armed by
+	 * timerclock_set for the next deadline, so when nothing is
+	 * waiting for the time it doesn't interrupt at all.
 	 */
-	if (!havetimerclock) {
-		havetimerclock = true;
+	if (timerclock_lt == NULL) {
+		timerclock_lt = lt;
 		lt->lt_timerclock = 1;
-
-		/* Wire it to go off once every second. */
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
-				   LT_GRANULARITY);
+		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 0);
+	}
+	else {
+		lt->lt_timerclock = 0;
 	}
 
 	return 0;
 }
 
+/*
+ * Arm the timerclock alarm.
+ */
+void
+timerclock_set(uint32_t usecs)
+{
+	struct ltimer_softc *lt = timerclock_lt;
+
+	if (lt == NULL) {
+		/* No timer (yet); nothing will ever go off. */
+		return;
+	}
+	if (usecs == 0) {
+		/* zero would stop the countdown */
+		usecs = 1;
+	}
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT, usecs);
+}
+
 /*
  * Interrupt handler.
  */
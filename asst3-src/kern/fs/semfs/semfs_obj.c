@@ -62,6 +62,7 @@ semfs_sem_create(const char *name)
 	if (sem->sems_cv == NULL) {
 		goto fail_lock;
 	}
+	pollqueue_init(&sem->sems_pollq);
 	sem->sems_count = 0;
 	sem->sems_hasvnode = false;
 	sem->sems_linked = false;
@@ -81,6 +82,7 @@ semfs_sem_create(const char *name)
 void
 semfs_sem_destroy(struct semfs_sem *sem)
 {
+	pollqueue_cleanup(&sem->sems_pollq);
 	cv_destroy(sem->sems_cv);
 	lock_destroy(sem->sems_lock);
 	kfree(sem);
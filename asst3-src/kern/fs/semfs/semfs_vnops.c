@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <uio.h>
 #include <synch.h>
@@ -136,7 +137,7 @@ semfs_getsem(struct semfs_vnode *semv)
  * Wakeup helper. We only need to wake up if there are sleepers, which
  * should only be the case if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. Anyone polling for P is in the same position.
  */
 static
 void
@@ -145,6 +146,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	if (sem->sems_count > 0 || newcount == 0) {
 		return;
 	}
+	pollqueue_wakeup(&sem->sems_pollq);
 	if (newcount == 1) {
 		cv_signal(sem->sems_cv, sem->sems_lock);
 	}
@@ -255,6 +257,32 @@ semfs_write(struct vnode *vn, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Poll. Reading (P) can go ahead if the count isn't zero; writing (V)
+ * never waits.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, struct pollentry *entry,
+	   int *revents)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+
+	sem = semfs_getsem(semv);
+
+	lock_acquire(sem->sems_lock);
+	if (entry != NULL) {
+		pollqueue_add(&sem->sems_pollq, entry);
+	}
+	*revents = events & POLLOUT;
+	if (sem->sems_count > 0) {
+		*revents |= events & POLLIN;
+	}
+	lock_release(sem->sems_lock);
+	return 0;
+}
+
 /*
  * Truncate. Set the count to the specified value.
  *
@@ -659,6 +687,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_getdirentry = semfs_getdirentry,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = vopnull_poll,
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
@@ -692,6 +721,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = semfs_write,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = semfs_poll,
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
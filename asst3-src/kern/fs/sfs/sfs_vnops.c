@@ -595,6 +595,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = sfs_write,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vopnull_poll,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
@@ -629,6 +630,7 @@ const struct vnode_ops sfs_dirops = {
 	.vop_getdirentry = vopfail_uio_nosys,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vopnull_poll,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
@@ -53,6 +53,7 @@ struct vnode;
 #define RG_W PF_W
 #define RG_X PF_X
 #define RG_OLD (1 << 4)
+#define RG_SHARED (1 << 5)  /* anonymous, shared with children */
 
 struct region_entry {
     vaddr_t vbase;
@@ -123,6 +124,10 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_shared - set up a region of zeroed memory whose frames
+ *                as_copy shares with the child instead of copying, so
+ *                that parent and child see each other's writes.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -148,6 +153,10 @@ int               as_define_mmap(struct addrspace *as,
                                  /* these are same as define_region */
                                  struct vnode *vn, off_t offset, size_t filesize);
 
+int               as_define_shared(struct addrspace *as,
+                                   vaddr_t vaddr, size_t sz,
+                                   int readable, int writeable);
+
 int find_mmap_place(struct addrspace *as, size_t length, vaddr_t *vaddr);
 void region_destroy_munmap(struct addrspace *as, struct region_entry *region);
 
@@ -45,14 +45,17 @@
 /* hardclocks per second */
 #define HZ  100
 
-void hardclock_bootstrap(void);
 void hardclock(void);
 
 /*
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU when the alarm set with
+ * timerclock_set() goes off; it runs the timers in <timer.h>.
+ * timerclock_set() is provided by whichever timer device is doing
+ * timerclock; it arms a one-shot alarm USECS microseconds from now,
+ * replacing any alarm already set.
  */
 void timerclock(void);
+void timerclock_set(uint32_t usecs);
 
 /*
  * gettime() may be used to fetch the current time of day.
@@ -33,6 +33,7 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <cputime.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
@@ -59,8 +60,25 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadpool;	/* Exited threads kept for reuse */
+	unsigned c_poolhits;		/* thread_forks served from the pool */
+	unsigned c_poolmisses;		/* ...and those that weren't */
+	struct threadlist c_migrants;	/* Threads to send to other cpus */
+	struct wchan *c_moverwchan;	/* Where our mover thread waits */
+	struct spinlock c_moverlock;	/* ...and its lock */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	bool c_tickless;		/* hardclock stopped while idle */
+	unsigned c_tickstops;		/* Times hardclock was stopped */
+	unsigned c_devirqs;		/* Device interrupts taken */
+	unsigned c_ipis;		/* Interprocessor interrupts taken */
+	int c_acctmode;			/* ACCT_* being charged now */
+	uint64_t c_acctstamp;		/* ...since this time */
+	uint64_t c_acct[ACCT_NMODES];	/* Time spent in each mode */
+	uint64_t c_rqsum;		/* Run queue length, summed each hardclock */
+	/* these two are also updated by cpu_loadstats, on any cpu */
+	uint64_t c_topacct[ACCT_NMODES]; /* c_acct at last cpu_loadstats */
+	uint64_t c_toprqsum;		/* c_rqsum then */
 
 	/*
 	 * Accessed by other cpus.
@@ -112,6 +130,30 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Print per-cpu interrupt counts, or zero them (for the kernel menu).
+ */
+void cpu_intrstats(void);
+void cpu_intrstats_reset(void);
+
+/*
+ * Print per-cpu thread pool sizes and hit counts (for the kernel
+ * menu's tpool).
+ */
+void cpu_poolstats(void);
+
+/*
+ * Print per-cpu utilization and average run queue length since the
+ * last call (for the kernel menu's top).
+ */
+void cpu_loadstats(void);
+
+/*
+ * The number of cpus; cpu numbers run from 0 to this minus one. Only
+ * final once thread_start_cpus has run.
+ */
+unsigned cpu_count(void);
+
 /*
  * Produce a string describing the CPU type.
  */
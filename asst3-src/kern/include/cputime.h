@@ -0,0 +1,30 @@
+#ifndef _CPUTIME_H_
+#define _CPUTIME_H_
+
+/*
+ * CPU time accounting. Each cpu is always charging time to one of
+ * these; see thread_account(). Times are in nanoseconds.
+ */
+#define ACCT_USER	0	/* current thread, in user mode */
+#define ACCT_SYS	1	/* current thread, in the kernel */
+#define ACCT_INTR	2	/* interrupt handlers */
+#define ACCT_IDLE	3	/* nothing to run */
+#define ACCT_NMODES	4
+
+struct cputime {
+	uint64_t ct_user;
+	uint64_t ct_sys;
+	uint64_t ct_intr;
+};
+
+/*
+ * Arithmetic (in thread.c).
+ *
+ * add: ret += t
+ * sub: ret -= t
+ */
+void cputime_add(struct cputime *ret, const struct cputime *t);
+void cputime_sub(struct cputime *ret, const struct cputime *t);
+
+
+#endif /* _CPUTIME_H_ */
@@ -38,15 +38,12 @@
 
 
 /*
- * The file table is an array of open files.
- *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * The file table is an array of open files that grows on demand, up
+ * to a limit the process can set (RLIMIT_NOFILE; see setrlimit(2)).
+ * It starts at FILETABLE_INITSIZE slots and doubles as needed. A
+ * bitmap of the slots in use, ft_inuse, makes finding the lowest free
+ * descriptor a matter of looking for a word that isn't all ones, and
+ * lets fork and exit visit only the open slots.
  *
  * Because we only have single-threaded processes, the file table is
  * never shared and so it doesn't require synchronization. On fork,
@@ -56,22 +53,33 @@
  * read() using the same file handle?
  */
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct openfile **ft_openfiles;	/* ft_size entries */
+	uint32_t *ft_inuse;		/* bit per entry, set if open */
+	unsigned ft_size;		/* always a multiple of 32 */
+	unsigned ft_limit;		/* fds must be below this */
+	unsigned ft_maxlimit;		/* ft_limit can't be raised above */
 };
 
+#define FILETABLE_INITSIZE	32
+/* Default soft and hard limits. */
+#define FILETABLE_LIMIT		OPEN_MAX
+#define FILETABLE_MAXLIMIT	(OPEN_MAX * 32)
+
 /*
  * Filetable ops:
  *
  * create -  Construct an empty file table.
  * destroy - Wipe out a file table, closing anything open in it.
  * copy -    Clone a file table.
- * okfd -    Check if a file handle is in range.
+ * okfd -    Check if a file handle is in range (below the limit).
  * get/put - Retrieve a fd for use and put it back when done. (Checks
  *           okfd and also fails on files not open; returned openfile
  *           is not NULL.) Call put with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
  *           previously there.
+ * getlimit/setlimit - Get or set the limit on file handles, as for
+ *           RLIMIT_NOFILE.
  */
 
 struct filetable *filetable_create(void);
@@ -83,8 +91,11 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
+
+void filetable_getlimit(struct filetable *ft, rlim_t *cur, rlim_t *max);
+int filetable_setlimit(struct filetable *ft, rlim_t cur, rlim_t max);
 
 
 #endif /* _FILETABLE_H_ */
@@ -0,0 +1,88 @@
+/*
+ * Definitions for the submission/completion ring (ioring_setup and
+ * ioring_enter).
+ */
+
+#ifndef _KERN_IORING_H_
+#define _KERN_IORING_H_
+
+/*
+ * The ring lives in the process's own memory: a struct ioring, and
+ * two arrays of ir_entries entries each, one of submissions and one
+ * of completions. ir_entries must be a power of two no bigger than
+ * IORING_MAXENTRIES. The four counters only ever increase (wrapping
+ * around), and entry N of a ring is at index N & (ir_entries - 1).
+ *
+ * To submit, the process fills in the entry at ir_sqtail and then
+ * advances ir_sqtail; ioring_enter takes entries up to there and
+ * advances ir_sqhead past them. Completions are posted at ir_cqtail,
+ * which the kernel advances; the process reads them from ir_cqhead
+ * and advances ir_cqhead to give the slots back. Completions come in
+ * the order the operations finish, not the order they were submitted;
+ * sqe_userdata is copied to cqe_userdata to match them up.
+ *
+ * ioring_setup zeroes the counters.
+ */
+struct ioring {
+	/* advanced by the kernel */
+	unsigned ir_sqhead;
+	unsigned ir_cqtail;
+	/* advanced by the process */
+	unsigned ir_sqtail;
+	unsigned ir_cqhead;
+
+	unsigned ir_entries;
+#ifdef _KERNEL
+	userptr_t ir_sqes;
+	userptr_t ir_cqes;
+#else
+	struct ioring_sqe *ir_sqes;
+	struct ioring_cqe *ir_cqes;
+#endif
+};
+
+/*
+ * A submission. READ and WRITE transfer at most IORING_MAXIO bytes
+ * and come back short if asked for more; with an sqe_off of -1 they
+ * use and update the file's seek position like read and write,
+ * otherwise they are like pread and pwrite. OPEN uses sqe_buf as the
+ * path, and sqe_flags and sqe_mode, and ignores sqe_fd; a relative
+ * path is taken from the current directory as of ioring_enter.
+ */
+struct ioring_sqe {
+	__u64 sqe_userdata;		/* copied to the completion */
+	__off_t sqe_off;		/* READ, WRITE: offset, or -1 */
+	int sqe_op;			/* IORING_OP_* below */
+	int sqe_fd;
+#ifdef _KERNEL
+	userptr_t sqe_buf;
+#else
+	void *sqe_buf;
+#endif
+	__size_t sqe_len;
+	int sqe_flags;			/* OPEN: O_* flags */
+	__mode_t sqe_mode;		/* OPEN: mode */
+};
+
+/*
+ * A completion. cqe_res is what the matching system call would have
+ * returned (a byte count, a file descriptor, or 0) or, on failure,
+ * the negated error code.
+ */
+struct ioring_cqe {
+	__u64 cqe_userdata;
+	int cqe_res;
+};
+
+/* Operations. */
+#define IORING_OP_NOP		0	/* Nothing; completes with 0 */
+#define IORING_OP_READ		1
+#define IORING_OP_WRITE		2
+#define IORING_OP_OPEN		3
+#define IORING_OP_CLOSE		4
+#define IORING_OP_FSYNC		5
+
+#define IORING_MAXENTRIES	256
+#define IORING_MAXIO		(64 * 1024)
+
+#endif /* _KERN_IORING_H_ */
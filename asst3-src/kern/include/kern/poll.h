@@ -0,0 +1,30 @@
+/*
+ * Definitions for poll().
+ */
+
+#ifndef _KERN_POLL_H_
+#define _KERN_POLL_H_
+
+/*
+ * One descriptor to poll: FD, the conditions wanted (EVENTS), and
+ * those found (REVENTS). A negative FD is ignored.
+ */
+struct pollfd {
+	int fd;
+	short events;
+	short revents;
+};
+
+/* Conditions. */
+#define POLLIN		0x0001	/* Reading won't block */
+#define POLLPRI		0x0002	/* Urgent data to read (never set) */
+#define POLLOUT		0x0004	/* Writing won't block */
+/* and these are only ever returned */
+#define POLLERR		0x0008	/* Error, e.g. a pipe with no reader */
+#define POLLHUP		0x0010	/* Hung up, e.g. a pipe with no writer */
+#define POLLNVAL	0x0020	/* Not an open file */
+
+#define POLLRDNORM	POLLIN
+#define POLLWRNORM	POLLOUT
+
+#endif /* _KERN_POLL_H_ */
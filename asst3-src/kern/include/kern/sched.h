@@ -0,0 +1,23 @@
+/*
+ * Definitions for sched_setaffinity and sched_getaffinity.
+ */
+
+#ifndef _KERN_SCHED_H_
+#define _KERN_SCHED_H_
+
+/*
+ * A set of cpus, one bit per cpu number. System/161 has at most 32.
+ */
+#define CPU_SETSIZE	32
+
+typedef struct {
+	__u32 __bits;
+} cpu_set_t;
+
+#define CPU_ZERO(set)		((set)->__bits = 0)
+#define CPU_SET(cpu, set)	((set)->__bits |= (__u32)1 << (cpu))
+#define CPU_CLR(cpu, set)	((set)->__bits &= ~((__u32)1 << (cpu)))
+#define CPU_ISSET(cpu, set)	(((set)->__bits >> (cpu)) & 1)
+
+
+#endif /* _KERN_SCHED_H_ */
@@ -0,0 +1,89 @@
+/*
+ * Lock contention statistics.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+#include <spinlock.h>
+
+/*
+ * Kinds of synchronization object. Records are kept per (name, kind),
+ * so e.g. a struct lock called "openfile" and the spinlock inside it
+ * show up as two separate lines.
+ */
+#define LOCKSTAT_LOCK	0	/* struct lock */
+#define LOCKSTAT_SPIN	1	/* struct spinlock */
+#define LOCKSTAT_SEM	2	/* struct semaphore (P) */
+#define LOCKSTAT_CV	3	/* struct cv (cv_wait) */
+
+/*
+ * Statistics for all the objects sharing one name.
+ *
+ * Records are created the first time a name is seen and never freed,
+ * so objects can hold a pointer to theirs and update it without any
+ * lookup. The counters are protected by ls_guard, a bare
+ * test-and-set word: it can't be a struct spinlock because the
+ * spinlock code itself updates these records.
+ *
+ * All times are in nanoseconds. Wait time is only accumulated for
+ * contended acquisitions (an uncontended acquisition waits for zero
+ * time by definition). For semaphores an "acquisition" is a P, and
+ * for CVs it is a cv_wait, which always counts as contended.
+ */
+struct lockstat {
+	const char *ls_name;
+	unsigned ls_kind;
+	struct lockstat *ls_next;	/* hash chain */
+
+	volatile spinlock_data_t ls_guard;
+	unsigned ls_acquires;
+	unsigned ls_contended;
+	uint64_t ls_waittotal;
+	uint64_t ls_waitmax;
+	uint64_t ls_holdtotal;
+	uint64_t ls_holdmax;
+};
+
+/*
+ * Collection is switched on and off at runtime from the kernel menu;
+ * while it is off each instrumented operation costs one test of
+ * lockstat_enabled. It starts off because the timestamps come from
+ * the realtime clock, which isn't attached until partway through
+ * boot.
+ */
+extern volatile bool lockstat_enabled;
+
+#define LOCKSTAT_ON(ls)		((ls) != NULL && lockstat_enabled)
+
+/*
+ * Functions:
+ *
+ * lockstat_get      - Find (or create) the record for NAME and KIND.
+ *                     Returns NULL if out of memory, in which case the
+ *                     object simply isn't profiled.
+ * lockstat_spinlock - Attach a name to a spinlock so it gets profiled.
+ *                     Spinlocks without one are not recorded.
+ * lockstat_now      - Current time, for passing as WAITSTART.
+ * lockstat_acquired - Count an acquisition. WAITSTART is the time the
+ *                     caller started waiting, or 0 if it didn't wait
+ *                     (or collection was switched on mid-wait).
+ *                     Returns the current time, to be handed back to
+ *                     lockstat_released.
+ * lockstat_released - Account holder time since ACQUIRED (0 = unknown).
+ * lockstat_enable   - Switch collection on or off.
+ * lockstat_reset    - Zero all counters.
+ * lockstat_dump     - Print all records with nonzero counts.
+ */
+struct lockstat *lockstat_get(const char *name, unsigned kind);
+void lockstat_spinlock(struct spinlock *splk, const char *name);
+uint64_t lockstat_now(void);
+uint64_t lockstat_acquired(struct lockstat *ls, bool contended,
+			   uint64_t waitstart);
+void lockstat_released(struct lockstat *ls, uint64_t acquired);
+void lockstat_enable(bool on);
+void lockstat_reset(void);
+void lockstat_dump(void);
+
+
+#endif /* _LOCKSTAT_H_ */
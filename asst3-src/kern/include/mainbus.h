@@ -52,6 +52,22 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Stop and restart the current cpu's hardclock tick. The scheduler
+ * stops it while the cpu is idle, since there's nothing to schedule,
+ * and restarts it when there's a thread to run. Call at splhigh.
+ */
+void mainbus_hardclock_stop(void);
+void mainbus_hardclock_start(void);
+
+/*
+ * Nanoseconds on a clock private to the current cpu, from around when
+ * it started. Much cheaper to read than the realtime clock (gettime),
+ * which is why CPU time accounting uses it, but readings from
+ * different cpus don't line up exactly. Call with interrupts off.
+ */
+uint64_t mainbus_cpuclock(void);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
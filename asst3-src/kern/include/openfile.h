@@ -51,6 +51,7 @@
 struct openfile {
 	struct vnode *of_vnode;
 	int of_accmode;	/* from open: O_RDONLY, O_WRONLY, or O_RDWR */
+	int of_flags;	/* O_NONBLOCK, set with fcntl */
 
 	struct lock *of_offsetlock;	/* lock for of_offset */
 	off_t of_offset;
@@ -59,10 +60,17 @@ struct openfile {
 	int of_refcount;
 };
 
+/* wrap an openfile around a vnode; takes over the caller's reference */
+struct openfile *openfile_create(struct vnode *vn, int accmode);
+
 /* open a file (args must be kernel pointers; destroys filename) */
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* the same, but relative paths start from DIR (see vfs_openat) */
+int openfile_openat(struct vnode *dir, char *filename, int openflags,
+		    mode_t mode, struct openfile **ret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
@@ -34,6 +34,7 @@
 #ifndef _PID_H_
 #define _PID_H_
 
+struct cputime;
 
 #define INVALID_PID	0	/* nothing has this pid */
 #define KERNEL_PID	1	/* kernel proc has this pid */
@@ -61,8 +62,9 @@ void pid_disown(pid_t targetpid);
 /*
  * Set the exit status of the current thread to status.  Wakes up any threads
  * waiting to read this status, and decrefs the current thread's pid.
+ * USAGE is passed on to the parent's children's cpu time when it waits.
  */
-void pid_setexitstatus(int status);
+void pid_setexitstatus(int status, const struct cputime *usage);
 
 /*
  * Causes the current thread to wait for the thread with pid PID to
@@ -0,0 +1,27 @@
+/*
+ * Anonymous pipes.
+ */
+
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+struct vnode;
+
+
+/*
+ * Most data a pipe holds before writers have to wait, in pages.
+ */
+#define PIPE_MAXPAGES	16
+
+/*
+ * pipe_create - make a pipe and return vnodes for its read end and
+ *               its write end. Each end goes away when its vnode's
+ *               refcount does, and the pipe when both ends have.
+ * pipe_setnonblock - turn O_NONBLOCK on or off for one end of a pipe.
+ *               The vnode must be one of the ones from pipe_create.
+ */
+int pipe_create(struct vnode **readvn_ret, struct vnode **writevn_ret);
+void pipe_setnonblock(struct vnode *vn, bool nonblock);
+
+
+#endif /* _PIPE_H_ */
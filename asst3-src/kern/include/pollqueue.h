@@ -0,0 +1,76 @@
+/*
+ * Wait queues for poll().
+ */
+
+#ifndef _POLLQUEUE_H_
+#define _POLLQUEUE_H_
+
+#include <spinlock.h>
+#include <kern/poll.h>
+
+struct wchan;
+
+
+/*
+ * Anything that can make poll() wait (see VOP_POLL) has a pollqueue.
+ * A thread in poll() has a pollwaiter, and a pollentry for each file
+ * it's polling; VOP_POLL puts the entry on the object's queue. Later,
+ * whenever the object's state changes in a way that might be waited
+ * for, the object calls pollqueue_wakeup, which wakes everyone on the
+ * queue. The entries stay queued until their owner takes them off
+ * with pollentry_remove, so that the object needn't know anything
+ * about the waiters.
+ *
+ * To avoid missing a wakeup, VOP_POLL should queue the entry before
+ * it looks at the object's state. Waking up a poller that turns out
+ * not to need it just costs it another trip around its loop.
+ *
+ * pollqueue_wakeup only takes spinlocks, so it can be called from an
+ * interrupt handler.
+ */
+
+struct pollwaiter {
+	struct spinlock pw_lock;
+	struct wchan *pw_wchan;
+	bool pw_woken;
+};
+
+struct pollentry {
+	struct pollwaiter *pe_waiter;
+	struct pollqueue *pe_queue;	/* NULL if not on a queue */
+	struct pollentry *pe_next;
+	struct pollentry **pe_prevp;
+};
+
+struct pollqueue {
+	struct spinlock pq_lock;
+	struct pollentry *pq_head;
+};
+
+/*
+ * pollqueue_init/cleanup - set up and tear down a queue. It must be
+ *                     empty when cleaned up.
+ * pollqueue_add     - put an entry on a queue.
+ * pollqueue_wakeup  - wake every waiter with an entry on the queue.
+ *
+ * pollwaiter_init/cleanup - set up and tear down a waiter.
+ * pollwaiter_wait   - sleep until woken, or until NSECS have passed
+ *                     unless FOREVER. Returns ETIMEDOUT if the time
+ *                     ran out, otherwise 0. A wakeup that comes
+ *                     before the wait isn't lost.
+ * pollentry_init    - set up an entry for a waiter, not on any queue.
+ * pollentry_remove  - take an entry off whatever queue it's on, if any.
+ */
+void pollqueue_init(struct pollqueue *pq);
+void pollqueue_cleanup(struct pollqueue *pq);
+void pollqueue_add(struct pollqueue *pq, struct pollentry *pe);
+void pollqueue_wakeup(struct pollqueue *pq);
+
+int pollwaiter_init(struct pollwaiter *pw);
+void pollwaiter_cleanup(struct pollwaiter *pw);
+int pollwaiter_wait(struct pollwaiter *pw, bool forever, uint64_t nsecs);
+void pollentry_init(struct pollentry *pe, struct pollwaiter *pw);
+void pollentry_remove(struct pollentry *pe);
+
+
+#endif /* _POLLQUEUE_H_ */
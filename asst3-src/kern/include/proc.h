@@ -41,6 +41,7 @@
 
 struct addrspace;
 struct vnode;
+struct ioring_ctx;
 
 /*
  * Process structure.
@@ -64,6 +65,13 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	struct ioring_ctx *p_ioring;	/* from ioring_setup, or NULL */
+
+	/* CPU time (see proc_getcputime) */
+	struct cputime p_cputime;	/* threads that have left; p_threadslock */
+	struct cputime p_childtime;	/* children waited for; p_lock */
+	struct cputime p_toptime;	/* as of last proc_cpustats */
+	struct proc *p_allnext;		/* list of all procs, for top */
 
 	/* add more material here as needed */
 };
@@ -101,6 +109,23 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/*
+ * Total cpu time used by a process's threads, past and present, not
+ * counting children. The figures for threads running on other cpus
+ * are approximate.
+ */
+void proc_getcputime(struct proc *proc, struct cputime *ret);
+
+/* Print each process's share of the cpu since the last call. */
+void proc_cpustats(void);
+
+/*
+ * Set or get the cpu affinity (see thread_setaffinity) of process
+ * PID's threads, or the current process's if PID is 0.
+ */
+int proc_setaffinity(pid_t pid, uint32_t mask);
+int proc_getaffinity(pid_t pid, uint32_t *ret);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
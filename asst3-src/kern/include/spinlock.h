@@ -46,6 +46,8 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+struct lockstat;	/* from <lockstat.h> */
+
 /*
  * Basic spinlock.
  *
@@ -58,6 +60,8 @@
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	struct lockstat *splk_stat;	    /* Contention stats, if named. */
+	uint64_t splk_acquired;		    /* When acquired, for lockstat. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
 };
 
@@ -65,10 +69,10 @@ struct spinlock {
  * Initializer for cases where a spinlock needs to be static or global.
  */
 #ifdef OPT_HANGMAN
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, NULL, 0, \
 				  HANGMAN_LOCKABLE_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, NULL, 0 }
 #endif
 
 /*
@@ -37,6 +37,8 @@
 
 #include <spinlock.h>
 
+struct lockstat;	/* from <lockstat.h> */
+
 /*
  * Dijkstra-style semaphore.
  *
@@ -48,6 +50,7 @@ struct semaphore {
         struct wchan *sem_wchan;
         struct spinlock sem_lock;
         volatile unsigned sem_count;
+        struct lockstat *sem_stat;      /* Contention stats (lockstat.h) */
 };
 
 struct semaphore *sem_create(const char *name, unsigned initial_count);
@@ -62,6 +65,12 @@ void sem_destroy(struct semaphore *);
 void P(struct semaphore *);
 void V(struct semaphore *);
 
+/*
+ * sem_timedP is P, but gives up after NSECS nanoseconds. Returns 0 if
+ * the count was decremented, ETIMEDOUT if not.
+ */
+int sem_timedP(struct semaphore *, uint64_t nsecs);
+
 
 /*
  * Simple lock for mutual exclusion.
@@ -78,6 +87,12 @@ struct lock {
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        struct lockstat *lk_stat;       /* Contention stats (lockstat.h) */
+        uint64_t lk_acquired;           /* When lk_holder got it, for stats */
+        /* Priority inheritance; see synch.c */
+        struct lock *lk_nextheld;       /* Next in lk_holder's t_heldlocks */
+        unsigned lk_nwaiters;           /* Threads with t_waitlock == us */
+        int lk_waitpri;                 /* Highest priority of waiters */
 };
 
 struct lock *lock_create(const char *name);
@@ -86,9 +101,10 @@ void lock_destroy(struct lock *);
 /*
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
- *                   same time.
+ *                   same time. While waiting, lends the caller's priority
+ *                   to the holder (and to whatever it is waiting for).
  *    lock_release - Free the lock. Only the thread holding the lock may do
- *                   this.
+ *                   this. Gives back any priority lent through it.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
  *
@@ -117,6 +133,7 @@ struct cv {
         char *cv_name;
         struct wchan *cv_wchan;
         struct spinlock cv_wchanlock;
+        struct lockstat *cv_stat;       /* Wait stats (lockstat.h) */
 };
 
 struct cv *cv_create(const char *name);
@@ -128,6 +145,9 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_timedwait - cv_wait, but give up waiting after NSECS nanoseconds.
+ *                   Returns ETIMEDOUT if the time ran out first, 0 if
+ *                   woken. Either way the lock is held again on return.
  *
  * For all three operations, the current thread must hold the lock passed
  * in. Note that under normal circumstances the same lock should be used
@@ -138,6 +158,61 @@ void cv_destroy(struct cv *);
 void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, uint64_t nsecs);
+
+
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or a single
+ * writer. Writers are preferred: once a writer is waiting, newly
+ * arriving readers wait behind it. To keep that from starving
+ * readers, when a writer releases the lock every reader that was
+ * already waiting at that point is let in ahead of the next writer
+ * (rw_readpass counts how many of them are still to come through).
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        struct wchan *rw_readwchan;     /* readers sleep here */
+        struct wchan *rw_writewchan;    /* writers sleep here */
+        struct spinlock rw_lock;
+        volatile unsigned rw_readers;   /* # of readers holding the lock */
+        volatile unsigned rw_readwait;  /* # of readers sleeping */
+        volatile unsigned rw_writewait; /* # of writers sleeping */
+        volatile unsigned rw_readpass;  /* readers admitted ahead of writers */
+        struct thread *volatile rw_writer;
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Blocks while a
+ *                           writer holds the lock or is waiting for it.
+ *    rwlock_release_read  - Drop a read hold.
+ *    rwlock_acquire_write - Get the lock for exclusive access.
+ *    rwlock_release_write - Drop the exclusive hold. Only the thread
+ *                           holding the lock for writing may do this.
+ *    rwlock_tryupgrade    - Convert a read hold into a write hold, if
+ *                           the caller is the only reader. Returns true
+ *                           on success (the caller now holds the lock
+ *                           for writing); otherwise returns false
+ *                           without blocking and the caller still holds
+ *                           its read hold. Never sleeps, so two readers
+ *                           trying to upgrade at once can't deadlock.
+ *
+ * A thread may not take a read hold on a lock it holds for writing,
+ * or vice versa.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_tryupgrade(struct rwlock *);
 
 
 #endif /* _SYNCH_H_ */
@@ -54,6 +54,16 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for the futex wait channels. */
+void futex_bootstrap(void);
+
+/* Setup function for the submission ring workers. */
+void ioring_bootstrap(void);
+
+/* Free a process's submission ring, waiting for its operations. */
+struct ioring_ctx;
+void ioring_destroy(struct ioring_ctx *ctx);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,18 +74,39 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys_getrusage(int who, userptr_t usage);
+int sys_getrlimit(int resource, userptr_t rlp);
+int sys_setrlimit(int resource, const_userptr_t rlp);
+int sys_sched_setaffinity(pid_t pid, size_t setsize, const_userptr_t set);
+int sys_sched_getaffinity(pid_t pid, size_t setsize, userptr_t set);
+int sys_sched_getcpu(int *retval);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
+int sys_pipe(userptr_t fdsptr);
+int sys_fcntl(int fd, int cmd, int arg, int *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	       int *retval);
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+		int *retval);
+int sys_copy_file_range(int infd, userptr_t inposp,
+			int outfd, userptr_t outposp,
+			size_t len, unsigned flags, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
 
 int sys_chdir(const_userptr_t path);
@@ -95,4 +126,10 @@ int sys_ftruncate(int fd, off_t len);
 int sys_sbrk(int amount, int *retval);
 int sys_mmap(size_t length, int prot, int fd, off_t offset, int *retval);
 int sys_munmap(vaddr_t vaddr);
+
+int sys_futex_wait(userptr_t uaddr, int expected);
+int sys_futex_wake(userptr_t uaddr, unsigned n, int *retval);
+
+int sys_ioring_setup(userptr_t ring);
+int sys_ioring_enter(unsigned to_submit, unsigned min_complete, int *retval);
 #endif /* _SYSCALL_H_ */
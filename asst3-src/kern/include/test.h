@@ -57,6 +57,13 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int cvbench(int, char **);
+int rwtest(int, char **);
+int rwbench(int, char **);
+int pitest(int, char **);
+int timertest(int, char **);
+int timerbench(int, char **);
+int wqtest(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
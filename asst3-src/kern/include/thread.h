@@ -39,8 +39,10 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include <cputime.h>
 
 struct cpu;
+struct lock;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -56,6 +58,16 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Thread priorities. Larger numbers are more important; runnable
+ * threads are run strictly in priority order, round-robin within a
+ * priority. PRI_NONE is less than any real priority.
+ */
+#define PRI_NONE	(-1)
+#define PRI_MIN		0
+#define PRI_DEFAULT	16
+#define PRI_MAX		31
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -72,6 +84,7 @@ struct thread {
 	 */
 	char *t_name;			/* Name of this thread */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
 	/*
@@ -102,6 +115,40 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Priority fields.
+	 *
+	 * t_pri is the priority the scheduler uses. It is t_basepri,
+	 * raised by priority inheritance while threads of higher
+	 * priority are waiting for a lock we hold; see synch.c. These
+	 * four fields are protected by the priority inheritance lock
+	 * in synch.c, except that t_heldlocks is only ever touched by
+	 * the thread itself.
+	 */
+	int t_basepri;			/* Priority set by thread_setpriority */
+	int t_pri;			/* Effective priority */
+	struct lock *t_waitlock;	/* Lock we are waiting for, if any */
+	struct lock *t_heldlocks;	/* Locks we hold, via lk_nextheld */
+
+	/*
+	 * CPU time accounting. t_cputime is only changed by the cpu
+	 * the thread is running on, with interrupts off. t_procstart
+	 * is what it was when the thread joined t_proc.
+	 */
+	struct cputime t_cputime;	/* Time used over our lifetime */
+	struct cputime t_procstart;	/* t_cputime on joining t_proc */
+	int t_acctmode;			/* ACCT_* to resume with */
+
+	/*
+	 * CPU affinity. t_cpumask has a bit for each cpu number the
+	 * thread may run on; it is protected by the run queue lock of
+	 * t_cpu. t_offcpu is when the thread last stopped running
+	 * (on the accounting clock), so migration can pick threads
+	 * whose cache footprint is likely gone anyway.
+	 */
+	uint32_t t_cpumask;		/* Cpus we may run on */
+	uint64_t t_offcpu;		/* When we last switched out */
+
 	/*
 	 * Public fields
 	 */
@@ -145,6 +192,14 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * The same, but the new thread starts on cpu CPUNUM and may only run
+ * there (see thread_setaffinity), for per-cpu kernel threads.
+ */
+int thread_fork_oncpu(const char *name, struct proc *proc, unsigned cpunum,
+		      void (*func)(void *, unsigned long),
+		      void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -158,6 +213,54 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Set the current thread's (base) priority, between PRI_MIN and
+ * PRI_MAX. New threads start with their parent's base priority.
+ * This lives in synch.c, with the priority inheritance code.
+ */
+void thread_setpriority(int pri);
+
+/*
+ * Restrict a thread to the cpus in MASK (one bit per cpu number;
+ * CPUMASK_ALL for any). Fails with EINVAL if that leaves no cpus
+ * that exist. A thread that is ready to run is moved right away; a
+ * sleeping one moves when it wakes up, and a running one the next
+ * time it is switched out, so the current thread should call
+ * thread_yield afterwards. (That moves it even if nothing else is
+ * ready to run here.)
+ */
+#define CPUMASK_ALL	0xffffffff
+int thread_setaffinity(struct thread *t, uint32_t mask);
+
+/*
+ * Turn stopping the hardclock on idle cpus on or off (it is on by
+ * default), so the interrupt load can be compared in one kernel.
+ */
+void thread_tickless_enable(bool on);
+
+/*
+ * Turn the reuse of exited threads by thread_fork on or off (it is on
+ * by default), so the two can be compared in one kernel. Threads
+ * already in the pools stay there until it is turned back on.
+ */
+void thread_pool_enable(bool on);
+
+/*
+ * CPU time accounting.
+ *
+ * thread_account charges the time since the last call on this cpu to
+ * whatever was being charged (the current thread's user, system, or
+ * interrupt time, or the cpu's idle time), and starts charging MODE.
+ * Returns the previous mode, so a trap handler can put it back.
+ * Nothing is charged until thread_account_start has been called,
+ * which must wait until the clock is available.
+ *
+ * thread_getcputime gets the current thread's times, up to now.
+ */
+int thread_account(int mode);
+void thread_account_start(void);
+void thread_getcputime(struct cputime *ret);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
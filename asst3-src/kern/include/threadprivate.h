@@ -55,6 +55,13 @@ struct switchframe;	/* from <machine/switchframe.h> */
 void thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 		    void *data1, unsigned long data2);
 
+/*
+ * Change a thread's effective priority, moving it within its run
+ * queue if it is on one. Used by the priority inheritance code in
+ * synch.c, which must hold its lock.
+ */
+void thread_reprioritize(struct thread *t, int pri);
+
 /* Initialize or clean up the machine-dependent portion of struct thread */
 void thread_machdep_init(struct thread_machdep *tm);
 void thread_machdep_cleanup(struct thread_machdep *tm);
@@ -0,0 +1,69 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timers (callouts).
+ *
+ * A struct timer runs a function once, some number of nanoseconds in
+ * the future. Timers are kept on a hierarchical timing wheel, so
+ * timer_start and timer_cancel take constant time no matter how many
+ * timers are pending, and the timerclock alarm is programmed for the
+ * next expiry rather than polled. The wheel has a resolution of
+ * TIMER_TICK_NSEC.
+ *
+ * The function is called in interrupt context, without any timer
+ * locks held; it may take spinlocks and wake threads but not sleep.
+ * The struct timer belongs to the caller and may live on the stack,
+ * provided it is cancelled before it goes out of scope.
+ */
+
+#define TIMER_TICK_NSEC		100000		/* 100 microseconds */
+
+struct timer {
+	struct timer *tm_next;		/* Slot list links */
+	struct timer **tm_prevp;
+	uint64_t tm_expire;		/* When, in wheel ticks */
+	unsigned tm_slot;		/* Which slot we're on */
+	volatile int tm_state;		/* TIMER_* below */
+	void (*tm_func)(void *);
+	void *tm_arg;
+};
+
+#define TIMER_IDLE	0		/* Not started, fired, or cancelled */
+#define TIMER_PENDING	1		/* Waiting to fire */
+
+/* Called during boot. */
+void timer_bootstrap(void);
+
+/* Set up a timer to call FUNC(ARG). */
+void timer_init(struct timer *tm, void (*func)(void *), void *arg);
+
+/*
+ * Arm a timer to fire NSECS nanoseconds from now (rounded up to the
+ * next wheel tick). If it was already pending it is moved.
+ */
+void timer_start(struct timer *tm, uint64_t nsecs);
+
+/*
+ * Disarm a timer. Returns true if it was pending, in which case its
+ * function will not be called. If the function is running on another
+ * cpu, waits for it to finish first, so that on return the timer is
+ * no longer in use and may be freed. Must not be called with any
+ * spinlock held that the function takes.
+ */
+bool timer_cancel(struct timer *tm);
+
+/* The current time in nanoseconds, on the same clock timers use. */
+uint64_t timer_now(void);
+
+/*
+ * Put the current thread to sleep for NSECS nanoseconds. This is
+ * what clocksleep and nanosleep use.
+ */
+void timer_sleep(uint64_t nsecs);
+
+/* Statistics, for the tests. */
+unsigned timer_npending(void);
+
+
+#endif /* _TIMER_H_ */
@@ -74,18 +74,28 @@ const char *vfs_getdevname(struct fs *fs);
  *                     goes to the correct filesystem.
  *    vfs_lookparent - Likewise, for VOP_LOOKPARENT.
  *
- * Both of these may destroy the path passed in.
+ *    vfs_lookupat, vfs_lookparentat
+ *                   - The same, but relative names are looked up from
+ *                     DIR instead of the current directory (unless DIR
+ *                     is NULL). For doing lookups on behalf of a
+ *                     process from a thread that isn't in it.
+ *
+ * All of these may destroy the path passed in.
  */
 
 int vfs_lookup(char *path, struct vnode **result);
 int vfs_lookparent(char *path, struct vnode **result,
 		   char *buf, size_t buflen);
+int vfs_lookupat(struct vnode *dir, char *path, struct vnode **result);
+int vfs_lookparentat(struct vnode *dir, char *path, struct vnode **result,
+		     char *buf, size_t buflen);
 
 /*
  * VFS layer high-level operations on pathnames
  * Because lookup may destroy pathnames, these all may too.
  *
  *    vfs_open         - Open or create a file. FLAGS/MODE per the syscall.
+ *    vfs_openat       - Likewise, looking up relative paths from DIR.
  *    vfs_readlink     - Read contents of a symlink into a uio.
  *    vfs_symlink      - Create a symlink PATH containing contents CONTENTS.
  *    vfs_mkdir        - Create a directory. MODE per the syscall.
@@ -102,6 +112,8 @@ int vfs_lookparent(char *path, struct vnode **result,
  */
 
 int vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret);
+int vfs_openat(struct vnode *dir, char *path, int openflags, mode_t mode,
+	       struct vnode **ret);
 void vfs_close(struct vnode *vn);
 int vfs_readlink(char *path, struct uio *data);
 int vfs_symlink(const char *contents, char *path);
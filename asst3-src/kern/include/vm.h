@@ -76,6 +76,7 @@ uint32_t vm_lookup(struct addrspace *as, vaddr_t vaddr);
 void vm_delete(struct addrspace *as, vaddr_t vaddr);
 int vm_insert(struct addrspace *as, vaddr_t vaddr, uint32_t entrylo);
 void vm_update(struct addrspace *as, vaddr_t vaddr, uint32_t entrylo);
+paddr_t vm_sharedpaddr(struct addrspace *as, vaddr_t vaddr);
 
 /* frametable funcs */
 
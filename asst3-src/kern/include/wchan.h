@@ -66,15 +66,28 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * The same, but give up and return ETIMEDOUT if not awakened within
+ * NSECS nanoseconds. Returns 0 if awakened normally.
+ */
+int wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk,
+			uint64_t nsecs);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
  *
- * The current implementation is FIFO but this is not promised by the
- * interface.
+ * wchan_wakeone picks the highest-priority sleeper, FIFO among equals;
+ * but this is not promised by the interface.
  */
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Return the highest priority of any thread sleeping on the channel,
+ * or PRI_NONE if it is empty. The associated spinlock should be locked.
+ */
+int wchan_maxpri(struct wchan *wc, struct spinlock *lk);
+
 
 #endif /* _WCHAN_H_ */
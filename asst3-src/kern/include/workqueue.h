@@ -0,0 +1,84 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Workqueues: deferred work run by kernel threads.
+ *
+ * A struct work names a function to call later, in thread context,
+ * where it may sleep and take locks. A workqueue has one worker
+ * thread per cpu, and work is queued on the current cpu's worker, so
+ * an interrupt handler can hand its slow part to a thread that runs
+ * where the interrupt's data is cache-hot.
+ *
+ * work_enqueue may be called from interrupt context. A work item is
+ * on at most one queue at a time; enqueueing one that is already
+ * pending does nothing. It may be enqueued again once its function
+ * has started, including by the function itself.
+ *
+ * Like struct timer, the struct work belongs to the caller; it must
+ * not be freed while pending or running (work_cancel ensures that).
+ */
+
+#include <spinlock.h>
+#include <timer.h>
+
+struct workqueue;
+struct wq_cpu;
+
+struct work {
+	struct work *w_next;		/* Queue link */
+	void (*w_func)(void *);
+	void *w_arg;
+	volatile spinlock_data_t w_pending; /* Set while queued or delayed */
+	int w_state;			/* WORK_* below */
+	struct wq_cpu *w_wc;		/* Where we're queued, or going */
+	uint64_t w_stamp;		/* When queued, for latency stats */
+	struct timer w_timer;		/* For work_enqueue_delayed */
+};
+
+#define WORK_IDLE	0		/* Not pending */
+#define WORK_DELAYED	1		/* Timer running */
+#define WORK_QUEUED	2		/* Waiting for a worker */
+
+/* General-purpose queue, for work that needs no queue of its own. */
+extern struct workqueue *system_workqueue;
+
+/* Called during boot, once all the cpus are running. */
+void workqueue_bootstrap(void);
+
+/*
+ * Create a workqueue, with worker threads at priority PRI (see
+ * thread.h). Workqueues are never destroyed.
+ */
+struct workqueue *workqueue_create(const char *name, int pri);
+
+/* Set up a work item to call FUNC(ARG). */
+void work_init(struct work *w, void (*func)(void *), void *arg);
+
+/*
+ * Queue a work item on WQ, on the current cpu. Returns false if it
+ * was already pending.
+ */
+bool work_enqueue(struct workqueue *wq, struct work *w);
+
+/*
+ * Queue a work item on WQ, on the current cpu, NSECS nanoseconds from
+ * now. Returns false if it was already pending.
+ */
+bool work_enqueue_delayed(struct workqueue *wq, struct work *w,
+			  uint64_t nsecs);
+
+/*
+ * Take a work item off its queue or timer. Returns true if it was
+ * pending, in which case its function will not be called. If the
+ * function is running, waits for it to finish. Must be called from
+ * thread context, not from the work item's own function, and not
+ * while someone else might be enqueueing the same item.
+ */
+bool work_cancel(struct work *w);
+
+/* Print per-queue statistics, including latency. */
+void workqueue_stats(void);
+
+
+#endif /* _WORKQUEUE_H_ */
@@ -38,6 +38,8 @@
 #include <lib.h>
 #include <spl.h>
 #include <clock.h>
+#include <timer.h>
+#include <workqueue.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -112,7 +114,7 @@ boot(void)
 	proc_bootstrap();
 	thread_bootstrap();
 	pid_bootstrap();
-	hardclock_bootstrap();
+	timer_bootstrap();
 	vfs_bootstrap();
 	kheap_nextgeneration();
 
@@ -121,6 +123,8 @@ boot(void)
 	KASSERT(curthread->t_curspl > 0);
 	mainbus_bootstrap();
 	KASSERT(curthread->t_curspl == 0);
+	/* The clock is attached now, so cpu time can be charged. */
+	thread_account_start();
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
@@ -130,7 +134,10 @@ boot(void)
 	vm_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	futex_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
+	ioring_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
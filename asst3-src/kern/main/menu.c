@@ -37,7 +37,9 @@
 #include <uio.h>
 #include <clock.h>
 #include <mainbus.h>
+#include <cpu.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <thread.h>
 #include <proc.h>
 #include <vfs.h>
@@ -45,6 +47,7 @@
 #include <pid.h>
 #include <syscall.h>
 #include <test.h>
+#include <workqueue.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
 
@@ -500,6 +503,143 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		lockstat_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		lockstat_enable(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		lockstat_enable(false);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else {
+		kprintf("Usage: lockstat [on|off|reset]\n");
+	}
+
+	return 0;
+}
+
+/*
+ * Command for turning thread reuse on and off, so that thread_fork
+ * and fork can be timed both ways (with tt1 or forktest -t) without
+ * rebuilding. With no argument, prints the pool stats.
+ */
+static
+int
+cmd_tpool(int nargs, char **args)
+{
+	if (nargs == 1) {
+		cpu_poolstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		thread_pool_enable(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		thread_pool_enable(false);
+	}
+	else {
+		kprintf("Usage: tpool [on|off]\n");
+	}
+
+	return 0;
+}
+
+static
+int
+cmd_intrstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		cpu_intrstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		cpu_intrstats_reset();
+	}
+	else {
+		kprintf("Usage: intrstat [reset]\n");
+	}
+
+	return 0;
+}
+
+/*
+ * Command for turning tickless idle on and off, to compare the
+ * interrupt load both ways without rebuilding.
+ */
+static
+int
+cmd_tickless(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		thread_tickless_enable(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		thread_tickless_enable(false);
+	}
+	else {
+		kprintf("Usage: tickless on|off\n");
+	}
+
+	return 0;
+}
+
+/*
+ * Command for leaving the system idle for a while, for measuring.
+ */
+static
+int
+cmd_idle(int nargs, char **args)
+{
+	int secs;
+
+	if (nargs != 2 || (secs = atoi(args[1])) <= 0) {
+		kprintf("Usage: idle seconds\n");
+		return 0;
+	}
+	clocksleep(secs);
+
+	return 0;
+}
+
+/*
+ * Command for showing where the cpu time went since the last top
+ * (or since boot): per cpu, then per process.
+ */
+static
+int
+cmd_top(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	cpu_loadstats();
+	kprintf("\n");
+	proc_cpustats();
+
+	return 0;
+}
+
+/*
+ * Command for printing workqueue statistics.
+ */
+static
+int
+cmd_wqstat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	workqueue_stats();
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -576,6 +716,13 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] RW lock test                  ",
+	"[sy6] RW lock reader benchmark      ",
+	"[sy7] Priority inheritance test     ",
+	"[sy8] CV broadcast benchmark        ",
+	"[tm1] Timer test                    ",
+	"[tm2] Timed sleep benchmark         ",
+	"[wq1] Workqueue test                ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -606,6 +753,13 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[lockstat] Lock contention stats    ",
+	"[intrstat] Interrupt counts per cpu ",
+	"[tickless] Idle tick stopping on/off",
+	"[idle] Sit idle for some seconds    ",
+	"[top] Cpu usage since last top      ",
+	"[tpool] Thread pool stats/on/off    ",
+	"[wqstat] Workqueue stats            ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +811,13 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "lockstat",   cmd_lockstat },
+	{ "intrstat",   cmd_intrstat },
+	{ "tickless",   cmd_tickless },
+	{ "idle",       cmd_idle },
+	{ "top",        cmd_top },
+	{ "tpool",      cmd_tpool },
+	{ "wqstat",     cmd_wqstat },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -679,6 +840,13 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	rwtest },
+	{ "sy6",	rwbench },
+	{ "sy7",	pitest },
+	{ "sy8",	cvbench },
+	{ "tm1",	timertest },
+	{ "tm2",	timerbench },
+	{ "wq1",	wqtest },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
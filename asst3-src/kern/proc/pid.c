@@ -56,7 +56,8 @@ struct pidinfo {
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct cputime pi_cputime;	// cpu time incl. children (ditto)
+	struct semaphore *pi_exitsem;	// V'd once when the thread exits
 };
 
 
@@ -67,8 +68,13 @@ struct pidinfo {
  * (pid % PROCS_MAX), and only allows one process per slot. If a
  * new pid allocation would cause a hash collision, we just don't
  * use that pid.
+ *
+ * The table is protected by a reader-writer lock. Lookups (checking
+ * a waitpid argument, polling with WNOHANG) only read the table and
+ * can run concurrently; anything that adds, removes, or updates an
+ * entry takes it for writing.
  */
-static struct lock *pidlock;		// lock for global exit data
+static struct rwlock *pidlock;		// lock for global exit data
 static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
 static pid_t nextpid;			// next candidate pid
 static int nprocs;			// number of allocated pids
@@ -91,8 +97,8 @@ pidinfo_create(pid_t pid, pid_t ppid)
 		return NULL;
 	}
 
-	pi->pi_cv = cv_create("pidinfo cv");
-	if (pi->pi_cv == NULL) {
+	pi->pi_exitsem = sem_create("pidinfo exit", 0);
+	if (pi->pi_exitsem == NULL) {
 		kfree(pi);
 		return NULL;
 	}
@@ -101,6 +107,9 @@ pidinfo_create(pid_t pid, pid_t ppid)
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	pi->pi_cputime.ct_user = 0;
+	pi->pi_cputime.ct_sys = 0;
+	pi->pi_cputime.ct_intr = 0;
 
 	return pi;
 }
@@ -114,7 +123,7 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
-	cv_destroy(pi->pi_cv);
+	sem_destroy(pi->pi_exitsem);
 	kfree(pi);
 }
 
@@ -128,7 +137,7 @@ pid_bootstrap(void)
 {
 	int i;
 
-	pidlock = lock_create("pidlock");
+	pidlock = rwlock_create("pidlock");
 	if (pidlock == NULL) {
 		panic("Out of memory creating pid lock\n");
 	}
@@ -148,7 +157,8 @@ pid_bootstrap(void)
 }
 
 /*
- * pi_get: look up a pidinfo in the process table.
+ * pi_get: look up a pidinfo in the process table. Caller must hold
+ * pidlock, for either reading or writing.
  */
 static
 struct pidinfo *
@@ -158,7 +168,6 @@ pi_get(pid_t pid)
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
 
 	pi = pidinfo[pid % PROCS_MAX];
 	if (pi==NULL) {
@@ -172,14 +181,12 @@ pi_get(pid_t pid)
 
 /*
  * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * must be empty. Caller must hold pidlock for writing.
  */
 static
 void
 pi_put(pid_t pid, struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
-
 	KASSERT(pid != INVALID_PID);
 
 	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
@@ -190,7 +197,7 @@ pi_put(pid_t pid, struct pidinfo *pi)
 /*
  * pi_drop: remove a pidinfo structure from the process table and free
  * it. It should reflect a process that has already exited and been
- * waited for.
+ * waited for. Caller must hold pidlock for writing.
  */
 static
 void
@@ -198,8 +205,6 @@ pi_drop(pid_t pid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(lock_do_i_hold(pidlock));
-
 	pi = pidinfo[pid % PROCS_MAX];
 	KASSERT(pi != NULL);
 	KASSERT(pi->pi_pid == pid);
@@ -218,8 +223,6 @@ static
 void
 inc_nextpid(void)
 {
-	KASSERT(lock_do_i_hold(pidlock));
-
 	nextpid++;
 	if (nextpid > PID_MAX) {
 		nextpid = PID_MIN;
@@ -239,10 +242,10 @@ pid_alloc(pid_t *retval)
 	KASSERT(curproc->p_pid != INVALID_PID);
 
 	/* lock the table */
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 
 	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
+		rwlock_release_write(pidlock);
 		return EAGAIN;
 	}
 
@@ -265,7 +268,7 @@ pid_alloc(pid_t *retval)
 
 	pi = pidinfo_create(pid, curproc->p_pid);
 	if (pi==NULL) {
-		lock_release(pidlock);
+		rwlock_release_write(pidlock);
 		return ENOMEM;
 	}
 
@@ -273,7 +276,7 @@ pid_alloc(pid_t *retval)
 
 	inc_nextpid();
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 
 	*retval = pid;
 	return 0;
@@ -290,7 +293,7 @@ pid_unalloc(pid_t theirpid)
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -304,7 +307,7 @@ pid_unalloc(pid_t theirpid)
 
 	pi_drop(theirpid);
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 }
 
 /*
@@ -318,7 +321,7 @@ pid_disown(pid_t theirpid)
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -329,24 +332,26 @@ pid_disown(pid_t theirpid)
 		pi_drop(them->pi_pid);
 	}
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 }
 
 /*
  * pid_setexitstatus: Sets the exit status of this process. Must only
  * be called if the thread actually had a pid assigned. Wakes up any
  * waiters and disposes of the piddata if nobody else is still using it.
+ * USAGE is the cpu time used by the process and its waited-for
+ * children, which is handed on to the parent when it waits.
  *
  * As far as the process is concerned, this releases its pid for
  * subsequent reuse; thus we set curproc->p_pid to INVALID_PID.
  */
 void
-pid_setexitstatus(int status)
+pid_setexitstatus(int status, const struct cputime *usage)
 {
 	struct pidinfo *us;
 	int i;
 
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 	KASSERT(curproc->p_pid != INVALID_PID);
 
 	/* First, disown all children */
@@ -367,6 +372,7 @@ pid_setexitstatus(int status)
 	KASSERT(us != NULL);
 
 	us->pi_exitstatus = status;
+	us->pi_cputime = *usage;
 	us->pi_exited = true;
 
 	if (us->pi_ppid == INVALID_PID) {
@@ -374,11 +380,11 @@ pid_setexitstatus(int status)
 		pi_drop(curproc->p_pid);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		V(us->pi_exitsem);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 }
 
 /*
@@ -415,11 +421,11 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
+	rwlock_acquire_read(pidlock);
 
 	them = pi_get(theirpid);
 	if (them==NULL) {
-		lock_release(pidlock);
+		rwlock_release_read(pidlock);
 		return ESRCH;
 	}
 
@@ -427,21 +433,29 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 
 	/* Only allow waiting for own children. */
 	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
+		rwlock_release_read(pidlock);
 		return EPERM;
 	}
 
-	if (them->pi_exited == false) {
-		if (flags == WNOHANG) {
-			lock_release(pidlock);
-			KASSERT(ret != NULL);
-			*ret = 0;
-			return 0;
-		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+	if (them->pi_exited == false && flags == WNOHANG) {
+		rwlock_release_read(pidlock);
+		KASSERT(ret != NULL);
+		*ret = 0;
+		return 0;
 	}
+	rwlock_release_read(pidlock);
+
+	/*
+	 * We're the parent, and only the parent ever drops a child's
+	 * pidinfo while the parent is still around, so THEM can't go
+	 * away while we sleep without the lock. If the child has
+	 * already exited the semaphore has been V'd and this doesn't
+	 * block.
+	 */
+	P(them->pi_exitsem);
+
+	rwlock_acquire_write(pidlock);
+	KASSERT(them->pi_exited == true);
 
 	if (status != NULL) {
 		*status = them->pi_exitstatus;
@@ -457,9 +471,14 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		*ret = theirpid;
 	}
 
+	/* Reaping the child collects its cpu time too (see getrusage). */
+	spinlock_acquire(&curproc->p_lock);
+	cputime_add(&curproc->p_childtime, &them->pi_cputime);
+	spinlock_release(&curproc->p_lock);
+
 	them->pi_ppid = 0;
 	pi_drop(them->pi_pid);
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 	return 0;
 }
@@ -52,12 +52,23 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <syscall.h>
+#include <timer.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
+/*
+ * All processes, for top. Processes are few, so this is a plain
+ * list; it is a sleep lock because proc_cpustats takes p_threadslock
+ * while walking it.
+ */
+static struct lock *allprocs_lock;
+static struct proc *allprocs;
+static uint64_t allprocs_topstamp;	/* when proc_cpustats last ran */
+
 /*
  * Create a proc structure.
  */
@@ -94,6 +105,28 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_ioring = NULL;
+
+	/* CPU time */
+	bzero(&proc->p_cputime, sizeof(proc->p_cputime));
+	bzero(&proc->p_childtime, sizeof(proc->p_childtime));
+	bzero(&proc->p_toptime, sizeof(proc->p_toptime));
+
+	/*
+	 * kproc is made by proc_bootstrap before there are any threads,
+	 * so there's no curthread to hold the lock yet, and nobody else
+	 * to look at the list either.
+	 */
+	if (kproc == NULL) {
+		proc->p_allnext = allprocs;
+		allprocs = proc;
+	}
+	else {
+		lock_acquire(allprocs_lock);
+		proc->p_allnext = allprocs;
+		allprocs = proc;
+		lock_release(allprocs_lock);
+	}
 
 	return proc;
 }
@@ -107,6 +140,8 @@ proc_create(const char *name)
 void
 proc_destroy(struct proc *proc)
 {
+	struct proc **pp;
+
 	/*
 	 * You probably want to destroy and null out much of the
 	 * process (particularly the address space) at exit time if
@@ -125,6 +160,11 @@ proc_destroy(struct proc *proc)
 	 */
 
 	/* VFS fields */
+	if (proc->p_ioring) {
+		/* first, as its operations may still be using files */
+		ioring_destroy(proc->p_ioring);
+		proc->p_ioring = NULL;
+	}
 	if (proc->p_cwd) {
 		VOP_DECREF(proc->p_cwd);
 		proc->p_cwd = NULL;
@@ -182,6 +222,13 @@ proc_destroy(struct proc *proc)
 		as_destroy(as);
 	}
 
+	lock_acquire(allprocs_lock);
+	for (pp = &allprocs; *pp != proc; pp = &(*pp)->p_allnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = proc->p_allnext;
+	lock_release(allprocs_lock);
+
 	KASSERT(proc->p_pid == INVALID_PID);
 	spinlock_cleanup(&proc->p_lock);
 	threadarray_cleanup(&proc->p_threads);
@@ -197,6 +244,10 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+	allprocs_lock = lock_create("allprocs");
+	if (allprocs_lock == NULL) {
+		panic("lock_create for allprocs failed\n");
+	}
 	kproc = proc_create("[kernel]");
 	if (kproc == NULL) {
 		panic("proc_create for kproc failed\n");
@@ -351,12 +402,21 @@ void
 proc_exit(int status)
 {
 	struct proc *proc = curproc;
+	struct cputime usage;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
-	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	/*
+	 * Set exit status and wake up anyone waiting for us. Our
+	 * parent inherits our cpu time, including that of our own
+	 * children.
+	 */
+	proc_getcputime(proc, &usage);
+	spinlock_acquire(&proc->p_lock);
+	cputime_add(&usage, &proc->p_childtime);
+	spinlock_release(&proc->p_lock);
+	pid_setexitstatus(status, &usage);
 
 	/* Detach from the process and attach to the kernel process. */
 	KASSERT(curthread->t_proc == proc);
@@ -391,6 +451,15 @@ proc_addthread(struct proc *proc, struct thread *t)
 
 	lock_acquire(proc->p_threadslock);
 	result = threadarray_add(&proc->p_threads, t, NULL);
+	if (result == 0) {
+		/* Only count the thread's time from here on. */
+		if (t == curthread) {
+			thread_getcputime(&t->t_procstart);
+		}
+		else {
+			t->t_procstart = t->t_cputime;
+		}
+	}
 	lock_release(proc->p_threadslock);
 	if (result) {
 		return result;
@@ -416,6 +485,7 @@ void
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
+	struct cputime ct;
 	unsigned num, i;
 	int spl;
 
@@ -428,6 +498,15 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			/* Leave its time behind with the process. */
+			if (t == curthread) {
+				thread_getcputime(&ct);
+			}
+			else {
+				ct = t->t_cputime;
+			}
+			cputime_sub(&ct, &t->t_procstart);
+			cputime_add(&proc->p_cputime, &ct);
 			lock_release(proc->p_threadslock);
 			goto finish;
 		}
@@ -442,6 +521,166 @@ finish:
 	splx(spl);
 }
 
+/*
+ * Add up the cpu time of a process's threads. Threads running on
+ * other cpus are not stopped, so their times may be a little out of
+ * date (or, on a 32-bit machine, torn); fine for statistics.
+ */
+void
+proc_getcputime(struct proc *proc, struct cputime *ret)
+{
+	struct thread *t;
+	struct cputime ct;
+	unsigned num, i;
+
+	lock_acquire(proc->p_threadslock);
+	*ret = proc->p_cputime;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t == curthread) {
+			thread_getcputime(&ct);
+		}
+		else {
+			ct = t->t_cputime;
+		}
+		cputime_sub(&ct, &t->t_procstart);
+		cputime_add(ret, &ct);
+	}
+	lock_release(proc->p_threadslock);
+}
+
+/*
+ * The process half of the top menu command: each process's user,
+ * system, and interrupt time since the last call, as a percentage of
+ * the elapsed time on one cpu.
+ */
+void
+proc_cpustats(void)
+{
+	struct proc *proc;
+	struct cputime now, delta;
+	uint64_t stamp, elapsed;
+
+	lock_acquire(allprocs_lock);
+	stamp = timer_now();
+	elapsed = stamp - allprocs_topstamp;
+	allprocs_topstamp = stamp;
+	if (elapsed == 0) {
+		elapsed = 1;
+	}
+
+	kprintf("%-5s %-16s %7s %7s %7s %12s\n",
+		"pid", "name", "user%", "sys%", "intr%", "total ms");
+	for (proc = allprocs; proc != NULL; proc = proc->p_allnext) {
+		proc_getcputime(proc, &now);
+		delta = now;
+		cputime_sub(&delta, &proc->p_toptime);
+		proc->p_toptime = now;
+
+		kprintf("%-5d %-16s %7llu %7llu %7llu %12llu\n",
+			proc->p_pid, proc->p_name,
+			(unsigned long long)(delta.ct_user * 100 / elapsed),
+			(unsigned long long)(delta.ct_sys * 100 / elapsed),
+			(unsigned long long)(delta.ct_intr * 100 / elapsed),
+			(unsigned long long)
+			((now.ct_user + now.ct_sys + now.ct_intr) / 1000000));
+	}
+	lock_release(allprocs_lock);
+}
+
+/*
+ * Find process PID, or the current process if PID is 0. The caller
+ * must hold allprocs_lock, which keeps it from going away.
+ */
+static
+struct proc *
+proc_find(pid_t pid)
+{
+	struct proc *proc;
+
+	KASSERT(lock_do_i_hold(allprocs_lock));
+
+	if (pid == 0) {
+		return curproc;
+	}
+	for (proc = allprocs; proc != NULL; proc = proc->p_allnext) {
+		if (proc->p_pid == pid) {
+			return proc;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Set the cpu affinity of all the threads in process PID (0 for the
+ * current process). The kernel process is off limits.
+ */
+int
+proc_setaffinity(pid_t pid, uint32_t mask)
+{
+	struct proc *proc;
+	unsigned num, i;
+	int result;
+
+	lock_acquire(allprocs_lock);
+	proc = proc_find(pid);
+	if (proc == NULL) {
+		lock_release(allprocs_lock);
+		return ESRCH;
+	}
+	if (proc == kproc) {
+		lock_release(allprocs_lock);
+		return EPERM;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	num = threadarray_num(&proc->p_threads);
+	/* no threads means it's exiting */
+	result = num > 0 ? 0 : ESRCH;
+	for (i=0; i<num; i++) {
+		/* fails only for a bad mask, so on the first thread */
+		result = thread_setaffinity(threadarray_get(&proc->p_threads,
+							    i), mask);
+		if (result) {
+			break;
+		}
+	}
+	lock_release(proc->p_threadslock);
+	lock_release(allprocs_lock);
+	return result;
+}
+
+/*
+ * Get the cpu affinity of process PID (0 for the current process).
+ * That's the mask of its first thread; they are all set together.
+ */
+int
+proc_getaffinity(pid_t pid, uint32_t *ret)
+{
+	struct proc *proc;
+	int result;
+
+	lock_acquire(allprocs_lock);
+	proc = proc_find(pid);
+	if (proc == NULL) {
+		lock_release(allprocs_lock);
+		return ESRCH;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	if (threadarray_num(&proc->p_threads) > 0) {
+		*ret = threadarray_get(&proc->p_threads, 0)->t_cpumask;
+		result = 0;
+	}
+	else {
+		result = ESRCH;
+	}
+	lock_release(proc->p_threadslock);
+	lock_release(allprocs_lock);
+	return result;
+}
+
 /*
  * Fetch the address space of (the current) process.
  *
@@ -35,9 +35,12 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/limits.h>
+#include <kern/poll.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <limits.h>
 #include <lib.h>
+#include <stat.h>
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
@@ -46,6 +49,9 @@
 #include <vfs.h>
 #include <vnode.h>
 #include <openfile.h>
+#include <pipe.h>
+#include <pollqueue.h>
+#include <timer.h>
 #include <filetable.h>
 #include <syscall.h>
 #include <addrspace.h>
@@ -106,20 +112,23 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for all the reads and writes.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on USERUIO, which
+ * the caller has set up with the user's buffers. If POSITIONAL, the
+ * caller has also set the offset, and the file's own seek position
+ * is neither used nor changed, so the offset lock isn't taken either;
+ * processes sharing the file (across fork) can then do I/O on it at
+ * the same time.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite_uio(int fd, struct uio *useruio, bool positional,
+		  int badaccmode, int *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -128,14 +137,19 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
+	if (positional && !VOP_ISSEEKABLE(file->of_vnode)) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return ESPIPE;
+	}
+
 	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
+	locked = !positional && VOP_ISSEEKABLE(file->of_vnode);
 	if (locked) {
 		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+		useruio->uio_offset = file->of_offset;
 	}
-	else {
-		pos = 0;
+	else if (!positional) {
+		useruio->uio_offset = 0;
 	}
 
 	if (file->of_accmode == badaccmode) {
@@ -143,20 +157,18 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
-
 	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
+	size = useruio->uio_resid;
+	result = (useruio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, useruio) :
+		VOP_WRITE(file->of_vnode, useruio);
 	if (result) {
 		goto fail;
 	}
 
 	if (locked) {
 		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		file->of_offset = useruio->uio_offset;
 		lock_release(file->of_offsetlock);
 	}
 
@@ -166,7 +178,7 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	 * The amount read (or written) is the original buffer size,
 	 * minus how much is left in it.
 	 */
-	*retval = size - useruio.uio_resid;
+	*retval = size - useruio->uio_resid;
 
 	return 0;
 
@@ -178,13 +190,107 @@ fail:
 	return result;
 }
 
+/*
+ * Read or write one buffer, at the seek position or (if POSITIONAL)
+ * at POS.
+ */
+static
+int
+sys_readwrite(int fd, userptr_t buf, size_t size, bool positional,
+	      off_t pos, enum uio_rw rw, int badaccmode, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	if (positional && pos < 0) {
+		return EINVAL;
+	}
+
+	/* set up a uio with the buffer and its size */
+	uio_uinit(&iov, &useruio, buf, size, positional ? pos : 0, rw);
+
+	return sys_readwrite_uio(fd, &useruio, positional, badaccmode, retval);
+}
+
+/*
+ * Read or write the IOVCNT buffers described by the user's iovec
+ * array IOVS, in order, as one operation. Up to READWRITEV_NSTACK
+ * iovecs are copied in on the stack; more than that go in a kmalloc'd
+ * array.
+ */
+#define READWRITEV_NSTACK 8
+/* the most the return value can report */
+#define READWRITEV_MAXTOTAL 0x7fffffff
+#define COPY_FILE_RANGE_MAX 0x7fffffff
+
+static
+int
+sys_readwritev(int fd, const_userptr_t iovs, int iovcnt, bool positional,
+	       off_t pos, enum uio_rw rw, int badaccmode, int *retval)
+{
+	struct iovec stackiov[READWRITEV_NSTACK];
+	struct iovec *iov;
+	struct uio useruio;
+	size_t total;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+	if (positional && pos < 0) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= READWRITEV_NSTACK) {
+		iov = stackiov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(struct iovec));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(iovs, iov, iovcnt * sizeof(struct iovec));
+	if (result) {
+		goto out;
+	}
+
+	/* the total has to fit in the return value */
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > READWRITEV_MAXTOTAL - total) {
+			result = EINVAL;
+			goto out;
+		}
+		total += iov[i].iov_len;
+	}
+
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_offset = positional ? pos : 0;
+	useruio.uio_resid = total;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
+
+	result = sys_readwrite_uio(fd, &useruio, positional, badaccmode, retval);
+
+ out:
+	if (iov != stackiov) {
+		kfree(iov);
+	}
+	return result;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	return sys_readwrite(fd, buf, size, false, 0,
+			     UIO_READ, O_WRONLY, retval);
 }
 
 /*
@@ -193,7 +299,316 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	return sys_readwrite(fd, buf, size, false, 0,
+			     UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pread() - use sys_readwrite, at POS
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, true, pos,
+			     UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite, at POS
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, true, pos,
+			     UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, false, 0,
+			      UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, false, 0,
+			      UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * preadv() - use sys_readwritev, at POS
+ */
+int
+sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, true, pos,
+			      UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwritev() - use sys_readwritev, at POS
+ */
+int
+sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, true, pos,
+			      UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * Get the position for one end of copy_file_range. If POSP isn't
+ * NULL the position is there, in userspace, and the file has to be
+ * seekable; otherwise the file's seek position is used, if it has
+ * one, and *USESEEK is set to say so.
+ */
+static
+int
+copy_file_range_pos(struct openfile *file, userptr_t posp, off_t *pos,
+		    bool *useseek)
+{
+	int result;
+
+	*pos = 0;
+	*useseek = false;
+	if (posp == NULL) {
+		*useseek = VOP_ISSEEKABLE(file->of_vnode);
+		return 0;
+	}
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		return ESPIPE;
+	}
+	result = copyin(posp, pos, sizeof(off_t));
+	if (result) {
+		return result;
+	}
+	if (*pos < 0) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Copy from one file to the other, through BUF, for up to LEN bytes.
+ * Returns the amount copied in *DONE_RET; if that's nonzero, any error
+ * after it is dropped, as for a short write.
+ *
+ * Stops at end of file, when a write comes up short, or when a read
+ * from a device comes up short, because then that's all there is for
+ * now and a reader like cat shouldn't sit on it.
+ */
+static
+int
+copy_file_range_copy(struct openfile *infile, off_t *inpos,
+		     struct openfile *outfile, off_t *outpos,
+		     char *buf, size_t len, size_t *done_ret)
+{
+	bool inseekable, outseekable;
+	struct iovec iov;
+	struct uio ku;
+	size_t total, chunk, got, put;
+	int result = 0;
+
+	inseekable = VOP_ISSEEKABLE(infile->of_vnode);
+	outseekable = VOP_ISSEEKABLE(outfile->of_vnode);
+
+	total = 0;
+	while (total < len) {
+		chunk = len - total;
+		if (chunk > PAGE_SIZE) {
+			chunk = PAGE_SIZE;
+		}
+
+		uio_kinit(&iov, &ku, buf, chunk, *inpos, UIO_READ);
+		result = VOP_READ(infile->of_vnode, &ku);
+		if (result) {
+			break;
+		}
+		got = chunk - ku.uio_resid;
+		if (got == 0) {
+			break;
+		}
+
+		put = 0;
+		while (put < got) {
+			uio_kinit(&iov, &ku, buf + put, got - put, *outpos,
+				  UIO_WRITE);
+			result = VOP_WRITE(outfile->of_vnode, &ku);
+			if (ku.uio_resid == got - put) {
+				/* nothing went; give up */
+				break;
+			}
+			if (outseekable) {
+				*outpos = ku.uio_offset;
+			}
+			put = got - ku.uio_resid;
+			if (result) {
+				break;
+			}
+		}
+		/* only count as read what got written */
+		if (inseekable) {
+			*inpos += put;
+		}
+		total += put;
+
+		if (result || put < got) {
+			break;
+		}
+		if (got < chunk && !inseekable) {
+			break;
+		}
+	}
+
+	*done_ret = total;
+	return total > 0 ? 0 : result;
+}
+
+/*
+ * copy_file_range() - copy from one file to another without the data
+ * coming out to userlevel and back, through a page-sized bounce
+ * buffer in the kernel.
+ *
+ * INPOSP and OUTPOSP, if not NULL, point to the positions to use,
+ * which are updated, and the files' seek positions are left alone
+ * (like pread and pwrite); otherwise the seek positions are used and
+ * updated. Either end can be a device. There are no flags yet.
+ *
+ * The seek position locks are taken in address order, so two copies
+ * going opposite ways between the same two files can't deadlock.
+ */
+int
+sys_copy_file_range(int infd, userptr_t inposp, int outfd, userptr_t outposp,
+		    size_t len, unsigned flags, int *retval)
+{
+	struct filetable *ft;
+	struct openfile *infile, *outfile;
+	struct lock *lock1, *lock2, *tmp;
+	off_t inpos, outpos;
+	bool inseek, outseek;
+	char *buf;
+	size_t done;
+	int result;
+
+	if (flags != 0) {
+		return EINVAL;
+	}
+	/* the result has to fit in the return value */
+	if (len > COPY_FILE_RANGE_MAX) {
+		len = COPY_FILE_RANGE_MAX;
+	}
+
+	ft = curproc->p_filetable;
+	result = filetable_get(ft, infd, &infile);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, outfd, &outfile);
+	if (result) {
+		filetable_put(ft, infd, infile);
+		return result;
+	}
+	buf = NULL;
+
+	if (infile->of_accmode == O_WRONLY || outfile->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+	result = copy_file_range_pos(infile, inposp, &inpos, &inseek);
+	if (result) {
+		goto out;
+	}
+	result = copy_file_range_pos(outfile, outposp, &outpos, &outseek);
+	if (result) {
+		goto out;
+	}
+
+	buf = kmalloc(PAGE_SIZE);
+	if (buf == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+
+	lock1 = inseek ? infile->of_offsetlock : NULL;
+	lock2 = outseek ? outfile->of_offsetlock : NULL;
+	if (lock1 == lock2) {
+		lock2 = NULL;
+	}
+	else if (lock1 != NULL && lock2 != NULL && lock2 < lock1) {
+		tmp = lock1;
+		lock1 = lock2;
+		lock2 = tmp;
+	}
+	if (lock1 != NULL) {
+		lock_acquire(lock1);
+	}
+	if (lock2 != NULL) {
+		lock_acquire(lock2);
+	}
+	if (inseek) {
+		inpos = infile->of_offset;
+	}
+	if (outseek) {
+		outpos = outfile->of_offset;
+	}
+
+	/* copying a file over an overlapping part of itself is refused */
+	if (infile->of_vnode == outfile->of_vnode &&
+	    VOP_ISSEEKABLE(infile->of_vnode) &&
+	    inpos < outpos + (off_t)len && outpos < inpos + (off_t)len) {
+		result = EINVAL;
+		done = 0;
+	}
+	else {
+		result = copy_file_range_copy(infile, &inpos, outfile, &outpos,
+					      buf, len, &done);
+	}
+
+	if (inseek) {
+		infile->of_offset = inpos;
+	}
+	if (outseek) {
+		outfile->of_offset = outpos;
+	}
+	if (lock2 != NULL) {
+		lock_release(lock2);
+	}
+	if (lock1 != NULL) {
+		lock_release(lock1);
+	}
+	if (result) {
+		goto out;
+	}
+
+	/* hand back the updated positions */
+	if (inposp != NULL) {
+		result = copyout(&inpos, inposp, sizeof(off_t));
+		if (result) {
+			goto out;
+		}
+	}
+	if (outposp != NULL) {
+		result = copyout(&outpos, outposp, sizeof(off_t));
+		if (result) {
+			goto out;
+		}
+	}
+	*retval = done;
+
+ out:
+	if (buf != NULL) {
+		kfree(buf);
+	}
+	filetable_put(ft, outfd, outfile);
+	filetable_put(ft, infd, infile);
+	return result;
 }
 
 /*
@@ -204,21 +619,25 @@ sys_close(int fd)
 {
 	struct filetable *ft;
 	struct openfile *file;
+	int result;
 
 	ft = curproc->p_filetable;
 
-	/* check if the file's in range before calling placeat */
-	if (!filetable_okfd(ft, fd)) {
-		return EBADF;
+	/*
+	 * Check that it's open; not with filetable_okfd, because a
+	 * file can be open above a lowered limit and it should still
+	 * be possible to close it.
+	 */
+	result = filetable_get(ft, fd, &file);
+	if (result) {
+		return result;
 	}
+	filetable_put(ft, fd, file);
 
 	/* place null in the filetable and get the file previously there */
-	filetable_placeat(ft, NULL, fd, &file);
-
-	if (file == NULL) {
-		/* oops, it wasn't open, that's an error */
-		return EBADF;
-	}
+	result = filetable_placeat(ft, NULL, fd, &file);
+	KASSERT(result == 0);
+	KASSERT(file != NULL);
 
 	/* drop the reference */
 	openfile_decref(file);
@@ -321,8 +740,12 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	openfile_incref(oldfdfile);
 	filetable_put(ft, oldfd, oldfdfile);
 
-	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	/* place it; this can fail if the table has to grow */
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
@@ -334,6 +757,230 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	return 0;
 }
 
+/*
+ * pipe() - make a pipe and put its read and write ends in the file
+ * table, in that order.
+ */
+int
+sys_pipe(userptr_t fdsptr)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile, *junk;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	readfile = openfile_create(readvn, O_RDONLY);
+	if (readfile == NULL) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+	writefile = openfile_create(writevn, O_WRONLY);
+	if (writefile == NULL) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		openfile_decref(writefile);
+		goto fail;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		filetable_placeat(ft, NULL, fds[1], &junk);
+		openfile_decref(writefile);
+		goto fail;
+	}
+	return 0;
+
+ fail:
+	filetable_placeat(ft, NULL, fds[0], &junk);
+	openfile_decref(readfile);
+	return result;
+}
+
+/*
+ * fcntl() - only F_GETFL and F_SETFL, and the only flag that can be
+ * changed is O_NONBLOCK, which only matters for pipes. A pipe end is
+ * only ever in one openfile, so it's fine to keep the pipe's copy of
+ * the flag on the vnode.
+ */
+int
+sys_fcntl(int fd, int cmd, int arg, int *retval)
+{
+	struct openfile *file;
+	mode_t type;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &file);
+	if (result) {
+		return result;
+	}
+
+	switch (cmd) {
+	    case F_GETFL:
+		*retval = file->of_accmode | file->of_flags;
+		break;
+	    case F_SETFL:
+		result = VOP_GETTYPE(file->of_vnode, &type);
+		if (result) {
+			break;
+		}
+		lock_acquire(file->of_offsetlock);
+		file->of_flags = arg & O_NONBLOCK;
+		if (type == S_IFIFO) {
+			pipe_setnonblock(file->of_vnode,
+					 (file->of_flags & O_NONBLOCK) != 0);
+		}
+		lock_release(file->of_offsetlock);
+		*retval = 0;
+		break;
+	    default:
+		result = EINVAL;
+		break;
+	}
+
+	filetable_put(curproc->p_filetable, fd, file);
+	return result;
+}
+
+/*
+ * poll() - wait until one of a set of files is ready, or TIMEOUT
+ * milliseconds pass (forever if TIMEOUT is negative).
+ *
+ * Each time around, ask every file with VOP_POLL what's ready, and
+ * unless we won't wait anyway, have them all put our entries on their
+ * queues; if nothing was ready, sleep until one of them wakes us or
+ * the time is up, take the entries off again, and look again.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct filetable *ft;
+	struct pollfd *fds;
+	struct pollentry *entries;
+	struct pollwaiter waiter;
+	struct openfile *file;
+	rlim_t limit, maxlimit;
+	uint64_t deadline, now;
+	unsigned i, nready;
+	int revents, result;
+
+	ft = curproc->p_filetable;
+
+	filetable_getlimit(ft, &limit, &maxlimit);
+	if (nfds > limit) {
+		return EINVAL;
+	}
+
+	fds = NULL;
+	entries = NULL;
+	if (nfds > 0) {
+		fds = kmalloc(nfds * sizeof(*fds));
+		entries = kmalloc(nfds * sizeof(*entries));
+		if (fds == NULL || entries == NULL) {
+			result = ENOMEM;
+			goto out;
+		}
+		result = copyin(ufds, fds, nfds * sizeof(*fds));
+		if (result) {
+			goto out;
+		}
+	}
+
+	result = pollwaiter_init(&waiter);
+	if (result) {
+		goto out;
+	}
+	for (i=0; i<nfds; i++) {
+		pollentry_init(&entries[i], &waiter);
+	}
+
+	deadline = 0;
+	if (timeout > 0) {
+		deadline = timer_now() + (uint64_t)timeout * 1000000;
+	}
+
+	while (1) {
+		nready = 0;
+		for (i=0; i<nfds; i++) {
+			fds[i].revents = 0;
+			if (fds[i].fd < 0) {
+				continue;
+			}
+			if (filetable_get(ft, fds[i].fd, &file)) {
+				fds[i].revents = POLLNVAL;
+				nready++;
+				continue;
+			}
+			result = VOP_POLL(file->of_vnode, fds[i].events,
+					  timeout != 0 ? &entries[i] : NULL,
+					  &revents);
+			filetable_put(ft, fds[i].fd, file);
+			if (result) {
+				goto done;
+			}
+			fds[i].revents = revents;
+			if (revents != 0) {
+				nready++;
+			}
+		}
+		if (nready > 0 || timeout == 0) {
+			break;
+		}
+
+		if (timeout < 0) {
+			pollwaiter_wait(&waiter, true, 0);
+		}
+		else {
+			now = timer_now();
+			if (now >= deadline) {
+				break;
+			}
+			pollwaiter_wait(&waiter, false, deadline - now);
+		}
+		for (i=0; i<nfds; i++) {
+			pollentry_remove(&entries[i]);
+		}
+	}
+
+	if (nfds > 0) {
+		result = copyout(fds, ufds, nfds * sizeof(*fds));
+	}
+	*retval = nready;
+
+ done:
+	for (i=0; i<nfds; i++) {
+		pollentry_remove(&entries[i]);
+	}
+	pollwaiter_cleanup(&waiter);
+ out:
+	if (fds != NULL) {
+		kfree(fds);
+	}
+	if (entries != NULL) {
+		kfree(entries);
+	}
+	return result;
+}
+
 /*
  * chdir() - change directory. Send the path off to the vfs layer.
  */
@@ -400,6 +1047,22 @@ int sys_mmap(size_t length, int prot, int fd, off_t offset, int *retval){
     if(result){
         return result;
     }
+    if(prot & 1){
+        read = RG_R;
+    }
+    if(prot & 2){
+        write = RG_W;
+    }
+
+    // no file: anonymous memory, shared with children across fork
+    if(fd == -1){
+        result = as_define_shared(as, vaddr, length, read, write);
+        if(result){
+            return result;
+        }
+        *retval = (int)vaddr;
+        return 0;
+    }
 
 	result = filetable_get(curproc->p_filetable, fd, &file);
 	if (result) {
@@ -412,12 +1075,6 @@ int sys_mmap(size_t length, int prot, int fd, off_t offset, int *retval){
         return EINVAL;
     }
     filesize -= offset;
-    if(prot & 1){
-        read = RG_R;
-    }
-    if(prot & 2){
-        write = RG_W;
-    }
     result = as_define_mmap(as, vaddr, length, read, write, 0, file->of_vnode, offset, filesize);
     if(result){
         return result;
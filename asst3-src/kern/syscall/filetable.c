@@ -39,25 +39,109 @@
 
 
 /*
- * Construct a filetable.
+ * Index of the lowest set bit in a nonzero word.
+ */
+static
+unsigned
+filetable_lowbit(uint32_t word)
+{
+	unsigned bit;
+
+	KASSERT(word != 0);
+	for (bit = 0; (word & 1) == 0; bit++) {
+		word >>= 1;
+	}
+	return bit;
+}
+
+/*
+ * Allocate a filetable with SIZE empty slots and the default limits.
  */
+static
 struct filetable *
-filetable_create(void)
+filetable_alloc(unsigned size)
 {
 	struct filetable *ft;
-	int fd;
+
+	KASSERT(size % 32 == 0);
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
 		return NULL;
 	}
+	ft->ft_openfiles = kmalloc(size * sizeof(struct openfile *));
+	if (ft->ft_openfiles == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+	ft->ft_inuse = kmalloc(size / 32 * sizeof(uint32_t));
+	if (ft->ft_inuse == NULL) {
+		kfree(ft->ft_openfiles);
+		kfree(ft);
+		return NULL;
+	}
 
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
+	bzero(ft->ft_openfiles, size * sizeof(struct openfile *));
+	bzero(ft->ft_inuse, size / 32 * sizeof(uint32_t));
+	ft->ft_size = size;
+	ft->ft_limit = FILETABLE_LIMIT;
+	ft->ft_maxlimit = FILETABLE_MAXLIMIT;
+	return ft;
+}
+
+/*
+ * Grow a filetable so it has at least MINSIZE slots.
+ */
+static
+int
+filetable_grow(struct filetable *ft, unsigned minsize)
+{
+	struct openfile **openfiles;
+	uint32_t *inuse;
+	unsigned newsize;
+
+	newsize = ft->ft_size;
+	while (newsize < minsize) {
+		newsize *= 2;
+	}
+	if (newsize == ft->ft_size) {
+		return 0;
 	}
 
-	return ft;
+	openfiles = kmalloc(newsize * sizeof(struct openfile *));
+	if (openfiles == NULL) {
+		return ENOMEM;
+	}
+	inuse = kmalloc(newsize / 32 * sizeof(uint32_t));
+	if (inuse == NULL) {
+		kfree(openfiles);
+		return ENOMEM;
+	}
+
+	memcpy(openfiles, ft->ft_openfiles,
+	       ft->ft_size * sizeof(struct openfile *));
+	bzero(openfiles + ft->ft_size,
+	      (newsize - ft->ft_size) * sizeof(struct openfile *));
+	memcpy(inuse, ft->ft_inuse, ft->ft_size / 32 * sizeof(uint32_t));
+	bzero(inuse + ft->ft_size / 32,
+	      (newsize - ft->ft_size) / 32 * sizeof(uint32_t));
+
+	kfree(ft->ft_openfiles);
+	kfree(ft->ft_inuse);
+	ft->ft_openfiles = openfiles;
+	ft->ft_inuse = inuse;
+	ft->ft_size = newsize;
+	return 0;
+}
+
+/*
+ * Construct a filetable.
+ */
+struct filetable *
+filetable_create(void)
+{
+	return filetable_alloc(FILETABLE_INITSIZE);
 }
 
 /*
@@ -66,17 +150,24 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
+	unsigned i, fd;
+	uint32_t word;
 
 	KASSERT(ft != NULL);
 
 	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
+	for (i = 0; i < ft->ft_size / 32; i++) {
+		word = ft->ft_inuse[i];
+		while (word != 0) {
+			fd = i * 32 + filetable_lowbit(word);
+			word &= word - 1;
 			openfile_decref(ft->ft_openfiles[fd]);
 			ft->ft_openfiles[fd] = NULL;
 		}
+		ft->ft_inuse[i] = 0;
 	}
+	kfree(ft->ft_openfiles);
+	kfree(ft->ft_inuse);
 	kfree(ft);
 }
 
@@ -94,13 +185,18 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * Only the slots that are open are visited, so this is cheap for the
+ * usual process with a handful of files open. The limits are
+ * inherited too.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
 	struct openfile *file;
-	int fd;
+	unsigned i, fd;
+	uint32_t word;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,18 +204,24 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = filetable_alloc(src->ft_size);
 	if (dest == NULL) {
 		return ENOMEM;
 	}
+	dest->ft_limit = src->ft_limit;
+	dest->ft_maxlimit = src->ft_maxlimit;
 
 	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		file = src->ft_openfiles[fd];
-		if (file != NULL) {
+	for (i = 0; i < src->ft_size / 32; i++) {
+		word = src->ft_inuse[i];
+		dest->ft_inuse[i] = word;
+		while (word != 0) {
+			fd = i * 32 + filetable_lowbit(word);
+			word &= word - 1;
+			file = src->ft_openfiles[fd];
 			openfile_incref(file);
+			dest->ft_openfiles[fd] = file;
 		}
-		dest->ft_openfiles[fd] = file;
 	}
 
 	*dest_ret = dest;
@@ -127,15 +229,14 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 }
 
 /*
- * Check if a file handle is in range.
+ * Check if a file handle is in range, that is, below the limit. (A
+ * file can be open above the limit if the limit was lowered after
+ * it was opened; filetable_get still finds it.)
  */
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
-	(void)ft;
-
-	return (fd >= 0 && fd < OPEN_MAX);
+	return (fd >= 0 && (unsigned)fd < ft->ft_limit);
 }
 
 /*
@@ -151,7 +252,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
 	struct openfile *file;
 
-	if (!filetable_okfd(ft, fd)) {
+	if (fd < 0 || (unsigned)fd >= ft->ft_size) {
 		return EBADF;
 	}
 
@@ -184,6 +285,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
+	KASSERT(fd >= 0 && (unsigned)fd < ft->ft_size);
 	KASSERT(ft->ft_openfiles[fd] == file);
 }
 
@@ -194,44 +296,119 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
  * the behavior had to be defined explicitly in order to allow
  * manipulating stdin/stdout/stderr.)
  *
+ * The lowest free descriptor is in the first word of ft_inuse that
+ * isn't all ones; if there isn't one, the table grows.
+ *
  * Consumes a reference to the openfile object. (That reference is
  * placed in the table.)
  */
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned i, fd;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
+	KASSERT(file != NULL);
+
+	for (i = 0; i < ft->ft_size / 32; i++) {
+		if (ft->ft_inuse[i] != 0xffffffff) {
+			break;
+		}
+	}
+	if (i < ft->ft_size / 32) {
+		fd = i * 32 + filetable_lowbit(~ft->ft_inuse[i]);
+	}
+	else {
+		fd = ft->ft_size;
+	}
+
+	if (fd >= ft->ft_limit) {
+		return EMFILE;
+	}
+	if (fd >= ft->ft_size) {
+		result = filetable_grow(ft, fd + 1);
+		if (result) {
+			return result;
 		}
 	}
 
-	return EMFILE;
+	ft->ft_openfiles[fd] = file;
+	ft->ft_inuse[fd / 32] |= (uint32_t)1 << (fd % 32);
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
  * Place a file in a file table at a specific location and return the
- * file previously at that location. The location must be in range.
+ * file previously at that location. To place a file the location must
+ * be in range; placing NULL works anywhere.
  *
  * Consumes a reference to the passed-in openfile object; returns a
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails only if the table needs to grow and can't; placing NULL
+ * never fails.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
-	KASSERT(filetable_okfd(ft, fd));
+	int result;
+
+	KASSERT(fd >= 0);
+	KASSERT(newfile == NULL || filetable_okfd(ft, fd));
+
+	if ((unsigned)fd >= ft->ft_size) {
+		if (newfile == NULL) {
+			*oldfile_ret = NULL;
+			return 0;
+		}
+		result = filetable_grow(ft, fd + 1);
+		if (result) {
+			return result;
+		}
+	}
 
 	*oldfile_ret = ft->ft_openfiles[fd];
 	ft->ft_openfiles[fd] = newfile;
+	if (newfile != NULL) {
+		ft->ft_inuse[fd / 32] |= (uint32_t)1 << (fd % 32);
+	}
+	else {
+		ft->ft_inuse[fd / 32] &= ~((uint32_t)1 << (fd % 32));
+	}
+	return 0;
+}
+
+/*
+ * Get the limit on file handles.
+ */
+void
+filetable_getlimit(struct filetable *ft, rlim_t *cur, rlim_t *max)
+{
+	*cur = ft->ft_limit;
+	*max = ft->ft_maxlimit;
+}
+
+/*
+ * Set the limit on file handles. As usual the soft limit can't be
+ * above the hard limit, and the hard limit can be lowered but not
+ * raised. Lowering the limit doesn't close anything.
+ */
+int
+filetable_setlimit(struct filetable *ft, rlim_t cur, rlim_t max)
+{
+	if (cur > max) {
+		return EINVAL;
+	}
+	if (max > ft->ft_maxlimit) {
+		return EPERM;
+	}
+	ft->ft_limit = cur;
+	ft->ft_maxlimit = max;
+	return 0;
 }
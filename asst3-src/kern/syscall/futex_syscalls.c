@@ -0,0 +1,221 @@
+/*
+ * Futex system calls: futex_wait and futex_wake.
+ *
+ * These let userland build mutexes and semaphores that stay entirely
+ * in user space when uncontended (see libc's usync.c) and only come
+ * into the kernel to sleep or to wake a sleeper.
+ *
+ * A futex is just an aligned int in user memory. One in shared memory
+ * (mmap with no file) is named by its physical address, so processes
+ * that share it after fork find each other; any other is named by
+ * (address space, virtual address), which only the process itself
+ * can use. Sleepers are kept on a small hash table of wait channels
+ * keyed on the name. Each sleeper puts a record on its bucket's list
+ * so that a wake can pick out exactly the threads waiting on the
+ * right address; collisions in a bucket cost an extra trip around
+ * the sleep loop but are otherwise harmless.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_HASHSIZE	32
+
+/*
+ * One sleeping thread. Lives on the sleeper's stack.
+ */
+struct futex_waiter {
+	struct addrspace *fw_as;	/* NULL for shared memory */
+	uintptr_t fw_addr;		/* virtual, or physical if shared */
+	bool fw_woken;			/* set by futex_wake */
+	struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;	/* protects fb_waiters, fw_woken */
+	struct wchan *fb_wchan;
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_HASHSIZE];
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, uintptr_t addr)
+{
+	unsigned h;
+
+	h = (unsigned)(uintptr_t)as ^ (unsigned)(addr >> 2);
+	h ^= h >> 16;
+	h ^= h >> 8;
+	return &futex_table[h % FUTEX_HASHSIZE];
+}
+
+/*
+ * Remove a waiter from its bucket. Must hold the bucket lock.
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	struct futex_waiter **pp;
+
+	for (pp = &fb->fb_waiters; *pp != NULL; pp = &(*pp)->fw_next) {
+		if (*pp == fw) {
+			*pp = fw->fw_next;
+			return;
+		}
+	}
+}
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		futex_table[i].fb_wchan = wchan_create("futex");
+		if (futex_table[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+/*
+ * Check a futex address, name it, and find its bucket.
+ */
+static
+int
+futex_lookup(userptr_t uaddr, struct addrspace **as_ret,
+	     uintptr_t *addr_ret, struct futex_bucket **fb_ret)
+{
+	struct addrspace *as;
+	vaddr_t addr;
+	paddr_t paddr;
+
+	addr = (vaddr_t)uaddr;
+	if (addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	as = proc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+	paddr = vm_sharedpaddr(as, addr);
+	if (paddr != 0) {
+		*as_ret = NULL;
+		*addr_ret = paddr;
+	}
+	else {
+		*as_ret = as;
+		*addr_ret = addr;
+	}
+	*fb_ret = futex_hash(*as_ret, *addr_ret);
+	return 0;
+}
+
+/*
+ * futex_wait: sleep until woken, provided *UADDR still contains
+ * EXPECTED. Fails with EAGAIN if it doesn't.
+ *
+ * We can't copyin while holding a spinlock (it might fault), so the
+ * waiter record goes on the list *before* the value is checked. A
+ * futex_wake that runs between the check and the sleep then finds
+ * the record and sets fw_woken, and we don't go to sleep at all.
+ * That closes the window where a wakeup could otherwise be lost.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int expected)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter fw;
+	int val, result;
+
+	result = futex_lookup(uaddr, &fw.fw_as, &fw.fw_addr, &fb);
+	if (result) {
+		return result;
+	}
+	fw.fw_woken = false;
+
+	spinlock_acquire(&fb->fb_lock);
+	fw.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &fw;
+	spinlock_release(&fb->fb_lock);
+
+	result = copyin(uaddr, &val, sizeof(val));
+	if (result == 0 && val != expected) {
+		result = EAGAIN;
+	}
+
+	spinlock_acquire(&fb->fb_lock);
+	if (result) {
+		if (!fw.fw_woken) {
+			futex_unlink(fb, &fw);
+		}
+		spinlock_release(&fb->fb_lock);
+		return result;
+	}
+	while (!fw.fw_woken) {
+		wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+	}
+	spinlock_release(&fb->fb_lock);
+	return 0;
+}
+
+/*
+ * futex_wake: wake up to N threads sleeping on UADDR. Returns the
+ * number actually woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, unsigned n, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **pp, *fw;
+	struct addrspace *as;
+	uintptr_t addr;
+	unsigned woken;
+	int result;
+
+	result = futex_lookup(uaddr, &as, &addr, &fb);
+	if (result) {
+		return result;
+	}
+
+	woken = 0;
+	spinlock_acquire(&fb->fb_lock);
+	pp = &fb->fb_waiters;
+	while (*pp != NULL && woken < n) {
+		fw = *pp;
+		if (fw->fw_as == as && fw->fw_addr == addr) {
+			*pp = fw->fw_next;
+			fw->fw_woken = true;
+			woken++;
+		}
+		else {
+			pp = &fw->fw_next;
+		}
+	}
+	if (woken > 0) {
+		/*
+		 * The wchan is shared by the whole bucket, so wake
+		 * everyone; sleepers whose record wasn't marked go
+		 * straight back to sleep.
+		 */
+		wchan_wakeall(fb->fb_wchan, &fb->fb_lock);
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
@@ -0,0 +1,679 @@
+/*
+ * Submission/completion rings: ioring_setup and ioring_enter.
+ *
+ * These batch file operations so that a process doing lots of small
+ * I/O pays for one trap per batch instead of one per operation. The
+ * process registers a struct ioring in its own memory (see
+ * <kern/ioring.h>), queues operations in it, and calls ioring_enter,
+ * which takes all the queued operations at once, hands each to a
+ * worker thread on ioring_wq, and posts completions for those that
+ * have finished.
+ *
+ * The workers don't run in the process, so they can touch neither
+ * its memory nor its file table. Everything that needs the process
+ * is done by ioring_enter on its way through: at submit time, write
+ * data and open paths are copied into kernel buffers, open takes a
+ * reference to the current directory to look its path up from, files
+ * are looked up and referenced, and close takes the fd out of the
+ * table;
+ * at completion time, read data is copied out and opened files are
+ * placed in the file table. The workers see only kernel buffers and
+ * openfiles.
+ *
+ * There are never more than ir_entries operations outstanding
+ * (submitted but not yet posted), so finished operations waiting for
+ * room in the completion ring can't pile up without bound.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/ioring.h>
+#include <limits.h>
+#include <lib.h>
+#include <uio.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <workqueue.h>
+#include <syscall.h>
+
+/*
+ * One operation, from submission until its completion is posted.
+ */
+struct ioring_op {
+	struct work io_work;
+	struct ioring_ctx *io_ctx;
+	struct ioring_op *io_next;	/* on ic_done */
+	int io_opcode;			/* IORING_OP_* */
+	uint64_t io_userdata;
+	struct openfile *io_file;	/* file; for OPEN, the one opened */
+	off_t io_off;			/* offset, or -1 */
+	void *io_kbuf;			/* data; for OPEN, the path */
+	struct vnode *io_cwd;		/* OPEN: the process's directory */
+	userptr_t io_ubuf;		/* READ: where the data goes */
+	size_t io_len;
+	int io_flags;			/* OPEN */
+	mode_t io_mode;			/* OPEN */
+	int io_result;			/* >= 0, or negated error */
+};
+
+/*
+ * A process's ring. Hangs off p_ioring.
+ */
+struct ioring_ctx {
+	struct lock *ic_lock;
+	struct cv *ic_cv;		/* an operation finished */
+	userptr_t ic_ring;		/* the process's struct ioring */
+	userptr_t ic_sqes;
+	userptr_t ic_cqes;
+	unsigned ic_entries;
+	unsigned ic_sqhead;		/* our copies of the counters */
+	unsigned ic_cqtail;		/* we advance */
+	unsigned ic_outstanding;	/* submitted, not yet posted */
+	unsigned ic_running;		/* submitted, not yet finished */
+	struct ioring_op *ic_done;	/* finished, not yet posted */
+	struct ioring_op **ic_donetail;
+};
+
+/* where one of the counters is in the process's struct ioring */
+#define RINGFIELD(ctx, field) \
+	((ctx)->ic_ring + __builtin_offsetof(struct ioring, field))
+
+static struct workqueue *ioring_wq;
+
+void
+ioring_bootstrap(void)
+{
+	ioring_wq = workqueue_create("ioring", PRI_DEFAULT);
+	if (ioring_wq == NULL) {
+		panic("ioring_bootstrap: Out of memory\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+// operations
+
+static
+void
+ioring_op_destroy(struct ioring_op *op)
+{
+	if (op->io_file != NULL) {
+		openfile_decref(op->io_file);
+	}
+	if (op->io_kbuf != NULL) {
+		kfree(op->io_kbuf);
+	}
+	if (op->io_cwd != NULL) {
+		VOP_DECREF(op->io_cwd);
+	}
+	kfree(op);
+}
+
+/*
+ * Put a finished operation on the done list. Caller holds ic_lock.
+ */
+static
+void
+ioring_done(struct ioring_ctx *ctx, struct ioring_op *op)
+{
+	KASSERT(lock_do_i_hold(ctx->ic_lock));
+
+	op->io_next = NULL;
+	*ctx->ic_donetail = op;
+	ctx->ic_donetail = &op->io_next;
+	cv_broadcast(ctx->ic_cv, ctx->ic_lock);
+}
+
+/*
+ * Read or write the kernel buffer, at io_off or at the seek position.
+ */
+static
+int
+ioring_rw(struct ioring_op *op, enum uio_rw rw)
+{
+	struct openfile *file = op->io_file;
+	struct iovec iov;
+	struct uio kuio;
+	bool locked;
+	int result;
+
+	uio_kinit(&iov, &kuio, op->io_kbuf, op->io_len, 0, rw);
+
+	locked = op->io_off < 0;
+	if (locked) {
+		lock_acquire(file->of_offsetlock);
+		kuio.uio_offset = file->of_offset;
+	}
+	else {
+		kuio.uio_offset = op->io_off;
+	}
+
+	result = (rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, &kuio) :
+		VOP_WRITE(file->of_vnode, &kuio);
+
+	if (locked) {
+		if (result == 0) {
+			file->of_offset = kuio.uio_offset;
+		}
+		lock_release(file->of_offsetlock);
+	}
+	if (result) {
+		return -result;
+	}
+	return op->io_len - kuio.uio_resid;
+}
+
+/*
+ * Worker function: do the operation, then queue it to be posted.
+ */
+static
+void
+ioring_run(void *data)
+{
+	struct ioring_op *op = data;
+	struct ioring_ctx *ctx = op->io_ctx;
+
+	switch (op->io_opcode) {
+	    case IORING_OP_READ:
+		op->io_result = ioring_rw(op, UIO_READ);
+		break;
+	    case IORING_OP_WRITE:
+		op->io_result = ioring_rw(op, UIO_WRITE);
+		break;
+	    case IORING_OP_OPEN:
+		/*
+		 * Our own cwd is kproc's, so look relative paths up
+		 * from the process's. openfile_openat trashes the
+		 * path; nobody needs it after.
+		 */
+		op->io_result = -openfile_openat(op->io_cwd, op->io_kbuf,
+						 op->io_flags, op->io_mode,
+						 &op->io_file);
+		break;
+	    case IORING_OP_CLOSE:
+		openfile_decref(op->io_file);
+		op->io_file = NULL;
+		op->io_result = 0;
+		break;
+	    case IORING_OP_FSYNC:
+		op->io_result = -VOP_FSYNC(op->io_file->of_vnode);
+		break;
+	    default:
+		panic("ioring_run: bad opcode %d\n", op->io_opcode);
+	}
+
+	lock_acquire(ctx->ic_lock);
+	KASSERT(ctx->ic_running > 0);
+	ctx->ic_running--;
+	ioring_done(ctx, op);
+	lock_release(ctx->ic_lock);
+	/* OP and CTX may be gone now */
+}
+
+////////////////////////////////////////////////////////////
+// submission
+
+/*
+ * Get a referenced file for FD, which mustn't have been opened with
+ * BADACCMODE.
+ */
+static
+int
+ioring_getfile(int fd, int badaccmode, struct openfile **ret)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile *file;
+	int result;
+
+	result = filetable_get(ft, fd, &file);
+	if (result) {
+		return result;
+	}
+	if (file->of_accmode == badaccmode) {
+		filetable_put(ft, fd, file);
+		return EBADF;
+	}
+	openfile_incref(file);
+	filetable_put(ft, fd, file);
+	*ret = file;
+	return 0;
+}
+
+/*
+ * Do the part of a submission that needs the process. On failure the
+ * operation completes at once with the error; whatever was set up in
+ * OP is freed with it.
+ *
+ * Reads and writes are only allowed on seekable objects: a read of
+ * an empty pipe or the console would tie up a worker indefinitely,
+ * and everything queued behind it on that cpu with it.
+ */
+static
+int
+ioring_prep(const struct ioring_sqe *sqe, struct ioring_op *op)
+{
+	const int openflags =
+		O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND | O_NOCTTY;
+
+	struct filetable *ft = curproc->p_filetable;
+	int result;
+
+	switch (sqe->sqe_op) {
+	    case IORING_OP_NOP:
+		return 0;
+
+	    case IORING_OP_READ:
+	    case IORING_OP_WRITE:
+		if (sqe->sqe_off < -1) {
+			return EINVAL;
+		}
+		result = ioring_getfile(sqe->sqe_fd,
+				sqe->sqe_op == IORING_OP_READ ?
+					O_WRONLY : O_RDONLY,
+				&op->io_file);
+		if (result) {
+			return result;
+		}
+		if (!VOP_ISSEEKABLE(op->io_file->of_vnode)) {
+			return ESPIPE;
+		}
+		op->io_off = sqe->sqe_off;
+		op->io_len = sqe->sqe_len;
+		if (op->io_len > IORING_MAXIO) {
+			op->io_len = IORING_MAXIO;
+		}
+		if (op->io_len == 0) {
+			return 0;
+		}
+		op->io_kbuf = kmalloc(op->io_len);
+		if (op->io_kbuf == NULL) {
+			return ENOMEM;
+		}
+		if (sqe->sqe_op == IORING_OP_READ) {
+			op->io_ubuf = sqe->sqe_buf;
+			return 0;
+		}
+		return copyin(sqe->sqe_buf, op->io_kbuf, op->io_len);
+
+	    case IORING_OP_OPEN:
+		if ((sqe->sqe_flags & openflags) != sqe->sqe_flags) {
+			return EINVAL;
+		}
+		op->io_flags = sqe->sqe_flags;
+		op->io_mode = sqe->sqe_mode;
+		op->io_kbuf = kmalloc(PATH_MAX);
+		if (op->io_kbuf == NULL) {
+			return ENOMEM;
+		}
+		result = copyinstr(sqe->sqe_buf, op->io_kbuf, PATH_MAX, NULL);
+		if (result) {
+			return result;
+		}
+		return vfs_getcurdir(&op->io_cwd);
+
+	    case IORING_OP_CLOSE:
+		/* as in sys_close; the worker drops the reference */
+		result = filetable_get(ft, sqe->sqe_fd, &op->io_file);
+		if (result) {
+			op->io_file = NULL;
+			return result;
+		}
+		filetable_put(ft, sqe->sqe_fd, op->io_file);
+		result = filetable_placeat(ft, NULL, sqe->sqe_fd,
+					   &op->io_file);
+		KASSERT(result == 0);
+		KASSERT(op->io_file != NULL);
+		return 0;
+
+	    case IORING_OP_FSYNC:
+		return ioring_getfile(sqe->sqe_fd, -1, &op->io_file);
+	}
+	return EINVAL;
+}
+
+/*
+ * Take up to TO_SUBMIT entries from the submission ring and start
+ * them. Stops early if the ring runs dry or too many operations are
+ * outstanding. Fails only if it couldn't take any.
+ */
+static
+int
+ioring_submit(struct ioring_ctx *ctx, unsigned to_submit,
+	      unsigned *nsubmitted)
+{
+	struct ioring_sqe sqe;
+	struct ioring_op *op;
+	unsigned sqtail, n;
+	int result;
+
+	KASSERT(lock_do_i_hold(ctx->ic_lock));
+
+	result = copyin(RINGFIELD(ctx, ir_sqtail),
+			&sqtail, sizeof(sqtail));
+	if (result) {
+		return result;
+	}
+
+	for (n = 0; n < to_submit; n++) {
+		if (ctx->ic_sqhead == sqtail ||
+		    ctx->ic_outstanding == ctx->ic_entries) {
+			break;
+		}
+
+		result = copyin(ctx->ic_sqes + (ctx->ic_sqhead &
+					(ctx->ic_entries - 1)) * sizeof(sqe),
+				&sqe, sizeof(sqe));
+		if (result) {
+			break;
+		}
+		op = kmalloc(sizeof(*op));
+		if (op == NULL) {
+			result = ENOMEM;
+			break;
+		}
+		work_init(&op->io_work, ioring_run, op);
+		op->io_ctx = ctx;
+		op->io_next = NULL;
+		op->io_opcode = sqe.sqe_op;
+		op->io_userdata = sqe.sqe_userdata;
+		op->io_file = NULL;
+		op->io_off = -1;
+		op->io_kbuf = NULL;
+		op->io_cwd = NULL;
+		op->io_ubuf = NULL;
+		op->io_len = 0;
+		op->io_flags = 0;
+		op->io_mode = 0;
+		op->io_result = 0;
+
+		ctx->ic_sqhead++;
+		ctx->ic_outstanding++;
+
+		result = ioring_prep(&sqe, op);
+		if (result) {
+			op->io_result = -result;
+			ioring_done(ctx, op);
+		}
+		else if (op->io_opcode == IORING_OP_NOP) {
+			ioring_done(ctx, op);
+		}
+		else {
+			ctx->ic_running++;
+			work_enqueue(ioring_wq, &op->io_work);
+		}
+	}
+
+	*nsubmitted = n;
+	if (n > 0) {
+		result = 0;
+	}
+	if (result == 0) {
+		result = copyout(&ctx->ic_sqhead,
+				 RINGFIELD(ctx, ir_sqhead),
+				 sizeof(ctx->ic_sqhead));
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// completion
+
+/*
+ * Post finished operations to the completion ring while there's
+ * room, finishing them off in the process as needed. Adds the number
+ * posted to *NPOSTED.
+ */
+static
+int
+ioring_post(struct ioring_ctx *ctx, unsigned *nposted)
+{
+	struct ioring_cqe cqe;
+	struct ioring_op *op;
+	struct openfile *file;
+	unsigned cqhead;
+	int fd, res, result;
+	bool placed;
+
+	KASSERT(lock_do_i_hold(ctx->ic_lock));
+
+	if (ctx->ic_done == NULL) {
+		return 0;
+	}
+
+	result = copyin(RINGFIELD(ctx, ir_cqhead),
+			&cqhead, sizeof(cqhead));
+	if (result) {
+		return result;
+	}
+
+	while (ctx->ic_done != NULL &&
+	       ctx->ic_cqtail - cqhead < ctx->ic_entries) {
+		op = ctx->ic_done;
+		ctx->ic_done = op->io_next;
+		if (ctx->ic_done == NULL) {
+			ctx->ic_donetail = &ctx->ic_done;
+		}
+
+		res = op->io_result;
+		placed = false;
+		fd = -1;
+		if (op->io_opcode == IORING_OP_READ && res > 0) {
+			result = copyout(op->io_kbuf, op->io_ubuf, res);
+			if (result) {
+				res = -result;
+			}
+		}
+		else if (op->io_opcode == IORING_OP_OPEN && res == 0) {
+			result = filetable_place(curproc->p_filetable,
+						 op->io_file, &fd);
+			if (result) {
+				res = -result;
+			}
+			else {
+				op->io_file = NULL;
+				placed = true;
+				res = fd;
+			}
+		}
+
+		/* zero it so the padding doesn't leak kernel stack */
+		bzero(&cqe, sizeof(cqe));
+		cqe.cqe_userdata = op->io_userdata;
+		cqe.cqe_res = res;
+
+		ioring_op_destroy(op);
+		ctx->ic_outstanding--;
+
+		result = copyout(&cqe, ctx->ic_cqes + (ctx->ic_cqtail &
+					(ctx->ic_entries - 1)) * sizeof(cqe),
+				 sizeof(cqe));
+		if (result) {
+			/*
+			 * The completion is lost; the ring is bad anyway.
+			 * But don't leave behind an fd the process never
+			 * heard about.
+			 */
+			if (placed) {
+				filetable_placeat(curproc->p_filetable, NULL,
+						  fd, &file);
+				if (file != NULL) {
+					openfile_decref(file);
+				}
+			}
+			return result;
+		}
+		ctx->ic_cqtail++;
+		(*nposted)++;
+	}
+
+	return copyout(&ctx->ic_cqtail,
+		       RINGFIELD(ctx, ir_cqtail),
+		       sizeof(ctx->ic_cqtail));
+}
+
+////////////////////////////////////////////////////////////
+// setup and teardown
+
+static
+struct ioring_ctx *
+ioring_create(userptr_t uring, const struct ioring *ring)
+{
+	struct ioring_ctx *ctx;
+
+	ctx = kmalloc(sizeof(*ctx));
+	if (ctx == NULL) {
+		return NULL;
+	}
+	ctx->ic_lock = lock_create("ioring");
+	if (ctx->ic_lock == NULL) {
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ic_cv = cv_create("ioring");
+	if (ctx->ic_cv == NULL) {
+		lock_destroy(ctx->ic_lock);
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ic_ring = uring;
+	ctx->ic_sqes = ring->ir_sqes;
+	ctx->ic_cqes = ring->ir_cqes;
+	ctx->ic_entries = ring->ir_entries;
+	ctx->ic_sqhead = 0;
+	ctx->ic_cqtail = 0;
+	ctx->ic_outstanding = 0;
+	ctx->ic_running = 0;
+	ctx->ic_done = NULL;
+	ctx->ic_donetail = &ctx->ic_done;
+	return ctx;
+}
+
+/*
+ * Wait for the workers to finish whatever is still running, then
+ * throw away the results. Called at exit and exec, and when a ring
+ * is replaced.
+ */
+void
+ioring_destroy(struct ioring_ctx *ctx)
+{
+	struct ioring_op *op;
+
+	lock_acquire(ctx->ic_lock);
+	while (ctx->ic_running > 0) {
+		cv_wait(ctx->ic_cv, ctx->ic_lock);
+	}
+	while (ctx->ic_done != NULL) {
+		op = ctx->ic_done;
+		ctx->ic_done = op->io_next;
+		ioring_op_destroy(op);
+	}
+	lock_release(ctx->ic_lock);
+
+	cv_destroy(ctx->ic_cv);
+	lock_destroy(ctx->ic_lock);
+	kfree(ctx);
+}
+
+////////////////////////////////////////////////////////////
+// system calls
+
+/*
+ * ioring_setup() - register the ring at URING, replacing any ring
+ * set up before.
+ */
+int
+sys_ioring_setup(userptr_t uring)
+{
+	struct ioring ring;
+	struct ioring_ctx *ctx;
+	int result;
+
+	result = copyin(uring, &ring, sizeof(ring));
+	if (result) {
+		return result;
+	}
+	if (ring.ir_entries == 0 || ring.ir_entries > IORING_MAXENTRIES ||
+	    (ring.ir_entries & (ring.ir_entries - 1)) != 0) {
+		return EINVAL;
+	}
+
+	ring.ir_sqhead = ring.ir_sqtail = 0;
+	ring.ir_cqhead = ring.ir_cqtail = 0;
+	result = copyout(&ring, uring, sizeof(ring));
+	if (result) {
+		return result;
+	}
+
+	ctx = ioring_create(uring, &ring);
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+	if (curproc->p_ioring != NULL) {
+		ioring_destroy(curproc->p_ioring);
+	}
+	curproc->p_ioring = ctx;
+	return 0;
+}
+
+/*
+ * ioring_enter() - post what has finished, submit up to TO_SUBMIT
+ * entries, then wait until MIN_COMPLETE completions in all have been
+ * posted by this call (or until nothing more can be). Returns the
+ * number of entries submitted.
+ */
+int
+sys_ioring_enter(unsigned to_submit, unsigned min_complete, int *retval)
+{
+	struct ioring_ctx *ctx = curproc->p_ioring;
+	unsigned nsubmitted, nposted, before;
+	int result;
+
+	if (ctx == NULL) {
+		return EINVAL;
+	}
+
+	lock_acquire(ctx->ic_lock);
+
+	nposted = 0;
+	result = ioring_post(ctx, &nposted);
+	if (result) {
+		goto out;
+	}
+
+	nsubmitted = 0;
+	if (to_submit > 0) {
+		result = ioring_submit(ctx, to_submit, &nsubmitted);
+		if (result) {
+			goto out;
+		}
+	}
+
+	while (nposted < min_complete && ctx->ic_outstanding > 0) {
+		if (ctx->ic_done == NULL) {
+			cv_wait(ctx->ic_cv, ctx->ic_lock);
+			continue;
+		}
+		before = nposted;
+		result = ioring_post(ctx, &nposted);
+		if (result) {
+			goto out;
+		}
+		if (nposted == before) {
+			/* the completion ring is full */
+			break;
+		}
+	}
+
+	*retval = nsubmitted;
+out:
+	lock_release(ctx->ic_lock);
+	return result;
+}
@@ -40,9 +40,10 @@
 #include <openfile.h>
 
 /*
- * Constructor for struct openfile.
+ * Constructor for struct openfile. The vnode reference passed in
+ * belongs to the openfile afterwards and is dropped with vfs_close
+ * when the openfile is destroyed.
  */
-static
 struct openfile *
 openfile_create(struct vnode *vn, int accmode)
 {
@@ -68,6 +69,7 @@ openfile_create(struct vnode *vn, int accmode)
 
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
+	file->of_flags = 0;
 	file->of_offset = 0;
 	file->of_refcount = 1;
 
@@ -96,12 +98,22 @@ openfile_destroy(struct openfile *file)
 int
 openfile_open(char *filename, int openflags, mode_t mode,
 	      struct openfile **ret)
+{
+	return openfile_openat(NULL, filename, openflags, mode, ret);
+}
+
+/*
+ * The same, with vfs_openat.
+ */
+int
+openfile_openat(struct vnode *dir, char *filename, int openflags,
+		mode_t mode, struct openfile **ret)
 {
 	struct vnode *vn;
 	struct openfile *file;
 	int result;
 
-	result = vfs_open(filename, openflags, mode, &vn);
+	result = vfs_openat(dir, filename, openflags, mode, &vn);
 	if (result) {
 		return result;
 	}
@@ -33,15 +33,20 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <kern/sched.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
+#include <cpu.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
 #include <copyinout.h>
 #include <pid.h>
+#include <filetable.h>
 #include <syscall.h>
 
 /* note that sys_execv is in runprogram.c */
@@ -58,6 +63,150 @@ sys_getpid(pid_t *retval)
 	return 0;
 }
 
+/*
+ * Convert nanoseconds to a struct timeval.
+ */
+static
+void
+ns_to_timeval(uint64_t ns, struct timeval *tv)
+{
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
+/*
+ * sys_getrusage
+ *
+ * Only the cpu times are filled in. Interrupt time that landed on
+ * the process is counted as system time.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+	struct rusage ru;
+	struct cputime ct;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		proc_getcputime(curproc, &ct);
+		break;
+	    case RUSAGE_CHILDREN:
+		spinlock_acquire(&curproc->p_lock);
+		ct = curproc->p_childtime;
+		spinlock_release(&curproc->p_lock);
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	ns_to_timeval(ct.ct_user, &ru.ru_utime);
+	ns_to_timeval(ct.ct_sys + ct.ct_intr, &ru.ru_stime);
+	return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * sys_getrlimit
+ *
+ * Only RLIMIT_NOFILE is supported; it lives in the file table.
+ */
+int
+sys_getrlimit(int resource, userptr_t rlp)
+{
+	struct rlimit rl;
+
+	if (resource != RLIMIT_NOFILE) {
+		return EINVAL;
+	}
+	filetable_getlimit(curproc->p_filetable, &rl.rlim_cur, &rl.rlim_max);
+	return copyout(&rl, rlp, sizeof(rl));
+}
+
+/*
+ * sys_setrlimit
+ */
+int
+sys_setrlimit(int resource, const_userptr_t rlp)
+{
+	struct rlimit rl;
+	int result;
+
+	if (resource != RLIMIT_NOFILE) {
+		return EINVAL;
+	}
+	result = copyin(rlp, &rl, sizeof(rl));
+	if (result) {
+		return result;
+	}
+	return filetable_setlimit(curproc->p_filetable,
+				  rl.rlim_cur, rl.rlim_max);
+}
+
+/*
+ * sys_sched_setaffinity
+ *
+ * Changes all the threads of the target process. If the caller is
+ * no longer allowed on the cpu it's on, yielding moves it.
+ */
+int
+sys_sched_setaffinity(pid_t pid, size_t setsize, const_userptr_t set)
+{
+	cpu_set_t cs;
+	int result;
+
+	if (pid < 0) {
+		return ESRCH;
+	}
+	if (setsize < sizeof(cs)) {
+		return EINVAL;
+	}
+	result = copyin(set, &cs, sizeof(cs));
+	if (result) {
+		return result;
+	}
+	result = proc_setaffinity(pid, cs.__bits);
+	if (result) {
+		return result;
+	}
+	thread_yield();
+	return 0;
+}
+
+/*
+ * sys_sched_getaffinity
+ */
+int
+sys_sched_getaffinity(pid_t pid, size_t setsize, userptr_t set)
+{
+	cpu_set_t cs;
+	int result;
+
+	if (pid < 0) {
+		return ESRCH;
+	}
+	if (setsize < sizeof(cs)) {
+		return EINVAL;
+	}
+	CPU_ZERO(&cs);
+	result = proc_getaffinity(pid, &cs.__bits);
+	if (result) {
+		return result;
+	}
+	return copyout(&cs, set, sizeof(cs));
+}
+
+/*
+ * sys_sched_getcpu
+ *
+ * Only a snapshot, of course; we can move as soon as we return.
+ */
+int
+sys_sched_getcpu(int *retval)
+{
+	*retval = curcpu->c_number;
+	return 0;
+}
+
 /*
  * sys__exit()
  *
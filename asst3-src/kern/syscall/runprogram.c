@@ -395,6 +395,12 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		as_destroy(oldvm);
 	}
 
+	/* Likewise the submission ring, which was in the old image. */
+	if (curproc->p_ioring != NULL) {
+		ioring_destroy(curproc->p_ioring);
+		curproc->p_ioring = NULL;
+	}
+
 	/*
 	 * Now that we know we're succeeding, change the current thread's
 	 * name to reflect the new process.
@@ -431,7 +437,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
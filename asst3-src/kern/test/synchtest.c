@@ -32,10 +32,12 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
+#include <current.h>
 #include <synch.h>
 #include <test.h>
 
@@ -400,3 +402,496 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+/*
+ * CV broadcast benchmark.
+ *
+ * Like cvtest2, but instead of one sleeper and one waker, a crowd of
+ * sleepers all wait on one CV and a waker broadcasts to them once
+ * they're all asleep, over and over. Reports the time spent inside
+ * cv_broadcast, which is dominated by wchan_wakeall putting the
+ * sleepers back on the run queues, as well as the total.
+ */
+
+#define CVBENCH_ROUNDS 200
+
+static struct cv *cvb_allin;
+static volatile unsigned cvb_asleep;
+static volatile unsigned cvb_generation;
+
+static
+void
+cvbenchthread(void *junk, unsigned long nthreads)
+{
+	unsigned i, gen;
+
+	(void)junk;
+
+	for (i=0; i<CVBENCH_ROUNDS; i++) {
+		lock_acquire(testlock);
+		gen = cvb_generation;
+		cvb_asleep++;
+		if (cvb_asleep == nthreads) {
+			cv_signal(cvb_allin, testlock);
+		}
+		while (gen == cvb_generation) {
+			cv_wait(testcv, testlock);
+		}
+		lock_release(testlock);
+	}
+	V(donesem);
+}
+
+int
+cvbench(int nargs, char **args)
+{
+	struct timespec before, after, bstart, bend, btotal;
+	unsigned nthreads, i;
+	int result;
+
+	nthreads = NTHREADS;
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+	}
+	if (nthreads == 0) {
+		kprintf("Usage: sy8 [nthreads]\n");
+		return EINVAL;
+	}
+
+	inititems();
+	if (cvb_allin == NULL) {
+		cvb_allin = cv_create("cvb_allin");
+		if (cvb_allin == NULL) {
+			panic("cvbench: cv_create failed\n");
+		}
+	}
+	cvb_asleep = 0;
+	cvb_generation = 0;
+	btotal.tv_sec = 0;
+	btotal.tv_nsec = 0;
+
+	gettime(&before);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("cvbench", NULL, cvbenchthread, NULL,
+				     nthreads);
+		if (result) {
+			panic("cvbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<CVBENCH_ROUNDS; i++) {
+		lock_acquire(testlock);
+		while (cvb_asleep < nthreads) {
+			cv_wait(cvb_allin, testlock);
+		}
+		cvb_asleep = 0;
+		cvb_generation++;
+		gettime(&bstart);
+		cv_broadcast(testcv, testlock);
+		gettime(&bend);
+		lock_release(testlock);
+
+		timespec_sub(&bend, &bstart, &bend);
+		timespec_add(&btotal, &bend, &btotal);
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &after);
+
+	kprintf("cvbench: %u sleepers, %u broadcasts in %llu.%09lu; "
+		"%llu.%09lu in cv_broadcast\n",
+		nthreads, CVBENCH_ROUNDS,
+		(unsigned long long) after.tv_sec,
+		(unsigned long) after.tv_nsec,
+		(unsigned long long) btotal.tv_sec,
+		(unsigned long) btotal.tv_nsec);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Reader-writer lock test.
+ *
+ * One thread in four is a writer; the rest are readers, some of which
+ * also try to upgrade to a write hold. Writers update a pair of values
+ * that readers check for consistency, and everyone checks that readers
+ * and writers never hold the lock at the same time.
+ */
+
+#define NRWLOOPS      60
+#define RWBENCH_LOOPS 200
+#define RWBENCH_WORK  2000
+
+static struct rwlock *testrwlock;
+static struct spinlock rwcount_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned rwreaders;
+static volatile unsigned rwwriters;
+static volatile unsigned rwupgrades;
+static volatile bool rwfailed;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: Mismatch on %s\n", num, msg);
+	rwfailed = true;
+}
+
+static
+void
+rwcheck_enter(unsigned long num, bool write)
+{
+	spinlock_acquire(&rwcount_lock);
+	if (write) {
+		rwwriters++;
+		if (rwwriters != 1 || rwreaders != 0) {
+			rwfail(num, "writer exclusion");
+		}
+	}
+	else {
+		rwreaders++;
+		if (rwwriters != 0) {
+			rwfail(num, "reader/writer exclusion");
+		}
+	}
+	spinlock_release(&rwcount_lock);
+}
+
+static
+void
+rwcheck_leave(bool write)
+{
+	spinlock_acquire(&rwcount_lock);
+	if (write) {
+		rwwriters--;
+	}
+	else {
+		rwreaders--;
+	}
+	spinlock_release(&rwcount_lock);
+}
+
+static
+void
+rwwrite_values(unsigned long num)
+{
+	volatile int j;
+
+	testval1 = num;
+	for (j=0; j<500; j++);
+	testval2 = num*num;
+	if (testval2 != testval1*testval1) {
+		rwfail(num, "testval2/testval1 (write)");
+	}
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrwlock);
+			rwcheck_enter(num, true);
+			rwwrite_values(num);
+			rwcheck_leave(true);
+			rwlock_release_write(testrwlock);
+			continue;
+		}
+
+		rwlock_acquire_read(testrwlock);
+		rwcheck_enter(num, false);
+		if (testval2 != testval1*testval1) {
+			rwfail(num, "testval2/testval1 (read)");
+		}
+		if (num % 4 == 1 && i % 8 == 0) {
+			/*
+			 * Drop out of the reader count before trying
+			 * to upgrade; if the upgrade succeeds there
+			 * must be nobody else in there.
+			 */
+			rwcheck_leave(false);
+			if (rwlock_tryupgrade(testrwlock)) {
+				rwcheck_enter(num, true);
+				rwwrite_values(num);
+				rwupgrades++;
+				rwcheck_leave(true);
+				rwlock_release_write(testrwlock);
+			}
+			else {
+				rwlock_release_read(testrwlock);
+			}
+			continue;
+		}
+		rwcheck_leave(false);
+		rwlock_release_read(testrwlock);
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	if (testrwlock == NULL) {
+		testrwlock = rwlock_create("testrwlock");
+		if (testrwlock == NULL) {
+			panic("rwtest: rwlock_create failed\n");
+		}
+	}
+	kprintf("Starting rwlock test...\n");
+
+	rwfailed = false;
+	rwupgrades = 0;
+	testval1 = testval2 = 0;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	KASSERT(rwreaders == 0 && rwwriters == 0);
+	kprintf("%u upgrades succeeded\n", rwupgrades);
+	kprintf(rwfailed ? "Test failed\n" : "rwlock test done.\n");
+
+	return 0;
+}
+
+/*
+ * Reader scaling benchmark. Times RWBENCH_LOOPS read-side critical
+ * sections per thread, with 1, 2, 4, and 8 readers, first under an
+ * rwlock and then under a plain lock for comparison. Readers under
+ * the rwlock should overlap on a multiprocessor; under the lock they
+ * cannot.
+ */
+
+static
+void
+rwbenchthread(void *junk, unsigned long userw)
+{
+	int i;
+	volatile int j;
+	(void)junk;
+
+	for (i=0; i<RWBENCH_LOOPS; i++) {
+		if (userw) {
+			rwlock_acquire_read(testrwlock);
+		}
+		else {
+			lock_acquire(testlock);
+		}
+		for (j=0; j<RWBENCH_WORK; j++);
+		if (userw) {
+			rwlock_release_read(testrwlock);
+		}
+		else {
+			lock_release(testlock);
+		}
+	}
+	V(donesem);
+}
+
+int
+rwbench(int nargs, char **args)
+{
+	struct timespec before, after;
+	unsigned nthreads, i, pass;
+	bool userw;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	if (testrwlock == NULL) {
+		testrwlock = rwlock_create("testrwlock");
+		if (testrwlock == NULL) {
+			panic("rwbench: rwlock_create failed\n");
+		}
+	}
+
+	for (pass=0; pass<2; pass++) {
+		userw = (pass == 0);
+		for (nthreads=1; nthreads<=8; nthreads*=2) {
+			gettime(&before);
+			for (i=0; i<nthreads; i++) {
+				result = thread_fork("rwbench", NULL,
+						     rwbenchthread, NULL,
+						     userw);
+				if (result) {
+					panic("rwbench: thread_fork failed: "
+					      "%s\n", strerror(result));
+				}
+			}
+			for (i=0; i<nthreads; i++) {
+				P(donesem);
+			}
+			gettime(&after);
+			timespec_sub(&after, &before, &after);
+
+			kprintf("rwbench: %s readers=%u ops=%u "
+				"time=%llu.%09lu\n",
+				userw ? "rwlock" : "lock", nthreads,
+				nthreads * RWBENCH_LOOPS,
+				(unsigned long long) after.tv_sec,
+				(unsigned long) after.tv_nsec);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Priority inversion test.
+ *
+ * A PRI_MIN thread takes testlock and then a PRI_MAX thread wants it,
+ * while NTHREADS medium-priority threads spin on every cpu. Without
+ * priority inheritance the low thread never gets to run again, and
+ * the high thread waits until the spinners give up after
+ * PITEST_GIVEUP seconds. With it, the low thread runs at PRI_MAX
+ * until it lets go, and the high thread's wait is bounded by the
+ * length of the low thread's critical section.
+ */
+
+#define PITEST_WORK   200000	/* length of the low thread's critical section */
+#define PITEST_GIVEUP 10	/* seconds before the spinners give up */
+
+static volatile bool pitest_stop;
+static struct timespec pitest_waited;
+static struct semaphore *pitest_holding;
+static struct semaphore *pitest_go;
+
+static
+void
+pitest_low(void *junk, unsigned long num)
+{
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_MIN);
+	lock_acquire(testlock);
+	V(pitest_holding);
+	P(pitest_go);
+	for (j=0; j<PITEST_WORK; j++);
+	lock_release(testlock);
+	KASSERT(curthread->t_pri == PRI_MIN);
+	V(donesem);
+}
+
+static
+void
+pitest_medium(void *junk, unsigned long num)
+{
+	struct timespec start, now;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_DEFAULT + 4);
+	gettime(&start);
+	while (!pitest_stop) {
+		gettime(&now);
+		if (now.tv_sec - start.tv_sec >= PITEST_GIVEUP) {
+			break;
+		}
+	}
+	V(donesem);
+}
+
+static
+void
+pitest_high(void *junk, unsigned long num)
+{
+	struct timespec before;
+	int i, result;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_MAX);
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("pitest-medium", NULL, pitest_medium,
+				     NULL, i);
+		if (result) {
+			panic("pitest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	V(pitest_go);
+	gettime(&before);
+	lock_acquire(testlock);
+	gettime(&pitest_waited);
+	pitest_stop = true;
+	lock_release(testlock);
+
+	timespec_sub(&pitest_waited, &before, &pitest_waited);
+	V(donesem);
+}
+
+int
+pitest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	if (pitest_holding == NULL) {
+		pitest_holding = sem_create("pitest_holding", 0);
+		pitest_go = sem_create("pitest_go", 0);
+		if (pitest_holding == NULL || pitest_go == NULL) {
+			panic("pitest: sem_create failed\n");
+		}
+	}
+	kprintf("Starting priority inheritance test...\n");
+
+	pitest_stop = false;
+
+	result = thread_fork("pitest-low", NULL, pitest_low, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	P(pitest_holding);
+
+	result = thread_fork("pitest-high", NULL, pitest_high, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	for (i=0; i<NTHREADS+2; i++) {
+		P(donesem);
+	}
+
+	kprintf("High-priority thread waited %llu.%09lu seconds\n",
+		(unsigned long long) pitest_waited.tv_sec,
+		(unsigned long) pitest_waited.tv_nsec);
+	if (pitest_waited.tv_sec >= PITEST_GIVEUP) {
+		kprintf("Test failed: priority inversion was not bounded\n");
+	}
+	else {
+		kprintf("Priority inheritance test done.\n");
+	}
+
+	return 0;
+}
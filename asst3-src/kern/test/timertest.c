@@ -0,0 +1,351 @@
+/*
+ * Timer wheel tests.
+ *
+ * tm1 checks that timers fire, not early, and not at all once
+ * cancelled, and times timer_start/timer_cancel with lots of timers
+ * pending; then tries sem_timedP and cv_timedwait.
+ *
+ * tm2 is a benchmark: lots of threads doing short timed sleeps at
+ * once, reporting how late they wake up.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <thread.h>
+#include <synch.h>
+#include <timer.h>
+#include <test.h>
+
+#define TM_NTIMERS	5000		/* timers in tm1 */
+#define TM_MAXDELAY	200000000	/* up to 200 ms */
+#define TM_SLACK	20000000	/* allowed lateness, 20 ms */
+
+#define TB_NTHREADS	1000		/* default sleepers in tm2 */
+#define TB_ROUNDS	10		/* sleeps per thread */
+#define TB_MINSLEEP	100000		/* 100 us */
+#define TB_MAXSLEEP	20000000	/* 20 ms */
+
+struct tmrec {
+	struct timer tr_timer;
+	uint64_t tr_due;		/* earliest allowed firing */
+	volatile uint64_t tr_fired;	/* when it did, or 0 */
+};
+
+static struct semaphore *tm_donesem;
+
+static
+void
+tm_fire(void *data)
+{
+	struct tmrec *tr = data;
+
+	tr->tr_fired = timer_now();
+	V(tm_donesem);
+}
+
+static
+uint64_t
+tm_delay(uint64_t max)
+{
+	return ((uint64_t)random() * random()) % max;
+}
+
+/*
+ * Start a lot of timers, cancel a third of them, and check the rest.
+ */
+static
+bool
+tm_firetest(void)
+{
+	struct tmrec *recs;
+	uint64_t now, late, maxlate;
+	unsigned i, nlive;
+	bool ok = true;
+
+	recs = kmalloc(TM_NTIMERS * sizeof(*recs));
+	if (recs == NULL) {
+		kprintf("tm1: Out of memory\n");
+		return false;
+	}
+
+	nlive = 0;
+	for (i=0; i<TM_NTIMERS; i++) {
+		timer_init(&recs[i].tr_timer, tm_fire, &recs[i]);
+		recs[i].tr_fired = 0;
+		now = timer_now();
+		recs[i].tr_due = now + tm_delay(TM_MAXDELAY);
+		timer_start(&recs[i].tr_timer, recs[i].tr_due - now);
+	}
+	for (i=0; i<TM_NTIMERS; i++) {
+		if (i % 3 == 0 && timer_cancel(&recs[i].tr_timer)) {
+			continue;
+		}
+		nlive++;
+	}
+	for (i=0; i<nlive; i++) {
+		P(tm_donesem);
+	}
+
+	maxlate = 0;
+	for (i=0; i<TM_NTIMERS; i++) {
+		if (recs[i].tr_fired == 0) {
+			if (i % 3 != 0) {
+				kprintf("tm1: timer %u never fired\n", i);
+				ok = false;
+			}
+			continue;
+		}
+		if (recs[i].tr_fired < recs[i].tr_due) {
+			kprintf("tm1: timer %u fired %llu ns early\n", i,
+				(unsigned long long)
+				(recs[i].tr_due - recs[i].tr_fired));
+			ok = false;
+			continue;
+		}
+		late = recs[i].tr_fired - recs[i].tr_due;
+		if (late > maxlate) {
+			maxlate = late;
+		}
+	}
+	if (timer_npending() != 0) {
+		kprintf("tm1: %u timers still pending\n", timer_npending());
+		ok = false;
+	}
+	kprintf("tm1: %u of %u timers fired, max lateness %llu us\n",
+		nlive, TM_NTIMERS, (unsigned long long)(maxlate / 1000));
+	if (maxlate > TM_SLACK) {
+		kprintf("tm1: (that's too late)\n");
+		ok = false;
+	}
+
+	kfree(recs);
+	return ok;
+}
+
+/*
+ * Time starting and cancelling timers with a crowd already pending.
+ */
+static
+void
+tm_costtest(void)
+{
+	struct tmrec *recs;
+	uint64_t before, after;
+	unsigned i;
+
+	recs = kmalloc(TM_NTIMERS * sizeof(*recs));
+	if (recs == NULL) {
+		kprintf("tm1: Out of memory\n");
+		return;
+	}
+	for (i=0; i<TM_NTIMERS; i++) {
+		timer_init(&recs[i].tr_timer, tm_fire, &recs[i]);
+	}
+
+	before = timer_now();
+	for (i=0; i<TM_NTIMERS; i++) {
+		/* far enough out that none of them go off */
+		timer_start(&recs[i].tr_timer,
+			    1000000000ULL + tm_delay(1000000000ULL * 3600));
+	}
+	after = timer_now();
+	kprintf("tm1: timer_start: %llu ns each with up to %u pending\n",
+		(unsigned long long)((after - before) / TM_NTIMERS),
+		TM_NTIMERS);
+
+	before = timer_now();
+	for (i=0; i<TM_NTIMERS; i++) {
+		timer_cancel(&recs[i].tr_timer);
+	}
+	after = timer_now();
+	kprintf("tm1: timer_cancel: %llu ns each\n",
+		(unsigned long long)((after - before) / TM_NTIMERS));
+
+	kfree(recs);
+}
+
+static struct lock *tm_lock;
+static struct cv *tm_cv;
+
+static
+void
+tm_signaller(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	timer_sleep(5000000);
+	lock_acquire(tm_lock);
+	cv_signal(tm_cv, tm_lock);
+	lock_release(tm_lock);
+	V(tm_donesem);
+}
+
+/*
+ * sem_timedP and cv_timedwait, both timing out and not.
+ */
+static
+bool
+tm_waittest(void)
+{
+	struct semaphore *sem;
+	uint64_t before, took;
+	bool ok = true;
+	int result;
+
+	sem = sem_create("tm1sem", 0);
+	tm_lock = lock_create("tm1lock");
+	tm_cv = cv_create("tm1cv");
+	if (sem == NULL || tm_lock == NULL || tm_cv == NULL) {
+		panic("tm1: Out of memory\n");
+	}
+
+	before = timer_now();
+	result = sem_timedP(sem, 3000000);
+	took = timer_now() - before;
+	if (result != ETIMEDOUT || took < 3000000) {
+		kprintf("tm1: sem_timedP returned %d after %llu us\n",
+			result, (unsigned long long)(took / 1000));
+		ok = false;
+	}
+
+	V(sem);
+	if (sem_timedP(sem, 3000000) != 0) {
+		kprintf("tm1: sem_timedP failed with count 1\n");
+		ok = false;
+	}
+
+	lock_acquire(tm_lock);
+	before = timer_now();
+	result = cv_timedwait(tm_cv, tm_lock, 500000);
+	took = timer_now() - before;
+	if (result != ETIMEDOUT || took < 500000 ||
+	    !lock_do_i_hold(tm_lock)) {
+		kprintf("tm1: cv_timedwait returned %d after %llu us\n",
+			result, (unsigned long long)(took / 1000));
+		ok = false;
+	}
+
+	result = thread_fork("tm1", NULL, tm_signaller, NULL, 0);
+	if (result) {
+		panic("tm1: thread_fork failed: %s\n", strerror(result));
+	}
+	result = cv_timedwait(tm_cv, tm_lock, 1000000000);
+	lock_release(tm_lock);
+	P(tm_donesem);
+	if (result != 0) {
+		kprintf("tm1: cv_timedwait timed out despite signal\n");
+		ok = false;
+	}
+
+	cv_destroy(tm_cv);
+	lock_destroy(tm_lock);
+	sem_destroy(sem);
+	return ok;
+}
+
+int
+timertest(int nargs, char **args)
+{
+	bool ok;
+
+	(void)nargs;
+	(void)args;
+
+	tm_donesem = sem_create("tm1done", 0);
+	if (tm_donesem == NULL) {
+		panic("tm1: Out of memory\n");
+	}
+
+	kprintf("Starting timer test...\n");
+	ok = tm_firetest();
+	tm_costtest();
+	ok = tm_waittest() && ok;
+	kprintf("Timer test %s\n", ok ? "done" : "FAILED");
+
+	sem_destroy(tm_donesem);
+	tm_donesem = NULL;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+static struct semaphore *tb_donesem;
+static struct spinlock tb_statlock = SPINLOCK_INITIALIZER;
+static uint64_t tb_totallate, tb_maxlate;
+
+static
+void
+tb_sleeper(void *junk, unsigned long num)
+{
+	uint64_t want, before, late;
+	unsigned i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<TB_ROUNDS; i++) {
+		want = TB_MINSLEEP + tm_delay(TB_MAXSLEEP - TB_MINSLEEP);
+		before = timer_now();
+		timer_sleep(want);
+		late = timer_now() - before - want;
+
+		spinlock_acquire(&tb_statlock);
+		tb_totallate += late;
+		if (late > tb_maxlate) {
+			tb_maxlate = late;
+		}
+		spinlock_release(&tb_statlock);
+	}
+	V(tb_donesem);
+}
+
+int
+timerbench(int nargs, char **args)
+{
+	unsigned nthreads, i;
+	uint64_t before, after;
+	int result;
+
+	nthreads = TB_NTHREADS;
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+	}
+	if (nthreads == 0) {
+		kprintf("Usage: tm2 [nthreads]\n");
+		return EINVAL;
+	}
+
+	tb_donesem = sem_create("tm2done", 0);
+	if (tb_donesem == NULL) {
+		panic("tm2: Out of memory\n");
+	}
+	tb_totallate = 0;
+	tb_maxlate = 0;
+
+	kprintf("tm2: %u threads x %u sleeps of %u-%u us\n", nthreads,
+		TB_ROUNDS, TB_MINSLEEP / 1000, TB_MAXSLEEP / 1000);
+	before = timer_now();
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("tm2", NULL, tb_sleeper, NULL, i);
+		if (result) {
+			panic("tm2: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(tb_donesem);
+	}
+	after = timer_now();
+
+	kprintf("tm2: done in %llu ms; average lateness %llu us, "
+		"max %llu us\n",
+		(unsigned long long)((after - before) / 1000000),
+		(unsigned long long)
+		(tb_totallate / ((uint64_t)nthreads * TB_ROUNDS) / 1000),
+		(unsigned long long)(tb_maxlate / 1000));
+
+	sem_destroy(tb_donesem);
+	tb_donesem = NULL;
+	return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * Workqueue test.
+ *
+ * wq1 queues lots of work from thread context and from timer
+ * (interrupt) context, checks that each item runs exactly once,
+ * checks delayed work isn't run early, and checks that cancelled
+ * work doesn't run at all. Then it prints the workqueue stats.
+ */
+#include <types.h>
+#include <lib.h>
+#include <thread.h>
+#include <synch.h>
+#include <timer.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define WQ_NITEMS	1000
+#define WQ_DELAY	5000000		/* 5 ms */
+
+struct wqrec {
+	struct work wr_work;
+	struct timer wr_timer;		/* for queueing from interrupts */
+	uint64_t wr_due;		/* for delayed work */
+	volatile unsigned wr_runs;
+	unsigned wr_expect;		/* how many times it should run */
+	volatile bool wr_early;
+};
+
+static struct workqueue *wq_testq;
+static struct semaphore *wq_donesem;
+
+static
+void
+wq_func(void *data)
+{
+	struct wqrec *wr = data;
+
+	if (wr->wr_due != 0 && timer_now() < wr->wr_due) {
+		wr->wr_early = true;
+	}
+	wr->wr_runs++;
+	V(wq_donesem);
+}
+
+static
+void
+wq_fromintr(void *data)
+{
+	struct wqrec *wr = data;
+
+	work_enqueue(wq_testq, &wr->wr_work);
+}
+
+static
+struct wqrec *
+wq_makerecs(void)
+{
+	struct wqrec *recs;
+	unsigned i;
+
+	recs = kmalloc(WQ_NITEMS * sizeof(*recs));
+	if (recs == NULL) {
+		panic("wq1: Out of memory\n");
+	}
+	for (i=0; i<WQ_NITEMS; i++) {
+		work_init(&recs[i].wr_work, wq_func, &recs[i]);
+		timer_init(&recs[i].wr_timer, wq_fromintr, &recs[i]);
+		recs[i].wr_due = 0;
+		recs[i].wr_runs = 0;
+		recs[i].wr_expect = 1;
+		recs[i].wr_early = false;
+	}
+	return recs;
+}
+
+static
+bool
+wq_checkrecs(const char *what, struct wqrec *recs)
+{
+	unsigned i;
+	bool ok = true;
+
+	for (i=0; i<WQ_NITEMS; i++) {
+		if (recs[i].wr_runs != recs[i].wr_expect) {
+			kprintf("wq1: %s: item %u ran %u times, not %u\n",
+				what, i, recs[i].wr_runs, recs[i].wr_expect);
+			ok = false;
+		}
+		if (recs[i].wr_early) {
+			kprintf("wq1: %s: item %u ran early\n", what, i);
+			ok = false;
+		}
+	}
+	kprintf("wq1: %s: %s\n", what, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/*
+ * Queue every item from here, twice. The second time should be
+ * refused unless the item has already started.
+ */
+static
+bool
+wq_threadtest(void)
+{
+	struct wqrec *recs;
+	unsigned i, total = 0;
+	bool ok;
+
+	recs = wq_makerecs();
+	for (i=0; i<WQ_NITEMS; i++) {
+		work_enqueue(wq_testq, &recs[i].wr_work);
+		if (work_enqueue(wq_testq, &recs[i].wr_work)) {
+			recs[i].wr_expect++;
+		}
+		total += recs[i].wr_expect;
+	}
+	for (i=0; i<total; i++) {
+		P(wq_donesem);
+	}
+	ok = wq_checkrecs("thread context", recs);
+	kfree(recs);
+	return ok;
+}
+
+/*
+ * Queue every item from a timer function.
+ */
+static
+bool
+wq_intrtest(void)
+{
+	struct wqrec *recs;
+	unsigned i;
+	bool ok;
+
+	recs = wq_makerecs();
+	for (i=0; i<WQ_NITEMS; i++) {
+		timer_start(&recs[i].wr_timer, random() % WQ_DELAY);
+	}
+	for (i=0; i<WQ_NITEMS; i++) {
+		P(wq_donesem);
+	}
+	/* make sure no timer function is still on its way out */
+	for (i=0; i<WQ_NITEMS; i++) {
+		timer_cancel(&recs[i].wr_timer);
+	}
+	ok = wq_checkrecs("interrupt context", recs);
+	kfree(recs);
+	return ok;
+}
+
+/*
+ * Delayed work, with every third item cancelled.
+ */
+static
+bool
+wq_delaytest(void)
+{
+	struct wqrec *recs;
+	unsigned i, nlive;
+	bool ok;
+
+	recs = wq_makerecs();
+	for (i=0; i<WQ_NITEMS; i++) {
+		recs[i].wr_due = timer_now() + WQ_DELAY;
+		work_enqueue_delayed(wq_testq, &recs[i].wr_work, WQ_DELAY);
+	}
+	nlive = 0;
+	for (i=0; i<WQ_NITEMS; i++) {
+		if (i % 3 == 0 && work_cancel(&recs[i].wr_work)) {
+			recs[i].wr_expect = 0;
+			continue;
+		}
+		nlive++;
+	}
+	for (i=0; i<nlive; i++) {
+		P(wq_donesem);
+	}
+	/* give any wrongly-run cancelled items time to show up */
+	timer_sleep(2 * WQ_DELAY);
+	ok = wq_checkrecs("delayed and cancelled", recs);
+	kfree(recs);
+	return ok;
+}
+
+int
+wqtest(int nargs, char **args)
+{
+	bool ok;
+
+	(void)nargs;
+	(void)args;
+
+	if (wq_testq == NULL) {
+		/* workqueues are forever, so keep it for next time */
+		wq_testq = workqueue_create("wqtest", PRI_DEFAULT);
+		if (wq_testq == NULL) {
+			panic("wq1: Out of memory\n");
+		}
+	}
+	wq_donesem = sem_create("wq1done", 0);
+	if (wq_donesem == NULL) {
+		panic("wq1: Out of memory\n");
+	}
+
+	kprintf("Starting workqueue test...\n");
+	ok = wq_threadtest();
+	ok = wq_intrtest() && ok;
+	ok = wq_delaytest() && ok;
+	workqueue_stats();
+	kprintf("Workqueue test %s\n", ok ? "done" : "FAILED");
+
+	sem_destroy(wq_donesem);
+	wq_donesem = NULL;
+	return 0;
+}
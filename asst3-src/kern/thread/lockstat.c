@@ -0,0 +1,254 @@
+/*
+ * Lock contention statistics.
+ *
+ * lock_acquire, spinlock_acquire, P, and cv_wait report here; see
+ * lockstat.h. Records are aggregated by object name, so all the
+ * "openfile" locks in the system share one line of output.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <clock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_HASHSIZE	64
+
+volatile bool lockstat_enabled = false;
+
+/* Hash table of records. Chains are only ever prepended to. */
+static struct lockstat *lockstat_table[LOCKSTAT_HASHSIZE];
+static struct spinlock lockstat_tablelock = SPINLOCK_INITIALIZER;
+
+static const char *const lockstat_kindnames[] = {
+	"lock", "spin", "sem", "cv",
+};
+
+static
+unsigned
+lockstat_hash(const char *name, unsigned kind)
+{
+	unsigned h = kind;
+
+	while (*name) {
+		h = h*31 + (unsigned char)*name++;
+	}
+	return h % LOCKSTAT_HASHSIZE;
+}
+
+static
+struct lockstat *
+lockstat_find(unsigned h, const char *name, unsigned kind)
+{
+	struct lockstat *ls;
+
+	for (ls = lockstat_table[h]; ls != NULL; ls = ls->ls_next) {
+		if (ls->ls_kind == kind && !strcmp(ls->ls_name, name)) {
+			return ls;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Lock and unlock a record's counters. Callers are at splhigh.
+ */
+static
+void
+lockstat_guard(struct lockstat *ls)
+{
+	while (spinlock_data_get(&ls->ls_guard) != 0 ||
+	       spinlock_data_testandset(&ls->ls_guard) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+}
+
+static
+void
+lockstat_unguard(struct lockstat *ls)
+{
+	membar_any_store();
+	spinlock_data_set(&ls->ls_guard, 0);
+}
+
+struct lockstat *
+lockstat_get(const char *name, unsigned kind)
+{
+	struct lockstat *ls, *newls;
+	unsigned h;
+
+	h = lockstat_hash(name, kind);
+
+	/* Records are never removed, so look without locking first. */
+	ls = lockstat_find(h, name, kind);
+	if (ls != NULL) {
+		return ls;
+	}
+
+	/* Allocate outside the table lock; kmalloc may be slow. */
+	newls = kmalloc(sizeof(*newls));
+	if (newls == NULL) {
+		return NULL;
+	}
+	newls->ls_name = kstrdup(name);
+	if (newls->ls_name == NULL) {
+		kfree(newls);
+		return NULL;
+	}
+	newls->ls_kind = kind;
+	spinlock_data_set(&newls->ls_guard, 0);
+	newls->ls_acquires = 0;
+	newls->ls_contended = 0;
+	newls->ls_waittotal = 0;
+	newls->ls_waitmax = 0;
+	newls->ls_holdtotal = 0;
+	newls->ls_holdmax = 0;
+
+	spinlock_acquire(&lockstat_tablelock);
+	ls = lockstat_find(h, name, kind);
+	if (ls == NULL) {
+		newls->ls_next = lockstat_table[h];
+		membar_store_store();
+		lockstat_table[h] = newls;
+		ls = newls;
+		newls = NULL;
+	}
+	spinlock_release(&lockstat_tablelock);
+
+	if (newls != NULL) {
+		/* lost a race with someone else creating it */
+		kfree((char *)newls->ls_name);
+		kfree(newls);
+	}
+	return ls;
+}
+
+void
+lockstat_spinlock(struct spinlock *splk, const char *name)
+{
+	splk->splk_stat = lockstat_get(name, LOCKSTAT_SPIN);
+}
+
+uint64_t
+lockstat_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t
+lockstat_acquired(struct lockstat *ls, bool contended, uint64_t waitstart)
+{
+	uint64_t now, wait;
+	int spl;
+
+	now = lockstat_now();
+	wait = (contended && waitstart != 0) ? now - waitstart : 0;
+
+	spl = splhigh();
+	lockstat_guard(ls);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		ls->ls_waittotal += wait;
+		if (wait > ls->ls_waitmax) {
+			ls->ls_waitmax = wait;
+		}
+	}
+	lockstat_unguard(ls);
+	splx(spl);
+
+	return now;
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t acquired)
+{
+	uint64_t hold;
+	int spl;
+
+	if (acquired == 0) {
+		return;
+	}
+	hold = lockstat_now() - acquired;
+
+	spl = splhigh();
+	lockstat_guard(ls);
+	ls->ls_holdtotal += hold;
+	if (hold > ls->ls_holdmax) {
+		ls->ls_holdmax = hold;
+	}
+	lockstat_unguard(ls);
+	splx(spl);
+}
+
+void
+lockstat_enable(bool on)
+{
+	lockstat_enabled = on;
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	for (i=0; i<LOCKSTAT_HASHSIZE; i++) {
+		for (ls = lockstat_table[i]; ls != NULL; ls = ls->ls_next) {
+			spl = splhigh();
+			lockstat_guard(ls);
+			ls->ls_acquires = 0;
+			ls->ls_contended = 0;
+			ls->ls_waittotal = 0;
+			ls->ls_waitmax = 0;
+			ls->ls_holdtotal = 0;
+			ls->ls_holdmax = 0;
+			lockstat_unguard(ls);
+			splx(spl);
+		}
+	}
+}
+
+void
+lockstat_dump(void)
+{
+	struct lockstat *ls, snap;
+	unsigned i;
+	int spl;
+
+	kprintf("lockstat: collection is %s; times in microseconds\n",
+		lockstat_enabled ? "on" : "off");
+	kprintf("%-20s %-4s %9s %9s %11s %9s %11s %9s\n",
+		"name", "kind", "acquires", "contended",
+		"wait", "maxwait", "hold", "maxhold");
+
+	for (i=0; i<LOCKSTAT_HASHSIZE; i++) {
+		for (ls = lockstat_table[i]; ls != NULL; ls = ls->ls_next) {
+			/* take a consistent snapshot before printing */
+			spl = splhigh();
+			lockstat_guard(ls);
+			snap = *ls;
+			lockstat_unguard(ls);
+			splx(spl);
+
+			if (snap.ls_acquires == 0) {
+				continue;
+			}
+			kprintf("%-20s %-4s %9u %9u %11llu %9llu %11llu %9llu\n",
+				snap.ls_name,
+				lockstat_kindnames[snap.ls_kind],
+				snap.ls_acquires, snap.ls_contended,
+				(unsigned long long)(snap.ls_waittotal / 1000),
+				(unsigned long long)(snap.ls_waitmax / 1000),
+				(unsigned long long)(snap.ls_holdtotal / 1000),
+				(unsigned long long)(snap.ls_holdmax / 1000));
+		}
+	}
+}
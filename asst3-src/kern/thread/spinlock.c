@@ -38,6 +38,7 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -52,6 +53,8 @@ spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+	splk->splk_stat = NULL;
+	splk->splk_acquired = 0;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
 }
 
@@ -76,6 +79,8 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	bool contended = false;
+	uint64_t waitstart = 0;
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -104,18 +109,31 @@ spinlock_acquire(struct spinlock *splk)
 		 * previously unheld and we now own it. If it was 1,
 		 * we don't.
 		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
+		if (spinlock_data_get(&splk->splk_lock) == 0 &&
+		    spinlock_data_testandset(&splk->splk_lock) == 0) {
+			break;
 		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
+
+		/* Only look at the clock if we actually have to wait. */
+		if (!contended) {
+			contended = true;
+			if (LOCKSTAT_ON(splk->splk_stat)) {
+				waitstart = lockstat_now();
+			}
 		}
-		break;
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
 
+	if (LOCKSTAT_ON(splk->splk_stat)) {
+		splk->splk_acquired = lockstat_acquired(splk->splk_stat,
+							contended, waitstart);
+	}
+	else {
+		splk->splk_acquired = 0;
+	}
+
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
 	}
@@ -135,6 +153,11 @@ spinlock_release(struct spinlock *splk)
 		HANGMAN_RELEASE(&curcpu->c_hangman, &splk->splk_hangman);
 	}
 
+	if (splk->splk_acquired != 0 && splk->splk_stat != NULL) {
+		lockstat_released(splk->splk_stat, splk->splk_acquired);
+		splk->splk_acquired = 0;
+	}
+
 	splk->splk_holder = NULL;
 	membar_any_store();
 	spinlock_data_set(&splk->splk_lock, 0);
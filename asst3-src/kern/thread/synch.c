@@ -33,12 +33,16 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
+#include <threadprivate.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
+#include <timer.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -68,7 +72,9 @@ sem_create(const char *name, unsigned initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+	lockstat_spinlock(&sem->sem_lock, sem->sem_name);
 	sem->sem_count = initial_count;
+	sem->sem_stat = lockstat_get(sem->sem_name, LOCKSTAT_SEM);
 
 	return sem;
 }
@@ -88,6 +94,9 @@ sem_destroy(struct semaphore *sem)
 void
 P(struct semaphore *sem)
 {
+	bool contended;
+	uint64_t waitstart = 0;
+
 	KASSERT(sem != NULL);
 
 	/*
@@ -100,6 +109,10 @@ P(struct semaphore *sem)
 
 	/* Use the semaphore spinlock to protect the wchan as well. */
 	spinlock_acquire(&sem->sem_lock);
+	contended = (sem->sem_count == 0);
+	if (contended && LOCKSTAT_ON(sem->sem_stat)) {
+		waitstart = lockstat_now();
+	}
 	while (sem->sem_count == 0) {
 		/*
 		 *
@@ -117,9 +130,55 @@ P(struct semaphore *sem)
 	}
 	KASSERT(sem->sem_count > 0);
 	sem->sem_count--;
+	if (LOCKSTAT_ON(sem->sem_stat)) {
+		lockstat_acquired(sem->sem_stat, contended, waitstart);
+	}
 	spinlock_release(&sem->sem_lock);
 }
 
+/*
+ * P, but give up after NSECS nanoseconds.
+ */
+int
+sem_timedP(struct semaphore *sem, uint64_t nsecs)
+{
+	bool contended;
+	uint64_t now, deadline, waitstart = 0;
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	deadline = timer_now() + nsecs;
+
+	spinlock_acquire(&sem->sem_lock);
+	contended = (sem->sem_count == 0);
+	if (contended && LOCKSTAT_ON(sem->sem_stat)) {
+		waitstart = lockstat_now();
+	}
+	while (sem->sem_count == 0) {
+		/*
+		 * Check the clock rather than wchan_sleep_timeout's
+		 * result, so a spurious wakeup or a V that another
+		 * thread beat us to just goes back to sleep for
+		 * whatever time is left.
+		 */
+		now = timer_now();
+		if (now >= deadline) {
+			spinlock_release(&sem->sem_lock);
+			return ETIMEDOUT;
+		}
+		(void)wchan_sleep_timeout(sem->sem_wchan, &sem->sem_lock,
+					  deadline - now);
+	}
+	KASSERT(sem->sem_count > 0);
+	sem->sem_count--;
+	if (LOCKSTAT_ON(sem->sem_stat)) {
+		lockstat_acquired(sem->sem_stat, contended, waitstart);
+	}
+	spinlock_release(&sem->sem_lock);
+	return 0;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -138,6 +197,107 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Priority inheritance.
+ *
+ * A thread that blocks in lock_acquire records the lock in its
+ * t_waitlock and lends its priority to the lock's holder. If the
+ * holder is itself blocked on a lock, the loan is passed along to
+ * that lock's holder, and so on down the chain. Each lock remembers
+ * the highest priority among its waiters in lk_waitpri, and a
+ * thread's effective priority is the maximum of its base priority
+ * and the lk_waitpri of every lock it holds; it is recomputed on
+ * release, which is what gives the loan back.
+ *
+ * All the cross-thread priority state (t_pri, t_basepri, t_waitlock,
+ * lk_waitpri, lk_nwaiters) is protected by one global spinlock,
+ * lock_pilock, which nests inside the per-lock spinlocks and outside
+ * the run queue locks. It is only taken when a lock is contended:
+ * while a lock has no waiters, and the releasing thread hasn't been
+ * lent anything, acquire and release don't touch it.
+ *
+ * While lk_nwaiters is nonzero, lk_holder only changes with
+ * lock_pilock held too, so the chain walk in lock_pi_lend can follow
+ * t_waitlock -> lk_holder safely.
+ */
+static struct spinlock lock_pilock = SPINLOCK_INITIALIZER;
+
+/*
+ * Lend priority PRI to the holder of LOCK, and transitively to
+ * whatever it is blocked on. Stops as soon as it finds someone who
+ * already has at least PRI. Must hold lock_pilock.
+ */
+static
+void
+lock_pi_lend(struct lock *lock, int pri)
+{
+	struct thread *holder;
+
+	while (lock != NULL && pri > lock->lk_waitpri) {
+		lock->lk_waitpri = pri;
+		holder = lock->lk_holder;
+		if (holder == NULL || holder->t_pri >= pri) {
+			break;
+		}
+		thread_reprioritize(holder, pri);
+		lock = holder->t_waitlock;
+	}
+}
+
+/*
+ * Compute the current thread's effective priority from its base
+ * priority and the locks it holds. Must hold lock_pilock.
+ */
+static
+int
+lock_pi_effective(void)
+{
+	struct lock *lock;
+	int pri;
+
+	pri = curthread->t_basepri;
+	for (lock = curthread->t_heldlocks; lock != NULL;
+	     lock = lock->lk_nextheld) {
+		if (lock->lk_waitpri > pri) {
+			pri = lock->lk_waitpri;
+		}
+	}
+	return pri;
+}
+
+/*
+ * Remove LOCK from the current thread's list of held locks. The
+ * list is private to the thread so this needs no extra locking.
+ */
+static
+void
+lock_unlink_held(struct lock *lock)
+{
+	struct lock **pp;
+
+	for (pp = &curthread->t_heldlocks; *pp != NULL;
+	     pp = &(*pp)->lk_nextheld) {
+		if (*pp == lock) {
+			*pp = lock->lk_nextheld;
+			lock->lk_nextheld = NULL;
+			return;
+		}
+	}
+	panic("lock_release: %s not on %s's held list\n",
+	      lock->lk_name, curthread->t_name);
+}
+
+void
+thread_setpriority(int pri)
+{
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	spinlock_acquire(&lock_pilock);
+	curthread->t_basepri = pri;
+	curthread->t_pri = lock_pi_effective();
+	spinlock_release(&lock_pilock);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -163,7 +323,13 @@ lock_create(const char *name)
 		return NULL;
 	}
 	spinlock_init(&lock->lk_lock);
+	lockstat_spinlock(&lock->lk_lock, lock->lk_name);
 	lock->lk_holder = NULL;
+	lock->lk_stat = lockstat_get(lock->lk_name, LOCKSTAT_LOCK);
+	lock->lk_acquired = 0;
+	lock->lk_nextheld = NULL;
+	lock->lk_nwaiters = 0;
+	lock->lk_waitpri = PRI_NONE;
 
 	return lock;
 }
@@ -174,6 +340,7 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	KASSERT(lock->lk_nwaiters == 0);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -184,6 +351,9 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+	bool contended;
+	uint64_t waitstart = 0;
+
 	DEBUGASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
 
@@ -193,11 +363,46 @@ lock_acquire(struct lock *lock)
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
-	while (lock->lk_holder != NULL) {
-		/* As in the semaphore. */
-		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+	contended = (lock->lk_holder != NULL);
+	if (contended && LOCKSTAT_ON(lock->lk_stat)) {
+		waitstart = lockstat_now();
+	}
+	if (lock->lk_holder == NULL && lock->lk_nwaiters == 0) {
+		/* Uncontended; no priority bookkeeping needed. */
+		lock->lk_holder = curthread;
+	}
+	else {
+		spinlock_acquire(&lock_pilock);
+		lock->lk_nwaiters++;
+		curthread->t_waitlock = lock;
+		while (lock->lk_holder != NULL) {
+			lock_pi_lend(lock, curthread->t_pri);
+			spinlock_release(&lock_pilock);
+			/* As in the semaphore. */
+			wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+			spinlock_acquire(&lock_pilock);
+		}
+		lock->lk_nwaiters--;
+		curthread->t_waitlock = NULL;
+		lock->lk_holder = curthread;
+
+		/* Inherit from whoever is still waiting. */
+		lock->lk_waitpri = wchan_maxpri(lock->lk_wchan,
+						&lock->lk_lock);
+		if (lock->lk_waitpri > curthread->t_pri) {
+			curthread->t_pri = lock->lk_waitpri;
+		}
+		spinlock_release(&lock_pilock);
+	}
+	lock->lk_nextheld = curthread->t_heldlocks;
+	curthread->t_heldlocks = lock;
+	if (LOCKSTAT_ON(lock->lk_stat)) {
+		lock->lk_acquired = lockstat_acquired(lock->lk_stat,
+						      contended, waitstart);
+	}
+	else {
+		lock->lk_acquired = 0;
 	}
-	lock->lk_holder = curthread;
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -213,7 +418,22 @@ lock_release(struct lock *lock)
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
-	lock->lk_holder = NULL;
+	if (lock->lk_acquired != 0 && lock->lk_stat != NULL) {
+		lockstat_released(lock->lk_stat, lock->lk_acquired);
+		lock->lk_acquired = 0;
+	}
+	lock_unlink_held(lock);
+	if (lock->lk_nwaiters == 0 &&
+	    curthread->t_pri == curthread->t_basepri) {
+		lock->lk_holder = NULL;
+	}
+	else {
+		/* Hand back anything lent to us through this lock. */
+		spinlock_acquire(&lock_pilock);
+		lock->lk_holder = NULL;
+		curthread->t_pri = lock_pi_effective();
+		spinlock_release(&lock_pilock);
+	}
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 
 	/* Call this (atomically) when the lock is released */
@@ -265,6 +485,8 @@ cv_create(const char *name)
 	}
 
 	spinlock_init(&cv->cv_wchanlock);
+	lockstat_spinlock(&cv->cv_wchanlock, cv->cv_name);
+	cv->cv_stat = lockstat_get(cv->cv_name, LOCKSTAT_CV);
 	return cv;
 }
 
@@ -283,9 +505,17 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+	uint64_t waitstart = 0;
+
 	spinlock_acquire(&cv->cv_wchanlock);
+	if (LOCKSTAT_ON(cv->cv_stat)) {
+		waitstart = lockstat_now();
+	}
 	lock_release(lock);
 	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
+	if (LOCKSTAT_ON(cv->cv_stat)) {
+		lockstat_acquired(cv->cv_stat, true, waitstart);
+	}
 	/*
 	 * It is kind of silly to acquire this spinlock in wchan_sleep
 	 * and then release it right away. If we were going for
@@ -298,6 +528,26 @@ cv_wait(struct cv *cv, struct lock *lock)
 	lock_acquire(lock);
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, uint64_t nsecs)
+{
+	uint64_t waitstart = 0;
+	int result;
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	if (LOCKSTAT_ON(cv->cv_stat)) {
+		waitstart = lockstat_now();
+	}
+	lock_release(lock);
+	result = wchan_sleep_timeout(cv->cv_wchan, &cv->cv_wchanlock, nsecs);
+	if (result == 0 && LOCKSTAT_ON(cv->cv_stat)) {
+		lockstat_acquired(cv->cv_stat, true, waitstart);
+	}
+	spinlock_release(&cv->cv_wchanlock);
+	lock_acquire(lock);
+	return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -315,3 +565,177 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	lockstat_spinlock(&rw->rw_lock, rw->rwlock_name);
+	rw->rw_readers = 0;
+	rw->rw_readwait = 0;
+	rw->rw_writewait = 0;
+	rw->rw_readpass = 0;
+	rw->rw_writer = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+	kfree(rw->rwlock_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer != curthread);
+	/*
+	 * Wait while a writer holds the lock, and also while one is
+	 * waiting, unless a writer has just released the lock and
+	 * passed it over to the readers queued behind it.
+	 */
+	while (rw->rw_writer != NULL ||
+	       (rw->rw_writewait > 0 && rw->rw_readpass == 0)) {
+		rw->rw_readwait++;
+		wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+		rw->rw_readwait--;
+	}
+	if (rw->rw_readpass > 0) {
+		rw->rw_readpass--;
+	}
+	rw->rw_readers++;
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_readpass == 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer != curthread);
+	while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+	       rw->rw_readpass > 0) {
+		rw->rw_writewait++;
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+		rw->rw_writewait--;
+	}
+	rw->rw_writer = curthread;
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer == curthread);
+	KASSERT(rw->rw_readers == 0);
+	rw->rw_writer = NULL;
+
+	if (rw->rw_readwait > 0) {
+		/*
+		 * Let everyone who queued up behind us in before the
+		 * next writer. Readers that arrive later still wait.
+		 */
+		rw->rw_readpass = rw->rw_readwait;
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	else {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_tryupgrade(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	ret = (rw->rw_readers == 1);
+	if (ret) {
+		rw->rw_readers = 0;
+		rw->rw_writer = curthread;
+	}
+
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
+}
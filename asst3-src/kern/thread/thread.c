@@ -53,11 +53,23 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <lockstat.h>
+#include <clock.h>
+#include <timer.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/* Number of exited threads each cpu keeps for reuse by thread_fork. */
+#define THREAD_POOLMAX 16
+
+/* Whether the pools are in use; see thread_pool_enable. */
+static volatile bool thread_pooling = true;
+
+/* Whether idle cpus stop their hardclock; see thread_tickless_enable. */
+static volatile bool thread_tickless = true;
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -111,6 +123,49 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Set up the fields of a new (or recycled) thread. Everything but
+ * the name and the stack.
+ */
+static
+void
+thread_initfields(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_wchan = NULL;
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_proc = NULL;
+	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* Priority fields */
+	thread->t_basepri = PRI_DEFAULT;
+	thread->t_pri = PRI_DEFAULT;
+	thread->t_waitlock = NULL;
+	thread->t_heldlocks = NULL;
+
+	/* Accounting fields */
+	bzero(&thread->t_cputime, sizeof(thread->t_cputime));
+	bzero(&thread->t_procstart, sizeof(thread->t_procstart));
+	thread->t_acctmode = ACCT_SYS;
+
+	/* Affinity fields */
+	thread->t_cpumask = CPUMASK_ALL;
+	thread->t_offcpu = 0;
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,25 +188,8 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
-
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
-
-	/* If you add to struct thread, be sure to initialize here */
-
+	thread_initfields(thread);
 	return thread;
 }
 
@@ -180,12 +218,29 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadpool);
+	c->c_poolhits = 0;
+	c->c_poolmisses = 0;
+	threadlist_init(&c->c_migrants);
+	c->c_moverwchan = NULL;
+	spinlock_init(&c->c_moverlock);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_tickless = false;
+	c->c_tickstops = 0;
+	c->c_devirqs = 0;
+	c->c_ipis = 0;
+	c->c_acctmode = ACCT_SYS;
+	c->c_acctstamp = 0;
+	bzero(c->c_acct, sizeof(c->c_acct));
+	c->c_rqsum = 0;
+	bzero(c->c_topacct, sizeof(c->c_topacct));
+	c->c_toprqsum = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	lockstat_spinlock(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -294,7 +349,14 @@ thread_destroy(struct thread *thread)
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
  *
- * The list of zombies is per-cpu.
+ * Rather than freeing them outright, up to THREAD_POOLMAX zombies
+ * (with their stacks) are kept on a per-cpu pool for thread_fork to
+ * reuse, which saves three kmallocs and three kfrees per thread.
+ * The most recently exited thread goes on the front, since its stack
+ * is the most likely to still be in the cache.
+ *
+ * The list of zombies and the pool are per-cpu. Both are touched
+ * only by their own cpu, at splhigh.
  */
 static
 void
@@ -305,8 +367,78 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (thread_pooling && z->t_stack != NULL &&
+		    curcpu->c_threadpool.tl_count < THREAD_POOLMAX) {
+			KASSERT(z->t_proc == NULL);
+			thread_machdep_cleanup(&z->t_machdep);
+			threadlist_addhead(&curcpu->c_threadpool, z);
+		}
+		else {
+			thread_destroy(z);
+		}
+	}
+}
+
+/*
+ * Take a thread off the current cpu's pool and set it up as a new
+ * thread called NAME. Returns NULL if the pool is empty (or we run
+ * out of memory for the name). The thread comes back with its old
+ * stack, which thread_exit has already checked, still attached.
+ */
+static
+struct thread *
+thread_pool_get(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+	int spl;
+
+	if (!thread_pooling) {
+		return NULL;
 	}
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadpool);
+	if (thread != NULL) {
+		curcpu->c_poolhits++;
+	}
+	else {
+		curcpu->c_poolmisses++;
+	}
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	/* Reuse the old name buffer if the new name fits. */
+	if (strlen(name) <= strlen(thread->t_name)) {
+		strcpy(thread->t_name, name);
+	}
+	else {
+		newname = kstrdup(name);
+		if (newname == NULL) {
+			thread_destroy(thread);
+			return NULL;
+		}
+		kfree(thread->t_name);
+		thread->t_name = newname;
+	}
+
+	thread_initfields(thread);
+	return thread;
+}
+
+void
+thread_pool_enable(bool on)
+{
+	thread_pooling = on;
+}
+
+void
+thread_tickless_enable(bool on)
+{
+	thread_tickless = on;
 }
 
 /*
@@ -423,6 +555,168 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Print interrupt counts for each cpu. The counters are only updated
+ * by their own cpu, so this is a snapshot, not a consistent one.
+ */
+void
+cpu_intrstats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	kprintf("Idle cpus %s their hardclock\n",
+		thread_tickless ? "stop" : "keep");
+	kprintf("%-4s %10s %10s %10s %10s\n",
+		"cpu", "hardclocks", "ipis", "devirqs", "tickstops");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%-4u %10u %10u %10u %10u\n", c->c_number,
+			c->c_hardclocks, c->c_ipis, c->c_devirqs,
+			c->c_tickstops);
+	}
+}
+
+/*
+ * Zero the interrupt counts, to start a measurement. Another cpu may
+ * be counting at the same time, so a count or two can survive.
+ */
+void
+cpu_intrstats_reset(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		c->c_hardclocks = 0;
+		c->c_ipis = 0;
+		c->c_devirqs = 0;
+		c->c_tickstops = 0;
+	}
+}
+
+/*
+ * Print each cpu's thread pool size and how often thread_fork found
+ * something in it. Like cpu_intrstats, not a consistent snapshot.
+ */
+void
+cpu_poolstats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	kprintf("Thread pools are %s\n", thread_pooling ? "on" : "off");
+	kprintf("%-4s %10s %10s %10s\n", "cpu", "pooled", "hits", "misses");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%-4u %10u %10u %10u\n", c->c_number,
+			c->c_threadpool.tl_count, c->c_poolhits,
+			c->c_poolmisses);
+	}
+}
+
+/*
+ * Print how each cpu has spent its time, and its average run queue
+ * length, since the last call (or since boot). Like cpu_intrstats,
+ * the figures are not a consistent snapshot.
+ */
+void
+cpu_loadstats(void)
+{
+	struct cpu *c;
+	uint64_t acct[ACCT_NMODES], total, rqsum, avg;
+	unsigned i, m;
+
+	kprintf("%-4s %7s %7s %7s %7s %8s\n",
+		"cpu", "user%", "sys%", "intr%", "idle%", "runqavg");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+
+		total = 0;
+		for (m=0; m<ACCT_NMODES; m++) {
+			acct[m] = c->c_acct[m] - c->c_topacct[m];
+			c->c_topacct[m] += acct[m];
+			total += acct[m];
+		}
+		rqsum = c->c_rqsum - c->c_toprqsum;
+		c->c_toprqsum += rqsum;
+
+		if (total == 0) {
+			kprintf("%-4u (no data)\n", c->c_number);
+			continue;
+		}
+		/*
+		 * The run queue is sampled every hardclock. An idle
+		 * cpu has no tick, but then its queue is empty, so
+		 * divide by the ticks there would have been.
+		 */
+		avg = rqsum * 100 * 1000000000ULL / (total * HZ);
+		kprintf("%-4u %7llu %7llu %7llu %7llu %5llu.%02llu\n",
+			c->c_number,
+			(unsigned long long)(acct[ACCT_USER] * 100 / total),
+			(unsigned long long)(acct[ACCT_SYS] * 100 / total),
+			(unsigned long long)(acct[ACCT_INTR] * 100 / total),
+			(unsigned long long)(acct[ACCT_IDLE] * 100 / total),
+			(unsigned long long)(avg / 100),
+			(unsigned long long)(avg % 100));
+	}
+}
+
+/*
+ * Per-cpu mover thread.
+ *
+ * A thread that may no longer run on the cpu it's on gets sent away
+ * after it is switched out (see thread_switch), by whichever thread
+ * runs next. If nothing else is ready, there is no next thread, and
+ * idling would happen on the departing thread's own stack; so
+ * thread_switch wakes this one, which does nothing else. Each cpu
+ * has one, pinned to it.
+ */
+static
+void
+thread_mover(void *data1, unsigned long data2)
+{
+	struct cpu *c = data1;
+
+	(void)data2;
+
+	spinlock_acquire(&c->c_moverlock);
+	while (1) {
+		wchan_sleep(c->c_moverwchan, &c->c_moverlock);
+	}
+}
+
+static
+void
+thread_movers_start(void)
+{
+	struct cpu *c;
+	char name[16];
+	unsigned i;
+	int result;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		snprintf(name, sizeof(name), "[mover %u]", i);
+		c->c_moverwchan = wchan_create("mover");
+		if (c->c_moverwchan == NULL) {
+			panic("thread_movers_start: Out of memory\n");
+		}
+		result = thread_fork_oncpu(name, NULL, i, thread_mover, c, 0);
+		if (result) {
+			panic("thread_movers_start: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -443,6 +737,198 @@ thread_start_cpus(void)
 	}
 	sem_destroy(cpu_startup_sem);
 	cpu_startup_sem = NULL;
+
+	thread_movers_start();
+}
+
+/*
+ * Put a thread on a cpu's run queue, behind everything of the same
+ * or higher priority. Usually everything has the same priority, so
+ * start looking from the tail. The run queue must be locked.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct thread *prev;
+
+	THREADLIST_FORALL_REV(prev, c->c_runqueue) {
+		if (prev->t_pri >= t->t_pri) {
+			threadlist_insertafter(&c->c_runqueue, prev, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
+/*
+ * Check if thread T may run on cpu C.
+ */
+static
+inline
+bool
+thread_cpuok(struct thread *t, struct cpu *c)
+{
+	return (t->t_cpumask & ((uint32_t)1 << c->c_number)) != 0;
+}
+
+/*
+ * Choose a cpu for T: the one it's on, if it's allowed there, or
+ * else the allowed cpu with the shortest run queue. The queue
+ * lengths are read without locking; it's only a hint.
+ */
+static
+struct cpu *
+thread_pickcpu(struct thread *t)
+{
+	struct cpu *c, *best;
+	unsigned i;
+
+	if (thread_cpuok(t, t->t_cpu)) {
+		return t->t_cpu;
+	}
+	best = NULL;
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!thread_cpuok(t, c)) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
+/*
+ * Put T, which is ready to run but not on any run queue, on cpu C's
+ * run queue. T must be completely switched out. No run queue lock
+ * may be held, since this takes C's.
+ */
+static
+void
+thread_sendto(struct thread *t, struct cpu *c)
+{
+	spinlock_acquire(&c->c_runqueue_lock);
+	t->t_cpu = c;
+	thread_enqueue(c, t);
+	if (c->c_isidle && c != curcpu->c_self) {
+		ipi_send(c, IPI_UNIDLE);
+	}
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+/*
+ * Send off the threads thread_switch found running on this cpu when
+ * they may no longer use it. This has to wait until after the
+ * switch, when their registers are saved and we're off their stacks,
+ * so it is called (like exorcise) by whichever thread runs next.
+ */
+static
+void
+thread_sendmigrants(void)
+{
+	struct thread *t;
+
+	while ((t = threadlist_remhead(&curcpu->c_migrants)) != NULL) {
+		KASSERT(t != curthread);
+		KASSERT(t->t_state == S_READY);
+		thread_sendto(t, thread_pickcpu(t));
+	}
+}
+
+/*
+ * Change a thread's effective priority.
+ *
+ * If the thread is waiting on a run queue, move it to its new place.
+ * We have to check that it's actually on the queue: a thread being
+ * migrated is S_READY but sits on a private list for a while, and
+ * will be inserted by priority when it lands anyway.
+ */
+void
+thread_reprioritize(struct thread *t, int pri)
+{
+	struct cpu *c;
+	struct thread *q;
+
+	/* t_cpu can change under us until we hold the right lock */
+	while (1) {
+		c = t->t_cpu;
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (c == t->t_cpu) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	t->t_pri = pri;
+	if (t->t_state == S_READY) {
+		THREADLIST_FORALL(q, c->c_runqueue) {
+			if (q == t) {
+				threadlist_remove(&c->c_runqueue, t);
+				thread_enqueue(c, t);
+				break;
+			}
+		}
+	}
+
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+/*
+ * Set a thread's cpu affinity.
+ *
+ * The mask is protected by the run queue lock of t_cpu, which as in
+ * thread_reprioritize can change until we hold it. A thread sitting
+ * on that run queue is moved now. Otherwise it is running, asleep,
+ * or on its way between cpus, and thread_switch, the wakeup code,
+ * or thread_sendmigrants will check the new mask when it next moves.
+ */
+int
+thread_setaffinity(struct thread *t, uint32_t mask)
+{
+	struct cpu *c;
+	struct thread *q;
+	unsigned ncpus;
+	bool moving;
+
+	ncpus = cpuarray_num(&allcpus);
+	if (ncpus < 32) {
+		mask &= ((uint32_t)1 << ncpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	while (1) {
+		c = t->t_cpu;
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (c == t->t_cpu) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	t->t_cpumask = mask;
+	moving = false;
+	if (t->t_state == S_READY && !thread_cpuok(t, c) &&
+	    c->c_curthread != t) {
+		THREADLIST_FORALL(q, c->c_runqueue) {
+			if (q == t) {
+				threadlist_remove(&c->c_runqueue, t);
+				moving = true;
+				break;
+			}
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+
+	if (moving) {
+		thread_sendto(t, thread_pickcpu(t));
+	}
+	return 0;
 }
 
 /*
@@ -469,7 +955,23 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+
+	/*
+	 * If it may no longer run on this cpu, send it to one where it
+	 * may. Holding the run queue lock means it has finished
+	 * switching out, unless the cpu went idle on its stack (see
+	 * thread_switch), in which case it has to come back here
+	 * first. The already_have_lock case is thread_switch's own
+	 * thread, which it deals with itself.
+	 */
+	if (!already_have_lock && !thread_cpuok(target, targetcpu) &&
+	    targetcpu->c_curthread != target) {
+		spinlock_release(&targetcpu->c_runqueue_lock);
+		thread_sendto(target, thread_pickcpu(target));
+		return;
+	}
+
+	thread_enqueue(targetcpu, target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -485,43 +987,46 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common code for thread_fork and thread_fork_oncpu: start the new
+ * thread on cpu C, with cpu mask MASK.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_on(const char *name,
+	       struct proc *proc,
+	       struct cpu *c,
+	       uint32_t mask,
+	       void (*entrypoint)(void *data1, unsigned long data2),
+	       void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	newthread = thread_pool_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = c;
+	newthread->t_basepri = curthread->t_basepri;
+	newthread->t_pri = curthread->t_basepri;
+	newthread->t_cpumask = mask;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -544,12 +1049,48 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock its cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_on(name, proc, curthread->t_cpu,
+			      curthread->t_cpumask, entrypoint, data1, data2);
+}
+
+/*
+ * The same, for a thread that belongs on one cpu. It goes straight
+ * onto that cpu's run queue, so it never runs anywhere else.
+ */
+int
+thread_fork_oncpu(const char *name,
+		  struct proc *proc,
+		  unsigned cpunum,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  void *data1, unsigned long data2)
+{
+	KASSERT(cpunum < cpuarray_num(&allcpus));
+	return thread_fork_on(name, proc, cpuarray_get(&allcpus, cpunum),
+			      (uint32_t)1 << cpunum, entrypoint, data1, data2);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -590,11 +1131,24 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
+	/*
+	 * Micro-optimization: if nothing to do, just return. Unless we
+	 * may no longer run here; then wake the mover so there's
+	 * something to switch to (see thread_mover). Its lock comes
+	 * before the run queue lock, so drop that first.
+	 */
 	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+		if (thread_cpuok(cur, curcpu->c_self) ||
+		    curcpu->c_moverwchan == NULL) {
+			spinlock_release(&curcpu->c_runqueue_lock);
+			splx(spl);
+			return;
+		}
 		spinlock_release(&curcpu->c_runqueue_lock);
-		splx(spl);
-		return;
+		spinlock_acquire(&curcpu->c_moverlock);
+		wchan_wakeone(curcpu->c_moverwchan, &curcpu->c_moverlock);
+		spinlock_release(&curcpu->c_moverlock);
+		spinlock_acquire(&curcpu->c_runqueue_lock);
 	}
 
 	/* Put the thread in the right place. */
@@ -602,10 +1156,23 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		if (thread_cpuok(cur, curcpu->c_self)) {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
+		else {
+			/*
+			 * We may no longer run here, but can't go on
+			 * another cpu's run queue while we're still
+			 * running on this one. The next thread sends
+			 * us on; there is one, because the run queue
+			 * isn't empty (if need be, we woke the mover).
+			 */
+			threadlist_addtail(&curcpu->c_migrants, cur);
+		}
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
+		cur->t_wchan = wc;
 		/*
 		 * Add the thread to the list in the wait channel, and
 		 * unlock same. To avoid a race with someone else
@@ -639,7 +1206,21 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * Note that c_isidle becomes true briefly even if we don't go
 	 * idle. However, because one is supposed to hold the runqueue
 	 * lock to look at it, this should not be visible or matter.
+	 *
+	 * While idle we also stop the hardclock tick: there is
+	 * nothing to schedule, and anything that makes a thread
+	 * runnable here sends us an IPI. Timed sleeps are driven by
+	 * the timerclock, which is not per-cpu. The tick is restarted
+	 * as soon as we have a thread to run.
+	 */
+
+	/*
+	 * Charge the outgoing thread for its time so far, and
+	 * remember what it was doing so that can be charged again
+	 * when it comes back.
 	 */
+	cur->t_acctmode = thread_account(ACCT_SYS);
+	cur->t_offcpu = curcpu->c_acctstamp;
 
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
@@ -647,11 +1228,24 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+			if (thread_tickless && !curcpu->c_tickless) {
+				curcpu->c_tickless = true;
+				curcpu->c_tickstops++;
+				mainbus_hardclock_stop();
+			}
+			thread_account(ACCT_IDLE);
 			cpu_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	if (curcpu->c_acctmode == ACCT_IDLE) {
+		thread_account(ACCT_SYS);
+	}
+	if (curcpu->c_tickless) {
+		curcpu->c_tickless = false;
+		mainbus_hardclock_start();
+	}
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -717,6 +1311,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	cur->t_wchan_name = NULL;
 	cur->t_state = S_RUN;
 
+	/* Resume charging whatever we were doing. */
+	thread_account(cur->t_acctmode);
+
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
@@ -726,6 +1323,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Send on anything that can't stay here. */
+	thread_sendmigrants();
+
 	/* Turn interrupts back on. */
 	splx(spl);
 }
@@ -750,6 +1350,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	cur->t_wchan_name = NULL;
 	cur->t_state = S_RUN;
 
+	/* Start charging our time. */
+	thread_account(ACCT_SYS);
+
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
@@ -759,6 +1362,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Send on anything that can't stay here. */
+	thread_sendmigrants();
+
 	/* Enable interrupts. */
 	spl0();
 
@@ -829,8 +1435,9 @@ void
 schedule(void)
 {
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * Nothing to do: thread_enqueue keeps the run queues in
+	 * priority order as threads are added, and threads of equal
+	 * priority run in round-robin fashion.
 	 */
 }
 
@@ -847,10 +1454,59 @@ schedule(void)
  * and the performance loss due to underutilization of some CPUs is
  * something that needs to be tuned and probably is workload-specific.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * System/161 does not (yet) model such cache effects, so we're
+ * aggressive about balancing the queues, but we do choose which
+ * threads to move: those that have been off the cpu longest, whose
+ * cache footprint is most likely gone anyway. And of course only to
+ * cpus their affinity masks allow.
+ */
+
+/*
+ * Take from our run queue the thread that has been off the cpu the
+ * longest and may run somewhere else, or return NULL if there isn't
+ * one. The run queue must be locked.
  */
+static
+struct thread *
+thread_pickvictim(void)
+{
+	struct thread *t, *victim;
+	uint32_t others;
+
+	others = ~((uint32_t)1 << curcpu->c_number);
+	victim = NULL;
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		/*
+		 * Ordinarily, curthread will not appear on the run
+		 * queue. However, it can under the following
+		 * circumstances:
+		 *   - it went to sleep;
+		 *   - the processor became idle, so it remained
+		 *     curthread;
+		 *   - it was reawakened, so it was put on the run
+		 *     queue;
+		 *   - and the processor hasn't fully unidled yet, so
+		 *     all these things are still true.
+		 *
+		 * If the timer interrupt happens at (almost) exactly
+		 * the proper moment, we can come here while things
+		 * are in this state and see curthread. However,
+		 * *migrating* curthread can cause bad things to happen
+		 * (Exercise: Why? And what?) so skip it.
+		 */
+		if (t == curthread || (t->t_cpumask & others) == 0) {
+			continue;
+		}
+		if (victim == NULL || t->t_offcpu < victim->t_offcpu) {
+			victim = t;
+		}
+	}
+	if (victim != NULL) {
+		threadlist_remove(&curcpu->c_runqueue, victim);
+	}
+	return victim;
+}
+
 void
 thread_consider_migration(void)
 {
@@ -877,57 +1533,42 @@ thread_consider_migration(void)
 		return;
 	}
 
+	/* Collect the victims, longest off-cpu first. */
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+		t = thread_pickvictim();
+		if (t == NULL) {
+			break;
+		}
+		threadlist_addtail(&victims, t);
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
+	for (i=0; i < numcpus && !threadlist_isempty(&victims); i++) {
 		c = cpuarray_get(&allcpus, i);
 		if (c == curcpu->c_self) {
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
+		while (c->c_runqueue.tl_count < one_share) {
+			/* the first victim that may run there */
+			THREADLIST_FORALL(t, victims) {
+				if (thread_cpuok(t, c)) {
+					break;
+				}
 			}
+			if (t == NULL) {
+				break;
+			}
+			threadlist_remove(&victims, t);
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_enqueue(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
 			if (c->c_isidle) {
 				/*
 				 * Other processor is idle; send
@@ -941,13 +1582,15 @@ thread_consider_migration(void)
 
 	/*
 	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
+	 * changed while we were working, and the victims' masks may not
+	 * have matched the cpus with room, so we may end up with
+	 * leftovers. Don't panic; just put them back on our own run
+	 * queue.
 	 */
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -958,6 +1601,99 @@ thread_consider_migration(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * CPU time accounting.
+ *
+ * Each cpu charges the time between calls to thread_account to
+ * whatever c_acctmode says it was doing. The mode changes on trap
+ * entry and exit (see mips_trap), on entering user mode, around
+ * idling, and across context switches, where each thread's mode is
+ * saved in t_acctmode. Interrupts taken while idle are charged to the
+ * cpu only, since the thread curthread points at isn't running.
+ *
+ * This runs twice per trap, so it reads the cheap per-cpu clock
+ * (mainbus_cpuclock) rather than the realtime clock.
+ */
+
+/* Set once the clock is available. */
+static volatile bool thread_accounting;
+
+void
+thread_account_start(void)
+{
+	thread_accounting = true;
+}
+
+/*
+ * Must be called with interrupts off. (Not with splhigh, because on
+ * trap entry the recorded spl may not match the hardware yet.)
+ */
+int
+thread_account(int mode)
+{
+	struct cpu *c = curcpu->c_self;
+	struct cputime *ct;
+	uint64_t now, delta;
+	int oldmode;
+
+	oldmode = c->c_acctmode;
+	c->c_acctmode = mode;
+	if (!thread_accounting) {
+		return oldmode;
+	}
+
+	now = mainbus_cpuclock();
+	if (c->c_acctstamp != 0) {
+		delta = now - c->c_acctstamp;
+		c->c_acct[oldmode] += delta;
+		ct = &curthread->t_cputime;
+		switch (oldmode) {
+		    case ACCT_USER:
+			ct->ct_user += delta;
+			break;
+		    case ACCT_SYS:
+			ct->ct_sys += delta;
+			break;
+		    case ACCT_INTR:
+			if (!c->c_isidle) {
+				ct->ct_intr += delta;
+			}
+			break;
+		}
+	}
+	c->c_acctstamp = now;
+	return oldmode;
+}
+
+void
+thread_getcputime(struct cputime *ret)
+{
+	int spl;
+
+	spl = splhigh();
+	thread_account(curcpu->c_acctmode);
+	*ret = curthread->t_cputime;
+	splx(spl);
+}
+
+void
+cputime_add(struct cputime *ret, const struct cputime *t)
+{
+	ret->ct_user += t->ct_user;
+	ret->ct_sys += t->ct_sys;
+	ret->ct_intr += t->ct_intr;
+}
+
+void
+cputime_sub(struct cputime *ret, const struct cputime *t)
+{
+	ret->ct_user -= t->ct_user;
+	ret->ct_sys -= t->ct_sys;
+	ret->ct_intr -= t->ct_intr;
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Wait channel functions
  */
@@ -1020,22 +1756,93 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * State shared between wchan_sleep_timeout and its timer.
+ */
+struct wchan_timeout {
+	struct thread *wt_thread;
+	struct wchan *wt_wchan;
+	struct spinlock *wt_lock;
+	bool wt_expired;		/* protected by wt_lock */
+};
+
+/*
+ * Timer function for wchan_sleep_timeout: if the thread is still
+ * asleep on the channel, take it off and wake it up.
+ */
+static
+void
+wchan_timeout(void *data)
+{
+	struct wchan_timeout *wt = data;
+	struct thread *t = wt->wt_thread;
+
+	spinlock_acquire(wt->wt_lock);
+	if (t->t_wchan == wt->wt_wchan) {
+		threadlist_remove(&wt->wt_wchan->wc_threads, t);
+		t->t_wchan = NULL;
+		wt->wt_expired = true;
+		thread_make_runnable(t, false);
+	}
+	spinlock_release(wt->wt_lock);
+}
+
+/*
+ * Like wchan_sleep, but give up after NSECS nanoseconds. Returns
+ * ETIMEDOUT if that's why we woke up, 0 otherwise.
+ *
+ * The timer can't be cancelled while we hold LK (its function takes
+ * LK), so it is cancelled after thread_switch lets go of LK and
+ * before it is taken back.
+ */
+int
+wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk, uint64_t nsecs)
+{
+	struct wchan_timeout wt;
+	struct timer tm;
+
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(lk));
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	wt.wt_thread = curthread;
+	wt.wt_wchan = wc;
+	wt.wt_lock = lk;
+	wt.wt_expired = false;
+	timer_init(&tm, wchan_timeout, &wt);
+	timer_start(&tm, nsecs);
+
+	thread_switch(S_SLEEP, wc, lk);
+
+	timer_cancel(&tm);
+	spinlock_acquire(lk);
+	return wt.wt_expired ? ETIMEDOUT : 0;
+}
+
+/*
+ * Wake up one thread sleeping on a wait channel: the first one of
+ * the highest priority.
  */
 void
 wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 {
-	struct thread *target;
+	struct thread *target, *t;
 
 	KASSERT(spinlock_do_i_hold(lk));
 
-	/* Grab a thread from the channel */
-	target = threadlist_remhead(&wc->wc_threads);
+	/* Pick a thread from the channel */
+	target = NULL;
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (target == NULL || t->t_pri > target->t_pri) {
+			target = t;
+		}
+	}
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
 		return;
 	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1048,37 +1855,116 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	thread_make_runnable(target, false);
 }
 
+/*
+ * Part of wchan_wakeall: make T, which slept on cpu C, runnable there
+ * with C's run queue locked. If it may no longer run on C, put it on
+ * STRAYS instead, to be sent elsewhere once the lock is dropped (see
+ * thread_make_runnable).
+ */
+static
+void
+wchan_wakeup_locked(struct cpu *c, struct thread *t, struct threadlist *strays)
+{
+	t->t_state = S_READY;
+	if (!thread_cpuok(t, c) && c->c_curthread != t) {
+		threadlist_addtail(strays, t);
+	}
+	else {
+		thread_enqueue(c, t);
+	}
+}
+
 /*
  * Wake up all threads sleeping on a wait channel.
+ *
+ * The threads are sorted out by cpu, and each cpu's share is put on
+ * its run queue under one acquisition of the run queue lock, with at
+ * most one IPI to unidle it, rather than paying for both once per
+ * thread. (A sleeping thread's t_cpu can't change, so it is safe to
+ * look at without the run queue lock.)
  */
 void
 wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *target;
-	struct threadlist list;
+	struct threadlist list, strays;
+	struct cpu *targetcpu;
+	unsigned n;
 
 	KASSERT(spinlock_do_i_hold(lk));
 
 	threadlist_init(&list);
+	threadlist_init(&strays);
 
 	/*
 	 * Grab all the threads from the channel, moving them to a
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
 	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
+	 * Take the cpu of the first thread left on the list, and move
+	 * every thread for that cpu onto its run queue in one go.
+	 * thread_enqueue keeps the queue in priority order; since
+	 * wakees mostly share a priority, each insert usually stops
+	 * at the tail.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
+		targetcpu = target->t_cpu;
+		spinlock_acquire(&targetcpu->c_runqueue_lock);
+
+		wchan_wakeup_locked(targetcpu, target, &strays);
+
+		/* go once around the rest, keeping the others */
+		for (n = list.tl_count; n > 0; n--) {
+			target = threadlist_remhead(&list);
+			if (target->t_cpu == targetcpu) {
+				wchan_wakeup_locked(targetcpu, target,
+						    &strays);
+			}
+			else {
+				threadlist_addtail(&list, target);
+			}
+		}
+
+		if (targetcpu->c_isidle && targetcpu != curcpu->c_self &&
+		    !threadlist_isempty(&targetcpu->c_runqueue)) {
+			ipi_send(targetcpu, IPI_UNIDLE);
+		}
+		spinlock_release(&targetcpu->c_runqueue_lock);
+	}
+
+	/* Threads whose affinity changed while they slept. */
+	while ((target = threadlist_remhead(&strays)) != NULL) {
+		thread_sendto(target, thread_pickcpu(target));
 	}
 
 	threadlist_cleanup(&list);
+	threadlist_cleanup(&strays);
+}
+
+/*
+ * Return the highest priority among the threads sleeping on the
+ * channel, or PRI_NONE if there aren't any.
+ */
+int
+wchan_maxpri(struct wchan *wc, struct spinlock *lk)
+{
+	struct thread *t;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	pri = PRI_NONE;
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (t->t_pri > pri) {
+			pri = t->t_pri;
+		}
+	}
+	return pri;
 }
 
 /*
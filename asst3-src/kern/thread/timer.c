@@ -0,0 +1,431 @@
+/*
+ * Kernel timers, on a hierarchical timing wheel. See timer.h.
+ *
+ * Time is counted in ticks of TIMER_TICK_NSEC since the epoch of
+ * gettime(). The wheel has TW_LEVELS levels of TW_SIZE slots each;
+ * level 0 slots are one tick wide, level 1 slots are TW_SIZE ticks
+ * wide, and so on. A timer goes on the lowest level whose span
+ * covers its distance from tw_now, in the slot its expiry falls in,
+ * so insertion is a list push and cancellation a list unlink.
+ *
+ * As tw_now advances, each level-0 slot it passes is expired, and
+ * each time it crosses a level-k slot boundary the level-k slot it
+ * enters is emptied and its timers redistributed further down
+ * ("cascaded"), where they are now close enough to be placed more
+ * precisely.
+ *
+ * Nothing ticks: the timerclock alarm is programmed for the first
+ * tick at which anything might happen (an occupied level-0 slot, or
+ * an occupied higher slot's cascade), and when it goes off the wheel
+ * is caught up to the current time in one go, skipping over empty
+ * stretches a whole slot at a time.
+ *
+ * Expired timers are moved to one more list, tw_expired, and their
+ * functions called one at a time with the wheel unlocked. Until its
+ * function starts, an expired timer is still pending and can be
+ * cancelled like any other.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <current.h>
+#include <clock.h>
+#include <timer.h>
+
+#define TW_BITS		6
+#define TW_SIZE		(1 << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	5
+#define TW_SHIFT(k)	((k) * TW_BITS)
+
+/* Slot numbers: TW_LEVELS * TW_SIZE wheel slots, then the expired list. */
+#define TW_NSLOTS	(TW_LEVELS * TW_SIZE)
+#define TW_EXPIRED	TW_NSLOTS
+
+/*
+ * The furthest ahead a timer can be placed: just short of a full
+ * turn of the top level (about 28 hours). Timers further out than
+ * that are placed at the limit and re-placed when they get there.
+ */
+#define TW_RANGE	((uint64_t)TW_MASK << TW_SHIFT(TW_LEVELS - 1))
+
+/* Longest alarm we program, in microseconds. */
+#define TW_MAXALARM	1000000000
+
+static struct spinlock tw_lock = SPINLOCK_INITIALIZER;
+static uint64_t tw_now;			/* Wheel is caught up to here */
+static struct timer *tw_slots[TW_NSLOTS + 1];
+static uint64_t tw_occupied[TW_LEVELS];	/* Bitmaps of nonempty slots */
+static unsigned tw_npending;		/* Timers in tw_slots */
+static bool tw_armed;			/* Alarm is set for tw_alarm */
+static uint64_t tw_alarm;
+static struct cpu *tw_runcpu;		/* Who is running tw_running */
+static struct timer *tw_running;	/* Timer whose function is running */
+
+/* For timer_sleep. Nobody ever wakes this; sleepers just time out. */
+static struct spinlock tw_sleeplock = SPINLOCK_INITIALIZER;
+static struct wchan *tw_sleepchan;
+
+void
+timer_bootstrap(void)
+{
+	tw_sleepchan = wchan_create("timer");
+	if (tw_sleepchan == NULL) {
+		panic("timer_bootstrap: Out of memory\n");
+	}
+}
+
+uint64_t
+timer_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned
+timer_npending(void)
+{
+	return tw_npending;
+}
+
+////////////////////////////////////////////////////////////
+// wheel
+
+static
+void
+tw_link(struct timer *tm, unsigned slot)
+{
+	tm->tm_slot = slot;
+	tm->tm_next = tw_slots[slot];
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_prevp = &tm->tm_next;
+	}
+	tm->tm_prevp = &tw_slots[slot];
+	tw_slots[slot] = tm;
+	if (slot != TW_EXPIRED) {
+		tw_occupied[slot / TW_SIZE] |= (uint64_t)1 << (slot & TW_MASK);
+	}
+	tw_npending++;
+}
+
+static
+void
+tw_unlink(struct timer *tm)
+{
+	unsigned slot = tm->tm_slot;
+
+	*tm->tm_prevp = tm->tm_next;
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_prevp = tm->tm_prevp;
+	}
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+	if (slot != TW_EXPIRED && tw_slots[slot] == NULL) {
+		tw_occupied[slot / TW_SIZE] &= ~((uint64_t)1 << (slot & TW_MASK));
+	}
+	tw_npending--;
+}
+
+/*
+ * Put a timer on the wheel, or on the expired list if it's due.
+ */
+static
+void
+tw_place(struct timer *tm)
+{
+	uint64_t when, delta;
+	unsigned k;
+
+	if (tm->tm_expire <= tw_now) {
+		tw_link(tm, TW_EXPIRED);
+		return;
+	}
+
+	delta = tm->tm_expire - tw_now;
+	if (delta > TW_RANGE) {
+		delta = TW_RANGE;
+	}
+	when = tw_now + delta;
+
+	for (k = 0; k < TW_LEVELS - 1; k++) {
+		if (delta < (uint64_t)1 << TW_SHIFT(k + 1)) {
+			break;
+		}
+	}
+	tw_link(tm, k * TW_SIZE + ((when >> TW_SHIFT(k)) & TW_MASK));
+}
+
+/*
+ * Empty a slot, re-placing each of its timers.
+ */
+static
+void
+tw_redistribute(unsigned slot)
+{
+	struct timer *tm;
+
+	while ((tm = tw_slots[slot]) != NULL) {
+		tw_unlink(tm);
+		tw_place(tm);
+	}
+}
+
+/*
+ * tw_now has just reached a multiple of TW_SIZE: cascade the slot
+ * entered at each level whose boundary it is on, top down.
+ */
+static
+void
+tw_cascade(void)
+{
+	unsigned k, top;
+
+	top = 1;
+	while (top < TW_LEVELS - 1 &&
+	       (tw_now & (((uint64_t)1 << TW_SHIFT(top + 1)) - 1)) == 0) {
+		top++;
+	}
+	for (k = top; k >= 1; k--) {
+		tw_redistribute(k * TW_SIZE +
+				((tw_now >> TW_SHIFT(k)) & TW_MASK));
+	}
+}
+
+/*
+ * Advance tw_now to TARGET, expiring and cascading along the way.
+ */
+static
+void
+tw_advance(uint64_t target)
+{
+	uint64_t end, span;
+	unsigned k;
+
+	while (tw_now < target) {
+		if (tw_occupied[0] != 0) {
+			/* step through the rest of this turn of level 0 */
+			end = (tw_now | TW_MASK) + 1;
+			if (end > target) {
+				end = target;
+			}
+			while (tw_now < end) {
+				tw_now++;
+				if (tw_occupied[0] &
+				    ((uint64_t)1 << (tw_now & TW_MASK))) {
+					tw_redistribute(tw_now & TW_MASK);
+				}
+			}
+		}
+		else {
+			/*
+			 * Nothing can happen until the lowest occupied
+			 * level next cascades, so jump straight there.
+			 */
+			for (k = 1; k < TW_LEVELS; k++) {
+				if (tw_occupied[k] != 0) {
+					break;
+				}
+			}
+			if (k == TW_LEVELS) {
+				tw_now = target;
+				break;
+			}
+			span = (uint64_t)1 << TW_SHIFT(k);
+			end = (tw_now | (span - 1)) + 1;
+			tw_now = end < target ? end : target;
+		}
+		if ((tw_now & TW_MASK) == 0) {
+			tw_cascade();
+		}
+	}
+}
+
+/*
+ * Distance (1..TW_SIZE) from slot CUR to the next occupied slot in
+ * OCC, going around the wheel, or 0 if there are none.
+ */
+static
+unsigned
+tw_nextslot(uint64_t occ, unsigned cur)
+{
+	unsigned d;
+
+	if (occ == 0) {
+		return 0;
+	}
+	for (d = 1; d <= TW_SIZE; d++) {
+		if (occ & ((uint64_t)1 << ((cur + d) & TW_MASK))) {
+			return d;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The first tick after tw_now at which the wheel has work to do, or
+ * 0 if it's empty.
+ */
+static
+uint64_t
+tw_nextevent(void)
+{
+	uint64_t best, when, base;
+	unsigned k, d;
+
+	best = 0;
+	for (k = 0; k < TW_LEVELS; k++) {
+		base = tw_now >> TW_SHIFT(k);
+		d = tw_nextslot(tw_occupied[k], base & TW_MASK);
+		if (d == 0) {
+			continue;
+		}
+		when = (base + d) << TW_SHIFT(k);
+		if (best == 0 || when < best) {
+			best = when;
+		}
+	}
+	return best;
+}
+
+/*
+ * Program the alarm for tick WHEN. NOW is the current time in
+ * nanoseconds.
+ */
+static
+void
+tw_setalarm(uint64_t when, uint64_t now)
+{
+	uint64_t at, usecs;
+
+	at = when * TIMER_TICK_NSEC;
+	usecs = at > now ? (at - now + 999) / 1000 : 0;
+	if (usecs > TW_MAXALARM) {
+		/* we'll just re-arm when it goes off */
+		usecs = TW_MAXALARM;
+	}
+	tw_armed = true;
+	tw_alarm = when;
+	timerclock_set(usecs);
+}
+
+////////////////////////////////////////////////////////////
+// interface
+
+void
+timer_init(struct timer *tm, void (*func)(void *), void *arg)
+{
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+	tm->tm_expire = 0;
+	tm->tm_slot = 0;
+	tm->tm_state = TIMER_IDLE;
+	tm->tm_func = func;
+	tm->tm_arg = arg;
+}
+
+void
+timer_start(struct timer *tm, uint64_t nsecs)
+{
+	uint64_t now, nowtick;
+
+	now = timer_now();
+	nowtick = now / TIMER_TICK_NSEC;
+
+	spinlock_acquire(&tw_lock);
+	if (tm->tm_state == TIMER_PENDING) {
+		tw_unlink(tm);
+	}
+	if (tw_npending == 0 && tw_now < nowtick) {
+		/* nothing to catch up on; just jump */
+		tw_now = nowtick;
+	}
+	/* round up, so we never fire early */
+	tm->tm_expire = (now + nsecs + TIMER_TICK_NSEC - 1) / TIMER_TICK_NSEC;
+	if (tm->tm_expire <= tw_now) {
+		tm->tm_expire = tw_now + 1;
+	}
+	tm->tm_state = TIMER_PENDING;
+	tw_place(tm);
+
+	if (!tw_armed || tm->tm_expire < tw_alarm) {
+		tw_setalarm(tm->tm_expire, now);
+	}
+	spinlock_release(&tw_lock);
+}
+
+bool
+timer_cancel(struct timer *tm)
+{
+	spinlock_acquire(&tw_lock);
+	if (tm->tm_state == TIMER_PENDING) {
+		tw_unlink(tm);
+		tm->tm_state = TIMER_IDLE;
+		spinlock_release(&tw_lock);
+		return true;
+	}
+	while (tw_running == tm && tw_runcpu != curcpu->c_self) {
+		spinlock_release(&tw_lock);
+		/* let it finish */
+		spinlock_acquire(&tw_lock);
+	}
+	spinlock_release(&tw_lock);
+	return false;
+}
+
+/*
+ * This is called on one processor by the timer code when the alarm
+ * goes off.
+ */
+void
+timerclock(void)
+{
+	struct timer *tm;
+	uint64_t now, next;
+
+	now = timer_now();
+
+	spinlock_acquire(&tw_lock);
+	tw_armed = false;
+	tw_advance(now / TIMER_TICK_NSEC);
+	next = tw_nextevent();
+	if (next != 0) {
+		tw_setalarm(next, now);
+	}
+
+	/* Somebody else is already running functions; they'll get these. */
+	if (tw_running != NULL) {
+		spinlock_release(&tw_lock);
+		return;
+	}
+
+	while ((tm = tw_slots[TW_EXPIRED]) != NULL) {
+		tw_unlink(tm);
+		tm->tm_state = TIMER_IDLE;
+		tw_running = tm;
+		tw_runcpu = curcpu->c_self;
+		spinlock_release(&tw_lock);
+
+		tm->tm_func(tm->tm_arg);
+
+		spinlock_acquire(&tw_lock);
+		tw_running = NULL;
+		tw_runcpu = NULL;
+	}
+	spinlock_release(&tw_lock);
+}
+
+void
+timer_sleep(uint64_t nsecs)
+{
+	if (nsecs == 0) {
+		return;
+	}
+	spinlock_acquire(&tw_sleeplock);
+	(void)wchan_sleep_timeout(tw_sleepchan, &tw_sleeplock, nsecs);
+	spinlock_release(&tw_sleeplock);
+}
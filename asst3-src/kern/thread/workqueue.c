@@ -0,0 +1,391 @@
+/*
+ * Workqueues. See workqueue.h.
+ *
+ * Each workqueue has a struct wq_cpu per cpu: a FIFO of work items,
+ * under a spinlock so that interrupt handlers can add to it, and a
+ * worker thread, pinned to that cpu, that sleeps on a wait channel
+ * while the FIFO is empty.
+ *
+ * Whether a work item is pending is an atomic flag, w_pending, so
+ * that work_enqueue on one cpu can tell that the item is already
+ * queued on another without taking that cpu's lock. Whoever sets the
+ * flag owns w_state and w_wc until the item is on a FIFO; from then
+ * on they are protected by that FIFO's lock. The worker clears the
+ * flag just before calling the function.
+ *
+ * Latency is measured from when an item goes on a FIFO (for delayed
+ * work, when its timer fires) until a worker calls it.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <synch.h>
+#include <timer.h>
+#include <workqueue.h>
+
+struct wq_cpu {
+	struct workqueue *wc_wq;
+	unsigned wc_cpu;		/* Cpu number */
+	struct spinlock wc_lock;
+	struct work *wc_head;		/* Pending work, oldest first */
+	struct work **wc_tailp;
+	struct wchan *wc_wchan;		/* Worker sleeps here */
+	struct work *wc_running;	/* Item the worker is running */
+	struct wchan *wc_donewchan;	/* work_cancel waits here */
+
+	/* Statistics */
+	unsigned wc_queued;		/* Items on the FIFO */
+	unsigned wc_maxqueued;
+	unsigned wc_runs;
+	uint64_t wc_latsum;		/* Queueing delay, ns */
+	uint64_t wc_latmax;
+	uint64_t wc_runsum;		/* Time in the functions, ns */
+	uint64_t wc_runmax;
+};
+
+struct workqueue {
+	char *wq_name;
+	struct workqueue *wq_next;	/* List of all workqueues */
+	unsigned wq_ncpus;
+	struct wq_cpu *wq_cpus;		/* One per cpu, by number */
+};
+
+struct workqueue *system_workqueue;
+
+/* All workqueues, for workqueue_stats. */
+static struct spinlock wq_listlock = SPINLOCK_INITIALIZER;
+static struct workqueue *wq_list;
+
+/*
+ * Put W on WC's FIFO and wake the worker. WC must be locked.
+ */
+static
+void
+wq_add(struct wq_cpu *wc, struct work *w)
+{
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	w->w_next = NULL;
+	w->w_wc = wc;
+	w->w_state = WORK_QUEUED;
+	w->w_stamp = timer_now();
+	*wc->wc_tailp = w;
+	wc->wc_tailp = &w->w_next;
+
+	wc->wc_queued++;
+	if (wc->wc_queued > wc->wc_maxqueued) {
+		wc->wc_maxqueued = wc->wc_queued;
+	}
+	wchan_wakeone(wc->wc_wchan, &wc->wc_lock);
+}
+
+/*
+ * Take W off WC's FIFO. WC must be locked.
+ */
+static
+void
+wq_remove(struct wq_cpu *wc, struct work *w)
+{
+	struct work **wp;
+
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	for (wp = &wc->wc_head; *wp != w; wp = &(*wp)->w_next) {
+		KASSERT(*wp != NULL);
+	}
+	*wp = w->w_next;
+	if (wc->wc_tailp == &w->w_next) {
+		wc->wc_tailp = wp;
+	}
+	w->w_next = NULL;
+	wc->wc_queued--;
+}
+
+/*
+ * Worker thread.
+ */
+static
+void
+wq_worker(void *data1, unsigned long data2)
+{
+	struct wq_cpu *wc = data1;
+	struct work *w;
+	void (*func)(void *);
+	void *arg;
+	uint64_t start, lat, run;
+
+	/* We were forked onto our cpu, and pinned there. */
+	thread_setpriority(data2);
+
+	spinlock_acquire(&wc->wc_lock);
+	while (1) {
+		while (wc->wc_head == NULL) {
+			wchan_sleep(wc->wc_wchan, &wc->wc_lock);
+		}
+		w = wc->wc_head;
+		wq_remove(wc, w);
+		w->w_state = WORK_IDLE;
+		wc->wc_running = w;
+		func = w->w_func;
+		arg = w->w_arg;
+
+		start = timer_now();
+		lat = start - w->w_stamp;
+		wc->wc_runs++;
+		wc->wc_latsum += lat;
+		if (lat > wc->wc_latmax) {
+			wc->wc_latmax = lat;
+		}
+
+		/* From here on it may be queued again. */
+		spinlock_data_set(&w->w_pending, 0);
+		spinlock_release(&wc->wc_lock);
+
+		func(arg);
+
+		/* W may be gone now; don't touch it. */
+		run = timer_now() - start;
+		spinlock_acquire(&wc->wc_lock);
+		wc->wc_runsum += run;
+		if (run > wc->wc_runmax) {
+			wc->wc_runmax = run;
+		}
+		wc->wc_running = NULL;
+		wchan_wakeall(wc->wc_donewchan, &wc->wc_lock);
+	}
+}
+
+/*
+ * Create a workqueue and start its workers.
+ */
+struct workqueue *
+workqueue_create(const char *name, int pri)
+{
+	struct workqueue *wq;
+	struct wq_cpu *wc;
+	unsigned i;
+	int result;
+
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+	wq->wq_name = kstrdup(name);
+	if (wq->wq_name == NULL) {
+		kfree(wq);
+		return NULL;
+	}
+	wq->wq_ncpus = cpu_count();
+	wq->wq_cpus = kmalloc(wq->wq_ncpus * sizeof(*wq->wq_cpus));
+	if (wq->wq_cpus == NULL) {
+		kfree(wq->wq_name);
+		kfree(wq);
+		return NULL;
+	}
+
+	for (i=0; i<wq->wq_ncpus; i++) {
+		wc = &wq->wq_cpus[i];
+		wc->wc_wq = wq;
+		wc->wc_cpu = i;
+		spinlock_init(&wc->wc_lock);
+		wc->wc_head = NULL;
+		wc->wc_tailp = &wc->wc_head;
+		wc->wc_wchan = wchan_create(wq->wq_name);
+		wc->wc_donewchan = wchan_create(wq->wq_name);
+		if (wc->wc_wchan == NULL || wc->wc_donewchan == NULL) {
+			panic("workqueue_create: Out of memory\n");
+		}
+		wc->wc_running = NULL;
+		wc->wc_queued = 0;
+		wc->wc_maxqueued = 0;
+		wc->wc_runs = 0;
+		wc->wc_latsum = 0;
+		wc->wc_latmax = 0;
+		wc->wc_runsum = 0;
+		wc->wc_runmax = 0;
+	}
+
+	/*
+	 * Workqueues can't be destroyed, so there's no backing out
+	 * once the workers start.
+	 */
+	for (i=0; i<wq->wq_ncpus; i++) {
+		result = thread_fork_oncpu(wq->wq_name, kproc,
+					   wq->wq_cpus[i].wc_cpu, wq_worker,
+					   &wq->wq_cpus[i], pri);
+		if (result) {
+			panic("workqueue_create: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+
+	spinlock_acquire(&wq_listlock);
+	wq->wq_next = wq_list;
+	wq_list = wq;
+	spinlock_release(&wq_listlock);
+
+	return wq;
+}
+
+void
+workqueue_bootstrap(void)
+{
+	system_workqueue = workqueue_create("events", PRI_DEFAULT + 4);
+	if (system_workqueue == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Timer function for delayed work.
+ */
+static
+void
+work_timeout(void *data)
+{
+	struct work *w = data;
+	struct wq_cpu *wc = w->w_wc;
+
+	spinlock_acquire(&wc->wc_lock);
+	KASSERT(w->w_state == WORK_DELAYED);
+	wq_add(wc, w);
+	spinlock_release(&wc->wc_lock);
+}
+
+void
+work_init(struct work *w, void (*func)(void *), void *arg)
+{
+	w->w_next = NULL;
+	w->w_func = func;
+	w->w_arg = arg;
+	spinlock_data_set(&w->w_pending, 0);
+	w->w_state = WORK_IDLE;
+	w->w_wc = NULL;
+	w->w_stamp = 0;
+	timer_init(&w->w_timer, work_timeout, w);
+}
+
+bool
+work_enqueue(struct workqueue *wq, struct work *w)
+{
+	struct wq_cpu *wc;
+
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		return false;
+	}
+
+	/* If we get moved meanwhile, it's no great matter. */
+	wc = &wq->wq_cpus[curcpu->c_number];
+
+	spinlock_acquire(&wc->wc_lock);
+	wq_add(wc, w);
+	spinlock_release(&wc->wc_lock);
+	return true;
+}
+
+bool
+work_enqueue_delayed(struct workqueue *wq, struct work *w, uint64_t nsecs)
+{
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		return false;
+	}
+
+	w->w_wc = &wq->wq_cpus[curcpu->c_number];
+	w->w_state = WORK_DELAYED;
+	timer_start(&w->w_timer, nsecs);
+	return true;
+}
+
+bool
+work_cancel(struct work *w)
+{
+	struct wq_cpu *wc;
+	bool wasqueued = false;
+
+	KASSERT(!curthread->t_in_interrupt);
+
+	wc = w->w_wc;
+	if (wc == NULL) {
+		/* never enqueued */
+		return false;
+	}
+
+	if (spinlock_data_get(&w->w_pending) && w->w_state == WORK_DELAYED) {
+		if (timer_cancel(&w->w_timer)) {
+			w->w_state = WORK_IDLE;
+			spinlock_data_set(&w->w_pending, 0);
+			return true;
+		}
+		/* The timer went off; it's on the FIFO now, or later. */
+	}
+
+	spinlock_acquire(&wc->wc_lock);
+	if (w->w_state == WORK_QUEUED) {
+		wq_remove(wc, w);
+		w->w_state = WORK_IDLE;
+		spinlock_data_set(&w->w_pending, 0);
+		wasqueued = true;
+	}
+	while (wc->wc_running == w) {
+		wchan_sleep(wc->wc_donewchan, &wc->wc_lock);
+	}
+	spinlock_release(&wc->wc_lock);
+	return wasqueued;
+}
+
+////////////////////////////////////////////////////////////
+
+void
+workqueue_stats(void)
+{
+	struct workqueue *wq;
+	struct wq_cpu *wc;
+	unsigned i, runs, maxq;
+	uint64_t latsum, latmax, runsum, runmax;
+
+	kprintf("%-10s %-4s %8s %6s %10s %10s %10s %10s\n",
+		"queue", "cpu", "runs", "maxq", "avglat us", "maxlat us",
+		"avgrun us", "maxrun us");
+
+	/* Workqueues are never destroyed, so the list only grows. */
+	spinlock_acquire(&wq_listlock);
+	wq = wq_list;
+	spinlock_release(&wq_listlock);
+
+	for (; wq != NULL; wq = wq->wq_next) {
+		for (i=0; i<wq->wq_ncpus; i++) {
+			wc = &wq->wq_cpus[i];
+			spinlock_acquire(&wc->wc_lock);
+			runs = wc->wc_runs;
+			maxq = wc->wc_maxqueued;
+			latsum = wc->wc_latsum;
+			latmax = wc->wc_latmax;
+			runsum = wc->wc_runsum;
+			runmax = wc->wc_runmax;
+			spinlock_release(&wc->wc_lock);
+
+			if (runs == 0) {
+				kprintf("%-10s %-4u %8u %6u\n", wq->wq_name,
+					i, runs, maxq);
+				continue;
+			}
+			kprintf("%-10s %-4u %8u %6u %10llu %10llu "
+				"%10llu %10llu\n",
+				wq->wq_name, i, runs, maxq,
+				(unsigned long long)(latsum / runs / 1000),
+				(unsigned long long)(latmax / 1000),
+				(unsigned long long)(runsum / runs / 1000),
+				(unsigned long long)(runmax / 1000));
+		}
+	}
+}
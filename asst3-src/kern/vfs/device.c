@@ -150,6 +150,21 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return DEVOP_IOCTL(d, op, data);
 }
 
+/*
+ * Called for poll(). Pass through, if the device cares.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct pollentry *entry, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return vopnull_poll(v, events, entry, revents);
+	}
+	return DEVOP_POLL(d, events, entry, revents);
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -332,6 +347,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = dev_write,
 	.vop_ioctl = dev_ioctl,
+	.vop_poll = dev_poll,
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
@@ -0,0 +1,668 @@
+/*
+ * Anonymous pipes.
+ *
+ * A pipe is a ring of up to PIPE_MAXPAGES page-sized buffers. Each
+ * buffer holds the bytes from pb_start to pb_end of its page; readers
+ * take from the oldest and writers add to the newest, starting a new
+ * page when it fills up. Pages that have been read are kept as a
+ * spare, so a pipe that's kept about empty doesn't keep going back to
+ * kmalloc.
+ *
+ * Small writes are copied into the newest page under the pipe lock.
+ * Writes of PIPE_BUF bytes or less wait until they fit entirely, so
+ * they never get mixed in with other writers' data. Writes of a page
+ * or more instead claim a free slot in the ring, fill a whole page
+ * with the lock released, and then hand the page over to the reader
+ * side; readers can drain the pipe while a large write is coming in,
+ * and nobody waits on the lock for the length of a copy from user
+ * space. (The data is still copied in and out; copyin and copyout
+ * only reach the current address space, so the reader can't take it
+ * straight from the writer's pages.)
+ *
+ * Each end of the pipe has its own vnode, both embedded in the pipe.
+ * When the last reference to an end goes away, VOP_RECLAIM marks it
+ * closed: readers of a pipe with no writer get EOF once it's empty,
+ * and writers to a pipe with no reader get EPIPE. The second end to
+ * be reclaimed frees the pipe.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <limits.h>
+#include <lib.h>
+#include <stat.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pollqueue.h>
+#include <pipe.h>
+
+struct pipebuf {
+	char *pb_data;			/* one page */
+	unsigned pb_start;		/* first unread byte */
+	unsigned pb_end;		/* one past the last byte written */
+};
+
+struct pipe {
+	struct lock *p_lock;
+	struct cv *p_readcv;		/* readers wait here for data */
+	struct cv *p_writecv;		/* writers wait here for space */
+	struct pollqueue p_pollq;	/* poll()ers of either end */
+
+	struct pipebuf p_bufs[PIPE_MAXPAGES];
+	unsigned p_head;		/* index of the oldest buffer */
+	unsigned p_nbufs;		/* number of buffers in the ring */
+	unsigned p_nreserved;		/* slots claimed by page handoffs */
+	size_t p_count;			/* bytes in the ring */
+	char *p_spare;			/* a free page, or NULL */
+
+	struct vnode p_readvn;
+	struct vnode p_writevn;
+	bool p_readopen, p_writeopen;
+	bool p_readnonblock, p_writenonblock;
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+////////////////////////////////////////////////////////////
+// buffers
+
+/*
+ * Get a page for the ring.
+ */
+static
+char *
+pipe_getpage(struct pipe *p)
+{
+	char *page;
+
+	if (p->p_spare != NULL) {
+		page = p->p_spare;
+		p->p_spare = NULL;
+		return page;
+	}
+	return kmalloc(PAGE_SIZE);
+}
+
+/*
+ * Give back a page that's no longer needed.
+ */
+static
+void
+pipe_putpage(struct pipe *p, char *page)
+{
+	if (p->p_spare == NULL) {
+		p->p_spare = page;
+	}
+	else {
+		kfree(page);
+	}
+}
+
+/*
+ * The newest buffer. The ring must not be empty.
+ */
+static
+struct pipebuf *
+pipe_tail(struct pipe *p)
+{
+	KASSERT(p->p_nbufs > 0);
+	return &p->p_bufs[(p->p_head + p->p_nbufs - 1) % PIPE_MAXPAGES];
+}
+
+/*
+ * Add a buffer for PAGE to the ring, holding LEN bytes.
+ */
+static
+void
+pipe_append(struct pipe *p, char *page, unsigned len)
+{
+	struct pipebuf *pb;
+
+	KASSERT(p->p_nbufs + p->p_nreserved < PIPE_MAXPAGES);
+	p->p_nbufs++;
+	pb = pipe_tail(p);
+	pb->pb_data = page;
+	pb->pb_start = 0;
+	pb->pb_end = len;
+	p->p_count += len;
+}
+
+/*
+ * How many bytes can be written without waiting. Slots claimed for a
+ * handoff count as full.
+ */
+static
+size_t
+pipe_room(struct pipe *p)
+{
+	size_t room;
+	struct pipebuf *pb;
+
+	room = (PIPE_MAXPAGES - p->p_nbufs - p->p_nreserved) * PAGE_SIZE;
+	if (p->p_nbufs > 0) {
+		pb = pipe_tail(p);
+		room += PAGE_SIZE - pb->pb_end;
+	}
+	return room;
+}
+
+////////////////////////////////////////////////////////////
+// reading and writing
+
+/*
+ * Copy as much of UIO as will fit into the ring. The lock is held
+ * throughout.
+ */
+static
+int
+pipe_copyin(struct pipe *p, struct uio *uio)
+{
+	struct pipebuf *pb;
+	char *page;
+	size_t len;
+	int result;
+
+	while (uio->uio_resid > 0) {
+		if (p->p_nbufs > 0 && pipe_tail(p)->pb_end < PAGE_SIZE) {
+			pb = pipe_tail(p);
+		}
+		else if (p->p_nbufs + p->p_nreserved < PIPE_MAXPAGES) {
+			page = pipe_getpage(p);
+			if (page == NULL) {
+				return ENOMEM;
+			}
+			pipe_append(p, page, 0);
+			pb = pipe_tail(p);
+		}
+		else {
+			/* full */
+			break;
+		}
+
+		len = PAGE_SIZE - pb->pb_end;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(pb->pb_data + pb->pb_end, len, uio);
+		if (result) {
+			return result;
+		}
+		pb->pb_end += len;
+		p->p_count += len;
+	}
+	return 0;
+}
+
+/*
+ * Move a whole page of UIO into the pipe. The caller holds the lock
+ * and has checked that there's a free slot; we claim it, fill a page
+ * without the lock, and then put the page in the ring.
+ */
+static
+int
+pipe_handoff(struct pipe *p, struct uio *uio)
+{
+	char *page;
+	int result;
+
+	KASSERT(p->p_nbufs + p->p_nreserved < PIPE_MAXPAGES);
+	KASSERT(uio->uio_resid >= PAGE_SIZE);
+
+	page = pipe_getpage(p);
+	if (page == NULL) {
+		return ENOMEM;
+	}
+	p->p_nreserved++;
+
+	lock_release(p->p_lock);
+	result = uiomove(page, PAGE_SIZE, uio);
+	lock_acquire(p->p_lock);
+
+	p->p_nreserved--;
+	if (result == 0 && !p->p_readopen) {
+		result = EPIPE;
+	}
+	if (result) {
+		pipe_putpage(p, page);
+		/* someone might have been waiting for the slot */
+		cv_broadcast(p->p_writecv, p->p_lock);
+		pollqueue_wakeup(&p->p_pollq);
+		return result;
+	}
+	pipe_append(p, page, PAGE_SIZE);
+	return 0;
+}
+
+/*
+ * VOP_READ: wait until there's something in the pipe, or no writer,
+ * then take as much as there is.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	struct pipebuf *pb;
+	size_t len;
+	int result;
+
+	KASSERT(v == &p->p_readvn);
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	lock_acquire(p->p_lock);
+	while (p->p_count == 0) {
+		if (!p->p_writeopen) {
+			/* EOF */
+			lock_release(p->p_lock);
+			return 0;
+		}
+		if (p->p_readnonblock) {
+			lock_release(p->p_lock);
+			return EAGAIN;
+		}
+		cv_wait(p->p_readcv, p->p_lock);
+	}
+
+	result = 0;
+	while (uio->uio_resid > 0 && p->p_count > 0) {
+		pb = &p->p_bufs[p->p_head];
+		len = pb->pb_end - pb->pb_start;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(pb->pb_data + pb->pb_start, len, uio);
+		if (result) {
+			break;
+		}
+		pb->pb_start += len;
+		p->p_count -= len;
+
+		/* drop the buffer if we've read all of it */
+		if (pb->pb_start == pb->pb_end) {
+			pipe_putpage(p, pb->pb_data);
+			pb->pb_data = NULL;
+			p->p_head = (p->p_head + 1) % PIPE_MAXPAGES;
+			p->p_nbufs--;
+		}
+	}
+
+	cv_broadcast(p->p_writecv, p->p_lock);
+	pollqueue_wakeup(&p->p_pollq);
+	lock_release(p->p_lock);
+	return result;
+}
+
+/*
+ * VOP_WRITE: put the whole of UIO in the pipe, waiting for space as
+ * needed. A nonblocking write takes what fits and only fails with
+ * EAGAIN if nothing did.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	size_t origresid, need;
+	int result;
+
+	KASSERT(v == &p->p_writevn);
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	origresid = uio->uio_resid;
+	/* writes of PIPE_BUF or less go in all at once or not at all */
+	need = origresid <= PIPE_BUF ? origresid : 1;
+
+	lock_acquire(p->p_lock);
+	result = 0;
+	while (uio->uio_resid > 0) {
+		if (!p->p_readopen) {
+			result = EPIPE;
+			break;
+		}
+		if (uio->uio_resid >= PAGE_SIZE &&
+		    p->p_nbufs + p->p_nreserved < PIPE_MAXPAGES) {
+			result = pipe_handoff(p, uio);
+		}
+		else if (pipe_room(p) >= need) {
+			result = pipe_copyin(p, uio);
+		}
+		else if (p->p_writenonblock) {
+			result = EAGAIN;
+		}
+		else {
+			cv_wait(p->p_writecv, p->p_lock);
+			continue;
+		}
+		if (result) {
+			break;
+		}
+		cv_broadcast(p->p_readcv, p->p_lock);
+		pollqueue_wakeup(&p->p_pollq);
+	}
+	lock_release(p->p_lock);
+
+	if (result == EAGAIN && uio->uio_resid < origresid) {
+		/* report the partial write */
+		result = 0;
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// other vnode ops
+
+/*
+ * VOP_EACHOPEN. Pipes aren't opened by name, so this isn't reached.
+ */
+static
+int
+pipe_eachopen(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+/*
+ * VOP_RECLAIM: the last reference to one end is gone, so close that
+ * end, and if the other end is closed too, destroy the pipe.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+	bool destroy;
+	unsigned i;
+
+	lock_acquire(p->p_lock);
+	if (v == &p->p_readvn) {
+		KASSERT(p->p_readopen);
+		p->p_readopen = false;
+		cv_broadcast(p->p_writecv, p->p_lock);
+		pollqueue_wakeup(&p->p_pollq);
+	}
+	else {
+		KASSERT(v == &p->p_writevn);
+		KASSERT(p->p_writeopen);
+		p->p_writeopen = false;
+		cv_broadcast(p->p_readcv, p->p_lock);
+		pollqueue_wakeup(&p->p_pollq);
+	}
+	vnode_cleanup(v);
+	destroy = !p->p_readopen && !p->p_writeopen;
+	lock_release(p->p_lock);
+
+	if (destroy) {
+		KASSERT(p->p_nreserved == 0);
+		for (i=0; i<p->p_nbufs; i++) {
+			kfree(p->p_bufs[(p->p_head + i) % PIPE_MAXPAGES].pb_data);
+		}
+		if (p->p_spare != NULL) {
+			kfree(p->p_spare);
+		}
+		pollqueue_cleanup(&p->p_pollq);
+		cv_destroy(p->p_writecv);
+		cv_destroy(p->p_readcv);
+		lock_destroy(p->p_lock);
+		kfree(p);
+	}
+	return 0;
+}
+
+/*
+ * VOP_IOCTL. No ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+/*
+ * VOP_POLL. The read end is ready when there's data or no writer
+ * (which is also a hangup); the write end is ready when a PIPE_BUF
+ * write would go straight in, and in error when there's no reader.
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct pollentry *entry, int *revents)
+{
+	struct pipe *p = v->vn_data;
+
+	lock_acquire(p->p_lock);
+	if (entry != NULL) {
+		pollqueue_add(&p->p_pollq, entry);
+	}
+	*revents = 0;
+	if (v == &p->p_readvn) {
+		if (p->p_count > 0 || !p->p_writeopen) {
+			*revents |= events & POLLIN;
+		}
+		if (!p->p_writeopen) {
+			*revents |= POLLHUP;
+		}
+	}
+	else {
+		if (!p->p_readopen) {
+			*revents |= POLLERR;
+		}
+		else if (pipe_room(p) >= PIPE_BUF) {
+			*revents |= events & POLLOUT;
+		}
+	}
+	lock_release(p->p_lock);
+	return 0;
+}
+
+/*
+ * VOP_GETTYPE.
+ */
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+/*
+ * VOP_STAT. The size is the amount of data waiting to be read.
+ */
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *p = v->vn_data;
+	int result;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	result = VOP_GETTYPE(v, &statbuf->st_mode);
+	if (result) {
+		return result;
+	}
+	statbuf->st_mode |= 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PAGE_SIZE;
+
+	lock_acquire(p->p_lock);
+	statbuf->st_size = p->p_count;
+	lock_release(p->p_lock);
+
+	return 0;
+}
+
+/*
+ * VOP_ISSEEKABLE. Pipes aren't.
+ */
+static
+bool
+pipe_isseekable(struct vnode *v)
+{
+	(void)v;
+	return false;
+}
+
+/*
+ * VOP_FSYNC. There's nowhere for the data to go, so this is an
+ * error, as for other things that can't be synced.
+ */
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return EINVAL;
+}
+
+/*
+ * VOP_TRUNCATE.
+ */
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * VOP_NAMEFILE. Pipes don't have names.
+ */
+static
+int
+pipe_namefile(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return ENOTDIR;
+}
+
+/*
+ * Function table for pipe vnodes.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_poll = pipe_poll,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = pipe_namefile,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// interface
+
+/*
+ * Make a pipe.
+ */
+int
+pipe_create(struct vnode **readvn_ret, struct vnode **writevn_ret)
+{
+	struct pipe *p;
+	int result;
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_lock = lock_create("pipe");
+	if (p->p_lock == NULL) {
+		result = ENOMEM;
+		goto fail_pipe;
+	}
+	p->p_readcv = cv_create("pipe read");
+	if (p->p_readcv == NULL) {
+		result = ENOMEM;
+		goto fail_lock;
+	}
+	p->p_writecv = cv_create("pipe write");
+	if (p->p_writecv == NULL) {
+		result = ENOMEM;
+		goto fail_readcv;
+	}
+
+	p->p_head = 0;
+	p->p_nbufs = 0;
+	p->p_nreserved = 0;
+	p->p_count = 0;
+	p->p_spare = NULL;
+	pollqueue_init(&p->p_pollq);
+	p->p_readopen = p->p_writeopen = true;
+	p->p_readnonblock = p->p_writenonblock = false;
+
+	result = vnode_init(&p->p_readvn, &pipe_vnode_ops, NULL, p);
+	if (result) {
+		goto fail_writecv;
+	}
+	result = vnode_init(&p->p_writevn, &pipe_vnode_ops, NULL, p);
+	if (result) {
+		vnode_cleanup(&p->p_readvn);
+		goto fail_writecv;
+	}
+
+	*readvn_ret = &p->p_readvn;
+	*writevn_ret = &p->p_writevn;
+	return 0;
+
+ fail_writecv:
+	cv_destroy(p->p_writecv);
+ fail_readcv:
+	cv_destroy(p->p_readcv);
+ fail_lock:
+	lock_destroy(p->p_lock);
+ fail_pipe:
+	kfree(p);
+	return result;
+}
+
+/*
+ * Set or clear nonblocking mode on one end. This affects later reads
+ * and writes; anyone already waiting keeps waiting.
+ */
+void
+pipe_setnonblock(struct vnode *vn, bool nonblock)
+{
+	struct pipe *p = vn->vn_data;
+
+	KASSERT(vn->vn_ops == &pipe_vnode_ops);
+
+	lock_acquire(p->p_lock);
+	if (vn == &p->p_readvn) {
+		p->p_readnonblock = nonblock;
+	}
+	else {
+		p->p_writenonblock = nonblock;
+	}
+	lock_release(p->p_lock);
+}
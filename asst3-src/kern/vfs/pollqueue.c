@@ -0,0 +1,136 @@
+/*
+ * Wait queues for poll(). See pollqueue.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <wchan.h>
+#include <pollqueue.h>
+
+////////////////////////////////////////////////////////////
+// queues
+
+void
+pollqueue_init(struct pollqueue *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_head = NULL;
+}
+
+void
+pollqueue_cleanup(struct pollqueue *pq)
+{
+	KASSERT(pq->pq_head == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+void
+pollqueue_add(struct pollqueue *pq, struct pollentry *pe)
+{
+	KASSERT(pe->pe_queue == NULL);
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_queue = pq;
+	pe->pe_next = pq->pq_head;
+	pe->pe_prevp = &pq->pq_head;
+	if (pq->pq_head != NULL) {
+		pq->pq_head->pe_prevp = &pe->pe_next;
+	}
+	pq->pq_head = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+void
+pollqueue_wakeup(struct pollqueue *pq)
+{
+	struct pollentry *pe;
+	struct pollwaiter *pw;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_head; pe != NULL; pe = pe->pe_next) {
+		pw = pe->pe_waiter;
+		spinlock_acquire(&pw->pw_lock);
+		if (!pw->pw_woken) {
+			pw->pw_woken = true;
+			wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+		}
+		spinlock_release(&pw->pw_lock);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// waiters and entries
+
+int
+pollwaiter_init(struct pollwaiter *pw)
+{
+	pw->pw_wchan = wchan_create("poll");
+	if (pw->pw_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pw->pw_lock);
+	pw->pw_woken = false;
+	return 0;
+}
+
+void
+pollwaiter_cleanup(struct pollwaiter *pw)
+{
+	spinlock_cleanup(&pw->pw_lock);
+	wchan_destroy(pw->pw_wchan);
+}
+
+/*
+ * Sleep until a pollqueue_wakeup or the time runs out, and reset the
+ * waiter for next time.
+ */
+int
+pollwaiter_wait(struct pollwaiter *pw, bool forever, uint64_t nsecs)
+{
+	int result = 0;
+
+	spinlock_acquire(&pw->pw_lock);
+	while (!pw->pw_woken && result == 0) {
+		if (forever) {
+			wchan_sleep(pw->pw_wchan, &pw->pw_lock);
+		}
+		else {
+			result = wchan_sleep_timeout(pw->pw_wchan,
+						     &pw->pw_lock, nsecs);
+		}
+	}
+	if (pw->pw_woken) {
+		result = 0;
+	}
+	pw->pw_woken = false;
+	spinlock_release(&pw->pw_lock);
+	return result;
+}
+
+void
+pollentry_init(struct pollentry *pe, struct pollwaiter *pw)
+{
+	pe->pe_waiter = pw;
+	pe->pe_queue = NULL;
+	pe->pe_next = NULL;
+	pe->pe_prevp = NULL;
+}
+
+void
+pollentry_remove(struct pollentry *pe)
+{
+	struct pollqueue *pq = pe->pe_queue;
+
+	if (pq == NULL) {
+		return;
+	}
+	spinlock_acquire(&pq->pq_lock);
+	*pe->pe_prevp = pe->pe_next;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_prevp = pe->pe_prevp;
+	}
+	spinlock_release(&pq->pq_lock);
+	pollentry_init(pe, pe->pe_waiter);
+}
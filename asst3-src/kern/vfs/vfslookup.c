@@ -120,14 +120,32 @@ vfs_clearbootfs(void)
 }
 
 
+/*
+ * Get the directory relative paths start from: DIR if there is one,
+ * otherwise the current directory.
+ */
+static
+int
+getstartdir(struct vnode *dir, struct vnode **ret)
+{
+	if (dir == NULL) {
+		return vfs_getcurdir(ret);
+	}
+	VOP_INCREF(dir);
+	*ret = dir;
+	return 0;
+}
+
 /*
  * Common code to pull the device name, if any, off the front of a
  * path and choose the vnode to begin the name lookup relative to.
+ * DIR stands in for the current directory, unless it's NULL.
  */
 
 static
 int
-getdevice(char *path, char **subpath, struct vnode **startvn)
+getdevice(char *path, struct vnode *dir, char **subpath,
+	  struct vnode **startvn)
 {
 	int slash=-1, colon=-1, i;
 	struct vnode *vn;
@@ -166,7 +184,7 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 		 * use the whole thing as the subpath.
 		 */
 		*subpath = path;
-		return vfs_getcurdir(startvn);
+		return getstartdir(dir, startvn);
 	}
 
 	if (colon>0) {
@@ -204,7 +222,7 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	else {
 		KASSERT(path[0]==':');
 
-		result = vfs_getcurdir(&vn);
+		result = getstartdir(dir, &vn);
 		if (result) {
 			return result;
 		}
@@ -240,15 +258,15 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
  */
 
 int
-vfs_lookparent(char *path, struct vnode **retval,
-	       char *buf, size_t buflen)
+vfs_lookparentat(struct vnode *dir, char *path, struct vnode **retval,
+		 char *buf, size_t buflen)
 {
 	struct vnode *startvn;
 	int result;
 
 	vfs_biglock_acquire();
 
-	result = getdevice(path, &path, &startvn);
+	result = getdevice(path, dir, &path, &startvn);
 	if (result) {
 		vfs_biglock_release();
 		return result;
@@ -273,14 +291,14 @@ vfs_lookparent(char *path, struct vnode **retval,
 }
 
 int
-vfs_lookup(char *path, struct vnode **retval)
+vfs_lookupat(struct vnode *dir, char *path, struct vnode **retval)
 {
 	struct vnode *startvn;
 	int result;
 
 	vfs_biglock_acquire();
 
-	result = getdevice(path, &path, &startvn);
+	result = getdevice(path, dir, &path, &startvn);
 	if (result) {
 		vfs_biglock_release();
 		return result;
@@ -298,3 +316,16 @@ vfs_lookup(char *path, struct vnode **retval)
 	vfs_biglock_release();
 	return result;
 }
+
+int
+vfs_lookparent(char *path, struct vnode **retval,
+	       char *buf, size_t buflen)
+{
+	return vfs_lookparentat(NULL, path, retval, buf, buflen);
+}
+
+int
+vfs_lookup(char *path, struct vnode **retval)
+{
+	return vfs_lookupat(NULL, path, retval);
+}
@@ -43,6 +43,13 @@
 /* Does most of the work for open(). */
 int
 vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
+{
+	return vfs_openat(NULL, path, openflags, mode, ret);
+}
+
+int
+vfs_openat(struct vnode *dir, char *path, int openflags, mode_t mode,
+	   struct vnode **ret)
 {
 	int how;
 	int result;
@@ -65,20 +72,21 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 
 	if (openflags & O_CREAT) {
 		char name[NAME_MAX+1];
-		struct vnode *dir;
+		struct vnode *parent;
 		int excl = (openflags & O_EXCL)!=0;
 
-		result = vfs_lookparent(path, &dir, name, sizeof(name));
+		result = vfs_lookparentat(dir, path, &parent, name,
+					  sizeof(name));
 		if (result) {
 			return result;
 		}
 
-		result = VOP_CREAT(dir, name, excl, mode, &vn);
+		result = VOP_CREAT(parent, name, excl, mode, &vn);
 
-		VOP_DECREF(dir);
+		VOP_DECREF(parent);
 	}
 	else {
-		result = vfs_lookup(path, &vn);
+		result = vfs_lookupat(dir, path, &vn);
 	}
 
 	if (result) {
@@ -32,6 +32,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
@@ -176,3 +177,17 @@ vnode_check(struct vnode *v, const char *opstr)
 	spinlock_release(&v->vn_countlock);
 	/*vfs_biglock_release();*/
 }
+
+/*
+ * VOP_POLL for things that are always ready.
+ */
+int
+vopnull_poll(struct vnode *vn, int events, struct pollentry *entry,
+	     int *revents)
+{
+	(void)vn;
+	(void)entry;
+
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
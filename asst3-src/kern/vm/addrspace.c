@@ -112,6 +112,18 @@ int as_copy(struct addrspace *old, struct addrspace **ret)
         {
             entrylo_old = vm_lookup(old, old_region->vbase + i * PAGE_SIZE);
             entryhi = (old_region->vbase + i * PAGE_SIZE) & TLBHI_VPAGE;
+            // shared memory: hand over the same frame, still writable
+            if (entrylo_old && (old_region->flags & RG_SHARED))
+            {
+                result = vm_insert(newas, new_region->vbase + i * PAGE_SIZE, entrylo_old);
+                if (result)
+                {
+                    as_destroy(newas);
+                    return result;
+                }
+                share_page(entrylo_old & PAGE_FRAME);
+                continue;
+            }
             // if we do have a entry, we need to insert a new one for newas
             if (entrylo_old)
             {
@@ -470,6 +482,65 @@ int as_define_mmap(struct addrspace *as, vaddr_t vaddr, size_t memsize,
     return 0;
 }
 
+// anonymous memory shared across fork
+// every page gets its frame now, so as_copy always has one to share
+int as_define_shared(struct addrspace *as, vaddr_t vaddr, size_t memsize,
+                     int readable, int writeable)
+{
+    int result;
+    paddr_t paddr;
+    uint32_t entrylo;
+    struct region_entry *region, **pp;
+    region = kmalloc(sizeof(struct region_entry));
+    if (region == NULL)
+    {
+        return ENOMEM;
+    }
+    result = create_region(region, vaddr, memsize, readable, writeable, 0);
+    if (result)
+    {
+        kfree(region);
+        return result;
+    }
+    region->flags |= RG_SHARED;
+    result = insert_region(as, region);
+    if (result)
+    {
+        return result;
+    }
+    for (uint32_t i = 0; i < region->npages; i++)
+    {
+        result = get_frame(&paddr);
+        if (result)
+        {
+            break;
+        }
+        entrylo = (paddr & TLBLO_PPAGE) | TLBLO_VALID;
+        if (writeable)
+        {
+            entrylo |= TLBLO_DIRTY;
+        }
+        result = vm_insert(as, region->vbase + i * PAGE_SIZE, entrylo);
+        if (result)
+        {
+            free_kpages(PADDR_TO_KVADDR(paddr));
+            break;
+        }
+    }
+    if (result)
+    {
+        // unlink it; region_destroy gives back the frames we got
+        for (pp = &as->region; *pp != region; pp = &(*pp)->next)
+        {
+            KASSERT(*pp != NULL);
+        }
+        *pp = region->next;
+        region_destroy(as, region);
+        return result;
+    }
+    return 0;
+}
+
 int find_mmap_place(struct addrspace *as, size_t length, vaddr_t *vaddr)
 {
     struct region_entry *region;
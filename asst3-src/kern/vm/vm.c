@@ -396,6 +396,29 @@ int vm_fault(int faulttype, vaddr_t faultaddress)
     return 0;
 }
 
+/*
+ * The physical address of VADDR if it's in a shared region of AS,
+ * otherwise 0. Shared regions get all their frames when created, so
+ * the page is always there.
+ */
+paddr_t vm_sharedpaddr(struct addrspace *as, vaddr_t vaddr)
+{
+    struct region_entry *region;
+    uint32_t entrylo;
+
+    region = get_region(as, vaddr);
+    if (region == NULL || !(region->flags & RG_SHARED))
+    {
+        return 0;
+    }
+    entrylo = vm_lookup(as, vaddr);
+    if (entrylo == 0)
+    {
+        return 0;
+    }
+    return (entrylo & PAGE_FRAME) | (vaddr & ~(vaddr_t)PAGE_FRAME);
+}
+
 void tlb_flush(void)
 {
     int spl, i;
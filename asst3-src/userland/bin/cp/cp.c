@@ -35,6 +35,9 @@
  * Usage: cp oldfile newfile
  */
 
+/* how much to ask copy_file_range for at once */
+#define COPYCHUNK (1024*1024)
+
 
 /* Copy one file to another. */
 static
@@ -58,6 +61,19 @@ copy(const char *from, const char *to)
 		err(1, "%s", to);
 	}
 
+	/*
+	 * Have the kernel do the copying if it can; then the data
+	 * never comes out here. If it fails, carry on below with
+	 * read and write from wherever it got to.
+	 */
+	while ((len = copy_file_range(fromfd, NULL, tofd, NULL,
+				      COPYCHUNK, 0)) > 0) {
+		/* nothing */
+	}
+	if (len == 0) {
+		goto done;
+	}
+
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -85,6 +101,7 @@ copy(const char *from, const char *to)
 		err(1, "%s", from);
 	}
 
+ done:
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
 	}
@@ -355,6 +355,116 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * runstage
+ * in the child, hooks up stdin and stdout for one command of a
+ * pipeline and runs it. doesn't return.
+ */
+static
+void
+runstage(char *args[], int infd, int outfd)
+{
+	if (infd != STDIN_FILENO) {
+		dup2(infd, STDIN_FILENO);
+		close(infd);
+	}
+	if (outfd != STDOUT_FILENO) {
+		dup2(outfd, STDOUT_FILENO);
+		close(outfd);
+	}
+	execvp(args[0], args);
+	warn("%s", args[0]);
+	/* _exit, not exit; see docommand */
+	_exit(1);
+}
+
+/*
+ * dopipeline
+ * runs the commands in args, separated by "|", with each one's output
+ * connected to the next one's input with a pipe, and waits for them
+ * all. the exit status is the last command's. builtins and "&" aren't
+ * supported in pipelines.
+ */
+static
+void
+dopipeline(char *args[], int nargs, struct exitinfo *ei)
+{
+	pid_t pids[NARG_MAX / 2 + 1];
+	int npids, start, i;
+	int fds[2], infd, outfd;
+	int status;
+
+	if (!strcmp(args[nargs-1], "&")) {
+		printf("Pipelines can't be run in the background\n");
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
+	npids = 0;
+	infd = STDIN_FILENO;
+	for (start = 0; start < nargs; start = i + 1) {
+		/* find the end of this command and cut it off there */
+		for (i = start; i < nargs && strcmp(args[i], "|"); i++) {
+			/* nothing */
+		}
+		if (i == start || (i == nargs - 1)) {
+			printf("Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			break;
+		}
+		args[i] = NULL;
+
+		if (i < nargs) {
+			if (pipe(fds) < 0) {
+				warn("pipe");
+				exitinfo_exit(ei, 255);
+				break;
+			}
+			outfd = fds[1];
+		}
+		else {
+			outfd = STDOUT_FILENO;
+		}
+
+		pids[npids] = fork();
+		if (pids[npids] == 0) {
+			if (outfd != STDOUT_FILENO) {
+				close(fds[0]);
+			}
+			runstage(&args[start], infd, outfd);
+		}
+
+		/* the parent keeps only the read end of the new pipe */
+		if (infd != STDIN_FILENO) {
+			close(infd);
+		}
+		if (outfd != STDOUT_FILENO) {
+			close(outfd);
+			infd = fds[0];
+		}
+		if (pids[npids] < 0) {
+			warn("fork");
+			exitinfo_exit(ei, 255);
+			break;
+		}
+		npids++;
+	}
+	if (infd != STDIN_FILENO) {
+		close(infd);
+	}
+
+	/* wait for them all; the last one's status is the pipeline's */
+	for (i = 0; i < npids; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else if (i == npids - 1 && start >= nargs) {
+			readstatus(status, ei);
+		}
+	}
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
@@ -394,6 +504,13 @@ docommand(char *buf, struct exitinfo *ei)
 		return;
 	}
 
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			dopipeline(args, nargs, ei);
+			return;
+		}
+	}
+
 	for (i=0; builtins[i].name; i++) {
 		if (!strcmp(builtins[i].name, args[0])) {
 			builtins[i].func(nargs, args, ei);
@@ -0,0 +1,23 @@
+/*
+ * Submission/completion rings: batched file I/O. See <kern/ioring.h>
+ * for the layout of the ring.
+ */
+
+#ifndef _IORING_H_
+#define _IORING_H_
+
+#include <sys/types.h>
+#include <kern/ioring.h>
+
+/*
+ * ioring_setup registers RING, whose ir_entries, ir_sqes, and ir_cqes
+ * must be filled in, and zeroes its counters.
+ *
+ * ioring_enter posts finished operations, submits up to TO_SUBMIT
+ * queued ones, and waits until MIN_COMPLETE completions have been
+ * posted. Returns the number submitted.
+ */
+int ioring_setup(struct ioring *ring);
+int ioring_enter(unsigned to_submit, unsigned min_complete);
+
+#endif /* _IORING_H_ */
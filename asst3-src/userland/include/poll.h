@@ -0,0 +1,14 @@
+/*
+ * poll() - wait for one of several files to be ready.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+#include <sys/types.h>
+#include <kern/poll.h>
+
+/* TIMEOUT is in milliseconds; negative waits forever. */
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+#endif /* _POLL_H_ */
@@ -0,0 +1,22 @@
+/*
+ * Scheduling control.
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+/* Get cpu_set_t and the CPU_ macros from the kernel. */
+#include <sys/types.h>
+#include <kern/sched.h>
+
+/*
+ * Set or get the cpus process PID (0 for the caller) may run on.
+ * SETSIZE is sizeof(cpu_set_t).
+ */
+int sched_setaffinity(pid_t pid, size_t setsize, const cpu_set_t *set);
+int sched_getaffinity(pid_t pid, size_t setsize, cpu_set_t *set);
+
+/* The number of the cpu the caller is running on. */
+int sched_getcpu(void);
+
+#endif /* _SCHED_H_ */
@@ -0,0 +1,25 @@
+/*
+ * Resource usage.
+ */
+
+#ifndef _SYS_RESOURCE_H_
+#define _SYS_RESOURCE_H_
+
+/* Get struct rusage and the RUSAGE_ codes from the kernel. */
+#include <sys/types.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+
+/*
+ * Only the user and system cpu times (ru_utime and ru_stime) are
+ * filled in; the rest of the structure is zero.
+ */
+int getrusage(int who, struct rusage *usage);
+
+/*
+ * Only RLIMIT_NOFILE, the limit on file descriptors, is supported.
+ */
+int getrlimit(int resource, struct rlimit *rlp);
+int setrlimit(int resource, const struct rlimit *rlp);
+
+#endif /* _SYS_RESOURCE_H_ */
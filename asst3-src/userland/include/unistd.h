@@ -145,8 +145,13 @@ ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+/* readv, writev, preadv, pwritev - see sys/uio.h */
 int pipe(int filehandles[2]);
+int fcntl(int filehandle, int code, ...);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -167,7 +172,29 @@ time_t time(time_t *seconds);			/* calls __time */
 #define PROT_READ 1
 #define PROT_WRITE 2
 
+/*
+ * With fd -1, mmap gives zeroed memory that is shared with children
+ * across fork rather than copied; offset is ignored.
+ */
+
 void *mmap(size_t length, int prot, int fd, off_t offset);
 int munmap(void *addr);
 
+/*
+ * Futexes: sleep while *addr == expected, and wake up to n sleepers
+ * on addr. These are the kernel half of the mutexes and semaphores
+ * in <usync.h>; you normally want those instead.
+ */
+int futex_wait(volatile int *addr, int expected);
+int futex_wake(volatile int *addr, unsigned n);
+
+/*
+ * Copy up to len bytes from one file to another inside the kernel.
+ * If inpos or outpos is not NULL it's the position to use at that
+ * end, and is updated; otherwise that file's seek position is used.
+ * flags must be 0. Returns the amount copied, 0 at end of file.
+ */
+ssize_t copy_file_range(int infd, off_t *inpos, int outfd, off_t *outpos,
+			size_t len, unsigned flags);
+
 #endif /* _UNISTD_H_ */
@@ -0,0 +1,43 @@
+/*
+ * User-level mutexes and semaphores.
+ */
+
+#ifndef _USYNC_H_
+#define _USYNC_H_
+
+/*
+ * These live in ordinary user memory and are manipulated with atomic
+ * instructions; the kernel is entered (via futex_wait/futex_wake)
+ * only when a thread actually has to sleep or wake someone up.
+ *
+ * Futexes are named by address space and address, except in memory
+ * from mmap with fd -1, where they are named by physical address. So
+ * these synchronize threads that share an address space, and also
+ * processes that share such memory after fork.
+ *
+ * Both can be initialized statically with the _INITIALIZER macros.
+ */
+
+struct umutex {
+	volatile int um_state;	/* 0 free, 1 held, 2 held with sleepers */
+};
+
+struct usema {
+	volatile int us_count;
+	volatile int us_sleepers;
+};
+
+#define UMUTEX_INITIALIZER	{ 0 }
+#define USEMA_INITIALIZER(n)	{ (n), 0 }
+
+void umutex_init(struct umutex *);
+void umutex_lock(struct umutex *);
+int umutex_trylock(struct umutex *);	/* returns 1 on success */
+void umutex_unlock(struct umutex *);
+
+void usema_init(struct usema *, unsigned count);
+void usema_P(struct usema *);
+int usema_tryP(struct usema *);		/* returns 1 on success */
+void usema_V(struct usema *);
+
+#endif /* _USYNC_H_ */
@@ -0,0 +1,205 @@
+/*
+ * User-level mutexes and semaphores built on futex_wait/futex_wake.
+ * See <usync.h>.
+ */
+
+#include <unistd.h>
+#include <usync.h>
+
+/*
+ * How many times to retry in user space before going to sleep in
+ * the kernel. Only useful on a multiprocessor, but cheap otherwise.
+ */
+#define USYNC_SPINS	100
+
+/*
+ * Atomic operations, using LL/SC (see the kernel's spinlock code
+ * for an explanation). Each is bracketed with SYNC so that it is
+ * also a full memory barrier.
+ */
+
+/* If *p == old, set it to new. Returns the old contents of *p. */
+static
+int
+usync_cas(volatile int *p, int old, int new)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"sync;"
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   if (x != old) give up */
+		"move %1, %4;"		/*   (delay slot) y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   lost the reservation; retry */
+		"nop;"
+		"2: sync;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return x;
+}
+
+/* Add delta to *p. Returns the old contents of *p. */
+static
+int
+usync_add(volatile int *p, int delta)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set noreorder;"
+		"sync;"
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + delta */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"
+		"nop;"
+		"sync;"
+		".set pop"
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return x;
+}
+
+/* Set *p to val. Returns the old contents of *p. */
+static
+int
+usync_swap(volatile int *p, int val)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set noreorder;"
+		"sync;"
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"move %1, %3;"		/*   y = val */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"
+		"nop;"
+		"sync;"
+		".set pop"
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (val)
+		: "memory");
+	return x;
+}
+
+////////////////////////////////////////////////////////////
+// mutex
+
+/*
+ * The state word is 0 when free, 1 when held, and 2 when held and
+ * someone may be asleep waiting for it. Only a thread that has seen
+ * (or set) 2 goes to sleep, and only an unlock that finds 2 calls
+ * into the kernel, so the uncontended paths are one atomic op each.
+ */
+
+void
+umutex_init(struct umutex *m)
+{
+	m->um_state = 0;
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	return usync_cas(&m->um_state, 0, 1) == 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	unsigned i;
+
+	for (i=0; i<USYNC_SPINS; i++) {
+		if (m->um_state == 0 && umutex_trylock(m)) {
+			return;
+		}
+	}
+
+	/*
+	 * Mark it contended. If it was free in the meantime, we now
+	 * hold it (in state 2, which costs the eventual unlock a
+	 * harmless extra syscall).
+	 */
+	while (usync_swap(&m->um_state, 2) != 0) {
+		(void)futex_wait(&m->um_state, 2);
+	}
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	if (usync_add(&m->um_state, -1) != 1) {
+		/* was 2: there may be sleepers */
+		m->um_state = 0;
+		(void)futex_wake(&m->um_state, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// semaphore
+
+/*
+ * Sleepers wait on the count word for it to stop being 0. A V that
+ * races with a P on its way to sleep either sees the sleeper count
+ * and wakes it, or changes the count first so that the P's
+ * futex_wait fails with EAGAIN and it goes around again.
+ */
+
+void
+usema_init(struct usema *s, unsigned count)
+{
+	s->us_count = count;
+	s->us_sleepers = 0;
+}
+
+int
+usema_tryP(struct usema *s)
+{
+	int c;
+
+	while ((c = s->us_count) > 0) {
+		if (usync_cas(&s->us_count, c, c - 1) == c) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void
+usema_P(struct usema *s)
+{
+	unsigned i;
+
+	for (i=0; i<USYNC_SPINS; i++) {
+		if (usema_tryP(s)) {
+			return;
+		}
+	}
+
+	while (!usema_tryP(s)) {
+		usync_add(&s->us_sleepers, 1);
+		(void)futex_wait(&s->us_count, 0);
+		usync_add(&s->us_sleepers, -1);
+	}
+}
+
+void
+usema_V(struct usema *s)
+{
+	usync_add(&s->us_count, 1);
+	if (s->us_sleepers > 0) {
+		(void)futex_wake(&s->us_count, 1);
+	}
+}
@@ -0,0 +1,168 @@
+/*
+ * affinity - check sched_setaffinity and sched_getaffinity.
+ *
+ * Checks the error cases, that a mask set is what comes back (limited
+ * to the cpus that exist), and that a forked child inherits it. Then
+ * pins itself to each cpu in turn, checks it is running there, and
+ * burns some time there, which shows up in the kernel's top command.
+ * Nothing else is running, so this also checks that pinning moves a
+ * thread off its cpu when there's nothing to switch to.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <err.h>
+
+#define SPINS 2000000
+
+static
+void
+check_errors(void)
+{
+	cpu_set_t cs;
+
+	CPU_ZERO(&cs);
+	if (sched_setaffinity(0, sizeof(cs), &cs) != -1 || errno != EINVAL) {
+		errx(1, "empty mask: expected EINVAL (errno %d)", errno);
+	}
+	CPU_SET(0, &cs);
+	if (sched_setaffinity(0, 1, &cs) != -1 || errno != EINVAL) {
+		errx(1, "short setsize: expected EINVAL (errno %d)", errno);
+	}
+	if (sched_getaffinity(30000, sizeof(cs), &cs) != -1 ||
+	    errno != ESRCH) {
+		errx(1, "bogus pid: expected ESRCH (errno %d)", errno);
+	}
+	printf("error cases: ok\n");
+}
+
+/*
+ * Returns the mask of cpus that exist, which is what setting all
+ * bits gives back.
+ */
+static
+cpu_set_t
+check_all(void)
+{
+	cpu_set_t cs;
+	unsigned i, n;
+
+	CPU_ZERO(&cs);
+	for (i=0; i<CPU_SETSIZE; i++) {
+		CPU_SET(i, &cs);
+	}
+	if (sched_setaffinity(0, sizeof(cs), &cs) == -1) {
+		err(1, "sched_setaffinity (all)");
+	}
+	if (sched_getaffinity(0, sizeof(cs), &cs) == -1) {
+		err(1, "sched_getaffinity");
+	}
+	n = 0;
+	for (i=0; i<CPU_SETSIZE; i++) {
+		if (CPU_ISSET(i, &cs)) {
+			n++;
+		}
+	}
+	if (n == 0 || !CPU_ISSET(0, &cs)) {
+		errx(1, "bad mask for all cpus: 0x%x", cs.__bits);
+	}
+	printf("%u cpus\n", n);
+	return cs;
+}
+
+static
+void
+spin(void)
+{
+	volatile unsigned i;
+
+	for (i=0; i<SPINS; i++) {
+		/* nothing */
+	}
+}
+
+static
+void
+check_pinned(cpu_set_t all)
+{
+	cpu_set_t cs, got;
+	unsigned i;
+
+	for (i=0; i<CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, &all)) {
+			continue;
+		}
+		CPU_ZERO(&cs);
+		CPU_SET(i, &cs);
+		if (sched_setaffinity(0, sizeof(cs), &cs) == -1) {
+			err(1, "sched_setaffinity (cpu %u)", i);
+		}
+		if (sched_getcpu() != (int)i) {
+			errx(1, "pinned to cpu %u but running on cpu %d",
+			     i, sched_getcpu());
+		}
+		spin();
+		if (sched_getcpu() != (int)i) {
+			errx(1, "pinned to cpu %u but moved to cpu %d",
+			     i, sched_getcpu());
+		}
+		if (sched_getaffinity(0, sizeof(got), &got) == -1) {
+			err(1, "sched_getaffinity");
+		}
+		if (got.__bits != cs.__bits) {
+			errx(1, "pinned to cpu %u but got mask 0x%x",
+			     i, got.__bits);
+		}
+	}
+	printf("pinning: ok\n");
+}
+
+static
+void
+check_inherit(void)
+{
+	cpu_set_t cs, got;
+	pid_t pid;
+	int status;
+
+	CPU_ZERO(&cs);
+	CPU_SET(0, &cs);
+	if (sched_setaffinity(0, sizeof(cs), &cs) == -1) {
+		err(1, "sched_setaffinity (cpu 0)");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (sched_getaffinity(0, sizeof(got), &got) == -1) {
+			err(1, "child: sched_getaffinity");
+		}
+		_exit(got.__bits == cs.__bits ? 0 : 1);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child did not inherit the mask");
+	}
+	printf("inheritance: ok\n");
+}
+
+int
+main(void)
+{
+	cpu_set_t all;
+
+	check_errors();
+	all = check_all();
+	check_pinned(all);
+	check_inherit();
+	printf("affinity: passed\n");
+	return 0;
+}
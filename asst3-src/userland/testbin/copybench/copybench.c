@@ -0,0 +1,197 @@
+/*
+ * copybench - compare copying a file with read/write and with
+ * copy_file_range.
+ *
+ * Creates a file of the given size, bigfile style, then copies it
+ * with a read/write loop using a 1k buffer (what cp used to do), the
+ * same with a 4k buffer, and with copy_file_range. Each copy is
+ * checked against the original, and the time and throughput of each
+ * is printed.
+ *
+ * Usage: copybench <size> [<source> [<dest>]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define BUFSIZE 4096
+
+static char buf[BUFSIZE];
+static char buf2[BUFSIZE];
+
+/* nanoseconds since some time or other */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000000ULL + nsecs;
+}
+
+static
+void
+report(const char *mode, size_t size, unsigned long long nsecs)
+{
+	unsigned long long usecs;
+
+	usecs = nsecs / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("copy: mode=%s bytes=%lu us=%llu kb_per_sec=%llu\n",
+	       mode, (unsigned long)size, usecs,
+	       (unsigned long long)size * 1000000ULL / 1024 / usecs);
+}
+
+static
+void
+makefile(const char *name, size_t size)
+{
+	size_t pos, len;
+	int fd;
+
+	fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	for (pos = 0; pos < size; pos += len) {
+		len = size - pos < BUFSIZE ? size - pos : BUFSIZE;
+		snprintf(buf, BUFSIZE, "%lu\n", (unsigned long)pos);
+		memset(buf + strlen(buf), '.', BUFSIZE - strlen(buf));
+		if (write(fd, buf, len) != (ssize_t)len) {
+			err(1, "%s: write", name);
+		}
+	}
+	close(fd);
+}
+
+static
+void
+checkfile(const char *from, const char *to, size_t size)
+{
+	int fd1, fd2;
+	ssize_t len1, len2;
+	size_t pos;
+
+	fd1 = open(from, O_RDONLY);
+	if (fd1 < 0) {
+		err(1, "%s", from);
+	}
+	fd2 = open(to, O_RDONLY);
+	if (fd2 < 0) {
+		err(1, "%s", to);
+	}
+	pos = 0;
+	while ((len1 = read(fd1, buf, BUFSIZE)) > 0) {
+		len2 = read(fd2, buf2, len1);
+		if (len2 != len1 || memcmp(buf, buf2, len1) != 0) {
+			errx(1, "%s: differs from %s at or after %lu",
+			     to, from, (unsigned long)pos);
+		}
+		pos += len1;
+	}
+	if (pos != size || read(fd2, buf2, 1) != 0) {
+		errx(1, "%s: wrong size", to);
+	}
+	close(fd1);
+	close(fd2);
+}
+
+static
+void
+copy_readwrite(const char *from, const char *to, size_t bufsize)
+{
+	int fromfd, tofd;
+	ssize_t len, wr, wrtot;
+
+	fromfd = open(from, O_RDONLY);
+	if (fromfd < 0) {
+		err(1, "%s", from);
+	}
+	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (tofd < 0) {
+		err(1, "%s", to);
+	}
+	while ((len = read(fromfd, buf, bufsize)) > 0) {
+		for (wrtot = 0; wrtot < len; wrtot += wr) {
+			wr = write(tofd, buf + wrtot, len - wrtot);
+			if (wr < 0) {
+				err(1, "%s: write", to);
+			}
+		}
+	}
+	if (len < 0) {
+		err(1, "%s: read", from);
+	}
+	close(fromfd);
+	close(tofd);
+}
+
+static
+void
+copy_range(const char *from, const char *to)
+{
+	int fromfd, tofd;
+	ssize_t len;
+
+	fromfd = open(from, O_RDONLY);
+	if (fromfd < 0) {
+		err(1, "%s", from);
+	}
+	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (tofd < 0) {
+		err(1, "%s", to);
+	}
+	while ((len = copy_file_range(fromfd, NULL, tofd, NULL,
+				      1024*1024, 0)) > 0) {
+		/* nothing */
+	}
+	if (len < 0) {
+		err(1, "copy_file_range");
+	}
+	close(fromfd);
+	close(tofd);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *from, *to;
+	unsigned long long start;
+	size_t size;
+
+	if (argc < 2 || argc > 4) {
+		errx(1, "Usage: copybench <size> [<source> [<dest>]]");
+	}
+	size = atoi(argv[1]);
+	from = argc > 2 ? argv[2] : "copybench.src";
+	to = argc > 3 ? argv[3] : "copybench.dst";
+
+	makefile(from, size);
+
+	start = now();
+	copy_readwrite(from, to, 1024);
+	report("readwrite_1k", size, now() - start);
+	checkfile(from, to, size);
+
+	start = now();
+	copy_readwrite(from, to, 4096);
+	report("readwrite_4k", size, now() - start);
+	checkfile(from, to, size);
+
+	start = now();
+	copy_range(from, to);
+	report("copy_file_range", size, now() - start);
+	checkfile(from, to, size);
+
+	remove(from);
+	remove(to);
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * fdlimit - check the file table's growth and RLIMIT_NOFILE.
+ *
+ * Raises the limit, opens the console until open fails with EMFILE,
+ * which takes the file table through several rounds of growth, and
+ * checks that the lowest free descriptor is always the one used.
+ * Then lowers the limit below what's open and checks that new
+ * descriptors are refused but the open ones can still be closed, and
+ * that a forked child inherits the limit.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define BIGLIMIT 300
+#define SMALLLIMIT 40
+
+static
+void
+setlimit(rlim_t cur, rlim_t max)
+{
+	struct rlimit rl;
+
+	rl.rlim_cur = cur;
+	rl.rlim_max = max;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		err(1, "setrlimit %llu %llu", cur, max);
+	}
+}
+
+static
+struct rlimit
+check_errors(void)
+{
+	struct rlimit rl, bad;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		err(1, "getrlimit");
+	}
+	printf("limit %llu, max %llu\n", rl.rlim_cur, rl.rlim_max);
+	if (rl.rlim_max < BIGLIMIT) {
+		errx(1, "max limit is less than %d", BIGLIMIT);
+	}
+
+	bad.rlim_cur = rl.rlim_max + 1;
+	bad.rlim_max = rl.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &bad) != -1 || errno != EINVAL) {
+		errx(1, "cur above max: expected EINVAL (errno %d)", errno);
+	}
+	bad.rlim_cur = rl.rlim_cur;
+	bad.rlim_max = rl.rlim_max + 1;
+	if (setrlimit(RLIMIT_NOFILE, &bad) != -1 || errno != EPERM) {
+		errx(1, "raising max: expected EPERM (errno %d)", errno);
+	}
+	if (getrlimit(RLIMIT_CPU, &bad) != -1 || errno != EINVAL) {
+		errx(1, "RLIMIT_CPU: expected EINVAL (errno %d)", errno);
+	}
+	printf("error cases: ok\n");
+	return rl;
+}
+
+static
+void
+check_fill(void)
+{
+	int fd, expect;
+
+	setlimit(BIGLIMIT, BIGLIMIT);
+	for (expect = 3; ; expect++) {
+		fd = open("con:", O_RDONLY);
+		if (fd < 0) {
+			break;
+		}
+		if (fd != expect) {
+			errx(1, "open gave fd %d, expected %d", fd, expect);
+		}
+	}
+	if (errno != EMFILE) {
+		err(1, "open");
+	}
+	if (expect != BIGLIMIT) {
+		errx(1, "only got to fd %d of %d", expect, BIGLIMIT);
+	}
+
+	/* the lowest free one is used */
+	close(200);
+	close(70);
+	if ((fd = open("con:", O_RDONLY)) != 70) {
+		errx(1, "reopen gave fd %d, expected 70", fd);
+	}
+	if ((fd = open("con:", O_RDONLY)) != 200) {
+		errx(1, "reopen gave fd %d, expected 200", fd);
+	}
+	if (dup2(0, BIGLIMIT) != -1 || errno != EBADF) {
+		errx(1, "dup2 at the limit: expected EBADF (errno %d)", errno);
+	}
+	printf("filling: ok\n");
+}
+
+static
+void
+check_lowered(void)
+{
+	int fd;
+
+	setlimit(SMALLLIMIT, BIGLIMIT);
+	close(10);
+	if ((fd = open("con:", O_RDONLY)) != 10) {
+		errx(1, "reopen gave fd %d, expected 10", fd);
+	}
+	if (open("con:", O_RDONLY) != -1 || errno != EMFILE) {
+		errx(1, "open over lowered limit: expected EMFILE (errno %d)",
+		     errno);
+	}
+	if (dup2(0, SMALLLIMIT + 10) != -1 || errno != EBADF) {
+		errx(1, "dup2 over lowered limit: expected EBADF (errno %d)",
+		     errno);
+	}
+	/* everything above the limit can still be closed */
+	for (fd = SMALLLIMIT; fd < BIGLIMIT; fd++) {
+		if (close(fd) == -1) {
+			err(1, "close %d", fd);
+		}
+	}
+	printf("lowering: ok\n");
+}
+
+static
+void
+check_inherit(void)
+{
+	struct rlimit rl;
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+			err(1, "child: getrlimit");
+		}
+		/* and the files, of course */
+		if (close(SMALLLIMIT - 1) == -1) {
+			err(1, "child: close");
+		}
+		_exit(rl.rlim_cur == SMALLLIMIT && rl.rlim_max == BIGLIMIT ?
+		      0 : 1);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child did not inherit the limit");
+	}
+	printf("inheritance: ok\n");
+}
+
+int
+main(void)
+{
+	int fd;
+
+	check_errors();
+	check_fill();
+	check_lowered();
+	check_inherit();
+	for (fd = 3; fd < SMALLLIMIT; fd++) {
+		close(fd);
+	}
+	printf("fdlimit: passed\n");
+	return 0;
+}
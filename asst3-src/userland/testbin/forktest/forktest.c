@@ -34,6 +34,9 @@
  *
  * It should also continue to work after subsequent assignments, most
  * notably after implementing the virtual memory system.
+ *
+ * With -t it also reports how long the forking took, which is handy
+ * for measuring fork latency.
  */
 
 #include <unistd.h>
@@ -198,20 +201,35 @@ main(int argc, char *argv[])
 {
 	static const char expected[] =
 		"|----------------------------|\n";
-	int nowait=0;
+	int nowait=0, timeit=0;
+	time_t secs0, secs1;
+	unsigned long nsecs0, nsecs1;
 
 	if (argc==2 && !strcmp(argv[1], "-w")) {
 		nowait=1;
 	}
+	else if (argc==2 && !strcmp(argv[1], "-t")) {
+		timeit=1;
+	}
 	else if (argc!=1 && argc!=0) {
-		warnx("usage: forktest [-w]");
+		warnx("usage: forktest [-w | -t]");
 		return 1;
 	}
 	warnx("Starting. Expect this many:");
 	write(STDERR_FILENO, expected, strlen(expected));
 
+	__time(&secs0, &nsecs0);
 	test(nowait);
+	__time(&secs1, &nsecs1);
 
 	warnx("Complete.");
+	if (timeit) {
+		if (nsecs1 < nsecs0) {
+			nsecs1 += 1000000000;
+			secs1--;
+		}
+		warnx("Elapsed: %lu.%09lu seconds",
+		      (unsigned long)(secs1 - secs0), nsecs1 - nsecs0);
+	}
 	return 0;
 }
@@ -0,0 +1,278 @@
+/*
+ * futextest - check the futex system calls and the <usync.h> mutexes
+ * and semaphores built on them, then time uncontended semaphore
+ * operations against semfs ("sem:"), which is what usemtest and
+ * friends use.
+ *
+ * First the system call error paths and the user-space fast paths.
+ * Then, since OS/161 processes are single-threaded, the sleeping
+ * paths are checked across fork, in memory from mmap with fd -1:
+ * a futex_wait that really sleeps until another process wakes it,
+ * processes contending for a mutex, and a semaphore ping-pong.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <usync.h>
+
+#define LOOPS 10000
+#define SEMNAME "sem:futextest"
+#define NPROCS 4
+#define SHAREDLOOPS 1000
+
+/* lives in shared memory */
+struct shared {
+	volatile int flag;
+	struct umutex mx;
+	volatile int counter;
+	struct usema ping;
+	struct usema pong;
+};
+
+static volatile int word;
+static struct umutex mx = UMUTEX_INITIALIZER;
+static struct usema sem = USEMA_INITIALIZER(2);
+
+static
+void
+check_futex(void)
+{
+	int r;
+
+	word = 1;
+	r = futex_wait(&word, 0);
+	if (r != -1 || errno != EAGAIN) {
+		errx(1, "futex_wait with wrong value: got %d (errno %d), "
+		     "expected EAGAIN", r, errno);
+	}
+	r = futex_wait((volatile int *)((char *)&word + 1), 1);
+	if (r != -1 || errno != EINVAL) {
+		errx(1, "futex_wait unaligned: got %d (errno %d), "
+		     "expected EINVAL", r, errno);
+	}
+	r = futex_wake(&word, 10);
+	if (r != 0) {
+		errx(1, "futex_wake with no sleepers returned %d", r);
+	}
+	printf("futex calls: ok\n");
+}
+
+static
+void
+check_mutex(void)
+{
+	umutex_lock(&mx);
+	if (umutex_trylock(&mx)) {
+		errx(1, "umutex_trylock succeeded on a held mutex");
+	}
+	umutex_unlock(&mx);
+	if (!umutex_trylock(&mx)) {
+		errx(1, "umutex_trylock failed on a free mutex");
+	}
+	umutex_unlock(&mx);
+	if (mx.um_state != 0) {
+		errx(1, "mutex state %d after unlock", mx.um_state);
+	}
+	printf("mutex: ok\n");
+}
+
+static
+void
+check_sema(void)
+{
+	usema_P(&sem);
+	usema_P(&sem);
+	if (usema_tryP(&sem)) {
+		errx(1, "usema_tryP succeeded on a zero semaphore");
+	}
+	usema_V(&sem);
+	if (!usema_tryP(&sem)) {
+		errx(1, "usema_tryP failed after V");
+	}
+	usema_V(&sem);
+	usema_V(&sem);
+	if (sem.us_count != 2) {
+		errx(1, "semaphore count %d, expected 2", sem.us_count);
+	}
+	printf("semaphore: ok\n");
+}
+
+static
+unsigned long
+elapsed_us(time_t s0, unsigned long ns0, time_t s1, unsigned long ns1)
+{
+	return (unsigned long)(s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+}
+
+static
+pid_t
+dofork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	return pid;
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child failed");
+	}
+}
+
+static
+void
+check_shared(void)
+{
+	struct shared *sh;
+	struct timespec ts;
+	time_t s0, s1;
+	unsigned long ns0, ns1, us;
+	pid_t pids[NPROCS];
+	unsigned i, j;
+	int r;
+
+	sh = mmap(4096, PROT_READ | PROT_WRITE, -1, 0);
+	if (sh == (void *)-1) {
+		err(1, "mmap");
+	}
+	if (sh->flag != 0 || sh->counter != 0) {
+		errx(1, "shared memory isn't zeroed");
+	}
+	umutex_init(&sh->mx);
+	usema_init(&sh->ping, 0);
+	usema_init(&sh->pong, 0);
+
+	/* a wait that sleeps until the child wakes it */
+	pids[0] = dofork();
+	if (pids[0] == 0) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 200000000;
+		nanosleep(&ts, NULL);
+		sh->flag = 1;
+		_exit(futex_wake(&sh->flag, 1) == 1 ? 0 : 1);
+	}
+	__time(&s0, &ns0);
+	r = futex_wait(&sh->flag, 0);
+	__time(&s1, &ns1);
+	us = elapsed_us(s0, ns0, s1, ns1);
+	if (r != 0) {
+		err(1, "futex_wait in shared memory");
+	}
+	if (sh->flag != 1 || us < 150000) {
+		errx(1, "futex_wait returned after %lu us with flag %d; "
+		     "it didn't sleep until woken", us, sh->flag);
+	}
+	reap(pids[0]);
+	printf("shared futex sleep/wake: ok (slept %lu us)\n", us);
+
+	/* processes contending for one mutex */
+	for (i=0; i<NPROCS; i++) {
+		pids[i] = dofork();
+		if (pids[i] == 0) {
+			for (j=0; j<SHAREDLOOPS; j++) {
+				umutex_lock(&sh->mx);
+				r = sh->counter;
+				sh->counter = r + 1;
+				umutex_unlock(&sh->mx);
+			}
+			_exit(0);
+		}
+	}
+	for (i=0; i<NPROCS; i++) {
+		reap(pids[i]);
+	}
+	if (sh->counter != NPROCS * SHAREDLOOPS) {
+		errx(1, "shared mutex: counter %d, expected %d",
+		     sh->counter, NPROCS * SHAREDLOOPS);
+	}
+	printf("shared mutex: ok\n");
+
+	/* a ping-pong, where every P has to sleep */
+	pids[0] = dofork();
+	if (pids[0] == 0) {
+		for (j=0; j<SHAREDLOOPS; j++) {
+			usema_P(&sh->ping);
+			usema_V(&sh->pong);
+		}
+		_exit(0);
+	}
+	__time(&s0, &ns0);
+	for (j=0; j<SHAREDLOOPS; j++) {
+		usema_V(&sh->ping);
+		usema_P(&sh->pong);
+	}
+	__time(&s1, &ns1);
+	reap(pids[0]);
+	printf("shared semaphore: ok (%u round trips in %lu us)\n",
+	       SHAREDLOOPS, elapsed_us(s0, ns0, s1, ns1));
+
+	if (munmap(sh) < 0) {
+		err(1, "munmap");
+	}
+}
+
+static
+void
+bench(void)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned i;
+	int fd;
+	char c = 0;
+
+	__time(&s0, &ns0);
+	for (i=0; i<LOOPS; i++) {
+		usema_V(&sem);
+		usema_P(&sem);
+	}
+	__time(&s1, &ns1);
+	printf("usema V+P: %u loops in %lu us\n", LOOPS,
+	       elapsed_us(s0, ns0, s1, ns1));
+
+	fd = open(SEMNAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		warn("%s: skipping semfs comparison", SEMNAME);
+		return;
+	}
+	__time(&s0, &ns0);
+	for (i=0; i<LOOPS; i++) {
+		if (write(fd, &c, 1) != 1 || read(fd, &c, 1) != 1) {
+			err(1, "%s", SEMNAME);
+		}
+	}
+	__time(&s1, &ns1);
+	printf("semfs V+P: %u loops in %lu us\n", LOOPS,
+	       elapsed_us(s0, ns0, s1, ns1));
+	close(fd);
+	(void)remove(SEMNAME);
+}
+
+int
+main(void)
+{
+	check_futex();
+	check_mutex();
+	check_sema();
+	check_shared();
+	bench();
+	printf("futextest: passed\n");
+	return 0;
+}
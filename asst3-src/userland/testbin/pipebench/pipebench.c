@@ -0,0 +1,296 @@
+/*
+ * pipebench - pipe throughput and latency.
+ *
+ * First checks the basics: EOF once the writer is gone, EPIPE once
+ * the reader is, and EAGAIN from a nonblocking end that would have to
+ * wait. Then a child writes the given number of bytes into a pipe in
+ * chunks of PIPE_BUF, a page, and 64k while the parent reads and
+ * checks them, and the time and throughput of each is printed; the
+ * bigger chunks go through the kernel's page handoff. Last, parent
+ * and child bounce a byte back and forth over two pipes, and the
+ * average round trip time is printed.
+ *
+ * Usage: pipebench [<size> [<roundtrips>]]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFSIZE (1024 * 1024)
+#define DEFTRIPS 1000
+#define MAXCHUNK (64 * 1024)
+
+static char buf[MAXCHUNK];
+
+/* nanoseconds since some time or other */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000000ULL + nsecs;
+}
+
+/* the byte at offset POS of the stream */
+static
+char
+pattern(size_t pos)
+{
+	return 'a' + (pos * 7 + pos / 4096) % 26;
+}
+
+static
+void
+mkpipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+static
+pid_t
+dofork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	return pid;
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child failed");
+	}
+}
+
+static
+void
+setnonblock(int fd)
+{
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+		err(1, "fcntl");
+	}
+	if ((fcntl(fd, F_GETFL, 0) & O_NONBLOCK) == 0) {
+		errx(1, "fcntl: O_NONBLOCK didn't stick");
+	}
+}
+
+static
+void
+check_basic(void)
+{
+	int fds[2];
+	ssize_t r;
+	size_t total;
+	char c;
+
+	/* data, then EOF when the writer closes */
+	mkpipe(fds);
+	if (write(fds[1], "hi", 2) != 2) {
+		err(1, "write");
+	}
+	close(fds[1]);
+	if (read(fds[0], buf, sizeof(buf)) != 2 || memcmp(buf, "hi", 2)) {
+		errx(1, "read got the wrong data");
+	}
+	if (read(fds[0], &c, 1) != 0) {
+		errx(1, "no EOF after the writer closed");
+	}
+	close(fds[0]);
+
+	/* EPIPE when the reader is gone */
+	mkpipe(fds);
+	close(fds[0]);
+	if (write(fds[1], "x", 1) != -1 || errno != EPIPE) {
+		errx(1, "write with no reader: expected EPIPE (errno %d)",
+		     errno);
+	}
+	close(fds[1]);
+
+	/* nonblocking: EAGAIN when empty, and when full */
+	mkpipe(fds);
+	setnonblock(fds[0]);
+	setnonblock(fds[1]);
+	if (read(fds[0], &c, 1) != -1 || errno != EAGAIN) {
+		errx(1, "read of empty pipe: expected EAGAIN (errno %d)",
+		     errno);
+	}
+	total = 0;
+	while ((r = write(fds[1], buf, PIPE_BUF)) > 0) {
+		if (r != PIPE_BUF) {
+			errx(1, "short write of %ld at %lu; not atomic",
+			     (long)r, (unsigned long)total);
+		}
+		total += r;
+	}
+	if (errno != EAGAIN) {
+		err(1, "write to full pipe: expected EAGAIN");
+	}
+	/* reading a page's worth frees a page; a big write takes that */
+	if (read(fds[0], buf, 4096) != 4096) {
+		err(1, "read");
+	}
+	if (write(fds[1], buf, sizeof(buf)) != 4096) {
+		errx(1, "nonblocking big write didn't fill the pipe");
+	}
+	close(fds[0]);
+	close(fds[1]);
+
+	printf("pipe holds %lu bytes\n", (unsigned long)total);
+	printf("basics: ok\n");
+}
+
+static
+void
+writer(int fd, size_t size, size_t chunk)
+{
+	size_t pos, len, i;
+
+	for (pos = 0; pos < size; pos += len) {
+		len = size - pos < chunk ? size - pos : chunk;
+		for (i=0; i<len; i++) {
+			buf[i] = pattern(pos + i);
+		}
+		if (write(fd, buf, len) != (ssize_t)len) {
+			_exit(1);
+		}
+	}
+	_exit(0);
+}
+
+static
+void
+throughput(size_t size, size_t chunk)
+{
+	unsigned long long start, usecs;
+	size_t pos, i;
+	ssize_t r;
+	int fds[2];
+	pid_t pid;
+
+	mkpipe(fds);
+	start = now();
+	pid = dofork();
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1], size, chunk);
+	}
+	close(fds[1]);
+
+	pos = 0;
+	while ((r = read(fds[0], buf, chunk)) > 0) {
+		for (i=0; i<(size_t)r; i++) {
+			if (buf[i] != pattern(pos + i)) {
+				errx(1, "wrong data at %lu",
+				     (unsigned long)(pos + i));
+			}
+		}
+		pos += r;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	close(fds[0]);
+	reap(pid);
+	if (pos != size) {
+		errx(1, "read %lu bytes, expected %lu", (unsigned long)pos,
+		     (unsigned long)size);
+	}
+
+	usecs = (now() - start) / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("throughput: %lu bytes in %lu-byte chunks, %llu us, "
+	       "%llu KB/s\n", (unsigned long)size, (unsigned long)chunk,
+	       usecs, (unsigned long long)size * 1000000ULL / 1024 / usecs);
+}
+
+static
+void
+latency(unsigned trips)
+{
+	unsigned long long start, nsecs;
+	int there[2], back[2];
+	unsigned i;
+	pid_t pid;
+	char c;
+
+	mkpipe(there);
+	mkpipe(back);
+	pid = dofork();
+	if (pid == 0) {
+		close(there[1]);
+		close(back[0]);
+		while (read(there[0], &c, 1) == 1) {
+			if (write(back[1], &c, 1) != 1) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	close(there[0]);
+	close(back[1]);
+
+	start = now();
+	for (i=0; i<trips; i++) {
+		c = 'a' + i % 26;
+		if (write(there[1], &c, 1) != 1) {
+			err(1, "write");
+		}
+		if (read(back[0], &c, 1) != 1 || c != (char)('a' + i % 26)) {
+			errx(1, "round trip %u came back wrong", i);
+		}
+	}
+	nsecs = now() - start;
+	close(there[1]);
+	close(back[0]);
+	reap(pid);
+
+	printf("latency: %u round trips, %llu ns each\n", trips,
+	       nsecs / (trips ? trips : 1));
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t size;
+	unsigned trips;
+
+	if (argc > 3) {
+		errx(1, "Usage: pipebench [<size> [<roundtrips>]]");
+	}
+	size = argc > 1 ? (size_t)atoi(argv[1]) : DEFSIZE;
+	trips = argc > 2 ? (unsigned)atoi(argv[2]) : DEFTRIPS;
+
+	check_basic();
+	throughput(size, PIPE_BUF);
+	throughput(size, 4096);
+	throughput(size, MAXCHUNK);
+	latency(trips);
+
+	printf("pipebench: passed\n");
+	return 0;
+}
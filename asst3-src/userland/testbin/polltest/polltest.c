@@ -0,0 +1,294 @@
+/*
+ * polltest - check poll() on pipes, semfs semaphores, and the console.
+ *
+ * Checks the immediate cases first: an empty pipe isn't readable, a
+ * pipe with room is writable, hangups and errors once the other end
+ * is gone, POLLNVAL for a bad descriptor, and the console's output
+ * side. Then that a timeout is honored, that a sleeping poll wakes up
+ * when a child writes to a pipe or V's a semaphore, and finally that
+ * one process can serve several children's pipes at once with a
+ * single poll loop.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <err.h>
+
+#define NCHILDREN 4
+#define NMESSAGES 8
+#define SEMNAME "sem:polltest"
+
+/* nanoseconds since some time or other */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000000ULL + nsecs;
+}
+
+static
+void
+msleep(unsigned ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+}
+
+static
+void
+mkpipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+static
+pid_t
+dofork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	return pid;
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child failed");
+	}
+}
+
+/* poll one fd and check the result */
+static
+void
+expect(const char *what, int fd, int events, int timeout, int want)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = -1;
+	r = poll(&pfd, 1, timeout);
+	if (r < 0) {
+		err(1, "%s: poll", what);
+	}
+	if (r != (want != 0) || pfd.revents != want) {
+		errx(1, "%s: poll returned %d, revents 0x%x, expected 0x%x",
+		     what, r, pfd.revents, want);
+	}
+}
+
+static
+void
+check_immediate(void)
+{
+	int fds[2];
+
+	mkpipe(fds);
+	expect("empty pipe", fds[0], POLLIN, 0, 0);
+	expect("pipe with room", fds[1], POLLIN | POLLOUT, 0, POLLOUT);
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	expect("pipe with data", fds[0], POLLIN, 0, POLLIN);
+	close(fds[1]);
+	expect("pipe with no writer", fds[0], POLLIN, 0, POLLIN | POLLHUP);
+	close(fds[0]);
+
+	mkpipe(fds);
+	close(fds[0]);
+	expect("pipe with no reader", fds[1], POLLOUT, 0, POLLERR);
+	close(fds[1]);
+
+	expect("bad fd", 99, POLLIN, 0, POLLNVAL);
+	expect("console output", STDOUT_FILENO, POLLOUT, 0, POLLOUT);
+	expect("negative fd", -1, POLLIN, 0, 0);
+
+	printf("immediate: ok\n");
+}
+
+static
+void
+check_timeout(void)
+{
+	unsigned long long start, ms;
+	int fds[2];
+
+	mkpipe(fds);
+	start = now();
+	expect("timeout", fds[0], POLLIN, 200, 0);
+	ms = (now() - start) / 1000000;
+	if (ms < 190) {
+		errx(1, "timeout: poll returned after %llu ms of 200", ms);
+	}
+	close(fds[0]);
+	close(fds[1]);
+	printf("timeout: ok (%llu ms)\n", ms);
+}
+
+static
+void
+check_wakeup(void)
+{
+	int fds[2], semfd;
+	pid_t pid;
+
+	/* a pipe */
+	mkpipe(fds);
+	pid = dofork();
+	if (pid == 0) {
+		close(fds[0]);
+		msleep(100);
+		_exit(write(fds[1], "x", 1) == 1 ? 0 : 1);
+	}
+	close(fds[1]);
+	expect("pipe wakeup", fds[0], POLLIN, -1, POLLIN);
+	reap(pid);
+	close(fds[0]);
+
+	/* a semaphore */
+	semfd = open(SEMNAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (semfd < 0) {
+		err(1, "%s", SEMNAME);
+	}
+	expect("semaphore at 0", semfd, POLLIN | POLLOUT, 0, POLLOUT);
+	pid = dofork();
+	if (pid == 0) {
+		msleep(100);
+		/* V */
+		_exit(write(semfd, "x", 1) == 1 ? 0 : 1);
+	}
+	expect("semaphore wakeup", semfd, POLLIN, -1, POLLIN);
+	reap(pid);
+	close(semfd);
+	remove(SEMNAME);
+
+	printf("wakeups: ok\n");
+}
+
+static
+void
+child(int fd, unsigned n)
+{
+	unsigned i;
+	char c;
+
+	for (i=0; i<NMESSAGES; i++) {
+		msleep(10 * (n + 1));
+		c = 'a' + n;
+		if (write(fd, &c, 1) != 1) {
+			_exit(1);
+		}
+	}
+	_exit(0);
+}
+
+static
+void
+check_multiplex(void)
+{
+	struct pollfd pfds[NCHILDREN];
+	pid_t pids[NCHILDREN];
+	unsigned counts[NCHILDREN];
+	unsigned i, nopen, npolls;
+	int fds[2], r;
+	char c;
+
+	for (i=0; i<NCHILDREN; i++) {
+		mkpipe(fds);
+		pids[i] = dofork();
+		if (pids[i] == 0) {
+			close(fds[0]);
+			child(fds[1], i);
+		}
+		close(fds[1]);
+		pfds[i].fd = fds[0];
+		pfds[i].events = POLLIN;
+		counts[i] = 0;
+	}
+
+	nopen = NCHILDREN;
+	npolls = 0;
+	while (nopen > 0) {
+		r = poll(pfds, NCHILDREN, 5000);
+		if (r < 0) {
+			err(1, "poll");
+		}
+		if (r == 0) {
+			errx(1, "multiplex: timed out");
+		}
+		npolls++;
+		for (i=0; i<NCHILDREN; i++) {
+			if (pfds[i].revents == 0) {
+				continue;
+			}
+			if ((pfds[i].revents & POLLIN) == 0) {
+				errx(1, "multiplex: revents 0x%x",
+				     pfds[i].revents);
+			}
+			r = read(pfds[i].fd, &c, 1);
+			if (r < 0) {
+				err(1, "read");
+			}
+			if (r == 0) {
+				/* EOF; stop polling it */
+				close(pfds[i].fd);
+				pfds[i].fd = -1;
+				nopen--;
+				continue;
+			}
+			if (c != 'a' + (int)i) {
+				errx(1, "multiplex: got %c from child %u",
+				     c, i);
+			}
+			counts[i]++;
+		}
+	}
+
+	for (i=0; i<NCHILDREN; i++) {
+		reap(pids[i]);
+		if (counts[i] != NMESSAGES) {
+			errx(1, "multiplex: got %u messages from child %u",
+			     counts[i], i);
+		}
+	}
+	printf("multiplex: ok (%u polls for %u messages)\n", npolls,
+	       NCHILDREN * NMESSAGES);
+}
+
+int
+main(void)
+{
+	check_immediate();
+	check_timeout();
+	check_wakeup();
+	check_multiplex();
+	printf("polltest: passed\n");
+	return 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * ringbench - check ioring_setup/ioring_enter, and compare batched
+ * small I/O through the ring with plain read and write.
+ *
+ * First checks each operation once: open, write, fsync, positional
+ * and seek-position reads, close, and the errors for a bad fd, a
+ * write to a read-only file, and a read from a pipe, and that open
+ * looks relative paths up from the caller's directory. Then writes and
+ * reads back a file in small chunks, once with one system call per
+ * chunk and once through the ring with a batch of chunks per
+ * ioring_enter, and prints the time for each. Last, compares the
+ * cost of an empty system call (getpid) with a no-op ring entry.
+ *
+ * Usage: ringbench [<size> [<chunk> [<batch>]]]
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ioring.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME "ringbench.tmp"
+#define DIRNAME "ringbench.dir"
+#define DEFSIZE (256 * 1024)
+#define DEFCHUNK 64
+#define DEFBATCH 32
+#define MAXBUF (64 * 1024)
+#define NNOPS 10000
+
+static struct ioring ring;
+static struct ioring_sqe sqes[IORING_MAXENTRIES];
+static struct ioring_cqe cqes[IORING_MAXENTRIES];
+static int results[IORING_MAXENTRIES];
+static char buf[MAXBUF];
+
+/* nanoseconds since some time or other */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000000ULL + nsecs;
+}
+
+/* the byte at offset POS of the file */
+static
+char
+pattern(size_t pos)
+{
+	return 'a' + (pos * 7 + pos / 512) % 26;
+}
+
+static
+void
+setup(unsigned entries)
+{
+	ring.ir_entries = entries;
+	ring.ir_sqes = sqes;
+	ring.ir_cqes = cqes;
+	if (ioring_setup(&ring) < 0) {
+		err(1, "ioring_setup");
+	}
+}
+
+/* queue one operation; its result will go in results[slot] */
+static
+void
+queue(unsigned slot, int op, int fd, void *ptr, size_t len, off_t off)
+{
+	struct ioring_sqe *sqe;
+
+	sqe = &sqes[ring.ir_sqtail & (ring.ir_entries - 1)];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->sqe_userdata = slot;
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_buf = ptr;
+	sqe->sqe_len = len;
+	sqe->sqe_off = off;
+	ring.ir_sqtail++;
+}
+
+/* submit everything queued, and wait for and reap all N completions */
+static
+void
+run(unsigned n)
+{
+	struct ioring_cqe *cqe;
+	unsigned got;
+	int r;
+
+	got = 0;
+	while (got < n) {
+		r = ioring_enter(ring.ir_sqtail - ring.ir_sqhead, n - got);
+		if (r < 0) {
+			err(1, "ioring_enter");
+		}
+		while (ring.ir_cqhead != ring.ir_cqtail) {
+			cqe = &cqes[ring.ir_cqhead & (ring.ir_entries - 1)];
+			if (cqe->cqe_userdata >= n) {
+				errx(1, "completion for unknown entry %llu",
+				     cqe->cqe_userdata);
+			}
+			results[cqe->cqe_userdata] = cqe->cqe_res;
+			ring.ir_cqhead++;
+			got++;
+		}
+	}
+	if (ring.ir_sqhead != ring.ir_sqtail) {
+		errx(1, "%u entries left unsubmitted",
+		     ring.ir_sqtail - ring.ir_sqhead);
+	}
+}
+
+static
+void
+expect(const char *what, int got, int want)
+{
+	if (got != want) {
+		errx(1, "%s: got %d, expected %d", what, got, want);
+	}
+}
+
+static
+void
+check_basic(void)
+{
+	struct ioring_sqe *sqe;
+	int fd, rofd, fds[2];
+
+	setup(16);
+
+	queue(0, IORING_OP_NOP, -1, NULL, 0, 0);
+	queue(1, IORING_OP_OPEN, -1, (void *)FILENAME, 0, 0);
+	sqe = &sqes[(ring.ir_sqtail - 1) & (ring.ir_entries - 1)];
+	sqe->sqe_flags = O_RDWR | O_CREAT | O_TRUNC;
+	sqe->sqe_mode = 0664;
+	run(2);
+	expect("nop", results[0], 0);
+	if (results[1] < 0) {
+		errno = -results[1];
+		err(1, "open %s", FILENAME);
+	}
+	fd = results[1];
+
+	queue(0, IORING_OP_WRITE, fd, (void *)"hello, world", 12, 0);
+	run(1);
+	expect("write", results[0], 12);
+
+	queue(0, IORING_OP_FSYNC, fd, NULL, 0, 0);
+	queue(1, IORING_OP_READ, fd, buf, 5, 7);
+	queue(2, IORING_OP_READ, fd, buf + 5, 5, -1);
+	queue(3, IORING_OP_READ, 99, buf, 1, -1);
+	run(4);
+	expect("fsync", results[0], 0);
+	expect("positional read", results[1], 5);
+	expect("read", results[2], 5);
+	expect("read of bad fd", results[3], -EBADF);
+	if (memcmp(buf, "worldhello", 10) != 0) {
+		errx(1, "read got the wrong data");
+	}
+	expect("seek position", (int)lseek(fd, 0, SEEK_CUR), 5);
+
+	rofd = open(FILENAME, O_RDONLY);
+	if (rofd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	queue(0, IORING_OP_WRITE, rofd, buf, 1, 0);
+	queue(1, IORING_OP_READ, fds[0], buf, 1, -1);
+	queue(2, IORING_OP_CLOSE, fd, NULL, 0, 0);
+	queue(3, 1234, -1, NULL, 0, 0);
+	run(4);
+	expect("write to read-only file", results[0], -EBADF);
+	expect("read of pipe", results[1], -ESPIPE);
+	expect("close", results[2], 0);
+	expect("bad operation", results[3], -EINVAL);
+	if (close(fd) != -1 || errno != EBADF) {
+		errx(1, "fd still open after close");
+	}
+	close(rofd);
+	close(fds[0]);
+	close(fds[1]);
+
+	printf("basics: ok\n");
+}
+
+/*
+ * The workers that do the operations aren't in our process, so make
+ * sure a relative open doesn't end up in their directory.
+ */
+static
+void
+check_cwd(void)
+{
+	struct ioring_sqe *sqe;
+	int fd;
+
+	remove(FILENAME);
+	if (mkdir(DIRNAME, 0775) < 0) {
+		err(1, "mkdir %s", DIRNAME);
+	}
+	if (chdir(DIRNAME) < 0) {
+		err(1, "chdir %s", DIRNAME);
+	}
+
+	setup(16);
+	queue(0, IORING_OP_OPEN, -1, (void *)FILENAME, 0, 0);
+	sqe = &sqes[(ring.ir_sqtail - 1) & (ring.ir_entries - 1)];
+	sqe->sqe_flags = O_WRONLY | O_CREAT | O_EXCL;
+	sqe->sqe_mode = 0664;
+	run(1);
+	if (results[0] < 0) {
+		errno = -results[0];
+		err(1, "open %s in %s", FILENAME, DIRNAME);
+	}
+	close(results[0]);
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s not created in %s", FILENAME, DIRNAME);
+	}
+	close(fd);
+
+	if (chdir("..") < 0) {
+		err(1, "chdir ..");
+	}
+	fd = open(FILENAME, O_RDONLY);
+	if (fd >= 0) {
+		errx(1, "relative open used the wrong directory");
+	}
+	remove(DIRNAME "/" FILENAME);
+	if (rmdir(DIRNAME) < 0) {
+		err(1, "rmdir %s", DIRNAME);
+	}
+
+	printf("relative open: ok\n");
+}
+
+static
+void
+report(const char *what, size_t size, size_t chunk,
+       unsigned long long start, unsigned long calls)
+{
+	unsigned long long usecs;
+
+	usecs = (now() - start) / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("%s: %lu bytes in %lu-byte chunks, %lu calls, %llu us, "
+	       "%llu KB/s\n", what, (unsigned long)size, (unsigned long)chunk,
+	       calls, usecs, (unsigned long long)size * 1000000ULL / 1024 / usecs);
+}
+
+static
+void
+checkdata(const char *where, size_t pos, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (buf[i] != pattern(pos + i)) {
+			errx(1, "%s: wrong data at %lu", where,
+			     (unsigned long)(pos + i));
+		}
+	}
+}
+
+static
+void
+plain(size_t size, size_t chunk)
+{
+	unsigned long long start;
+	unsigned long calls;
+	size_t pos, len, i;
+	int fd;
+
+	fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	start = now();
+	calls = 0;
+	for (pos = 0; pos < size; pos += len) {
+		len = size - pos < chunk ? size - pos : chunk;
+		for (i=0; i<len; i++) {
+			buf[i] = pattern(pos + i);
+		}
+		if (write(fd, buf, len) != (ssize_t)len) {
+			err(1, "write");
+		}
+		calls++;
+	}
+	report("plain write", size, chunk, start, calls);
+
+	lseek(fd, 0, SEEK_SET);
+	start = now();
+	calls = 0;
+	for (pos = 0; pos < size; pos += len) {
+		len = size - pos < chunk ? size - pos : chunk;
+		if (read(fd, buf, len) != (ssize_t)len) {
+			err(1, "read");
+		}
+		calls++;
+		checkdata("plain read", pos, len);
+	}
+	report("plain read", size, chunk, start, calls);
+
+	close(fd);
+}
+
+static
+void
+batched(size_t size, size_t chunk, unsigned batch)
+{
+	unsigned long long start;
+	unsigned long calls;
+	size_t pos, len, i;
+	unsigned n;
+	int fd;
+
+	setup(batch);
+	fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	/* write data is copied at submit, so one chunk's buffer will do */
+	start = now();
+	calls = 0;
+	for (pos = 0; pos < size; ) {
+		for (n = 0; n < batch && pos < size; n++, pos += len) {
+			len = size - pos < chunk ? size - pos : chunk;
+			for (i=0; i<len; i++) {
+				buf[n * chunk + i] = pattern(pos + i);
+			}
+			queue(n, IORING_OP_WRITE, fd, buf + n * chunk, len, pos);
+		}
+		run(n);
+		calls++;
+		while (n-- > 0) {
+			if (results[n] < 0) {
+				errno = -results[n];
+				err(1, "ring write");
+			}
+		}
+	}
+	report("ring write", size, chunk, start, calls);
+
+	start = now();
+	calls = 0;
+	for (pos = 0; pos < size; ) {
+		size_t base = pos;
+
+		for (n = 0; n < batch && pos < size; n++, pos += len) {
+			len = size - pos < chunk ? size - pos : chunk;
+			queue(n, IORING_OP_READ, fd, buf + n * chunk, len, pos);
+		}
+		run(n);
+		calls++;
+		for (i = 0; i < n; i++) {
+			len = size - (base + i * chunk);
+			if (len > chunk) {
+				len = chunk;
+			}
+			if (results[i] != (int)len) {
+				errx(1, "ring read returned %d", results[i]);
+			}
+		}
+		/* the chunks are laid out in BUF just as in the file */
+		checkdata("ring read", base, pos - base);
+	}
+	report("ring read", size, chunk, start, calls);
+
+	close(fd);
+}
+
+static
+void
+overhead(unsigned batch)
+{
+	unsigned long long start, plainns, ringns;
+	unsigned i, n;
+
+	start = now();
+	for (i=0; i<NNOPS; i++) {
+		getpid();
+	}
+	plainns = now() - start;
+
+	setup(batch);
+	start = now();
+	for (i=0; i<NNOPS; i += n) {
+		for (n = 0; n < batch && i + n < NNOPS; n++) {
+			queue(n, IORING_OP_NOP, -1, NULL, 0, 0);
+		}
+		run(n);
+	}
+	ringns = now() - start;
+
+	printf("overhead: getpid %llu ns each, ring no-op %llu ns each\n",
+	       plainns / NNOPS, ringns / NNOPS);
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t size, chunk;
+	unsigned batch;
+
+	if (argc > 4) {
+		errx(1, "Usage: ringbench [<size> [<chunk> [<batch>]]]");
+	}
+	size = argc > 1 ? (size_t)atoi(argv[1]) : DEFSIZE;
+	chunk = argc > 2 ? (size_t)atoi(argv[2]) : DEFCHUNK;
+	batch = argc > 3 ? (unsigned)atoi(argv[3]) : DEFBATCH;
+	if (chunk == 0 || batch == 0 || batch > IORING_MAXENTRIES ||
+	    (batch & (batch - 1)) != 0 || chunk * batch > MAXBUF) {
+		errx(1, "chunk * batch must be at most %d, and batch a "
+		     "power of two no more than %d", MAXBUF,
+		     IORING_MAXENTRIES);
+	}
+
+	check_basic();
+	check_cwd();
+	plain(size, chunk);
+	batched(size, chunk, batch);
+	overhead(batch);
+
+	remove(FILENAME);
+	printf("ringbench: passed\n");
+	return 0;
+}
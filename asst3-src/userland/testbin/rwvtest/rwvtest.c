@@ -0,0 +1,226 @@
+/*
+ * rwvtest - check pread/pwrite and readv/writev/preadv/pwritev.
+ *
+ * Writes a file with writev, reads pieces of it back with pread and
+ * preadv and checks that the seek position didn't move, patches it
+ * with pwrite and pwritev, and checks the error cases. Then forks
+ * some workers that share the fd and each pwrite their own part of
+ * the file at the same time, and checks the result.
+ *
+ * Usage: rwvtest [filename]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define NWORKERS 4
+#define WORKSIZE 2048
+#define WORKCHUNK 64
+
+static char buf[NWORKERS * WORKSIZE];
+
+static
+void
+expect(const char *what, ssize_t got, ssize_t want)
+{
+	if (got < 0) {
+		err(1, "%s", what);
+	}
+	if (got != want) {
+		errx(1, "%s: got %ld, expected %ld", what, (long)got,
+		     (long)want);
+	}
+}
+
+static
+void
+expect_err(const char *what, ssize_t got, int wanterr)
+{
+	if (got != -1 || errno != wanterr) {
+		errx(1, "%s: expected error %d, got %ld (errno %d)",
+		     what, wanterr, (long)got, errno);
+	}
+}
+
+static
+void
+check_pos(int fd, off_t want)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos != want) {
+		errx(1, "seek position is %ld, expected %ld", (long)pos,
+		     (long)want);
+	}
+}
+
+static
+void
+check_basic(int fd)
+{
+	struct iovec iov[3];
+	char a[5], b[3], c[8];
+
+	/* "hello" "the" "universe" */
+	iov[0].iov_base = (char *)"hello";
+	iov[0].iov_len = 5;
+	iov[1].iov_base = (char *)"the";
+	iov[1].iov_len = 3;
+	iov[2].iov_base = (char *)"universe";
+	iov[2].iov_len = 8;
+	expect("writev", writev(fd, iov, 3), 16);
+	check_pos(fd, 16);
+
+	expect("pread", pread(fd, c, 8, 8), 8);
+	if (memcmp(c, "universe", 8) != 0) {
+		errx(1, "pread got the wrong data");
+	}
+	check_pos(fd, 16);
+
+	expect("pwrite", pwrite(fd, "THE", 3, 5), 3);
+	check_pos(fd, 16);
+
+	/* read it back scattered differently */
+	iov[0].iov_base = b;
+	iov[0].iov_len = 3;
+	iov[1].iov_base = a;
+	iov[1].iov_len = 5;
+	expect("preadv", preadv(fd, iov, 2, 3), 8);
+	if (memcmp(b, "loT", 3) != 0 || memcmp(a, "HEuni", 5) != 0) {
+		errx(1, "preadv got the wrong data");
+	}
+	check_pos(fd, 16);
+
+	iov[0].iov_base = (char *)"HE";
+	iov[0].iov_len = 2;
+	iov[1].iov_base = (char *)"LLO";
+	iov[1].iov_len = 3;
+	expect("pwritev", pwritev(fd, iov, 2, 0), 5);
+	check_pos(fd, 16);
+
+	lseek(fd, 0, SEEK_SET);
+	iov[0].iov_base = a;
+	iov[0].iov_len = 5;
+	iov[1].iov_base = b;
+	iov[1].iov_len = 3;
+	iov[2].iov_base = c;
+	iov[2].iov_len = 8;
+	expect("readv", readv(fd, iov, 3), 16);
+	if (memcmp(a, "HELLO", 5) != 0 || memcmp(b, "THE", 3) != 0 ||
+	    memcmp(c, "universe", 8) != 0) {
+		errx(1, "readv got the wrong data");
+	}
+	check_pos(fd, 16);
+
+	/* reading past the end gets nothing */
+	expect("pread at end", pread(fd, c, 8, 16), 0);
+	printf("basic: ok\n");
+}
+
+static
+void
+check_errors(int fd)
+{
+	struct iovec iov[1];
+	char c;
+
+	iov[0].iov_base = &c;
+	iov[0].iov_len = 1;
+	expect_err("pread at negative offset", pread(fd, &c, 1, -1), EINVAL);
+	expect_err("readv with no iovecs", readv(fd, iov, 0), EINVAL);
+	expect_err("pread on the console", pread(STDIN_FILENO, &c, 1, 0),
+		   ESPIPE);
+	expect_err("pwritev on a bad fd", pwritev(-1, iov, 1, 0), EBADF);
+	expect_err("readv with a bad iovec array",
+		   readv(fd, (struct iovec *)0x80000000, 1), EFAULT);
+	printf("error cases: ok\n");
+}
+
+static
+void
+worker(int fd, unsigned n)
+{
+	char chunk[WORKCHUNK];
+	unsigned i;
+	off_t pos;
+
+	memset(chunk, 'a' + n, sizeof(chunk));
+	/* interleave with the other workers as much as we can */
+	for (i=0; i<WORKSIZE / WORKCHUNK; i++) {
+		pos = (off_t)i * WORKCHUNK * NWORKERS + n * WORKCHUNK;
+		if (pwrite(fd, chunk, WORKCHUNK, pos) != WORKCHUNK) {
+			_exit(1);
+		}
+	}
+	_exit(0);
+}
+
+static
+void
+check_workers(int fd)
+{
+	pid_t pids[NWORKERS];
+	unsigned i;
+	int status;
+	char want;
+
+	for (i=0; i<NWORKERS; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			worker(fd, i);
+		}
+	}
+	for (i=0; i<NWORKERS; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "worker %u failed", i);
+		}
+	}
+
+	expect("pread of workers' data", pread(fd, buf, sizeof(buf), 0),
+	       sizeof(buf));
+	for (i=0; i<sizeof(buf); i++) {
+		want = 'a' + (i / WORKCHUNK) % NWORKERS;
+		if (buf[i] != want) {
+			errx(1, "byte %u is %c, expected %c", i, buf[i], want);
+		}
+	}
+	/* nobody moved the shared seek position */
+	check_pos(fd, 16);
+	printf("workers: ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *filename;
+	int fd;
+
+	filename = argc > 1 ? argv[1] : "rwvtest.dat";
+	fd = open(filename, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+
+	check_basic(fd);
+	check_errors(fd);
+	check_workers(fd);
+
+	close(fd);
+	remove(filename);
+	printf("rwvtest: passed\n");
+	return 0;
+}